@@ -16,6 +16,7 @@ inline const char **_buildargv{nullptr};
 
 inline bool quitevent{false};
 inline bool appactive{true};
+inline bool headless{false};	// -headless: no window, video, input or sound
 
 enum {
     STARTWIN_CANCEL = 0,
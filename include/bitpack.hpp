@@ -0,0 +1,100 @@
+// bitpack.h
+
+#ifndef __bitpack_hpp__
+#define __bitpack_hpp__
+
+#include <cstddef>
+#include <span>
+
+	// Packs values of a few bits each into a byte buffer, lowest bit first.
+	// Writing past the end of the buffer is dropped and remembered.
+class bitwriter {
+public:
+	explicit bitwriter(std::span<unsigned char> buf) : buf{buf} {}
+
+	void put(unsigned int value, int bits)
+	{
+		for (int i{0}; i < bits; i++, pos++) {
+			if ((std::size_t)(pos >> 3) >= buf.size()) {
+				over = true;
+				return;
+			}
+			if ((pos & 7) == 0) buf[pos >> 3] = 0;
+			buf[pos >> 3] |= (unsigned char)(((value >> i) & 1) << (pos & 7));
+		}
+	}
+
+		// Small values are cheaper: a 0 and 3 bits for 0-7, a 1, a 0 and 5
+		// bits for 8-39, and two 1s and 8 bits for the rest up to 255
+	void putsmall(unsigned int value)
+	{
+		if (value < 8) {
+			put(0, 1);
+			put(value, 3);
+		} else if (value < 40) {
+			put(1, 2);
+			put(value - 8, 5);
+		} else {
+			put(3, 2);
+			put(value, 8);
+		}
+	}
+
+	int bytes() const { return (pos + 7) >> 3; }
+	int bits() const { return pos; }
+	bool overflowed() const { return over; }
+
+private:
+	std::span<unsigned char> buf;
+	int pos{0};
+	bool over{false};
+};
+
+	// Reads what a bitwriter wrote. Reading past the end gives zeros and is
+	// remembered.
+class bitreader {
+public:
+	explicit bitreader(std::span<const unsigned char> buf) : buf{buf} {}
+
+	unsigned int get(int bits)
+	{
+		unsigned int value{0};
+
+		for (int i{0}; i < bits; i++, pos++) {
+			if ((std::size_t)(pos >> 3) >= buf.size()) {
+				over = true;
+				return value;
+			}
+			value |= (unsigned int)((buf[pos >> 3] >> (pos & 7)) & 1) << i;
+		}
+		return value;
+	}
+
+	unsigned int getsmall()
+	{
+		if (!get(1)) return get(3);
+		if (!get(1)) return get(5) + 8;
+		return get(8);
+	}
+
+	int bytes() const { return (pos + 7) >> 3; }
+	bool overrun() const { return over; }
+
+private:
+	std::span<const unsigned char> buf;
+	int pos{0};
+	bool over{false};
+};
+
+	// Signed differences as small unsigned values: 0, -1, 1, -2, 2, ...
+inline constexpr unsigned int zigzag(int value)
+{
+	return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+inline constexpr int unzigzag(unsigned int value)
+{
+	return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+#endif	// __bitpack_hpp__
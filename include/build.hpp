@@ -491,6 +491,8 @@ void   uninitengine();
 void   initspritelists();
 int   loadboard(const std::string& filename, char fromwhere, int *daposx, int *daposy, int *daposz, short *daang, short *dacursectnum);
 int   loadmaphack(const std::string& filename);
+int   loadpvs(const std::string& filename);	// visible sets made for this map by savepvs()
+int   savepvs(const std::string& filename);
 int   saveboard(const std::string& filename, const int *daposx, const int *daposy, const int *daposz, const short *daang, const short *dacursectnum);
 int   saveoldboard(const char *filename, const int *daposx, const int *daposy, const int *daposz, const short *daang, const short *dacursectnum);
 int   loadpics(const std::string& filename, int askedsize);
@@ -526,6 +528,32 @@ void   rotatesprite(int sx, int sy, int z, short a, short picnum, signed char da
 void   drawline256(int x1, int y1, int x2, int y2, unsigned char col);
 void   printext256(int xpos, int ypos, short col, short backcol, std::string_view name, char fontsize);
 
+inline constexpr auto MAXCLIPNUM{1024};
+inline constexpr auto MAXCLIPDIST{1024};	// extra reach of clipmove() and getzrange() searches, for sprites on sector lines
+
+	// Scratch state of the collision queries below. The functions without a
+	// context share one, so only one thread may call those; any thread may call
+	// the overloads taking a context, as long as no two use the same context
+	// at once. They only read the map.
+struct clipcontext {
+	struct clipline {
+		int x1, y1;
+		int x2, y2;
+	};
+
+	std::array<clipline, MAXCLIPNUM> clipit;		// lines clipmove() can hit
+	std::array<short, MAXCLIPNUM> clipobjectval;	// hit value of each line
+	short clipnum;
+	std::array<short, MAXCLIPNUM> clipsectorlist;	// sectors searched so far
+	short clipsectnum;
+	std::array<short, 4> hitwalls;
+	short nonblocking{-1};	// a sprite getzrange() sees with its blocking bit clear, or -1
+};
+
+	// 1 = clipmove() and getzrange() find sprites through a grid, which needs
+	// updatespriteclip() after writing a sprite's position or shape directly
+inline int clipbroadphase{0};
+
 int   clipmove(int *x, int *y, const int *z, short *sectnum, int xvect, int yvect, int walldist, int ceildist, int flordist, unsigned int cliptype);
 int   clipinsidebox(int x, int y, short wallnum, int walldist);
 int   clipinsideboxline(int x, int y, int x1, int y1, int x2, int y2, int walldist);
@@ -534,11 +562,85 @@ void   getzrange(int x, int y, int z, short sectnum, int *ceilz, int *ceilhit, i
 int    hitscan(int xs, int ys, int zs, short sectnum, int vx, int vy, int vz, short *hitsect, short *hitwall, short *hitsprite, int *hitx, int *hity, int *hitz, unsigned int cliptype);
 int   neartag(int xs, int ys, int zs, short sectnum, short ange, short *neartagsector, short *neartagwall, short *neartagsprite, int *neartaghitdist, int neartagrange, unsigned char tagsearch);
 bool  cansee(int x1, int y1, int z1, short sect1, int x2, int y2, int z2, short sect2);
+
+int   clipmove(clipcontext& ctx, int *x, int *y, const int *z, short *sectnum, int xvect, int yvect, int walldist, int ceildist, int flordist, unsigned int cliptype);
+int   pushmove(clipcontext& ctx, int *x, int *y, const int *z, short *sectnum, int walldist, int ceildist, int flordist, unsigned int cliptype);
+void   getzrange(clipcontext& ctx, int x, int y, int z, short sectnum, int *ceilz, int *ceilhit, int *florz, int *florhit, int walldist, unsigned int cliptype);
+int    hitscan(clipcontext& ctx, int xs, int ys, int zs, short sectnum, int vx, int vy, int vz, short *hitsect, short *hitwall, short *hitsprite, int *hitx, int *hity, int *hitz, unsigned int cliptype);
+int   neartag(clipcontext& ctx, int xs, int ys, int zs, short sectnum, short ange, short *neartagsector, short *neartagwall, short *neartagsprite, int *neartaghitdist, int neartagrange, unsigned char tagsearch);
+bool  cansee(clipcontext& ctx, int x1, int y1, int z1, short sect1, int x2, int y2, int z2, short sect2);
+void   updatespriteclip(short spritenum);	// after moving or reshaping a sprite by hand, or -1 after replacing them all
+
+struct clipbox {
+	int x1, y1;
+	int x2, y2;		// inclusive
+};
+clipbox spriteclipbox(const spritetype& spr);		// where clipmove() and getzrange() can run into a sprite
+
+struct canseequery {
+	int x1, y1, z1;
+	short sect1;
+	int x2, y2, z2;
+	short sect2;
+};
+
+struct hitscanquery {
+	int xs, ys, zs;
+	short sectnum;
+	int vx, vy, vz;
+	unsigned int cliptype;
+};
+
+struct hitscanresult {
+	short hitsect, hitwall, hitsprite;
+	int hitx, hity, hitz;	// hitz stays 0 if nothing was hit
+};
+
+struct clipmovequery {
+	int x, y, z;
+	short sectnum;
+	int xvect, yvect;
+	int walldist, ceildist, flordist;
+	unsigned int cliptype;
+};
+
+struct clipmoveresult {
+	int x, y;
+	short sectnum;
+	int retval;
+};
+
+struct getzrangequery {
+	int x, y, z;
+	short sectnum;
+	int walldist;
+	unsigned int cliptype;
+	short nonblocking;	// as clipcontext::nonblocking
+};
+
+struct getzrangeresult {
+	int ceilz, ceilhit, florz, florhit;
+};
+
+	// many cansee()/hitscan() calls at once, with identical results, on up to numthreads threads (0 = all)
+void  canseebatch(std::span<const canseequery> queries, std::span<bool> results, int numthreads = 0);
+void  hitscanbatch(std::span<const hitscanquery> queries, std::span<hitscanresult> results, int numthreads = 0);
+	// and clipmove()/getzrange(), none of which may move anything the others could run into
+void  clipmovebatch(std::span<const clipmovequery> queries, std::span<clipmoveresult> results, int numthreads = 0);
+void  getzrangebatch(std::span<const getzrangequery> queries, std::span<getzrangeresult> results, int numthreads = 0);
+
 void   updatesector(int x, int y, short *sectnum);
 void   updatesectorz(int x, int y, int z, short *sectnum);
 int   inside(int x, int y, short sectnum);
 void   dragpoint(short pt_highlight, int dax, int day);
+void   updatesectorindex(short sectnum);	// after moving a sector's walls, or -1 after editing the map
 void   setfirstwall(short sectnum, short newfirstwall);
+void   updatetopology();	// after relinking walls or sectors by hand
+void   buildpvs();	// works out which sectors might see which, for cansee() and drawrooms() to cull with
+bool   pvsvisible(short fromsect, short tosect);	// false only if nowhere in fromsect can see into tosect
+
+	// 0 = ignore the visible sets from buildpvs() or loadpvs()
+inline int usepvs{1};
 
 void   getmousevalues(int *mousx, int *mousy, int *bstatus);
 int    krand();
@@ -1,10 +1,38 @@
 #ifndef __crc32_h__
 #define __crc32_h__
 
+#include <cstddef>
+#include <span>
+
 unsigned int crc32once(unsigned char *blk, unsigned int len);
 
 void crc32init(unsigned int *crcvar);
 void crc32block(unsigned int *crcvar, unsigned char *blk, unsigned int len);
 unsigned int crc32finish(unsigned int *crcvar);
 
+/**
+ * Runs mmulti's CRC16 (CCITT, polynomial 0x1021) over a block from its
+ * last byte to its first
+ * @param crc the CRC so far, 0 to start
+ * @param blk the block
+ * @param len its length
+ * @return the CRC including the block, to carry on into the block before it
+ */
+unsigned short crc16back(unsigned short crc, const unsigned char *blk, std::size_t len);
+
+	// A way of working out the CRCs, for checking and timing them against
+	// each other. A null function means it can't do that CRC.
+struct crcmethod {
+	const char *name;
+	unsigned int (*crc32)(unsigned int crc, const unsigned char *blk, std::size_t len);	// not inverted
+	unsigned short (*crc16back)(unsigned short crc, const unsigned char *blk, std::size_t len);
+};
+
+/**
+ * Lists the ways this machine can work out the CRCs, slowest first. The
+ * last one with a function for each CRC is the one used.
+ * @return the methods
+ */
+std::span<const crcmethod> crcmethods();
+
 #endif
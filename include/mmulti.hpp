@@ -17,6 +17,15 @@ inline int connecthead{0};
 inline std::array<int, MAXMULTIPLAYERS> connectpoint2{};
 inline unsigned char syncstate{0};
 
+	// The game's view of its sync loop, kept up to date by the game for the
+	// network stats to report alongside mmulti's own
+struct mmultigamestats {
+	std::array<int, MAXMULTIPLAYERS> fifodepth{};	// each player's inputs received but not yet simulated
+	int inputlag{0};	// ticks from making an input to simulating it
+	int syncerrors{0};	// sync values that didn't match another player's
+};
+inline mmultigamestats netgamestats;
+
 void initsingleplayers();
 void initmultiplayers(int argc, char const * const argv[]);
 int initmultiplayersparms(int argc, char const * const argv[]);
@@ -25,7 +34,7 @@ int initmultiplayerscycle();
 void setpackettimeout(int datimeoutcount, int daresendagaincount);
 void uninitmultiplayers();
 void setsocket(int newsocket);
-void sendpacket(int other, const unsigned char *bufptr, int messleng);
+void sendpacket(int other, const unsigned char *bufptr, int messleng);	// other -1 for every other player
 int getpacket(int *other, unsigned char *bufptr);
 void flushpackets();
 void genericmultifunction(int other, const unsigned char *bufptr, int messleng, int command);
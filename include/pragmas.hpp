@@ -8,8 +8,26 @@
 #include "point.hpp"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdint>
 #include <limits>
+#include <span>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#define PRAGMAS_SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PRAGMAS_AVX2
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PRAGMAS_NEON
+#endif
 
 #if defined(__GNUC__) && defined(__i386__) && USE_ASM
 
@@ -3641,6 +3659,396 @@ inline constexpr int tmulscalen(int eax, int edx, int ebx, int ecx, int esi, int
 	return dw(((qw(eax) * qw(edx)) + (qw(ebx) * qw(ecx)) + (qw(esi) * qw(edi))) >> N);
 }
 
+inline constexpr std::array<int, 2048> reciptable = []() {
+	std::array<int, 2048> rectable;
+	std::ranges::generate(rectable, [n = 0]() mutable {
+				return divscalen<30>(2048L, (n++) + 2048);
+			});
+	return rectable;
+}();
+
+// krecip() in C, which the array form below matches
+inline int kreciplane(int i)
+{ // Ken did this
+	const int f = std::bit_cast<int>((float)i);
+	return((reciptable[(f>>12)&2047]>>(((f-0x3f800000)>>23)&31))^(f>>31));
+}
+
+//
+// Vector versions, giving exactly what the scalar ones do for each lane,
+// overflow included. Products are kept 64 bits wide, and as only bits N to
+// N+31 of each sum survive, logical shifts do for the arithmetic ones.
+// These are chosen when compiling, by the instruction sets the build allows.
+//
+
+#if defined(PRAGMAS_SSE2)
+
+/**
+ * Sums of signed 32x32 bit products, as 64 bit sums of lanes 0 and 2 and of
+ * lanes 1 and 3
+ */
+struct mulsum128 {
+	__m128i even{_mm_setzero_si128()};
+	__m128i odd{_mm_setzero_si128()};
+	__m128i fix{_mm_setzero_si128()};	// without SSE4.1 the products are unsigned, less this times 2^32
+
+	void add(__m128i a, __m128i b)
+	{
+		const __m128i aodd = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 1, 1));
+		const __m128i bodd = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 1, 1));
+#if defined(__SSE4_1__)
+		even = _mm_add_epi64(even, _mm_mul_epi32(a, b));
+		odd = _mm_add_epi64(odd, _mm_mul_epi32(aodd, bodd));
+#else
+		even = _mm_add_epi64(even, _mm_mul_epu32(a, b));
+		odd = _mm_add_epi64(odd, _mm_mul_epu32(aodd, bodd));
+		fix = _mm_add_epi32(fix, _mm_add_epi32(_mm_and_si128(_mm_srai_epi32(a, 31), b),
+											   _mm_and_si128(_mm_srai_epi32(b, 31), a)));
+#endif
+	}
+
+	template<std::uint8_t N>
+	__m128i scale() const
+	{
+		static_assert(N <= 32);
+
+		const __m128i lo = _mm_set_epi32(0, -1, 0, -1);
+#if defined(__SSE4_1__)
+		const __m128i e = even;
+		const __m128i o = odd;
+#else
+		const __m128i e = _mm_sub_epi64(even, _mm_slli_epi64(fix, 32));
+		const __m128i o = _mm_sub_epi64(odd, _mm_andnot_si128(lo, fix));
+#endif
+
+		return _mm_or_si128(_mm_and_si128(_mm_srli_epi64(e, N), lo),
+							_mm_andnot_si128(lo, _mm_slli_epi64(o, 32 - N)));
+	}
+};
+
+template<std::uint8_t N>
+inline __m128i mulscalen(__m128i eax, __m128i edx)
+{
+	mulsum128 sum;
+	sum.add(eax, edx);
+	return sum.scale<N>();
+}
+
+template<std::uint8_t N>
+inline __m128i dmulscalen(__m128i eax, __m128i edx, __m128i esi, __m128i edi)
+{
+	mulsum128 sum;
+	sum.add(eax, edx);
+	sum.add(esi, edi);
+	return sum.scale<N>();
+}
+
+template<std::uint8_t N>
+inline __m128i tmulscalen(__m128i eax, __m128i edx, __m128i ebx, __m128i ecx, __m128i esi, __m128i edi)
+{
+	mulsum128 sum;
+	sum.add(eax, edx);
+	sum.add(ebx, ecx);
+	sum.add(esi, edi);
+	return sum.scale<N>();
+}
+
+#endif
+
+#if defined(PRAGMAS_AVX2)
+
+/**
+ * Sums of signed 32x32 bit products, as 64 bit sums of the even lanes and
+ * of the odd lanes
+ */
+struct mulsum256 {
+	__m256i even{_mm256_setzero_si256()};
+	__m256i odd{_mm256_setzero_si256()};
+
+	void add(__m256i a, __m256i b)
+	{
+		even = _mm256_add_epi64(even, _mm256_mul_epi32(a, b));
+		odd = _mm256_add_epi64(odd, _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)));
+	}
+
+	template<std::uint8_t N>
+	__m256i scale() const
+	{
+		static_assert(N <= 32);
+
+		return _mm256_blend_epi32(_mm256_srli_epi64(even, N), _mm256_slli_epi64(odd, 32 - N), 0xAA);
+	}
+};
+
+template<std::uint8_t N>
+inline __m256i mulscalen(__m256i eax, __m256i edx)
+{
+	mulsum256 sum;
+	sum.add(eax, edx);
+	return sum.scale<N>();
+}
+
+template<std::uint8_t N>
+inline __m256i dmulscalen(__m256i eax, __m256i edx, __m256i esi, __m256i edi)
+{
+	mulsum256 sum;
+	sum.add(eax, edx);
+	sum.add(esi, edi);
+	return sum.scale<N>();
+}
+
+template<std::uint8_t N>
+inline __m256i tmulscalen(__m256i eax, __m256i edx, __m256i ebx, __m256i ecx, __m256i esi, __m256i edi)
+{
+	mulsum256 sum;
+	sum.add(eax, edx);
+	sum.add(ebx, ecx);
+	sum.add(esi, edi);
+	return sum.scale<N>();
+}
+
+inline __m256i krecip(__m256i i)
+{
+	const __m256i f = _mm256_castps_si256(_mm256_cvtepi32_ps(i));
+	const __m256i index = _mm256_and_si256(_mm256_srli_epi32(f, 12), _mm256_set1_epi32(2047));
+	const __m256i shift = _mm256_and_si256(_mm256_srli_epi32(_mm256_sub_epi32(f, _mm256_set1_epi32(0x3f800000)), 23),
+										   _mm256_set1_epi32(31));
+
+	// the table holds positive values only, so a logical shift will do
+	return _mm256_xor_si256(_mm256_srlv_epi32(_mm256_i32gather_epi32(reciptable.data(), index, 4), shift),
+							_mm256_srai_epi32(f, 31));
+}
+
+#endif
+
+#if defined(PRAGMAS_NEON)
+
+/**
+ * Sums of signed 32x32 bit products, as 64 bit sums of lanes 0 and 1 and of
+ * lanes 2 and 3
+ */
+struct mulsum128 {
+	int64x2_t low{vdupq_n_s64(0)};
+	int64x2_t high{vdupq_n_s64(0)};
+
+	void add(int32x4_t a, int32x4_t b)
+	{
+		low = vmlal_s32(low, vget_low_s32(a), vget_low_s32(b));
+		high = vmlal_s32(high, vget_high_s32(a), vget_high_s32(b));
+	}
+
+	template<std::uint8_t N>
+	int32x4_t scale() const
+	{
+		static_assert(N <= 32);
+
+		if constexpr (N == 0) {
+			return vcombine_s32(vmovn_s64(low), vmovn_s64(high));
+		} else {
+			return vcombine_s32(vshrn_n_s64(low, N), vshrn_n_s64(high, N));
+		}
+	}
+};
+
+template<std::uint8_t N>
+inline int32x4_t mulscalen(int32x4_t eax, int32x4_t edx)
+{
+	mulsum128 sum;
+	sum.add(eax, edx);
+	return sum.scale<N>();
+}
+
+template<std::uint8_t N>
+inline int32x4_t dmulscalen(int32x4_t eax, int32x4_t edx, int32x4_t esi, int32x4_t edi)
+{
+	mulsum128 sum;
+	sum.add(eax, edx);
+	sum.add(esi, edi);
+	return sum.scale<N>();
+}
+
+template<std::uint8_t N>
+inline int32x4_t tmulscalen(int32x4_t eax, int32x4_t edx, int32x4_t ebx, int32x4_t ecx, int32x4_t esi, int32x4_t edi)
+{
+	mulsum128 sum;
+	sum.add(eax, edx);
+	sum.add(ebx, ecx);
+	sum.add(esi, edi);
+	return sum.scale<N>();
+}
+
+#endif
+
+//
+// Array versions. out may be the same array as an input but must not
+// otherwise overlap one. Factors passed as plain ints apply to every element.
+//
+// Unlike the register versions above, which are chosen when compiling, these
+// go through the fastest of fixarraymethods() the CPU running them has, so a
+// build for plain x86-64 still gets SSE4.1 or AVX2 for them.
+//
+
+/** one way of doing the array versions, each with the shift passed in */
+struct fixarraymethod {
+	const char *name;
+	void (*mulscale)(int *out, const int *eax, const int *edx, int count, int shift);
+	void (*mulscaleby)(int *out, const int *eax, int edx, int count, int shift);
+	void (*dmulscale)(int *out, const int *eax, const int *edx, const int *esi, const int *edi, int count, int shift);
+	void (*dmulscaleby)(int *out, const int *eax, int edx, const int *esi, int edi, int count, int shift);
+	void (*tmulscale)(int *out, const int *eax, const int *edx, const int *ebx, const int *ecx,
+					  const int *esi, const int *edi, int count, int shift);
+	void (*tmulscaleby)(int *out, const int *eax, int edx, const int *ebx, int ecx,
+						const int *esi, int edi, int count, int shift);
+	void (*krecip)(int *out, const int *num, int count);
+};
+
+/**
+ * Lists the array methods the CPU can run, slowest first, the first being
+ * plain C
+ */
+std::span<const fixarraymethod> fixarraymethods();
+
+/** the array method in use, plain C until initfixarrays() is called */
+extern const fixarraymethod *fixarrays;
+
+/**
+ * Picks the last of fixarraymethods() for the array versions
+ */
+void initfixarrays();
+
+/**
+ * out[i] = mulscalen<N>(eax[i], edx[i])
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void mulscalen(int *out, const int *eax, const int *edx, int count)
+{
+	static_assert(N <= 32);
+
+	if consteval {
+		for (int i{0}; i < count; ++i) {
+			out[i] = mulscalen<N>(eax[i], edx[i]);
+		}
+	} else {
+		fixarrays->mulscale(out, eax, edx, count, N);
+	}
+}
+
+/**
+ * out[i] = mulscalen<N>(eax[i], edx)
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void mulscalen(int *out, const int *eax, int edx, int count)
+{
+	static_assert(N <= 32);
+
+	if consteval {
+		for (int i{0}; i < count; ++i) {
+			out[i] = mulscalen<N>(eax[i], edx);
+		}
+	} else {
+		fixarrays->mulscaleby(out, eax, edx, count, N);
+	}
+}
+
+/**
+ * out[i] = dmulscalen<N>(eax[i], edx[i], esi[i], edi[i])
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void dmulscalen(int *out, const int *eax, const int *edx, const int *esi, const int *edi, int count)
+{
+	static_assert(N <= 32);
+
+	if consteval {
+		for (int i{0}; i < count; ++i) {
+			out[i] = dmulscalen<N>(eax[i], edx[i], esi[i], edi[i]);
+		}
+	} else {
+		fixarrays->dmulscale(out, eax, edx, esi, edi, count, N);
+	}
+}
+
+/**
+ * out[i] = dmulscalen<N>(eax[i], edx, esi[i], edi)
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void dmulscalen(int *out, const int *eax, int edx, const int *esi, int edi, int count)
+{
+	static_assert(N <= 32);
+
+	if consteval {
+		for (int i{0}; i < count; ++i) {
+			out[i] = dmulscalen<N>(eax[i], edx, esi[i], edi);
+		}
+	} else {
+		fixarrays->dmulscaleby(out, eax, edx, esi, edi, count, N);
+	}
+}
+
+/**
+ * out[i] = tmulscalen<N>(eax[i], edx[i], ebx[i], ecx[i], esi[i], edi[i])
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void tmulscalen(int *out, const int *eax, const int *edx, const int *ebx, const int *ecx,
+								 const int *esi, const int *edi, int count)
+{
+	static_assert(N <= 32);
+
+	if consteval {
+		for (int i{0}; i < count; ++i) {
+			out[i] = tmulscalen<N>(eax[i], edx[i], ebx[i], ecx[i], esi[i], edi[i]);
+		}
+	} else {
+		fixarrays->tmulscale(out, eax, edx, ebx, ecx, esi, edi, count, N);
+	}
+}
+
+/**
+ * out[i] = tmulscalen<N>(eax[i], edx, ebx[i], ecx, esi[i], edi)
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void tmulscalen(int *out, const int *eax, int edx, const int *ebx, int ecx,
+								 const int *esi, int edi, int count)
+{
+	static_assert(N <= 32);
+
+	if consteval {
+		for (int i{0}; i < count; ++i) {
+			out[i] = tmulscalen<N>(eax[i], edx, ebx[i], ecx, esi[i], edi);
+		}
+	} else {
+		fixarrays->tmulscaleby(out, eax, edx, ebx, ecx, esi, edi, count, N);
+	}
+}
+
+/**
+ * out[i] = divscalen<N>(eax[i], ebx[i]). No SIMD set divides 64 bit
+ * integers, so this is the scalar loop everywhere.
+ * @param count number of elements
+ */
+template<std::uint8_t N>
+inline constexpr void divscalen(int *out, const int *eax, const int *ebx, int count)
+{
+	for (int i{0}; i < count; ++i) {
+		out[i] = divscalen<N>(eax[i], ebx[i]);
+	}
+}
+
+/**
+ * out[i] = krecip(num[i]), vectorized where there are gathers and
+ * per lane shifts (AVX2)
+ * @param count number of elements
+ */
+inline void krecip(int *out, const int *num, int count)
+{
+	fixarrays->krecip(out, num, count);
+}
+
 static inline void swapchar(void* a, void* b)  { int8_t t = *((int8_t*)b); *((int8_t*)b) = *((int8_t*)a); *((int8_t*)a) = t; }
 static inline void swapchar2(void* a, void* b, int s) { swapchar(a,b); swapchar((int8_t*)a+1, (int8_t*)b+s); }
 
@@ -3746,5 +4154,12 @@ inline void copybufreverse(void *S, void *D, int c)
 
 #endif
 
+/**
+ * Checks each of fixarraymethods() against the scalar scale functions on
+ * random and edge case values, and times both
+ * @param count elements per array
+ */
+void pragmasbench(int count);
+
 #endif // __pragmas_h__
 
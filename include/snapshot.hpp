@@ -0,0 +1,60 @@
+// snapshot.h
+
+#ifndef __snapshot_hpp__
+#define __snapshot_hpp__
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Adds memory for every snapshot to keep alongside the engine's map and
+ * sprite state, which is always kept
+ * @param name what differences() calls it
+ * @param data the memory
+ * @param elemsize bytes per element, for reporting which element differs
+ * @param maxcount number of elements
+ * @param count if not null, only this many elements are in use
+ */
+void snapshot_register(const char *name, void *data, std::size_t elemsize, std::size_t maxcount, const short *count = nullptr);
+
+	// A copy of the engine's and the game's registered state, made to be
+	// taken and put back many times a second. Both ways only write the
+	// blocks that differ between the state and the copy, so when little has
+	// changed since the last time, little is copied.
+class enginesnapshot {
+public:
+	void capture();
+	void restore();
+
+	bool empty() const { return regions.empty(); }
+	std::size_t size() const { return buf.size(); }
+	std::size_t lastcopied() const { return copied; }	// bytes written by the last capture() or restore()
+
+	/**
+	 * Reports the elements that differ between two snapshots, to find where
+	 * simulations went apart
+	 * @param other the other snapshot
+	 * @param maxreport how many differing elements to print
+	 * @return the number of differing elements
+	 */
+	int differences(const enginesnapshot& other, int maxreport) const;
+
+private:
+	struct region {
+		std::size_t offset;		// into buf
+		std::size_t used;		// bytes in use when captured
+	};
+	std::vector<unsigned char> buf;
+	std::vector<region> regions;
+	int generation{-1};
+	std::size_t copied{0};
+};
+
+/**
+ * Times taking and putting back snapshots of the loaded map while moving
+ * some of its sprites in between, and checks the state comes back the same
+ * @param sprites how many sprites to move each time
+ */
+void snapshotbench(int sprites);
+
+#endif	// __snapshot_hpp__
@@ -11,6 +11,9 @@
 #include "game.hpp"
 #include "osd.hpp"
 #include "mmulti.hpp"
+#include "bitpack.hpp"
+#include "snapshot.hpp"
+#include "crc32.hpp"
 #include "kdmsound.hpp"
 #include "string_utils.hpp"
 #include "point.hpp"
@@ -19,8 +22,13 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <charconv>
+#include <chrono>
 #include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
 
 constexpr auto TIMERINTSPERSECOND{140}; //280
 constexpr auto MOVESPERSECOND{40};
@@ -163,6 +171,17 @@ static input baksync[MOVEFIFOSIZ][MAXPLAYERS];
 	//Game recording variables
 static int reccnt, recstat = 1;
 static input recsync[16384][2];
+static unsigned int rechash[16384];   //gamestatehash() after each recorded tick
+static const char *demobenchfile = nullptr;   //-demobench: replay this, then quit
+
+	//Where domovethings() spends its time while a demo is benchmarked
+enum { TICKPLAYERS, TICKANIMATIONS, TICKTAGS, TICKSTATUS, TICKPARTS };
+static bool tickprofiling = false;
+static std::array<std::chrono::steady_clock::duration, TICKPARTS> tickprofile;
+
+	//statuslistcode() works out actor moves on every core ahead of time
+static int parallelactors = 0;
+static struct { int predicted, used; } actormovestats;
 
 //static int myminlag[MAXPLAYERS], mymaxlag, otherminlag, bufferjitter = 1;
 static signed char otherlag[MAXPLAYERS] = {1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1};
@@ -179,6 +198,7 @@ static short myangbak[MOVEFIFOSIZ];
 	//GAME.C sync state variables
 static unsigned char syncstat, syncval[MOVEFIFOSIZ], othersyncval[MOVEFIFOSIZ];
 static int syncvaltottail, syncvalhead, othersyncvalhead, syncvaltail;
+static int slaveinputs, mastermoves;   //Ticks of input a slave has made, and master moves it has had
 
 static unsigned char detailmode = 0, ready2send = 0;
 static int ototalclock = 0, gotlastpacketclock = 0, smoothratio;
@@ -273,6 +293,108 @@ constexpr auto MAXANIMATES{512};
 static int *animateptr[MAXANIMATES], animategoal[MAXANIMATES];
 static int animatevel[MAXANIMATES], animateacc[MAXANIMATES], animatecnt = 0;
 
+	//Quicksave and quickload in memory (F6 and F9, single player only)
+static enginesnapshot quicksnapshot;
+
+	//Everything savegame() writes that play changes, for snapshots to keep
+	//along with the engine's own state
+static void registersnapshotstate()
+{
+	snapshot_register("numplayers",&numplayers,sizeof(numplayers),1);
+	snapshot_register("connectpoint2",connectpoint2.data(),sizeof(int),MAXPLAYERS);
+
+	snapshot_register("posx",posx,sizeof(posx[0]),MAXPLAYERS);
+	snapshot_register("posy",posy,sizeof(posy[0]),MAXPLAYERS);
+	snapshot_register("posz",posz,sizeof(posz[0]),MAXPLAYERS);
+	snapshot_register("horiz",horiz,sizeof(horiz[0]),MAXPLAYERS);
+	snapshot_register("zoom",zoom,sizeof(zoom[0]),MAXPLAYERS);
+	snapshot_register("hvel",hvel,sizeof(hvel[0]),MAXPLAYERS);
+	snapshot_register("ang",ang,sizeof(ang[0]),MAXPLAYERS);
+	snapshot_register("cursectnum",cursectnum,sizeof(cursectnum[0]),MAXPLAYERS);
+	snapshot_register("ocursectnum",ocursectnum,sizeof(ocursectnum[0]),MAXPLAYERS);
+	snapshot_register("playersprite",playersprite,sizeof(playersprite[0]),MAXPLAYERS);
+	snapshot_register("deaths",deaths,sizeof(deaths[0]),MAXPLAYERS);
+	snapshot_register("lastchaingun",lastchaingun,sizeof(lastchaingun[0]),MAXPLAYERS);
+	snapshot_register("health",health,sizeof(health[0]),MAXPLAYERS);
+	snapshot_register("numgrabbers",numgrabbers,sizeof(numgrabbers[0]),MAXPLAYERS);
+	snapshot_register("nummissiles",nummissiles,sizeof(nummissiles[0]),MAXPLAYERS);
+	snapshot_register("numbombs",numbombs,sizeof(numbombs[0]),MAXPLAYERS);
+	snapshot_register("flytime",flytime,sizeof(flytime[0]),MAXPLAYERS);
+	snapshot_register("oflags",oflags,sizeof(oflags[0]),MAXPLAYERS);
+	snapshot_register("dimensionmode",dimensionmode,sizeof(dimensionmode[0]),MAXPLAYERS);
+	snapshot_register("revolvedoorstat",revolvedoorstat,sizeof(revolvedoorstat[0]),MAXPLAYERS);
+	snapshot_register("revolvedoorang",revolvedoorang,sizeof(revolvedoorang[0]),MAXPLAYERS);
+	snapshot_register("revolvedoorrotang",revolvedoorrotang,sizeof(revolvedoorrotang[0]),MAXPLAYERS);
+	snapshot_register("revolvedoorx",revolvedoorx,sizeof(revolvedoorx[0]),MAXPLAYERS);
+	snapshot_register("revolvedoory",revolvedoory,sizeof(revolvedoory[0]),MAXPLAYERS);
+	snapshot_register("waterfountainwall",waterfountainwall,sizeof(waterfountainwall[0]),MAXPLAYERS);
+	snapshot_register("waterfountaincnt",waterfountaincnt,sizeof(waterfountaincnt[0]),MAXPLAYERS);
+	snapshot_register("slimesoundcnt",slimesoundcnt,sizeof(slimesoundcnt[0]),MAXPLAYERS);
+
+	snapshot_register("ssync",ssync.data(),sizeof(input),MAXPLAYERS);
+	snapshot_register("osync",osync.data(),sizeof(input),MAXPLAYERS);
+	snapshot_register("osprite",osprite,sizeof(osprite[0]),MAXSPRITES);
+	snapshot_register("lockclock",&lockclock,sizeof(lockclock),1);
+	snapshot_register("nummoves",&nummoves,sizeof(nummoves),1);
+
+	snapshot_register("turnspritelist",turnspritelist,sizeof(turnspritelist[0]),16);
+	snapshot_register("turnspritecnt",&turnspritecnt,sizeof(turnspritecnt),1);
+	snapshot_register("warpsectorlist",warpsectorlist,sizeof(warpsectorlist[0]),64);
+	snapshot_register("warpsectorcnt",&warpsectorcnt,sizeof(warpsectorcnt),1);
+	snapshot_register("xpanningsectorlist",xpanningsectorlist,sizeof(xpanningsectorlist[0]),16);
+	snapshot_register("xpanningsectorcnt",&xpanningsectorcnt,sizeof(xpanningsectorcnt),1);
+	snapshot_register("ypanningwalllist",ypanningwalllist,sizeof(ypanningwalllist[0]),64);
+	snapshot_register("ypanningwallcnt",&ypanningwallcnt,sizeof(ypanningwallcnt),1);
+	snapshot_register("floorpanninglist",floorpanninglist,sizeof(floorpanninglist[0]),64);
+	snapshot_register("floorpanningcnt",&floorpanningcnt,sizeof(floorpanningcnt),1);
+	snapshot_register("dragsectorlist",dragsectorlist,sizeof(dragsectorlist[0]),16);
+	snapshot_register("dragxdir",dragxdir,sizeof(dragxdir[0]),16);
+	snapshot_register("dragydir",dragydir,sizeof(dragydir[0]),16);
+	snapshot_register("dragsectorcnt",&dragsectorcnt,sizeof(dragsectorcnt),1);
+	snapshot_register("dragx1",dragx1,sizeof(dragx1[0]),16);
+	snapshot_register("dragy1",dragy1,sizeof(dragy1[0]),16);
+	snapshot_register("dragx2",dragx2,sizeof(dragx2[0]),16);
+	snapshot_register("dragy2",dragy2,sizeof(dragy2[0]),16);
+	snapshot_register("dragfloorz",dragfloorz,sizeof(dragfloorz[0]),16);
+	snapshot_register("swingcnt",&swingcnt,sizeof(swingcnt),1);
+	snapshot_register("swingwall",swingwall,sizeof(swingwall[0]),32);
+	snapshot_register("swingsector",swingsector,sizeof(swingsector[0]),32);
+	snapshot_register("swingangopen",swingangopen,sizeof(swingangopen[0]),32);
+	snapshot_register("swingangclosed",swingangclosed,sizeof(swingangclosed[0]),32);
+	snapshot_register("swingangopendir",swingangopendir,sizeof(swingangopendir[0]),32);
+	snapshot_register("swingang",swingang,sizeof(swingang[0]),32);
+	snapshot_register("swinganginc",swinganginc,sizeof(swinganginc[0]),32);
+	snapshot_register("swingx",swingx,sizeof(swingx[0]),32);
+	snapshot_register("swingy",swingy,sizeof(swingy[0]),32);
+	snapshot_register("revolvesector",revolvesector,sizeof(revolvesector[0]),4);
+	snapshot_register("revolveang",revolveang,sizeof(revolveang[0]),4);
+	snapshot_register("revolvecnt",&revolvecnt,sizeof(revolvecnt),1);
+	snapshot_register("revolvex",revolvex,sizeof(revolvex[0]),4);
+	snapshot_register("revolvey",revolvey,sizeof(revolvey[0]),4);
+	snapshot_register("revolvepivotx",revolvepivotx,sizeof(revolvepivotx[0]),4);
+	snapshot_register("revolvepivoty",revolvepivoty,sizeof(revolvepivoty[0]),4);
+	snapshot_register("subwaytracksector",subwaytracksector,sizeof(subwaytracksector[0]),4);
+	snapshot_register("subwaynumsectors",subwaynumsectors,sizeof(subwaynumsectors[0]),4);
+	snapshot_register("subwaytrackcnt",&subwaytrackcnt,sizeof(subwaytrackcnt),1);
+	snapshot_register("subwaystop",subwaystop,sizeof(subwaystop[0]),4);
+	snapshot_register("subwaystopcnt",subwaystopcnt,sizeof(subwaystopcnt[0]),4);
+	snapshot_register("subwaytrackx1",subwaytrackx1,sizeof(subwaytrackx1[0]),4);
+	snapshot_register("subwaytracky1",subwaytracky1,sizeof(subwaytracky1[0]),4);
+	snapshot_register("subwaytrackx2",subwaytrackx2,sizeof(subwaytrackx2[0]),4);
+	snapshot_register("subwaytracky2",subwaytracky2,sizeof(subwaytracky2[0]),4);
+	snapshot_register("subwayx",subwayx,sizeof(subwayx[0]),4);
+	snapshot_register("subwaygoalstop",subwaygoalstop,sizeof(subwaygoalstop[0]),4);
+	snapshot_register("subwayvel",subwayvel,sizeof(subwayvel[0]),4);
+	snapshot_register("subwaypausetime",subwaypausetime,sizeof(subwaypausetime[0]),4);
+
+		//The pointers only ever point into g_sector, which snapshots keep
+	snapshot_register("animateptr",animateptr,sizeof(animateptr[0]),MAXANIMATES);
+	snapshot_register("animategoal",animategoal,sizeof(animategoal[0]),MAXANIMATES);
+	snapshot_register("animatevel",animatevel,sizeof(animatevel[0]),MAXANIMATES);
+	snapshot_register("animateacc",animateacc,sizeof(animateacc[0]),MAXANIMATES);
+	snapshot_register("animatecnt",&animatecnt,sizeof(animatecnt),1);
+}
+
 #if USE_POLYMOST && USE_OPENGL
 	//These parameters are in exact order of sprite structure in BUILD.H
 #define spawnsprite(newspriteindex2,x2,y2,z2,cstat2,shade2,pal2,       \
@@ -323,6 +445,77 @@ static int animatevel[MAXANIMATES], animateacc[MAXANIMATES], animatecnt = 0;
 
 int nextvoxid = 0;
 
+	//Inputs go out as bit-packed differences from the last one sent: a bit
+	//for any change at all, then for each field a bit for a change and how
+	//much it changed by. Buttons mostly flip one or two at a time, so those
+	//go as the positions of the bits that flipped.
+static bool sameinput(const input& a, const input& b)
+{
+	return (a.fvel == b.fvel) && (a.svel == b.svel) && (a.avel == b.avel) && (a.bits == b.bits);
+}
+
+static void packvel(bitwriter& w, signed char vel, signed char last)
+{
+	if (vel == last) { w.put(0,1); return; }
+	w.put(1,1);
+	w.putsmall(zigzag((signed char)(vel-last)));
+}
+
+static void packinput(bitwriter& w, const input& in, const input& last)
+{
+	const unsigned int flipped = (unsigned short)(in.bits^last.bits);
+
+	if (sameinput(in,last)) { w.put(0,1); return; }
+	w.put(1,1);
+
+	packvel(w,in.fvel,last.fvel);
+	packvel(w,in.svel,last.svel);
+	packvel(w,in.avel,last.avel);
+
+	if (flipped == 0) { w.put(0,1); return; }
+	w.put(1,1);
+	if (std::popcount(flipped) <= 2)
+	{
+		w.put(0,1);
+		w.put(std::popcount(flipped)-1,1);
+		for(int i=0;i<16;i++)
+			if (flipped&(1<<i)) w.put(i,4);
+	}
+	else
+	{
+		w.put(1,1);
+		w.put(flipped,16);
+	}
+}
+
+static void unpackvel(bitreader& r, signed char& vel)
+{
+	if (r.get(1)) vel = (signed char)(vel+unzigzag(r.getsmall()));
+}
+
+	//in holds the last input, and is changed into the new one
+static void unpackinput(bitreader& r, input& in)
+{
+	unsigned int flipped;
+	unsigned int two;
+
+	if (!r.get(1)) return;
+
+	unpackvel(r,in.fvel);
+	unpackvel(r,in.svel);
+	unpackvel(r,in.avel);
+
+	if (!r.get(1)) return;
+	if (!r.get(1))
+	{
+		two = r.get(1);
+		flipped = (1<<r.get(4));
+		if (two) flipped |= (1<<r.get(4));
+	}
+	else flipped = r.get(16);
+	in.bits = (short)(in.bits^flipped);
+}
+
 static int osdcmd_restartvid(const osdfuncparm_t *parm)
 {
 	(void)parm;
@@ -385,6 +578,8 @@ static int osdcmd_map(const osdfuncparm_t *parm) {
     }
 
     prepareboard(namebuf);
+    strncpy(boardfilename, namebuf, BMAX_PATH-1);
+    boardfilename[BMAX_PATH-1] = 0;
 
     screenpeek = myconnectindex;
 	reccnt = 0;
@@ -394,11 +589,527 @@ static int osdcmd_map(const osdfuncparm_t *parm) {
 	totalclock = ototalclock = 0; gotlastpacketclock = 0; nummoves = 0;
 
 	ready2send = 1;
-	drawscreen(screenpeek,65536L);
+	if (!headless) drawscreen(screenpeek,65536L);
 
     return OSDCMD_OK;
 }
 
+	//What the recorded inputs cost to send each tick, in the byte-aligned
+	//packets that came before the bit-packed ones and in those. Games of
+	//more than two players replay the two recorded tracks from other ticks.
+static void netinputbenchgame(int players)
+{
+	std::array<input, MAXPLAYERS> in, last{}, decoded{};
+	std::array<int, MAXPLAYERS> start;
+	unsigned char buf[256];
+	int oldms = 0, newms = 0, oldp2p = 0, newp2p = 0, slavesends = 0, errors = 0;
+	int i;
+	int j;
+	int t;
+
+	for(i=0;i<players;i++) start[i] = (i>>1)*reccnt/((players+1)>>1);
+
+	for(t=0;t<reccnt;t++)
+	{
+		for(i=0;i<players;i++)
+			copybufbyte(&recsync[(start[i]+t)%reccnt][i&1],&in[i],sizeof(input));
+
+			//Before: master sends a nibble of flags and whole bytes per player
+			//to each slave in turn; slaves and peers send theirs every tick
+		j = ((players+1)>>1)+1;
+		for(i=0;i<players;i++)
+		{
+			const int k = (in[i].fvel != last[i].fvel)+(in[i].svel != last[i].svel)+(in[i].avel != last[i].avel);
+			j += k+((in[i].bits != last[i].bits)<<1);
+			if (i > 0) oldms += 2+k+(((in[i].bits^last[i].bits)&0x00ff) != 0)+(((in[i].bits^last[i].bits)&0xff00) != 0);
+			oldp2p += (3+k+(((in[i].bits^last[i].bits)&0x00ff) != 0)+(((in[i].bits^last[i].bits)&0xff00) != 0))*(players-1);
+		}
+		oldms += j*(players-1);
+
+			//After: one bit-packed broadcast, and slaves send only changes
+		bitwriter w{std::span(buf)};
+		for(i=0;i<players;i++) packinput(w,in[i],last[i]);
+		newms += (1+w.bytes())*(players-1);
+
+		bitreader r{std::span(buf).first(w.bytes())};
+		for(i=0;i<players;i++)
+		{
+			unpackinput(r,decoded[i]);
+			if (!sameinput(decoded[i],in[i])) errors++;
+		}
+
+		for(i=0;i<players;i++)
+		{
+			bitwriter v{std::span(buf)};
+			packinput(v,in[i],last[i]);
+			if ((i > 0) && !sameinput(in[i],last[i])) newms += 1+v.bytes(), slavesends++;
+			v.putsmall(0);   //Peers also send how far ahead they are, a tick or two
+			newp2p += (1+v.bytes())*(players-1);
+			copybufbyte(&in[i],&last[i],sizeof(input));
+		}
+	}
+
+	const float perplayer = 1.F/((float)reccnt*(float)players);
+	buildprintf("  {:7}  {:10.2f}  {:9.2f}  {:10.2f}  {:9.2f}  {:10.0f}%  {:6}\n", players,
+		(float)oldms*perplayer, (float)newms*perplayer, (float)oldp2p*perplayer, (float)newp2p*perplayer,
+		100.F*(float)slavesends/((float)reccnt*(float)(players-1)), errors);
+}
+
+static int osdcmd_netinputbench(const osdfuncparm_t *parm)
+{
+	int players = 0;
+
+	if (parm->parms.size() > 1) return OSDCMD_SHOWHELP;
+	if (parm->parms.size() == 1)
+	{
+		std::from_chars(parm->parms[0].data(), parm->parms[0].data() + parm->parms[0].size(), players);
+		if ((players < 2) || (players > MAXPLAYERS)) return OSDCMD_SHOWHELP;
+	}
+	if (reccnt < 2)
+	{
+		buildputs("netinputbench: no inputs recorded yet, play a while first\n");
+		return OSDCMD_OK;
+	}
+
+	buildprintf("netinputbench: {} recorded ticks, payload bytes per tick per player\n", reccnt);
+	buildputs("  players  m/s before  m/s after  p2p before  p2p after  slave sends  errors\n");
+	if (players) netinputbenchgame(players);
+	else for(players=2;players<=MAXPLAYERS;players<<=1) netinputbenchgame(players);
+	return OSDCMD_OK;
+}
+
+static std::chrono::steady_clock::time_point ticklap(int part, std::chrono::steady_clock::time_point since)
+{
+	const auto now = std::chrono::steady_clock::now();
+	tickprofile[part] += now-since;
+	return now;
+}
+
+	//A checksum of what the simulation moves: the random seed, the players,
+	//the sectors and the sprites in play. The walls are left out to keep it
+	//quick, as a wall out of place soon moves something that is checked.
+static unsigned int gamestatehash()
+{
+	unsigned int crc;
+	int i;
+	int j;
+
+	crc32init(&crc);
+	crc32block(&crc,(unsigned char *)&randomseed,sizeof(randomseed));
+	crc32block(&crc,(unsigned char *)&lockclock,sizeof(lockclock));
+	for(i=connecthead;i>=0;i=connectpoint2[i])
+	{
+		crc32block(&crc,(unsigned char *)&posx[i],sizeof(posx[i]));
+		crc32block(&crc,(unsigned char *)&posy[i],sizeof(posy[i]));
+		crc32block(&crc,(unsigned char *)&posz[i],sizeof(posz[i]));
+		crc32block(&crc,(unsigned char *)&ang[i],sizeof(ang[i]));
+		crc32block(&crc,(unsigned char *)&horiz[i],sizeof(horiz[i]));
+		crc32block(&crc,(unsigned char *)&health[i],sizeof(health[i]));
+		crc32block(&crc,(unsigned char *)&cursectnum[i],sizeof(cursectnum[i]));
+	}
+	crc32block(&crc,(unsigned char *)g_sector.data(),(unsigned int)(numsectors*sizeof(sectortype)));
+	for(j=0;j<MAXSTATUS;j++)
+		for(i=headspritestat[j];i>=0;i=nextspritestat[i])
+			crc32block(&crc,(unsigned char *)&sprite[i],sizeof(spritetype));
+	return crc32finish(&crc);
+}
+
+	//A recorded game: its board, each tick's inputs and the checksum of the
+	//state they led to
+struct demo
+{
+	char board[BMAX_PATH];
+	int players;
+	std::vector<std::array<input, 2>> inputs;
+	std::vector<unsigned int> hashes;
+};
+constexpr char demomagic[4] = {'K','B','D','M'};
+constexpr auto DEMOVERSION{1};
+
+static int savedemo(const char *filename)
+{
+	std::FILE *fil;
+	int i = DEMOVERSION;
+	char board[BMAX_PATH] = {0};
+
+	if ((fil = std::fopen(filename,"wb")) == nullptr) return(-1);
+
+	std::strcpy(board,boardfilename);
+	dfwrite((void *)demomagic,4,1,fil);
+	dfwrite(&i,4,1,fil);
+	dfwrite(board,BMAX_PATH,1,fil);
+	dfwrite(&numplayers,4,1,fil);
+	dfwrite(&reccnt,4,1,fil);
+	dfwrite(recsync,sizeof(recsync[0]),reccnt,fil);
+	dfwrite(rechash,4,reccnt,fil);
+
+	std::fclose(fil);
+	return(0);
+}
+
+static int loaddemo(const char *filename, demo& dem)
+{
+	int fil;
+	int version = 0, ticks = 0;
+	char magic[4];
+
+	if ((fil = kopen4load(filename,0)) == -1) return(-1);
+
+	if ((kdfread(magic,4,1,fil) != 1) || std::memcmp(magic,demomagic,4) ||
+		(kdfread(&version,4,1,fil) != 1) || (version != DEMOVERSION) ||
+		(kdfread(dem.board,BMAX_PATH,1,fil) != 1) ||
+		(kdfread(&dem.players,4,1,fil) != 1) || (dem.players < 1) || (dem.players > 2) ||
+		(kdfread(&ticks,4,1,fil) != 1) || (ticks < 1) || (ticks > 16384))
+	{
+		kclose(fil);
+		return(-1);
+	}
+	dem.board[BMAX_PATH-1] = 0;
+
+	dem.inputs.resize(ticks);
+	dem.hashes.resize(ticks);
+	if ((kdfread(dem.inputs.data(),sizeof(dem.inputs[0]),ticks,fil) != (unsigned)ticks) ||
+		(kdfread(dem.hashes.data(),4,ticks,fil) != (unsigned)ticks))
+	{
+		kclose(fil);
+		return(-1);
+	}
+
+	kclose(fil);
+	return(0);
+}
+
+	//Replays a demo through domovethings() as fast as it will go, checking
+	//each tick against the recorded checksum, and reports the ticks a second
+	//and where they went. Draws every drawevery'th tick, or none if 0.
+	//Afterwards the game carries on as it was, or from the start of its
+	//board if the demo was of another. Returns the number of ticks whose
+	//state differed, or -1 if the demo can't be played here.
+static int demobench(demo& dem, int drawevery)
+{
+	using clock = std::chrono::steady_clock;
+	using us = std::chrono::duration<float, std::micro>;
+	enginesnapshot before;
+	clock::duration checking{}, drawing{};
+	const int ticks = (int)dem.inputs.size();
+	const int oldrecstat = recstat, oldready2send = ready2send;
+	const bool sameboard = IsSameAsNoCase(dem.board, boardfilename);
+	int differ = 0, firstdiffer = -1;
+	int i;
+	int j;
+	int t;
+
+	if ((option[4] != 0) || (dem.players != numplayers))
+	{
+		buildprintf("demobench: the demo is for {} player(s) on one computer, this game has {}{}\n",
+			dem.players, numplayers, option[4] ? " over the network" : "");
+		return(-1);
+	}
+
+	if (sameboard) before.capture();
+	recstat = 0;      //Don't record over the recording
+	ready2send = 0;   //drawscreen() mustn't send inputs of its own
+
+	prepareboard(dem.board);
+	for(i=connecthead;i>=0;i=connectpoint2[i]) initplayersprite((short)i);
+	nummoves = 0;
+	if (!headless) screensize = xdim+1;   //No status bar to draw each tick
+
+	tickprofile.fill({});
+	tickprofiling = true;
+	const auto start = clock::now();
+	for(t=0;t<ticks;t++)
+	{
+		for(i=connecthead,j=0;i>=0;i=connectpoint2[i],j++)
+			copybufbyte(&dem.inputs[t][j],&ffsync[i],sizeof(input));
+		movethings(); domovethings();
+
+		const auto simulated = clock::now();
+		if (gamestatehash() != dem.hashes[t])
+		{
+			if (differ++ == 0) firstdiffer = t;
+		}
+		const auto checked = clock::now();
+		checking += checked-simulated;
+
+		if ((drawevery > 0) && !headless && ((t%drawevery) == 0))
+		{
+			handleevents();
+			drawscreen(screenpeek,65536L);
+			drawing += clock::now()-checked;
+		}
+	}
+	const auto took = clock::now()-start;
+	tickprofiling = false;
+
+	const auto sim = took-checking-drawing;
+	auto rest = sim;
+	for(const auto& part : tickprofile) rest -= part;
+	const float pertick = 1.F/(float)ticks;
+	buildprintf("demobench: {} ticks on {} in {:.3f} s, {:.0f} ticks a second\n", ticks, dem.board,
+		std::chrono::duration<float>(took).count(), (float)ticks/std::chrono::duration<float>(sim).count());
+	buildprintf("  simulation:       {:9.2f} us a tick\n", us(sim).count()*pertick);
+	buildprintf("    player moves:   {:9.2f} us\n", us(tickprofile[TICKPLAYERS]).count()*pertick);
+	buildprintf("    doanimations:   {:9.2f} us\n", us(tickprofile[TICKANIMATIONS]).count()*pertick);
+	buildprintf("    tagcode:        {:9.2f} us\n", us(tickprofile[TICKTAGS]).count()*pertick);
+	buildprintf("    statuslistcode: {:9.2f} us\n", us(tickprofile[TICKSTATUS]).count()*pertick);
+	buildprintf("    the rest:       {:9.2f} us\n", us(rest).count()*pertick);
+	buildprintf("  state checksum:   {:9.2f} us a tick\n", us(checking).count()*pertick);
+	if (drawing.count()) buildprintf("  drawing:          {:9.2f} us a frame\n", us(drawing).count()/(float)((ticks+drawevery-1)/drawevery));
+	if (differ) buildprintf("  state: {} ticks differ from the recording, the first at tick {}\n", differ, firstdiffer);
+	else buildputs("  state: same as recorded at every tick\n");
+
+	recstat = oldrecstat;
+	ready2send = oldready2send;
+	if (sameboard)
+	{
+		before.restore();
+		for(i=connecthead;i>=0;i=connectpoint2[i])
+		{
+			oposx[i] = posx[i]; oposy[i] = posy[i]; oposz[i] = posz[i];
+			ohoriz[i] = horiz[i]; ozoom[i] = zoom[i]; oang[i] = ang[i];
+		}
+	}
+	else
+	{
+		prepareboard(boardfilename);
+		for(i=connecthead;i>=0;i=connectpoint2[i]) initplayersprite((short)i);
+		reccnt = 0;
+	}
+	if (!headless)
+	{
+		screensize = xdim;
+		drawstatusbar(screenpeek);
+	}
+	return(differ);
+}
+
+static int osdcmd_demosave(const osdfuncparm_t *parm)
+{
+	const char *filename = "demo.dmo";
+
+	if (parm->parms.size() > 1) return OSDCMD_SHOWHELP;
+	if (parm->parms.size() == 1) filename = parm->parms[0].c_str();
+
+	if ((reccnt < 1) || (numplayers > 2))
+		buildputs("demosave: nothing recorded, play a while first\n");
+	else if (savedemo(filename))
+		buildprintf("demosave: could not write {}\n", filename);
+	else
+		buildprintf("demosave: {} ticks on {} saved to {}\n", reccnt, boardfilename, filename);
+	return OSDCMD_OK;
+}
+
+static int osdcmd_demobench(const osdfuncparm_t *parm)
+{
+	demo dem;
+	int drawevery = 0;
+
+	if (parm->parms.size() > 2) return OSDCMD_SHOWHELP;
+	if (parm->parms.size() >= 1)
+		std::from_chars(parm->parms[0].data(), parm->parms[0].data() + parm->parms[0].size(), drawevery);
+
+	if (parm->parms.size() == 2)
+	{
+		if (loaddemo(parm->parms[1].c_str(),dem))
+		{
+			buildprintf("demobench: could not load {}\n", parm->parms[1]);
+			return OSDCMD_OK;
+		}
+	}
+	else if ((reccnt < 1) || (numplayers > 2))
+	{
+		buildputs("demobench: nothing recorded, play a while first or name a demo\n");
+		return OSDCMD_OK;
+	}
+	else
+	{
+		std::strcpy(dem.board,boardfilename);
+		dem.players = numplayers;
+		dem.inputs.resize(reccnt);
+		copybufbyte(recsync,dem.inputs.data(),reccnt*(int)sizeof(recsync[0]));
+		dem.hashes.assign(rechash,rechash+reccnt);
+	}
+
+	demobench(dem,std::max(drawevery,0));
+	return OSDCMD_OK;
+}
+
+	//Adds brown monsters at random spots on the board and runs
+	//statuslistcode() for a number of ticks, once moving the actors one at
+	//a time and once with their moves worked out ahead, and reports both
+	//times and whether every tick came out the same. Afterwards the game
+	//carries on as it was.
+static void actorbench(int monsters, int ticks)
+{
+	using clock = std::chrono::steady_clock;
+	using ms = std::chrono::duration<float, std::milli>;
+	enginesnapshot before, start;
+	std::vector<unsigned int> serialhashes(ticks), parallelhashes(ticks);
+	const int oldparallelactors = parallelactors, oldnummoves = nummoves;
+	int added = 0, tries = 0;
+	int i;
+	int t;
+
+	if (numsectors <= 0)
+	{
+		buildputs("actorbench: no board loaded\n");
+		return;
+	}
+
+	before.capture();
+	while ((added < monsters) && (tries++ < monsters*64))
+	{
+		const short dasector = (short)mulscalen<16>(krand(),numsectors);
+		const auto& sec = g_sector[dasector];
+		int minx = 0x7fffffff, maxx = 0x80000000, miny = 0x7fffffff, maxy = 0x80000000;
+
+		for(i=sec.wallptr;i<sec.wallptr+sec.wallnum;i++)
+		{
+			minx = std::min(minx,wall[i].pt.x); maxx = std::max(maxx,wall[i].pt.x);
+			miny = std::min(miny,wall[i].pt.y); maxy = std::max(maxy,wall[i].pt.y);
+		}
+		if ((maxx-minx <= 256) || (maxy-miny <= 256) || (sec.lotag != 0)) continue;
+		const int x = minx+mulscalen<16>(krand(),maxx-minx);
+		const int y = miny+mulscalen<16>(krand(),maxy-miny);
+		if (inside(x,y,dasector) != 1) continue;
+
+		const int j = insertsprite(dasector,1);
+		if (j < 0) break;
+		auto& spr = sprite[j];
+		spr = {};
+		spr.x = x; spr.y = y;
+		spr.picnum = BROWNMONSTER;
+		spr.xrepeat = spr.yrepeat = 64;
+		spr.z = getflorzofslope(dasector,x,y)-((tilesizy[BROWNMONSTER]*spr.yrepeat)<<1);
+		spr.cstat = 0x181;   //Centred, blocking and hitscan sensitive, as prepareboard() has them
+		spr.clipdist = mulscalen<7>(spr.xrepeat,tilesizx[BROWNMONSTER]);
+		spr.ang = spr.extra = (short)(krand()&2047);
+		spr.lotag = mulscalen<5>(spr.xrepeat,spr.yrepeat);
+		spr.owner = -1;
+		spr.sectnum = dasector;
+		spr.statnum = 1;
+		updatespriteclip((short)j);
+		added++;
+	}
+	start.capture();
+
+	const auto run = [&start, ticks, oldnummoves](std::vector<unsigned int>& hashes) {
+		clock::duration took{};
+
+		start.restore();
+		nummoves = oldnummoves;
+		actormovestats = {};
+		for(int tick=0;tick<ticks;tick++)
+		{
+			nummoves++;
+			const auto began = clock::now();
+			statuslistcode();
+			took += clock::now()-began;
+			hashes[tick] = gamestatehash();
+		}
+		return took;
+	};
+
+	parallelactors = 0;
+	const auto serial = run(serialhashes);
+	parallelactors = 1;
+	const auto parallel = run(parallelhashes);
+	const auto stats = actormovestats;
+
+	for(t=0;t<ticks;t++)
+		if (serialhashes[t] != parallelhashes[t]) break;
+
+	buildprintf("actorbench: {} monsters added, {} ticks\n", added, ticks);
+	buildprintf("  one at a time: {:8.3f} ms a tick\n", ms(serial).count()/(float)ticks);
+	buildprintf("  worked ahead:  {:8.3f} ms a tick, {:.2f}x, {} of {} moves worked out ahead used\n",
+		ms(parallel).count()/(float)ticks, ms(serial).count()/std::max(ms(parallel).count(),0.001F),
+		stats.used, stats.predicted);
+	if (t < ticks) buildprintf("  state: DIFFERS from tick {}\n", t);
+	else buildputs("  state: same at every tick\n");
+
+	before.restore();
+	nummoves = oldnummoves;
+	parallelactors = oldparallelactors;
+}
+
+static int osdcmd_actorbench(const osdfuncparm_t *parm)
+{
+	int monsters = 512, ticks = 240;
+
+	if (parm->parms.size() > 2) return OSDCMD_SHOWHELP;
+	if (parm->parms.size() >= 1)
+		std::from_chars(parm->parms[0].data(), parm->parms[0].data() + parm->parms[0].size(), monsters);
+	if (parm->parms.size() >= 2)
+		std::from_chars(parm->parms[1].data(), parm->parms[1].data() + parm->parms[1].size(), ticks);
+	if ((monsters < 0) || (ticks < 1)) return OSDCMD_SHOWHELP;
+
+	actorbench(monsters,ticks);
+	return OSDCMD_OK;
+}
+
+static int osdcmd_parallelactors(const osdfuncparm_t *parm)
+{
+	if (parm->parms.size() > 1) return OSDCMD_SHOWHELP;
+	if (parm->parms.size() == 1)
+		std::from_chars(parm->parms[0].data(), parm->parms[0].data() + parm->parms[0].size(), parallelactors);
+	buildprintf("parallelactors is {}\n", parallelactors);
+	return OSDCMD_OK;
+}
+
+	//Headless in place of drawscreen(): sends the inputs for the ticks that
+	//are due, then sleeps until the next one is. Every so often it reports
+	//how much of each tick the simulation and networking took.
+static void headlesstick()
+{
+	using clock = std::chrono::steady_clock;
+	constexpr auto tick = std::chrono::duration_cast<clock::duration>(
+		std::chrono::duration<int, std::ratio<TIMERINTSPERSECOND/MOVESPERSECOND, TIMERINTSPERSECOND>>{1});
+	constexpr auto reportevery = std::chrono::seconds{10};
+	static clock::time_point woke = clock::now(), since = woke, nexttick;
+	static clock::duration busy{}, busymax{}, slept{};
+	static int lastmoves = nummoves, ticks = 0, overruns = 0;
+	bool due = false;
+
+	while (ready2send && totalclock >= ototalclock+(TIMERINTSPERSECOND/MOVESPERSECOND))
+	{
+		faketimerhandler();
+		due = true;
+	}
+
+	const auto now = clock::now();
+	const auto took = now - woke;
+	busy += took;
+	busymax = std::max(busymax, took);
+	if (took > tick) overruns++;
+	ticks += std::max(nummoves-lastmoves, 0);
+	lastmoves = nummoves;
+
+	if (now-since >= reportevery)
+	{
+		using ms = std::chrono::duration<float, std::milli>;
+		buildprintf("headless: {} ticks in {:.1f} s, {:.3f} ms a tick, {:.3f} ms longest, {} over {:.1f} ms, {:.1f}% busy\n",
+			ticks, std::chrono::duration<float>(now-since).count(),
+			ticks ? ms(busy).count()/(float)ticks : 0.F, ms(busymax).count(), overruns, ms(tick).count(),
+			100.F*ms(busy).count()/(ms(busy).count()+ms(slept).count()));
+		since = now;
+		busy = busymax = slept = {};
+		ticks = overruns = 0;
+	}
+
+		//Keep to the timer's rate, starting over when too far behind
+	if (due)
+	{
+		nexttick += tick;
+		if (nexttick < now) nexttick = now+tick;
+		std::this_thread::sleep_until(nexttick);
+	}
+	else std::this_thread::sleep_for(std::chrono::milliseconds{1});
+
+	woke = clock::now();
+	slept += woke-now;
+}
+
 #if defined RENDERTYPEWIN || (defined RENDERTYPESDL && (defined __APPLE__ || defined HAVE_GTK))
 # define HAVE_STARTWIN
 #endif
@@ -414,6 +1125,7 @@ int app_main(int argc, char const * const argv[])
 	int x2;
 	int y2;
 	int other, netparm = 0, endnetparm = 0, netsuccess = 0;
+	int retval = 0;
 
 #ifdef HAVE_STARTWIN
 	int cmdsetup = 0;
@@ -489,6 +1201,11 @@ int app_main(int argc, char const * const argv[])
 	OSD_RegisterFunction("restartvid","restartvid: reinitialise the video mode",osdcmd_restartvid);
 	OSD_RegisterFunction("vidmode","vidmode [xdim ydim] [bpp] [fullscreen]: immediately change the video mode",osdcmd_vidmode);
 	OSD_RegisterFunction("map", "map [filename]: load a map", osdcmd_map);
+	OSD_RegisterFunction("netinputbench", "netinputbench [players]: compare the bytes per tick the recorded inputs take to send, byte-aligned and bit-packed", osdcmd_netinputbench);
+	OSD_RegisterFunction("demosave", "demosave [filename]: save the game recorded since the board started as a demo", osdcmd_demosave);
+	OSD_RegisterFunction("demobench", "demobench [drawevery] [filename]: replay the recorded game or a demo as fast as possible, checking its state and timing each part of a tick", osdcmd_demobench);
+	OSD_RegisterFunction("parallelactors", "parallelactors [0/1]: work out monster and bullet moves on every core ahead of each status list", osdcmd_parallelactors);
+	OSD_RegisterFunction("actorbench", "actorbench [monsters] [ticks]: add monsters to the board and time their ticks with and without parallelactors, checking both agree", osdcmd_actorbench);
 
 	wm_setapptitle("KenBuild by Ken Silverman");
 
@@ -505,6 +1222,7 @@ int app_main(int argc, char const * const argv[])
 					if (IsSameAsNoCase(argv[i], "--")) break;
 				endnetparm = i;
 			}
+			else if (IsSameAsNoCase(&argv[i][1], "demobench") && (i+1 < argc)) demobenchfile = argv[++i];
 #ifdef HAVE_STARTWIN
 			else if (IsSameAsNoCase(&argv[i][1], "setup")) cmdsetup = 1;
 			else if (IsSameAsNoCase(&argv[i][1], "nosetup")) cmdsetup = -1;
@@ -534,7 +1252,7 @@ int app_main(int argc, char const * const argv[])
     settings.forcesetup = forcesetup;
     settings.netoverride = netparm > 0;
 
-	if (i || (forcesetup && cmdsetup == 0) || (cmdsetup > 0)) {
+	if (!headless && (i || (forcesetup && cmdsetup == 0) || (cmdsetup > 0))) {
         if (quitevent) return 0;
 
         startretval = startwin_run(&settings);
@@ -551,8 +1269,11 @@ int app_main(int argc, char const * const argv[])
 
     writesetup("game.cfg");
 
-	initinput();
-	if (option[3] != 0) initmouse();
+	if (!headless)
+	{
+		initinput();
+		if (option[3] != 0) initmouse();
+	}
 	inittimer(TIMERINTSPERSECOND, nullptr);
 
 	if (netparm) {
@@ -587,6 +1308,7 @@ int app_main(int argc, char const * const argv[])
         buildputs("Waiting for players...\n");
         while (initmultiplayerscycle()) {
             handleevents();
+            if (headless) std::this_thread::sleep_for(std::chrono::milliseconds{1});
             if (quitevent) {
                 musicoff();
                 uninitmultiplayers();
@@ -639,14 +1361,18 @@ int app_main(int argc, char const * const argv[])
 	for(j=0;j<256;j++) remapbuf[j] = j; //(j&31)+32;
 	makepalookup(18,remapbuf,8,8,48,1);
 
+	registersnapshotstate();
 	prepareboard(boardfilename);                   //Load board
 
-	initsb(option[1],option[2],digihz[option[7]>>4],((option[7]&4)>0)+1,((option[7]&2)>0)+1,60,option[7]&1);
-	if (IsSameAsNoCase(boardfilename, "klab.map"))
-	    loadsong("klabsong.kdm");
-	else
-		loadsong("neatsong.kdm");
-	musicon();
+	if (!headless)
+	{
+		initsb(option[1],option[2],digihz[option[7]>>4],((option[7]&4)>0)+1,((option[7]&2)>0)+1,60,option[7]&1);
+		if (IsSameAsNoCase(boardfilename, "klab.map"))
+			loadsong("klabsong.kdm");
+		else
+			loadsong("neatsong.kdm");
+		musicon();
+	}
 
 	if (option[4] > 0)
 	{
@@ -655,14 +1381,18 @@ int app_main(int argc, char const * const argv[])
 		y1 = (((ydim-32)-scale(screensize,ydim-32,xdim))>>1);
 		y2 = y1 + scale(screensize,ydim-32,xdim)-1;
 
-		drawtilebackground(0L,0L,BACKGROUND,8,x1,y1,x2,y2,0);
+		if (!headless) drawtilebackground(0L,0L,BACKGROUND,8,x1,y1,x2,y2,0);
 
 		if (option[4] < 5) waitplayers = 2; else waitplayers = option[4]-3;
 		while (numplayers < waitplayers)
 		{
-			std::sprintf(tempbuf,"%d of %d players in...",numplayers,waitplayers);
-			printext256(68L,84L,31,0,tempbuf,0);
-			nextpage();
+			if (!headless)
+			{
+				std::sprintf(tempbuf,"%d of %d players in...",numplayers,waitplayers);
+				printext256(68L,84L,31,0,tempbuf,0);
+				nextpage();
+			}
+			else std::this_thread::sleep_for(std::chrono::milliseconds{1});
 
 			if (getpacket(&other,packbuf) > 0)
 				if (packbuf[0] == 255)
@@ -712,7 +1442,20 @@ int app_main(int argc, char const * const argv[])
 	totalclock = ototalclock = 0; gotlastpacketclock = 0; nummoves = 0;
 
 	ready2send = 1;
-	drawscreen(screenpeek,65536L);
+	if (demobenchfile)
+	{
+		demo dem;
+
+		if (loaddemo(demobenchfile,dem))
+		{
+			buildprintf("demobench: could not load {}\n", demobenchfile);
+			retval = 1;
+		}
+		else retval = (demobench(dem,0) != 0);
+		keystatus[1] = 1;   //Quit when done
+	}
+	else if (!headless) drawscreen(screenpeek,65536L);
+	else buildputs("Running headless, interrupt to quit\n");
 
 	while (!keystatus[1])       //Main loop starts here
 	{
@@ -780,6 +1523,12 @@ int app_main(int argc, char const * const argv[])
 				domovethings();
 			}
 		}
+		if (headless)
+		{
+			headlesstick();
+			continue;
+		}
+
 		i = (totalclock-gotlastpacketclock)*(65536/(TIMERINTSPERSECOND/MOVESPERSECOND));
 
 		drawscreen(screenpeek,i);
@@ -791,7 +1540,7 @@ int app_main(int argc, char const * const argv[])
 	uninitsb();
 	uninitgroupfile();
 
-	return(0);
+	return(retval);
 }
 
 void operatesector(short dasector)
@@ -1227,10 +1976,12 @@ void prepareboard(char *daboardfilename)
 		if (std::strlen(tempfn) <= BMAX_PATH-4) {
 			std::strcat(tempfn,".mhk");
 			loadmaphack(tempfn);
+			std::strcpy(tempfn + std::strlen(tempfn) - 4,".pvs");
+			loadpvs(tempfn);
 		}
 	}
 
-	setup3dscreen();
+	if (!headless) setup3dscreen();
 
 	for(i=0;i<MAXPLAYERS;i++)
 	{
@@ -1272,6 +2023,8 @@ void prepareboard(char *daboardfilename)
 	movefifoplc = fakemovefifoplc = 0;
 	syncvalhead = 0L; othersyncvalhead = 0L;
 	syncvaltottail = 0L; syncvaltail = 0L;
+	slaveinputs = mastermoves = 0;
+	netgamestats = {};
 	numinterpolations = 0;
 
 	clearbufbyte(&oloc,sizeof(input),0L);
@@ -1631,12 +2384,17 @@ void prepareboard(char *daboardfilename)
 	ototalclock = 0;
 	gotlastpacketclock = 0;
 
-	screensize = xdim;
-	dax = ((xdim-screensize)>>1);
-	dax2 = dax+screensize-1;
-	day = (((ydim-32)-scale(screensize,ydim-32,xdim))>>1);
-	day2 = day + scale(screensize,ydim-32,xdim)-1;
-	setview(dax,day,dax2,day2);
+	if (headless)
+		screensize = xdim+1;   //No status bar to draw on
+	else
+	{
+		screensize = xdim;
+		dax = ((xdim-screensize)>>1);
+		dax2 = dax+screensize-1;
+		day = (((ydim-32)-scale(screensize,ydim-32,xdim))>>1);
+		day2 = day + scale(screensize,ydim-32,xdim)-1;
+		setview(dax,day,dax2,day2);
+	}
 
 	startofdynamicinterpolations = numinterpolations;
 
@@ -2252,6 +3010,8 @@ void tagcode()
 						} while ((good == 0) && (cnt > 0));
 					}
 			}
+			for(k=1;k<=3;k++)
+				updatesectorindex(sectorofwall(swingwall[i][k]));
 		}
 		if (swinganginc[i] == 0)
 			for(j=1;j<=3;j++)
@@ -2287,6 +3047,7 @@ void tagcode()
 						if (wall[k].pt.x < subwaytrackx2[i])
 							if (wall[k].pt.y < subwaytracky2[i])
 								wall[k].pt.x += subwayvel[i];
+			updatesectorindex(dasector);
 
 			for(j=1;j<subwaynumsectors[i];j++)
 			{
@@ -2296,6 +3057,7 @@ void tagcode()
 				endwall = startwall+g_sector[dasector].wallnum;
 				for(k=startwall;k<endwall;k++)
 					wall[k].pt.x += subwayvel[i];
+				updatesectorindex(dasector);
 
 				for(s=headspritesect[dasector];s>=0;s=nextspritesect[s])
 					sprite[s].x += subwayvel[i];
@@ -2377,6 +3139,186 @@ void tagcode()
 	}
 }
 
+	//Actor moves for statuslistcode(), worked out on every core before a
+	//status list runs. The list's code still runs in order on this thread,
+	//and where it moves an actor it takes the move worked out ahead only if
+	//nothing that move read has changed since: the actor itself, and every
+	//sprite near enough to it that the list's code has changed so far. Any
+	//other move is made there and then, so the outcome is the same bit for
+	//bit as with parallelactors off, and network games and demos stay in
+	//step whatever each computer has it set to.
+struct actormove
+{
+	short spritenum;
+	int dx, dy, dz, ceildist, flordist, clipmask;
+	spritetype was;       //The sprite as the move was worked out from
+	int x, y, z;
+	short sectnum;
+	int retval;
+	int hiz, hihit, loz, lohit;
+	clipbox reach;        //Sprites changing in here could change the move
+};
+static std::vector<actormove> actormoves;
+static std::array<int, MAXSPRITES> actormoveof;   //Index into actormoves, or -1
+static std::vector<clipbox> actorschanged;        //Where the list's code has changed sprites so far
+static bool actorschangedall;                     //Or somewhere it can't tell
+
+static bool clipboxesmeet(const clipbox& a, const clipbox& b)
+{
+	return (a.x1 <= b.x2) && (b.x1 <= a.x2) && (a.y1 <= b.y2) && (b.y1 <= a.y2);
+}
+
+	//argsfor(i,m) fills in the movesprite() arguments of m the list's code
+	//will most likely use for sprite i, or returns false if it won't move it
+template<typename F>
+static void predictactormoves(short statnum, F argsfor)
+{
+	static std::vector<clipmovequery> moves;
+	static std::vector<clipmoveresult> moved;
+	static std::vector<getzrangequery> looks;
+	static std::vector<getzrangeresult> seen;
+	static bool cleared = false;
+	int i;
+	int k;
+
+	if (!cleared) { actormoveof.fill(-1); cleared = true; }
+	for(const auto& m : actormoves) actormoveof[m.spritenum] = -1;
+	actormoves.clear();
+	actorschanged.clear();
+	actorschangedall = false;
+	if (!parallelactors) return;
+
+	for(i=headspritestat[statnum];i>=0;i=nextspritestat[i])
+	{
+		actormove m{};
+		if (!argsfor((short)i,m)) continue;
+			//getzrange() would find it in the sector list it is about to join
+		if ((sprite[i].cstat&~1) & (m.clipmask>>16)) continue;
+		m.spritenum = (short)i;
+		std::memcpy(&m.was,&sprite[i],sizeof(spritetype));
+		actormoves.push_back(m);
+	}
+
+	const int n = (int)actormoves.size();
+	moves.resize(n); moved.resize(n);
+	looks.resize(n); seen.resize(n);
+
+		//As movesprite() does, in two steps so nothing moves until all are done
+	for(k=0;k<n;k++)
+	{
+		const auto& m = actormoves[k];
+		const auto& spr = m.was;
+		const int zoffs = ((spr.cstat&128) == 0) ? -((tilesizy[spr.picnum]*spr.yrepeat)<<1) : 0;
+		moves[k] = {spr.x,spr.y,spr.z+zoffs,spr.sectnum,m.dx,m.dy,((int)spr.clipdist)<<2,m.ceildist,m.flordist,(unsigned int)m.clipmask};
+	}
+	clipmovebatch(moves,moved);
+
+	for(k=0;k<n;k++)
+	{
+		const auto& m = actormoves[k];
+		const short dasectnum = moved[k].sectnum;
+		looks[k] = {moved[k].x,moved[k].y,m.was.z-1,(dasectnum >= 0) ? dasectnum : m.was.sectnum,
+			((int)m.was.clipdist)<<2,(unsigned int)m.clipmask,m.spritenum};
+	}
+	getzrangebatch(looks,seen);
+
+	for(k=0;k<n;k++)
+	{
+		auto& m = actormoves[k];
+		const auto& spr = m.was;
+		const int zoffs = moves[k].z-spr.z;
+		const int walldist = moves[k].walldist;
+		short retval = (short)moved[k].retval;
+
+		m.x = moved[k].x; m.y = moved[k].y; m.sectnum = moved[k].sectnum;
+		if (m.sectnum < 0) retval = -1;
+		m.hiz = seen[k].ceilz; m.hihit = seen[k].ceilhit;
+		m.loz = seen[k].florz; m.lohit = seen[k].florhit;
+
+		const int daz = spr.z+zoffs+m.dz;
+		if ((daz <= m.hiz) || (daz > m.loz))
+		{
+			m.z = spr.z;
+			m.retval = (retval != 0) ? retval : 16384+m.sectnum;
+		}
+		else
+		{
+			m.z = daz-zoffs;
+			m.retval = retval;
+		}
+
+			//clipmove() looks this far for sprites, getzrange() only around
+			//where the move ends
+		const int gx = m.dx>>14, gy = m.dy>>14;
+		const int cx = (spr.x+spr.x+gx)>>1, cy = (spr.y+spr.y+gy)>>1;
+		const int rad = (int)std::hypot(gx,gy)+MAXCLIPDIST+walldist+8;
+		m.reach = {std::min(cx-rad,m.x-walldist-8),std::min(cy-rad,m.y-walldist-8),
+			std::max(cx+rad,m.x+walldist+8),std::max(cy+rad,m.y+walldist+8)};
+
+		actormoveof[m.spritenum] = k;
+	}
+	actormovestats.predicted += n;
+}
+
+	//movesprite() for the list statuslistcode() is going through
+static int moveactor(short spritenum, int dx, int dy, int dz, int ceildist, int flordist, int clipmask)
+{
+	const int k = actormoveof[spritenum];
+
+	if ((k >= 0) && !actorschangedall)
+	{
+		const auto& m = actormoves[k];
+		if ((m.dx == dx) && (m.dy == dy) && (m.dz == dz) && (m.ceildist == ceildist) &&
+			(m.flordist == flordist) && (m.clipmask == clipmask) &&
+			!std::memcmp(&m.was,&sprite[spritenum],sizeof(spritetype)) &&
+			std::ranges::none_of(actorschanged,[&m](const clipbox& b) { return clipboxesmeet(b,m.reach); }))
+		{
+			sprite[spritenum].x = m.x; sprite[spritenum].y = m.y;
+			if ((m.sectnum != sprite[spritenum].sectnum) && (m.sectnum >= 0))
+				changespritesect(spritenum,m.sectnum);
+			sprite[spritenum].z = m.z;
+			globhiz = m.hiz; globhihit = m.hihit;
+			globloz = m.loz; globlohit = m.lohit;
+			actormovestats.used++;
+			return(m.retval);
+		}
+	}
+	return(movesprite(spritenum,dx,dy,dz,ceildist,flordist,clipmask));
+}
+
+	//Marks a sprite the list's code has made or changed out of turn.
+	//Moves worked out ahead are only as good as this record, so any code
+	//added to statuslistcode() must keep to it: wrap each actor's own turn
+	//in an actorturn, call this for every other sprite it inserts, moves
+	//or changes, and set actorschangedall where it changes sectors or
+	//walls, or sprites it can't name one by one. Miss one and the moves
+	//taken may differ from those made with parallelactors off, which
+	//actorbench will show as a differing tick.
+static void actorchanged(short spritenum)
+{
+	if (!actormoves.empty() && (sprite[spritenum].statnum < MAXSTATUS))
+		actorschanged.push_back(spriteclipbox(sprite[spritenum]));
+}
+
+	//Marks where an actor was at the start of its turn and where it is at
+	//the end, if its code changed it in between
+struct actorturn
+{
+	short spritenum;
+	spritetype was;
+
+	explicit actorturn(short i) : spritenum{i}
+	{
+		if (!actormoves.empty()) std::memcpy(&was,&sprite[i],sizeof(spritetype));
+	}
+	~actorturn()
+	{
+		if (actormoves.empty() || !std::memcmp(&was,&sprite[spritenum],sizeof(spritetype))) return;
+		actorschanged.push_back(spriteclipbox(was));
+		actorchanged(spritenum);
+	}
+};
+
 void statuslistcode()
 {
 	short p;
@@ -2388,7 +3330,6 @@ void statuslistcode()
 	int i;
 	int nexti;
 	int j;
-	int nextj;
 	int k;
 	int l;
 	int dax;
@@ -2403,9 +3344,17 @@ void statuslistcode()
 	int yvect;
 
 		//Go through active BROWNMONSTER list
+	predictactormoves(1,[](short i, actormove& m) {
+		const int doubvel = std::max(mulscalen<7>(sprite[i].xrepeat, sprite[i].yrepeat), 4);
+		m.dx = (int)sintable[(sprite[i].ang+512)&2047]*doubvel;
+		m.dy = (int)sintable[sprite[i].ang]*doubvel;
+		m.ceildist = 4<<8; m.flordist = 4<<8; m.clipmask = CLIPMASK0;
+		return true;
+	});
 	for(i=headspritestat[1];i>=0;i=nexti)
 	{
 		nexti = nextspritestat[i];
+		actorturn turn((short)i);
 
 		k = krand();
 
@@ -2473,6 +3422,7 @@ void statuslistcode()
 
 				spawnsprite(j,sprite[i].x,sprite[i].y,sprite[i].z,128,0,0,
 					16,sprite[i].xrepeat,sprite[i].yrepeat,0,0,BULLET,daang,dax,day,daz,i,sprite[i].sectnum,6,0,0,0);
+				actorchanged((short)j);
 
 				sprite[i].extra &= (~2047);
 			}
@@ -2485,7 +3435,7 @@ void statuslistcode()
 		doubvel = std::max(mulscalen<7>(sprite[i].xrepeat, sprite[i].yrepeat), 4);
 
 		osectnum = sprite[i].sectnum;
-		movestat = movesprite((short)i,(int)sintable[(sprite[i].ang+512)&2047]*doubvel,(int)sintable[sprite[i].ang]*doubvel,0L,4L<<8,4L<<8,CLIPMASK0);
+		movestat = moveactor((short)i,(int)sintable[(sprite[i].ang+512)&2047]*doubvel,(int)sintable[sprite[i].ang]*doubvel,0L,4L<<8,4L<<8,CLIPMASK0);
 		if (globloz > sprite[i].z+(48<<8))
 			{ sprite[i].x = dax; sprite[i].y = day; movestat = 1; }
 		else
@@ -2515,9 +3465,19 @@ void statuslistcode()
 		}
 	}
 
+	predictactormoves(10,[](short i, actormove& m) {
+		if ((sprite[i].yrepeat < 64) || ((nummoves-i)&statrate[10])) return false;
+		int l = (((sprite[i].lotag&3)+2)<<8);
+		if (sprite[i].lotag&4) l = -l;
+		m.dx = sintable[(sprite[i].ang+512)&2047]*l;
+		m.dy = sintable[sprite[i].ang]*l;
+		m.ceildist = -(8<<8); m.flordist = -(8<<8); m.clipmask = CLIPMASK0;
+		return true;
+	});
 	for(i=headspritestat[10];i>=0;i=nexti)  //EVILAL list
 	{
 		nexti = nextspritestat[i];
+		actorturn turn((short)i);
 
 		if (sprite[i].yrepeat < 38) continue;
 		if (sprite[i].yrepeat < 64)
@@ -2551,6 +3511,7 @@ void statuslistcode()
 				spawnsprite(j,sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].cstat,sprite[i].shade,sprite[i].pal,
 					sprite[i].clipdist,38,38,sprite[i].xoffset,sprite[i].yoffset,sprite[i].picnum,krand()&2047,0,0,0,i,
 					sprite[i].sectnum,10,sprite[i].lotag,sprite[i].hitag,sprite[i].extra);
+				actorchanged((short)j);
 				switch(krand()&31)  //Mutations!
 				{
 					case 0: sprite[i].cstat ^= 2; break;
@@ -2582,6 +3543,7 @@ void statuslistcode()
 								(posy[target]-sprite[j].y) *
 								(posy[target]-sprite[j].y))+1),
 								i,sprite[i].sectnum,6,0,0,0);
+				actorchanged((short)j);
 			}
 		}
 
@@ -2592,7 +3554,7 @@ void statuslistcode()
 		day = sintable[sprite[i].ang]*l;
 
 		osectnum = sprite[i].sectnum;
-		movestat = movesprite((short)i,dax,day,0L,-(8L<<8),-(8L<<8),CLIPMASK0);
+		movestat = moveactor((short)i,dax,day,0L,-(8L<<8),-(8L<<8),CLIPMASK0);
 		sprite[i].z = globloz;
 		if ((sprite[i].sectnum != osectnum) && (g_sector[sprite[i].sectnum].lotag == 10))
 		{
@@ -2654,11 +3616,22 @@ void statuslistcode()
 	}
 
 		//Go through travelling bullet sprites
+	predictactormoves(6,[](short i, actormove& m) {
+		const short picnum = sprite[i].picnum;
+		if ((nummoves-i)&statrate[6]) return false;
+		if ((picnum != BULLET) && (picnum != GRABBER) && (picnum != MISSILE) && (picnum != BOMB)) return false;
+		m.dx = ((((int)sprite[i].xvel)*TICSPERFRAME)<<12);
+		m.dy = ((((int)sprite[i].yvel)*TICSPERFRAME)<<12);
+		m.dz = (picnum == BOMB) ? 0 : ((((int)sprite[i].zvel)*TICSPERFRAME)>>2);
+		m.ceildist = 4<<8; m.flordist = 4<<8; m.clipmask = CLIPMASK1;
+		return true;
+	});
 	for(i=headspritestat[6];i>=0;i=nexti)
 	{
 		nexti = nextspritestat[i];
 
 		if ((nummoves-i)&statrate[6]) continue;
+		actorturn turn((short)i);
 
 			 //If the sprite is a bullet then...
 		if ((sprite[i].picnum == BULLET) || (sprite[i].picnum == GRABBER) || (sprite[i].picnum == MISSILE) || (sprite[i].picnum == BOMB))
@@ -2669,7 +3642,7 @@ void statuslistcode()
 			if (sprite[i].picnum == BOMB) daz = 0;
 
 			osectnum = sprite[i].sectnum;
-			hitobject = movesprite((short)i,dax,day,daz,4L<<8,4L<<8,CLIPMASK1);
+			hitobject = moveactor((short)i,dax,day,daz,4L<<8,4L<<8,CLIPMASK1);
 			if ((sprite[i].sectnum != osectnum) && (g_sector[sprite[i].sectnum].lotag == 10))
 			{
 				warpsprite((short)i);
@@ -2677,43 +3650,37 @@ void statuslistcode()
 			}
 
 			if (sprite[i].picnum == GRABBER) {   // Andy did this (& Ken) !Homing!
+				actorschangedall = true;   //Picking things up changes them
 				checkgrabbertouchsprite(i,sprite[i].sectnum);
-				l = 0x7fffffff;
+
+					// look at every player and monster in one batch, then home in on the nearest one seen.
+					// A few dozen looks cost less than waking the worker pool, so those run right here.
+				static std::vector<canseequery> grabberlooks;
+				grabberlooks.clear();
 				for (j = connecthead; j >= 0; j = connectpoint2[j])   // Players
 					if (j != (sprite[i].owner & (MAXSPRITES - 1)))
-						if (cansee(sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].sectnum,posx[j],posy[j],posz[j],cursectnum[j])) {
-							k = std::sqrt(sqr(posx[j] - sprite[i].x) + sqr(posy[j] - sprite[i].y) + (sqr(posz[j] - sprite[i].z) >> 8));
-							if (k < l) {
-								l = k;
-								dax = (posx[j] - sprite[i].x);
-								day = (posy[j] - sprite[i].y);
-								daz = (posz[j] - sprite[i].z);
-							}
-						}
-				for(j = headspritestat[1]; j >= 0; j = nextj) {   // Active monsters
-					nextj = nextspritestat[j];
-					if (cansee(sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].sectnum,sprite[j].x,sprite[j].y,sprite[j].z,sprite[j].sectnum)) {
-						k = std::sqrt(sqr(sprite[j].x - sprite[i].x) + sqr(sprite[j].y - sprite[i].y) + (sqr(sprite[j].z - sprite[i].z) >> 8));
-						if (k < l) {
-							l = k;
-							dax = (sprite[j].x - sprite[i].x);
-							day = (sprite[j].y - sprite[i].y);
-							daz = (sprite[j].z - sprite[i].z);
-						}
-					}
-				}
-				for(j = headspritestat[2]; j >= 0; j = nextj) {   // Inactive monsters
-					nextj = nextspritestat[j];
-					if (cansee(sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].sectnum,sprite[j].x,sprite[j].y,sprite[j].z,sprite[j].sectnum)) {
-						k = std::sqrt(sqr(sprite[j].x - sprite[i].x) + sqr(sprite[j].y - sprite[i].y) + (sqr(sprite[j].z - sprite[i].z) >> 8));
+						grabberlooks.push_back({sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].sectnum,posx[j],posy[j],posz[j],cursectnum[j]});
+				for(j = headspritestat[1]; j >= 0; j = nextspritestat[j])   // Active monsters
+					grabberlooks.push_back({sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].sectnum,sprite[j].x,sprite[j].y,sprite[j].z,sprite[j].sectnum});
+				for(j = headspritestat[2]; j >= 0; j = nextspritestat[j])   // Inactive monsters
+					grabberlooks.push_back({sprite[i].x,sprite[i].y,sprite[i].z,sprite[i].sectnum,sprite[j].x,sprite[j].y,sprite[j].z,sprite[j].sectnum});
+				const int numlooks = (int)grabberlooks.size();
+				auto grabbersees = std::make_unique<bool[]>(grabberlooks.size());
+				canseebatch(grabberlooks, std::span(grabbersees.get(), grabberlooks.size()),
+					(parallelactors && numlooks >= 64) ? 0 : 1);
+
+				l = 0x7fffffff;
+				for(j = 0; j < numlooks; j++)
+					if (grabbersees[j]) {
+						const auto& look = grabberlooks[j];
+						k = std::sqrt(sqr(look.x2 - sprite[i].x) + sqr(look.y2 - sprite[i].y) + (sqr(look.z2 - sprite[i].z) >> 8));
 						if (k < l) {
 							l = k;
-							dax = (sprite[j].x - sprite[i].x);
-							day = (sprite[j].y - sprite[i].y);
-							daz = (sprite[j].z - sprite[i].z);
+							dax = (look.x2 - sprite[i].x);
+							day = (look.y2 - sprite[i].y);
+							daz = (look.z2 - sprite[i].z);
 						}
 					}
-				}
 				if (l != 0x7fffffff) {
 					sprite[i].xvel = (divscalen<7>(dax,l) + sprite[i].xvel);   // 1/5 of velocity is homing, 4/5 is momentum
 					sprite[i].yvel = (divscalen<7>(day,l) + sprite[i].yvel);   // 1/5 of velocity is homing, 4/5 is momentum
@@ -2756,6 +3723,7 @@ void statuslistcode()
 				dist = dax*dax+day*day;
 				if (dist < 512)
 				{
+					actorschangedall = true;
 					bombexplode(i);
 					goto bulletisdeletedskip;
 				}
@@ -2876,6 +3844,7 @@ void statuslistcode()
 
 			if (hitobject != 0)
 			{
+				actorschangedall = true;   //Hits change what was hit, and explosions all around
 				if ((sprite[i].picnum == MISSILE) || (sprite[i].picnum == BOMB))
 				{
 					if ((hitobject&0xc000) == 49152)
@@ -4402,6 +5371,30 @@ void drawscreen(short snum, int dasmoothratio)
 
 	if (option[4] == 0)           //Single player only keys
 	{
+		if (keystatus[0x40])   //F6 - quicksave
+		{
+			keystatus[0x40] = 0;
+			quicksnapshot.capture();
+			std::strcpy(getmessage,"Game saved in memory.");
+			getmessageleng = (int)std::strlen(getmessage);
+			getmessagetimeoff = totalclock+360+(getmessageleng<<4);
+		}
+		if (keystatus[0x43])   //F9 - quickload
+		{
+			keystatus[0x43] = 0;
+			if (!quicksnapshot.empty())
+			{
+				quicksnapshot.restore();
+				if (myconnectindex >= numplayers) myconnectindex = 0;
+				if (screenpeek >= numplayers) screenpeek = 0;
+				for(int i=connecthead;i>=0;i=connectpoint2[i])
+				{
+					oposx[i] = posx[i]; oposy[i] = posy[i]; oposz[i] = posz[i];
+					ohoriz[i] = horiz[i]; ozoom[i] = zoom[i]; oang[i] = ang[i];
+				}
+				drawstatusbar(screenpeek);
+			}
+		}
 		if (keystatus[0xd2])   //Insert - Insert player
 		{
 			keystatus[0xd2] = 0;
@@ -4623,6 +5616,8 @@ void domovethings()
 	short startwall;
 	short endwall;
 	walltype *wal;
+	int rectick = -1;
+	auto lap = tickprofiling ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
 
 	nummoves++;
 
@@ -4665,6 +5660,7 @@ void domovethings()
 			copybufbyte(&ssync[i],&recsync[reccnt][j],sizeof(input));
 			j++;
 		}
+		rectick = reccnt;
 		reccnt++; if (reccnt > 16383) reccnt = 16383;
 	}
 
@@ -4691,10 +5687,16 @@ void domovethings()
 		for(j=startwall,wal=&wall[j];j<endwall;j++,wal++)
 			if (wal->nextsector >= 0) checktouchsprite(i,wal->nextsector);
 	}
+	if (tickprofiling) lap = ticklap(TICKPLAYERS,lap);
 
 	doanimations();
+	if (tickprofiling) lap = ticklap(TICKANIMATIONS,lap);
 	tagcode();            //Door code, moving sector code, other stuff
+	if (tickprofiling) lap = ticklap(TICKTAGS,lap);
 	statuslistcode();     //Monster / bullet code / explosions
+	if (tickprofiling) lap = ticklap(TICKSTATUS,lap);
+
+	if (rectick >= 0) rechash[rectick] = gamestatehash();
 
 	fakedomovethingscorrect();
 
@@ -4710,6 +5712,8 @@ void getinput()
 	int mousy;
 	int bstatus;
 
+	if (headless) return;   //The server's own player stands still
+
 	if (typemode == 0)           //if normal game keys active
 	{
 		if (keystatus[keys[15]])
@@ -5541,6 +6545,8 @@ int loadgame()
 	kdfread(&g_sector[0],sizeof(sectortype),numsectors,fil);
 	kdfread(&numwalls,2,1,fil);
 	kdfread(&wall[0],sizeof(walltype),numwalls,fil);
+	updatesectorindex(-1);
+	updatetopology();
 		//Store all sprites (even holes) to preserve indeces
 	kdfread(&sprite[0],sizeof(spritetype),MAXSPRITES,fil);
 	kdfread(&headspritesect[0],2,MAXSECTORS+1,fil);
@@ -5549,6 +6555,7 @@ int loadgame()
 	kdfread(&headspritestat[0],2,MAXSTATUS+1,fil);
 	kdfread(&prevspritestat[0],2,MAXSPRITES,fil);
 	kdfread(&nextspritestat[0],2,MAXSPRITES,fil);
+	updatespriteclip(-1);
 
 	kdfread(&fvel,4,1,fil);
 	kdfread(&svel,4,1,fil);
@@ -5851,8 +6858,6 @@ void faketimerhandler()
 	short other;
 	int i;
 	int j;
-	int k;
-	int l;
 
 	sampletimer();
 	if ((totalclock < ototalclock+(TIMERINTSPERSECOND/MOVESPERSECOND)) || (ready2send == 0)) return;
@@ -5880,14 +6885,6 @@ void faketimerhandler()
 
 	if (networkmode == 1)
 	{
-		packbuf[2] = 0; j = 3;
-		if (loc.fvel != oloc.fvel) packbuf[j++] = loc.fvel, packbuf[2] |= 1;
-		if (loc.svel != oloc.svel) packbuf[j++] = loc.svel, packbuf[2] |= 2;
-		if (loc.avel != oloc.avel) packbuf[j++] = loc.avel, packbuf[2] |= 4;
-		if ((loc.bits^oloc.bits)&0x00ff) packbuf[j++] = (loc.bits&255), packbuf[2] |= 8;
-		if ((loc.bits^oloc.bits)&0xff00) packbuf[j++] = ((loc.bits>>8)&255), packbuf[2] |= 16;
-		copybufbyte(&loc,&oloc,sizeof(input));
-
 		copybufbyte(&loc,&baksync[movefifoend[myconnectindex]][myconnectindex],sizeof(input));
 		movefifoend[myconnectindex] = ((movefifoend[myconnectindex]+1)&(MOVEFIFOSIZ-1));
 
@@ -5895,9 +6892,11 @@ void faketimerhandler()
 			if (i != myconnectindex)
 			{
 				packbuf[0] = 17;
-				packbuf[1] = (unsigned char)((movefifoend[myconnectindex]-movefifoend[i])&(MOVEFIFOSIZ-1));
+				bitwriter w{std::span(packbuf).subspan(1)};
+				w.putsmall((movefifoend[myconnectindex]-movefifoend[i])&(MOVEFIFOSIZ-1));
+				packinput(w,loc,oloc);
+				j = 1+w.bytes();
 
-				k = j;
 				if ((myconnectindex == connecthead) || ((i == connecthead) && (myconnectindex == connectpoint2[connecthead])))
 				{
 					while (syncvalhead != syncvaltail)
@@ -5907,8 +6906,8 @@ void faketimerhandler()
 					}
 				}
 				sendpacket(i,packbuf,j);
-				j = k;
 			}
+		copybufbyte(&loc,&oloc,sizeof(input));
 
 		gotlastpacketclock = totalclock;
 		return;
@@ -5922,26 +6921,13 @@ void faketimerhandler()
 		if (option[4] != 0)
 		{
 			packbuf[0] = 0;
-			j = ((numplayers+1)>>1)+1;
-			for(k=1;k<j;k++) packbuf[k] = 0;
-			k = (1<<3);
+			bitwriter w{std::span(packbuf).subspan(1)};
 			for(i=connecthead;i>=0;i=connectpoint2[i])
 			{
-				l = 0;
-				if (ffsync[i].fvel != osync[i].fvel) packbuf[j++] = ffsync[i].fvel, l |= 1;
-				if (ffsync[i].svel != osync[i].svel) packbuf[j++] = ffsync[i].svel, l |= 2;
-				if (ffsync[i].avel != osync[i].avel) packbuf[j++] = ffsync[i].avel, l |= 4;
-				if (ffsync[i].bits != osync[i].bits)
-				{
-					packbuf[j++] = (ffsync[i].bits&255);
-					packbuf[j++] = ((ffsync[i].bits>>8)&255);
-					l |= 8;
-				}
-				packbuf[k>>3] |= (l<<(k&7));
-				k += 4;
-
+				packinput(w,ffsync[i],osync[i]);
 				copybufbyte(&ffsync[i],&osync[i],sizeof(input));
 			}
+			j = 1+w.bytes();
 
 			while (syncvalhead != syncvaltail)
 			{
@@ -5949,8 +6935,7 @@ void faketimerhandler()
 				syncvaltail = ((syncvaltail+1)&(MOVEFIFOSIZ-1));
 			}
 
-			for(i=connectpoint2[connecthead];i>=0;i=connectpoint2[i])
-				sendpacket(i,packbuf,j);
+			sendpacket(-1,packbuf,j);   //One message shared by every slave
 		}
 		else if (numplayers >= 2)
 		{
@@ -5982,14 +6967,17 @@ void faketimerhandler()
 	}
 	else                        //I am a SLAVE
 	{
-		packbuf[0] = 1; packbuf[1] = 0; j = 2;
-		if (loc.fvel != oloc.fvel) packbuf[j++] = loc.fvel, packbuf[1] |= 1;
-		if (loc.svel != oloc.svel) packbuf[j++] = loc.svel, packbuf[1] |= 2;
-		if (loc.avel != oloc.avel) packbuf[j++] = loc.avel, packbuf[1] |= 4;
-		if ((loc.bits^oloc.bits)&0x00ff) packbuf[j++] = (loc.bits&255), packbuf[1] |= 8;
-		if ((loc.bits^oloc.bits)&0xff00) packbuf[j++] = ((loc.bits>>8)&255), packbuf[1] |= 16;
-		copybufbyte(&loc,&oloc,sizeof(input));
-		sendpacket(connecthead,packbuf,j);
+			//The master keeps using the last input it got, so a run of
+			//repeated inputs costs nothing to send
+		if (!sameinput(loc,oloc))
+		{
+			packbuf[0] = 1;
+			bitwriter w{std::span(packbuf).subspan(1)};
+			packinput(w,loc,oloc);
+			copybufbyte(&loc,&oloc,sizeof(input));
+			sendpacket(connecthead,packbuf,1+w.bytes());
+		}
+		slaveinputs++;
 	}
 }
 
@@ -5997,8 +6985,6 @@ void getpackets()
 {
 	int i;
 	int j;
-	int k;
-	int l;
 	int other;
 	int packbufleng;
 	int movecnt;
@@ -6011,19 +6997,11 @@ void getpackets()
 		switch(packbuf[0])
 		{
 			case 0:  //[0] (receive master sync buffer)
-				j = ((numplayers+1)>>1)+1; k = (1<<3);
-				for(i=connecthead;i>=0;i=connectpoint2[i])
 				{
-					l = (packbuf[k>>3]>>(k&7));
-					if (l&1) ffsync[i].fvel = packbuf[j++];
-					if (l&2) ffsync[i].svel = packbuf[j++];
-					if (l&4) ffsync[i].avel = packbuf[j++];
-					if (l&8)
-					{
-						ffsync[i].bits = ((short)packbuf[j])+(((short)packbuf[j+1])<<8);
-						j += 2;
-					}
-					k += 4;
+					bitreader r{std::span(packbuf).subspan(1,packbufleng-1)};
+					for(i=connecthead;i>=0;i=connectpoint2[i])
+						unpackinput(r,ffsync[i]);
+					j = 1+r.bytes();
 				}
 
 				while (j != packbufleng)
@@ -6037,20 +7015,20 @@ void getpackets()
 					do
 					{
 						syncstat |= (syncval[syncvaltottail]^othersyncval[syncvaltottail]);
+						if (syncval[syncvaltottail] != othersyncval[syncvaltottail]) netgamestats.syncerrors++;
 						syncvaltottail = ((syncvaltottail+1)&(MOVEFIFOSIZ-1));
 					} while ((syncvalhead != syncvaltottail) && (othersyncvalhead != syncvaltottail));
 				}
 
 				movethings();        //Move all players and sprites
 				movecnt++;
+				mastermoves++;
 				break;
 			case 1:  //[1] (receive slave sync buffer)
-				j = 2; k = packbuf[1];
-				if (k&1) ffsync[other].fvel = packbuf[j++];
-				if (k&2) ffsync[other].svel = packbuf[j++];
-				if (k&4) ffsync[other].avel = packbuf[j++];
-				if (k&8) ffsync[other].bits = ((ffsync[other].bits&0xff00)|((short)packbuf[j++]));
-				if (k&16) ffsync[other].bits = ((ffsync[other].bits&0x00ff)|(((short)packbuf[j++])<<8));
+				{
+					bitreader r{std::span(packbuf).subspan(1,packbufleng-1)};
+					unpackinput(r,ffsync[other]);
+				}
 				break;
 			case 2:
 				getmessageleng = packbufleng-1;
@@ -6072,13 +7050,12 @@ void getpackets()
 				playerreadyflag[other]++;
 				break;
 			case 17:
-				j = 3; k = packbuf[2];
-				if (k&1) ffsync[other].fvel = packbuf[j++];
-				if (k&2) ffsync[other].svel = packbuf[j++];
-				if (k&4) ffsync[other].avel = packbuf[j++];
-				if (k&8) ffsync[other].bits = ((ffsync[other].bits&0xff00)|((short)packbuf[j++]));
-				if (k&16) ffsync[other].bits = ((ffsync[other].bits&0x00ff)|(((short)packbuf[j++])<<8));
-				otherlag[other] = packbuf[1];
+				{
+					bitreader r{std::span(packbuf).subspan(1,packbufleng-1)};
+					otherlag[other] = (signed char)r.getsmall();
+					unpackinput(r,ffsync[other]);
+					j = 1+r.bytes();
+				}
 
 				copybufbyte(&ffsync[other],&baksync[movefifoend[other]][other],sizeof(input));
 				movefifoend[other] = ((movefifoend[other]+1)&(MOVEFIFOSIZ-1));
@@ -6094,6 +7071,7 @@ void getpackets()
 					do
 					{
 						syncstat |= (syncval[syncvaltottail]^othersyncval[syncvaltottail]);
+						if (syncval[syncvaltottail] != othersyncval[syncvaltottail]) netgamestats.syncerrors++;
 						syncvaltottail = ((syncvaltottail+1)&(MOVEFIFOSIZ-1));
 					} while ((syncvalhead != syncvaltottail) && (othersyncvalhead != syncvaltottail));
 				}
@@ -6109,6 +7087,13 @@ void getpackets()
 		if (rand()&1) ototalclock += (TICSPERFRAME>>1);
 		else ototalclock -= (TICSPERFRAME>>1);
 	}
+
+		//Keep what netstats reports of the sync loop up to date
+	for(i=connecthead;i>=0;i=connectpoint2[i])
+		netgamestats.fifodepth[i] = ((movefifoend[i]-movefifoplc)&(MOVEFIFOSIZ-1));
+	netgamestats.inputlag = netgamestats.fifodepth[myconnectindex];
+	if ((networkmode == 0) && (myconnectindex != connecthead))
+		netgamestats.inputlag += slaveinputs-mastermoves;
 }
 
 void drawoverheadmap(int cposx, int cposy, int czoom, short cang)
@@ -6452,40 +7437,44 @@ void waitforeverybody ()
 		handleevents();
 		refreshaudio();
 
-		drawrooms(posx[myconnectindex],posy[myconnectindex],posz[myconnectindex],ang[myconnectindex],horiz[myconnectindex],cursectnum[myconnectindex]);
-		if (!networkmode) std::sprintf(tempbuf,"Master/slave mode");
-						 else std::sprintf(tempbuf,"Peer-peer mode");
-		printext256((xdim>>1)-(int)(std::strlen(tempbuf)<<2),(ydim>>1)-24,31,0,tempbuf,0);
-		std::sprintf(tempbuf,"Waiting for players");
-		printext256((xdim>>1)-(int)(std::strlen(tempbuf)<<2),(ydim>>1)-16,31,0,tempbuf,0);
-		for(i=connecthead;i>=0;i=connectpoint2[i])
+		if (headless) std::this_thread::sleep_for(std::chrono::milliseconds{1});
+		else
 		{
-			if (playerreadyflag[i] < playerreadyflag[myconnectindex])
+			drawrooms(posx[myconnectindex],posy[myconnectindex],posz[myconnectindex],ang[myconnectindex],horiz[myconnectindex],cursectnum[myconnectindex]);
+			if (!networkmode) std::sprintf(tempbuf,"Master/slave mode");
+							 else std::sprintf(tempbuf,"Peer-peer mode");
+			printext256((xdim>>1)-(int)(std::strlen(tempbuf)<<2),(ydim>>1)-24,31,0,tempbuf,0);
+			std::sprintf(tempbuf,"Waiting for players");
+			printext256((xdim>>1)-(int)(std::strlen(tempbuf)<<2),(ydim>>1)-16,31,0,tempbuf,0);
+			for(i=connecthead;i>=0;i=connectpoint2[i])
 			{
-					//slaves in M/S mode only wait for master
-				if ((!networkmode) && (myconnectindex != connecthead) && (i != connecthead))
+				if (playerreadyflag[i] < playerreadyflag[myconnectindex])
 				{
-					std::sprintf(tempbuf,"Player %d",i);
-					printext256((xdim>>1)-(16<<2),(ydim>>1)+i*8,15,0,tempbuf,0);
+						//slaves in M/S mode only wait for master
+					if ((!networkmode) && (myconnectindex != connecthead) && (i != connecthead))
+					{
+						std::sprintf(tempbuf,"Player %d",i);
+						printext256((xdim>>1)-(16<<2),(ydim>>1)+i*8,15,0,tempbuf,0);
+					}
+					else
+					{
+						std::sprintf(tempbuf,"Player %d NOT ready",i);
+						printext256((xdim>>1)-(16<<2),(ydim>>1)+i*8,127,0,tempbuf,0);
+					}
 				}
 				else
 				{
-					std::sprintf(tempbuf,"Player %d NOT ready",i);
-					printext256((xdim>>1)-(16<<2),(ydim>>1)+i*8,127,0,tempbuf,0);
+					std::sprintf(tempbuf,"Player %d ready",i);
+					printext256((xdim>>1)-(16<<2),(ydim>>1)+i*8,31,0,tempbuf,0);
+				}
+				if (i == myconnectindex)
+				{
+					std::sprintf(tempbuf,"You->");
+					printext256((xdim>>1)-(26<<2),(ydim>>1)+i*8,95,0,tempbuf,0);
 				}
 			}
-			else
-			{
-				std::sprintf(tempbuf,"Player %d ready",i);
-				printext256((xdim>>1)-(16<<2),(ydim>>1)+i*8,31,0,tempbuf,0);
-			}
-			if (i == myconnectindex)
-			{
-				std::sprintf(tempbuf,"You->");
-				printext256((xdim>>1)-(26<<2),(ydim>>1)+i*8,95,0,tempbuf,0);
-			}
+			nextpage();
 		}
-		nextpage();
 
 
 		if (quitevent || keystatus[1]) {
@@ -9,7 +9,15 @@
 #include "osd.hpp"
 #include "baselayer.hpp"
 #include "baselayer_priv.hpp"
+#include "engine_priv.hpp"
+#include "mmulti_priv.hpp"
+#include "pragmas.hpp"
+#include "pvs_priv.hpp"
 #include "string_utils.hpp"
+#include "sectindex_priv.hpp"
+#include "snapshot.hpp"
+#include "clipgrid_priv.hpp"
+#include "crc32.hpp"
 
 #ifdef RENDERTYPEWIN
 #include "winlayer.hpp"
@@ -23,8 +31,11 @@ struct glbuild_info glinfo;
 #include <algorithm>
 #include <charconv>
 #include <limits>
+#include <memory>
+#include <random>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 void (*baselayer_videomodewillchange)() = nullptr;
 void (*baselayer_videomodedidchange)() = nullptr;
@@ -242,19 +253,416 @@ int osdcmd_vars(const osdfuncparm_t *parm)
 		}
 		return OSDCMD_OK;
 	}
+	else if (IsSameAsNoCase(parm->name, "clipbroadphase")) {
+		if (showval) { buildprintf("clipbroadphase is {}\n", clipbroadphase); }
+		else {
+			const std::string_view parmv{parm->parms[0]};
+			int tmpval{0};
+			std::from_chars(parmv.data(), parmv.data() + parmv.size(), tmpval);
+			clipbroadphase = tmpval != 0;
+		}
+		return OSDCMD_OK;
+	}
+	else if (IsSameAsNoCase(parm->name, "usepvs")) {
+		if (showval) { buildprintf("usepvs is {}\n", usepvs); }
+		else {
+			const std::string_view parmv{parm->parms[0]};
+			int tmpval{0};
+			std::from_chars(parmv.data(), parmv.data() + parmv.size(), tmpval);
+			usepvs = tmpval != 0;
+		}
+		return OSDCMD_OK;
+	}
 	return OSDCMD_SHOWHELP;
 }
 
+int osdcmd_masksortbench(const osdfuncparm_t *parm)
+{
+	int sprites{2000};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), sprites);
+	}
+	if (sprites < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	masksortbench(sprites);
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_pragmasbench(const osdfuncparm_t *parm)
+{
+	int count{65536};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), count);
+	}
+	if (count < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	pragmasbench(count);
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_pvsbuild(const osdfuncparm_t *parm)
+{
+	if (numsectors <= 0) {
+		buildprintf("pvsbuild: no map loaded\n");
+		return OSDCMD_OK;
+	}
+
+	buildpvs();
+
+	if (parm->parms.size() > 0) {
+		if (savepvs(parm->parms[0]) < 0) {
+			buildprintf("pvsbuild: could not write {}\n", parm->parms[0]);
+		} else {
+			buildprintf("pvsbuild: wrote {}\n", parm->parms[0]);
+		}
+	}
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_netloopbench(const osdfuncparm_t *parm)
+{
+	int players{0};
+	mmultiloopconfig config;
+	std::array<int *, 6> parms{ &players, &config.latency, &config.jitter, &config.loss, &config.duplicate, &config.reorder };
+
+	for (std::size_t i{0}; i < parm->parms.size() && i < parms.size(); i++) {
+		const std::string_view parmv{parm->parms[i]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), *parms[i]);
+	}
+	if ((players != 0 && (players < 2 || players > MAXPLAYERS)) ||
+		config.latency < 0 || config.jitter < 0 || config.loss < 0 || config.loss > 100 ||
+		config.duplicate < 0 || config.reorder < 0) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	netloopbench(players, config);
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_netstats(const osdfuncparm_t *parm)
+{
+	std::ignore = parm;
+
+	netstatsprint();
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_netstatslog(const osdfuncparm_t *parm)
+{
+	int interval{1000};
+
+	if (parm->parms.size() > 1) {
+		const std::string_view parmv{parm->parms[1]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), interval);
+	}
+	if (interval < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	if (parm->parms.empty()) {
+		netstatslog({}, interval);
+		buildprintf("netstatslog: stopped\n");
+	} else if (netstatslog(parm->parms[0], interval) < 0) {
+		buildprintf("netstatslog: could not open {}\n", parm->parms[0]);
+	} else {
+		buildprintf("netstatslog: appending to {} every {} ms\n", parm->parms[0], interval);
+	}
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_pvsbench(const osdfuncparm_t *parm)
+{
+	int views{1000};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), views);
+	}
+	if (views < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	pvsbench(views);
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_sectindexbench(const osdfuncparm_t *parm)
+{
+	int lookups{100000};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), lookups);
+	}
+	if (lookups < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	sectindexbench(lookups);
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_snapshotbench(const osdfuncparm_t *parm)
+{
+	int sprites{64};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), sprites);
+	}
+	if (sprites < 0) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	snapshotbench(sprites);
+
+	return OSDCMD_OK;
+}
+
+	// casts rays between and out of random sprites one at a time, then as batches,
+	// and checks the batches agree bit for bit
+void raybatchbench(int rays)
+{
+	std::vector<short> sprites;
+
+	for (int i{0}; i < MAXSPRITES; ++i) {
+		if (sprite[i].statnum < MAXSTATUS && sprite[i].sectnum >= 0 && sprite[i].sectnum < numsectors) {
+			sprites.push_back((short)i);
+		}
+	}
+	if (sprites.size() < 2) {
+		buildprintf("raybatchbench: the map needs at least two sprites\n");
+		return;
+	}
+
+	std::mt19937 rng(numsectors);
+	std::uniform_int_distribution<std::size_t> pick(0, sprites.size() - 1);
+	std::uniform_int_distribution<int> ang(0, 2047);
+	std::vector<canseequery> looks(rays);
+	std::vector<hitscanquery> shots(rays);
+
+	for (int n{0}; n < rays; ++n) {
+		const auto& a = sprite[sprites[pick(rng)]];
+		const auto& b = sprite[sprites[pick(rng)]];
+		const int da = ang(rng);
+
+		looks[n] = { a.x, a.y, a.z, a.sectnum, b.x, b.y, b.z, b.sectnum };
+		shots[n] = { a.x, a.y, a.z, a.sectnum, sintable[(da + 512) & 2047], sintable[da],
+			(ang(rng) - 1024) << 6, CLIPMASK1 };
+	}
+
+	auto single = std::make_unique<bool[]>(rays);
+	auto batched = std::make_unique<bool[]>(rays);
+	std::vector<hitscanresult> singlehits(rays);
+	std::vector<hitscanresult> batchedhits(rays);
+
+	unsigned int t = getusecticks();
+	for (int n{0}; n < rays; ++n) {
+		const auto& q = looks[n];
+		single[n] = cansee(q.x1, q.y1, q.z1, q.sect1, q.x2, q.y2, q.z2, q.sect2);
+	}
+	const unsigned int canseet = getusecticks() - t;
+
+	t = getusecticks();
+	for (int n{0}; n < rays; ++n) {
+		const auto& q = shots[n];
+		auto& r = singlehits[n];
+		hitscan(q.xs, q.ys, q.zs, q.sectnum, q.vx, q.vy, q.vz,
+			&r.hitsect, &r.hitwall, &r.hitsprite, &r.hitx, &r.hity, &r.hitz, q.cliptype);
+	}
+	const unsigned int hitscant = getusecticks() - t;
+
+	t = getusecticks();
+	canseebatch(looks, std::span(batched.get(), rays));
+	const unsigned int canseebatcht = getusecticks() - t;
+
+	t = getusecticks();
+	hitscanbatch(shots, batchedhits);
+	const unsigned int hitscanbatcht = getusecticks() - t;
+
+	int mismatches{0};
+	for (int n{0}; n < rays; ++n) {
+		const auto& a = singlehits[n];
+		const auto& b = batchedhits[n];
+		mismatches += (single[n] != batched[n]);
+		mismatches += (a.hitsect != b.hitsect || a.hitwall != b.hitwall || a.hitsprite != b.hitsprite ||
+			a.hitx != b.hitx || a.hity != b.hity || a.hitz != b.hitz);
+	}
+
+	buildprintf("{} rays from {} sprites, {} mismatches\n", rays, sprites.size(), mismatches);
+	buildprintf("  cansee: {:.2f} ms single, {:.2f} ms batched\n",
+			   (double)canseet / 1000.0, (double)canseebatcht / 1000.0);
+	buildprintf("  hitscan: {:.2f} ms single, {:.2f} ms batched\n",
+			   (double)hitscant / 1000.0, (double)hitscanbatcht / 1000.0);
+}
+
+int osdcmd_raybatchbench(const osdfuncparm_t *parm)
+{
+	int rays{10000};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), rays);
+	}
+	if (rays < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	raybatchbench(rays);
+
+	return OSDCMD_OK;
+}
+
+int osdcmd_clipgridbench(const osdfuncparm_t *parm)
+{
+	int actors{256};
+	int tics{120};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), actors);
+	}
+	if (parm->parms.size() > 1) {
+		const std::string_view parmv{parm->parms[1]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), tics);
+	}
+	if (actors < 1 || tics < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	clipgridbench(actors, tics);
+
+	return OSDCMD_OK;
+}
+
+	// checks every way of working out the CRCs against the bytewise one over
+	// odd lengths, alignments and split blocks, then times them
+void crcbench(int kilobytes)
+{
+	const auto methods = crcmethods();
+	const auto& ref = methods[0];
+	const std::size_t size{(std::size_t)kilobytes * 1024};
+	std::vector<unsigned char> buf(size + 16);
+	std::mt19937 rng(kilobytes);
+	std::uniform_int_distribution<int> byte(0, 255);
+
+	for (auto& b : buf) b = (unsigned char)byte(rng);
+
+	buildprintf("crcbench: {} kB buffer, {} byte packets, checked against {}\n", kilobytes, 128, ref.name);
+
+	for (const auto& m : methods) {
+		int mismatches{0};
+
+		for (int n{0}; n < 4096; ++n) {
+			const std::size_t offset{rng() & 15};
+			const std::size_t len{n < 4000 ? rng() % 300 : rng() % (size + 1)};
+			const std::size_t split{len ? rng() % len : 0};
+			const unsigned char *p = &buf[offset];
+			const unsigned int crc32{(unsigned int)rng()};
+			const unsigned short crc16{(unsigned short)rng()};
+
+			if (m.crc32) {
+				const unsigned int want{ref.crc32(crc32, p, len)};
+				mismatches += m.crc32(crc32, p, len) != want;
+				mismatches += m.crc32(m.crc32(crc32, p, split), p + split, len - split) != want;
+			}
+			if (m.crc16back) {
+				const unsigned short want{ref.crc16back(crc16, p, len)};
+				mismatches += m.crc16back(crc16, p, len) != want;
+				mismatches += m.crc16back(m.crc16back(crc16, p + split, len - split), p, split) != want;
+			}
+		}
+
+			// a whole buffer, and mmulti sized packets
+		constexpr int packet{128};
+		const int passes{std::max(1, 256 * 1024 / kilobytes)};
+		const int packets{(int)(size / packet)};
+		float crc32gbs{0.F};
+		float crc16gbs{0.F};
+		float crc16ns{0.F};
+		unsigned int sink{0};
+
+		if (m.crc32) {
+			const unsigned int t = getusecticks();
+			for (int p{0}; p < passes; ++p) sink += m.crc32(sink, buf.data(), size);
+			crc32gbs = (float)size * (float)passes / (float)std::max(1u, getusecticks() - t) / 1000.F;
+		}
+		if (m.crc16back) {
+			unsigned int t = getusecticks();
+			for (int p{0}; p < passes; ++p) sink += m.crc16back((unsigned short)sink, buf.data(), size);
+			crc16gbs = (float)size * (float)passes / (float)std::max(1u, getusecticks() - t) / 1000.F;
+
+			t = getusecticks();
+			for (int p{0}; p < passes; ++p) {
+				for (int i{0}; i < packets; ++i) sink += m.crc16back(0, &buf[i * packet], packet);
+			}
+			crc16ns = (float)(getusecticks() - t) * 1000.F / (float)std::max(1, passes * packets);
+		}
+
+		buildprintf("  {:12} crc32 {:6.2f} GB/s  crc16 {:6.2f} GB/s {:7.1f} ns/packet  {} mismatches\n", m.name,
+			crc32gbs, crc16gbs, crc16ns, mismatches);
+	}
+}
+
+int osdcmd_crcbench(const osdfuncparm_t *parm)
+{
+	int kilobytes{1024};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), kilobytes);
+	}
+	if (kilobytes < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	crcbench(kilobytes);
+
+	return OSDCMD_OK;
+}
+
 } // namespace
 
 int baselayer_init()
 {
     OSD_Init();
 
+	initfixarrays();
+
 	OSD_RegisterFunction("screencaptureformat","screencaptureformat: sets the output format for screenshots (TGA, PCX, PNG)",osdcmd_vars);
 
 	OSD_RegisterFunction("novoxmips","novoxmips: turn off/on the use of mipmaps when rendering 8-bit voxels",osdcmd_vars);
 	OSD_RegisterFunction("usevoxels","usevoxels: enable/disable automatic sprite->voxel rendering",osdcmd_vars);
+	OSD_RegisterFunction("clipbroadphase","clipbroadphase: enable/disable the grid clipmove and getzrange find nearby sprites with",osdcmd_vars);
+	OSD_RegisterFunction("usepvs","usepvs: enable/disable culling with the visible sets from pvsbuild or a .pvs file",osdcmd_vars);
+	OSD_RegisterFunction("clipgridbench","clipgridbench [actors] [tics]: move actors around the map with and without the clipping grid and compare",osdcmd_clipgridbench);
+	OSD_RegisterFunction("crcbench","crcbench [kilobytes]: check the table and hardware CRC32 and CRC16 against the bytewise ones and time them",osdcmd_crcbench);
+	OSD_RegisterFunction("masksortbench","masksortbench [sprites]: sort and interleave made up sprites in front of the last view with the old and new drawmasks loops",osdcmd_masksortbench);
+	OSD_RegisterFunction("netloopbench","netloopbench [players] [latency] [jitter] [loss%] [dup%] [reorder%]: play simulated network games in-process and report bandwidth, resends and input lag",osdcmd_netloopbench);
+	OSD_RegisterFunction("netstats","netstats: show round trip, traffic, resends and sync figures for each player in the game",osdcmd_netstats);
+	OSD_RegisterFunction("netstatslog","netstatslog [filename] [interval ms]: append the netstats figures to a CSV file every interval, or stop",osdcmd_netstatslog);
+	OSD_RegisterFunction("pragmasbench","pragmasbench [count]: check each way of doing the array fixed point functions against the scalar ones and time them",osdcmd_pragmasbench);
+	OSD_RegisterFunction("pvsbench","pvsbench [views]: render random views and test random cansee pairs with and without the visible sets",osdcmd_pvsbench);
+	OSD_RegisterFunction("pvsbuild","pvsbuild [filename]: work out the visible sets for the current map, optionally saving them",osdcmd_pvsbuild);
+	OSD_RegisterFunction("raybatchbench","raybatchbench [rays]: time cansee and hitscan one ray at a time against the batched versions",osdcmd_raybatchbench);
+	OSD_RegisterFunction("sectindexbench","sectindexbench [lookups]: time random point lookups through the sector index against a linear scan",osdcmd_sectindexbench);
+	OSD_RegisterFunction("snapshotbench","snapshotbench [sprites]: time taking and restoring snapshots of the map while moving sprites in between",osdcmd_snapshotbench);
 
 #if USE_POLYMOST
 	OSD_RegisterFunction("setrendermode","setrendermode <number>: sets the engine's rendering mode.\n"
@@ -7,6 +7,7 @@
 
 #include "build.hpp"
 #include "engine_priv.hpp"
+#include "topology_priv.hpp"
 #include "pragmas.hpp"
 #include "osd.hpp"
 #include "cache1d.hpp"
@@ -2938,6 +2939,10 @@ void overheadeditor()
 	keystatus[buildkeys[14]] = 0;
 	while ((keystatus[buildkeys[14]]>>1) == 0)
 	{
+		// most edits below move walls directly, so have the engine reindex when next needed
+		updatesectorindex(-1);
+		updatetopology();
+
 		if (handleevents()) {
 			if (quitevent) {
 				keystatus[1] = 1;
@@ -6137,6 +6142,8 @@ void movewalls(int start, int offs)
 		if (wall[i].point2 >= start)
 			wall[i].point2 += offs;
 	}
+
+	updatetopology();
 }
 
 void checksectorpointer(short i, short sectnum)
@@ -6175,6 +6182,8 @@ void checksectorpointer(short i, short sectnum)
 					}
 		}
 	}
+
+	updatetopology();
 }
 
 void fixrepeats(short i)
@@ -6230,6 +6239,11 @@ short loopinside(int x, int y, short startwall)
 
 int numloopsofsector(short sectnum)
 {
+	const auto& topo = maptopology();
+
+	if (topo.current(sectnum))
+		return topo.numloops(sectnum);
+
 	int numloops{0};
 	const int startwall = g_sector[sectnum].wallptr;
 	const int endwall = startwall + g_sector[sectnum].wallnum;
@@ -0,0 +1,511 @@
+#include "build.hpp"
+#include "baselayer.hpp"
+#include "clipgrid_priv.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+/*
+ Clipping broadphase
+
+ clipmove() and getzrange() walk the sprite list of every sector their
+ search reaches and test each sprite against the movement box. With
+ clipbroadphase on they instead take the sprites from a uniform grid over
+ the map, filed under every cell their clipping extent covers, so a sector
+ packed with actors only costs the ones nearby. The per-sprite tests are
+ unchanged; the grid only skips sprites those tests would reject, or whose
+ clip lines clipmove() could never reach.
+
+ Sprite order matters to both functions when two candidates tie, so each
+ sprite carries a key of its sector and a stamp given out whenever it joins
+ the head of a sector list, which reproduces the list order. Cells keep
+ their entries in key order and a gather merges them. The grid keeps itself
+ up to date through insertsprite(), deletesprite(), changespritesect(),
+ setsprite() and setspritez(); code that writes a sprite's position or
+ shape directly must call updatespriteclip() afterwards. It is built on
+ first use, and again after updatespriteclip(-1) or whenever it has gone
+ unused while clipbroadphase was off.
+
+ Results only part from the sector lists' when a move's clip lines outgrow
+ clipit[]: the lists then drop whatever comes last, near or not, while the
+ grid never collected the far lines to begin with.
+ */
+
+namespace {
+
+constexpr int MINCELLSHIFT{9};
+constexpr int MAXGRIDCELLS{256};	// cells along each side, at most
+
+static_assert(MAXSPRITES <= (1 << 14) && MAXSECTORS <= (1 << 18), "sort keys are too narrow");
+
+	// sector, then list order, then the sprite itself, packed to sort as one number
+uint64_t sortkey(short sectnum, unsigned int stamp, short spritenum)
+{
+	return ((uint64_t)sectnum << 46) | ((uint64_t)(UINT_MAX - stamp) << 14) | (uint64_t)spritenum;
+}
+
+short keysprite(uint64_t key)
+{
+	return (short)(key & (MAXSPRITES - 1));
+}
+
+struct Reach {
+	int x1, y1;
+	int x2, y2;			// inclusive
+};
+
+struct CellEntry {
+	uint64_t key;
+	Reach reach;
+};
+
+struct Filing {
+	uint64_t key;
+	Reach reach;
+	short cx1, cy1;
+	short cx2, cy2;		// cells it is filed in, inclusive, cx1 > cx2 when not filed
+};
+
+struct {
+	int numsectors{0};		// numsectors and numwalls when built
+	int numwalls{0};
+	int x0{0}, y0{0};		// map position of the first cell
+	int shift{MINCELLSHIFT};
+	int xcells{0}, ycells{0};
+	std::vector<std::vector<CellEntry>> cells;		// each kept in key order
+	std::array<Filing, MAXSPRITES> filed{};
+	unsigned int nextstamp{0};		// higher is nearer the head of a sector list
+} grid;
+
+constexpr Filing UNFILED{ 0, { 0, 0, 0, 0 }, 1, 1, 0, 0 };
+
+std::atomic<bool> gridready{false};
+std::mutex gridbuild;
+thread_local std::vector<uint64_t> sortkeys;
+thread_local std::vector<short> gathered;
+
+int cellx(int x)
+{
+	return (int)std::clamp<int64_t>(((int64_t)x - grid.x0) >> grid.shift, 0, grid.xcells - 1);
+}
+
+int celly(int y)
+{
+	return (int)std::clamp<int64_t>(((int64_t)y - grid.y0) >> grid.shift, 0, grid.ycells - 1);
+}
+
+/**
+ * Works out how far from its position a sprite can reach in clipmove() and
+ * getzrange(), going by the shape tests both make
+ */
+Reach spritereach(const spritetype& spr)
+{
+	const int tilenum = std::clamp<int>(spr.picnum, 0, MAXTILES - 1);
+	const int64_t xspan = tilesizx[tilenum];
+	const int64_t yspan = tilesizy[tilenum];
+	const int64_t xoff = std::abs((int)((signed char)((picanm[tilenum] >> 8) & 255)) + (int)spr.xoffset);
+	const int64_t yoff = std::abs((int)((signed char)((picanm[tilenum] >> 16) & 255)) + (int)spr.yoffset);
+	int64_t r{0};
+
+	switch (spr.cstat & 48) {
+		case 16:
+			r = ((spr.xrepeat * ((xspan >> 1) + xoff + xspan)) >> 2) + 2;
+			break;
+		case 32:
+			r = ((((xspan >> 1) + xoff) * spr.xrepeat + ((yspan >> 1) + yoff) * spr.yrepeat +
+				xspan * spr.xrepeat + yspan * spr.yrepeat) >> 2) + 4;
+			break;
+		default:
+			r = spr.clipdist << 2;
+			break;
+	}
+
+	return {
+		(int)std::max<int64_t>(INT_MIN, spr.x - r), (int)std::max<int64_t>(INT_MIN, spr.y - r),
+		(int)std::min<int64_t>(INT_MAX, spr.x + r), (int)std::min<int64_t>(INT_MAX, spr.y + r)
+	};
+}
+
+template<typename F>
+void forfiledcells(const Filing& f, F&& func)
+{
+	for (int cy = f.cy1; cy <= f.cy2; ++cy) {
+		for (int cx = f.cx1; cx <= f.cx2; ++cx) {
+			func(grid.cells[cy * grid.xcells + cx]);
+		}
+	}
+}
+
+auto findentry(std::vector<CellEntry>& cell, uint64_t key)
+{
+	return std::ranges::lower_bound(cell, key, {}, &CellEntry::key);
+}
+
+void unfile(short spritenum)
+{
+	auto& f = grid.filed[spritenum];
+
+	forfiledcells(f, [&f](auto& cell) {
+		cell.erase(findentry(cell, f.key));
+	});
+
+	f = UNFILED;
+}
+
+void file(short spritenum, uint64_t key)
+{
+	auto& f = grid.filed[spritenum];
+
+	f.key = key;
+	f.reach = spritereach(sprite[spritenum]);
+	f.cx1 = (short)cellx(f.reach.x1);
+	f.cy1 = (short)celly(f.reach.y1);
+	f.cx2 = (short)cellx(f.reach.x2);
+	f.cy2 = (short)celly(f.reach.y2);
+
+	forfiledcells(f, [&f](auto& cell) {
+		cell.insert(findentry(cell, f.key), { f.key, f.reach });
+	});
+}
+
+/**
+ * Refiles a sprite after it moved, touching only its entries when it still
+ * covers the same cells
+ */
+void refile(short spritenum)
+{
+	auto& f = grid.filed[spritenum];
+	const auto reach = spritereach(sprite[spritenum]);
+
+	if (f.cx1 > f.cx2) {
+		return;
+	}
+	if (cellx(reach.x1) != f.cx1 || celly(reach.y1) != f.cy1 ||
+		cellx(reach.x2) != f.cx2 || celly(reach.y2) != f.cy2) {
+		const auto key = f.key;
+		unfile(spritenum);
+		file(spritenum, key);
+		return;
+	}
+
+	f.reach = reach;
+	forfiledcells(f, [&f](auto& cell) {
+		findentry(cell, f.key)->reach = f.reach;
+	});
+}
+
+void buildgrid()
+{
+	grid.numsectors = numsectors;
+	grid.numwalls = numwalls;
+
+	int64_t x1{0}, y1{0}, x2{0}, y2{0};
+
+	if (numwalls > 0) {
+		x1 = y1 = INT_MAX;
+		x2 = y2 = INT_MIN;
+		for (int i{0}; i < numwalls; ++i) {
+			x1 = std::min<int64_t>(x1, wall[i].pt.x);
+			y1 = std::min<int64_t>(y1, wall[i].pt.y);
+			x2 = std::max<int64_t>(x2, wall[i].pt.x);
+			y2 = std::max<int64_t>(y2, wall[i].pt.y);
+		}
+	}
+
+	grid.x0 = (int)x1;
+	grid.y0 = (int)y1;
+	grid.shift = MINCELLSHIFT;
+	while (((x2 - x1) >> grid.shift) >= MAXGRIDCELLS || ((y2 - y1) >> grid.shift) >= MAXGRIDCELLS) {
+		grid.shift++;
+	}
+	grid.xcells = (int)((x2 - x1) >> grid.shift) + 1;
+	grid.ycells = (int)((y2 - y1) >> grid.shift) + 1;
+
+	grid.cells.assign(grid.xcells * grid.ycells, {});
+	std::ranges::fill(grid.filed, UNFILED);
+
+		// stamp each list from its tail, so the head ends up highest
+	std::vector<short> list;
+	grid.nextstamp = 0;
+
+	for (int s{0}; s < MAXSECTORS; ++s) {
+		list.clear();
+		for (int j = headspritesect[s]; j >= 0; j = nextspritesect[j]) {
+			list.push_back((short)j);
+		}
+		for (auto it = list.rbegin(); it != list.rend(); ++it) {
+			file(*it, sortkey((short)s, ++grid.nextstamp, *it));
+		}
+	}
+}
+
+} // namespace
+
+void clipgridlink(short spritenum)
+{
+	if (!clipbroadphase) {
+		gridready = false;
+		return;
+	}
+	if (!gridready) {
+		return;
+	}
+	if (grid.nextstamp == UINT_MAX) {
+		gridready = false;	// restamp everything on the next gather
+		return;
+	}
+
+	unfile(spritenum);
+	file(spritenum, sortkey(sprite[spritenum].sectnum, ++grid.nextstamp, spritenum));
+}
+
+void clipgridunlink(short spritenum)
+{
+	if (!clipbroadphase) {
+		gridready = false;
+		return;
+	}
+	if (gridready) {
+		unfile(spritenum);
+	}
+}
+
+void updatespriteclip(short spritenum)
+{
+	if (spritenum < 0 || !clipbroadphase) {
+		gridready = false;
+		return;
+	}
+	if (gridready && spritenum < MAXSPRITES && sprite[spritenum].sectnum < MAXSECTORS) {
+		refile(spritenum);
+	}
+}
+
+clipbox spriteclipbox(const spritetype& spr)
+{
+	const auto r = spritereach(spr);
+
+	return { r.x1, r.y1, r.x2, r.y2 };
+}
+
+std::span<const short> clipgridgather(int xmin, int ymin, int xmax, int ymax)
+{
+	if (!gridready.load(std::memory_order_acquire) || grid.numsectors != numsectors || grid.numwalls != numwalls) {
+		std::lock_guard lock(gridbuild);
+		if (!gridready.load(std::memory_order_relaxed) || grid.numsectors != numsectors || grid.numwalls != numwalls) {
+			buildgrid();
+			gridready.store(true, std::memory_order_release);
+		}
+	}
+
+	const int cx1 = cellx(xmin);
+	const int cy1 = celly(ymin);
+	const int cx2 = cellx(xmax);
+	const int cy2 = celly(ymax);
+
+	sortkeys.clear();
+
+	for (int cy = cy1; cy <= cy2; ++cy) {
+		for (int cx = cx1; cx <= cx2; ++cx) {
+			const auto merged = (std::ptrdiff_t)sortkeys.size();
+
+			for (const auto& e : grid.cells[cy * grid.xcells + cx]) {
+				if (e.reach.x2 < xmin || e.reach.x1 > xmax || e.reach.y2 < ymin || e.reach.y1 > ymax) {
+					continue;
+				}
+
+				if (std::max(cellx(e.reach.x1), cx1) != cx || std::max(celly(e.reach.y1), cy1) != cy) {
+					continue;	// taken from another cell already
+				}
+
+				sortkeys.push_back(e.key);
+			}
+
+				// each cell is in order already, so merging them is enough
+			std::inplace_merge(sortkeys.begin(), sortkeys.begin() + merged, sortkeys.end());
+		}
+	}
+
+	gathered.resize(sortkeys.size());
+	std::ranges::transform(sortkeys, gathered.begin(), keysprite);
+
+	return gathered;
+}
+
+std::span<const short> clipgridsector(std::span<const short> sprites, short sectnum)
+{
+	const auto bysector = [](short j) { return sprite[j].sectnum; };
+	const auto [first, last] = std::ranges::equal_range(sprites, sectnum, {}, bysector);
+
+	return { first, last };
+}
+
+void clipgridbench(int actors, int tics)
+{
+	if (numsectors <= 0) {
+		buildprintf("clipgridbench: no map loaded\n");
+		return;
+	}
+
+	struct SpriteState {
+		std::array<spritetype, MAXSPRITES> sprites;
+		std::array<short, MAXSECTORS + 1> headsect;
+		std::array<short, MAXSTATUS + 1> headstat;
+		std::array<short, MAXSPRITES> prevsect, nextsect, prevstat, nextstat;
+
+		void save()
+		{
+			sprites = sprite;
+			headsect = headspritesect;
+			headstat = headspritestat;
+			prevsect = prevspritesect;
+			nextsect = nextspritesect;
+			prevstat = prevspritestat;
+			nextstat = nextspritestat;
+		}
+		void restore() const
+		{
+			sprite = sprites;
+			headspritesect = headsect;
+			headspritestat = headstat;
+			prevspritesect = prevsect;
+			nextspritesect = nextsect;
+			prevspritestat = prevstat;
+			nextspritestat = nextstat;
+			updatespriteclip(-1);
+		}
+	};
+
+	const int oldbroadphase = clipbroadphase;
+	auto original = std::make_unique<SpriteState>();
+	auto start = std::make_unique<SpriteState>();
+
+	original->save();
+
+	std::mt19937 rng(numsectors + actors);
+	std::vector<short> movers;
+
+		// scatter the actors over random points of random sectors
+	for (int n{0}, tries{0}; n < actors && tries < actors * 64; ++tries) {
+		const short sectnum = (short)(rng() % numsectors);
+		const auto& sec = g_sector[sectnum];
+		int x1{INT_MAX}, y1{INT_MAX}, x2{INT_MIN}, y2{INT_MIN};
+
+		for (int w = sec.wallptr; w < sec.wallptr + sec.wallnum; ++w) {
+			x1 = std::min(x1, wall[w].pt.x);
+			y1 = std::min(y1, wall[w].pt.y);
+			x2 = std::max(x2, wall[w].pt.x);
+			y2 = std::max(y2, wall[w].pt.y);
+		}
+		if (x1 >= x2 || y1 >= y2) {
+			continue;
+		}
+
+		const int x = std::uniform_int_distribution<int>(x1, x2)(rng);
+		const int y = std::uniform_int_distribution<int>(y1, y2)(rng);
+
+		if (inside(x, y, sectnum) != 1) {
+			continue;
+		}
+
+		const int j = insertsprite(sectnum, 0);
+
+		if (j < 0) {
+			break;
+		}
+
+		auto& spr = sprite[j];
+		spr = {};
+		spr.x = x;
+		spr.y = y;
+		spr.z = getflorzofslope(sectnum, x, y);
+		spr.cstat = 1 | 256;
+		spr.xrepeat = spr.yrepeat = 64;
+		spr.clipdist = 32;
+		spr.ang = (short)(rng() & 2047);
+		spr.sectnum = sectnum;
+		spr.statnum = 0;
+		movers.push_back((short)j);
+		n++;
+	}
+
+	start->save();
+
+	auto run = [&movers, tics](uint64_t& hash, int& overflows) {
+		std::mt19937 turns(12345);
+		auto ctx = std::make_unique<clipcontext>();
+
+		const unsigned int t0 = getusecticks();
+
+		for (int tic{0}; tic < tics; ++tic) {
+			for (short j : movers) {
+				auto& spr = sprite[j];
+				short sectnum = spr.sectnum;
+				const int xvect = sintable[(spr.ang + 512) & 2047] << 6;
+				const int yvect = sintable[spr.ang & 2047] << 6;
+				const int z = spr.z - (16 << 8);
+
+				const int ret = clipmove(*ctx, &spr.x, &spr.y, &z, &sectnum, xvect, yvect,
+					spr.clipdist << 2, 4 << 8, 4 << 8, CLIPMASK0);
+
+				overflows += (ctx->clipnum >= MAXCLIPNUM);
+				if (sectnum >= 0 && sectnum != spr.sectnum) {
+					changespritesect(j, sectnum);
+				}
+				updatespriteclip(j);
+
+				if (ret != 0) {
+					spr.ang = (short)((spr.ang + 512 + (turns() & 1023)) & 2047);
+				}
+
+				int ceilz, ceilhit, florz, florhit;
+
+				spr.cstat &= ~1;
+				getzrange(*ctx, spr.x, spr.y, spr.z - 1, spr.sectnum, &ceilz, &ceilhit, &florz, &florhit,
+					spr.clipdist << 2, CLIPMASK0);
+				spr.cstat |= 1;
+
+				if (florz > ceilz) {
+					spr.z = florz;
+				}
+
+				for (const int v : { ret, spr.x, spr.y, spr.z, (int)spr.sectnum, ceilhit, florhit }) {
+					hash = (hash ^ (uint32_t)v) * 0x100000001b3ULL;
+				}
+			}
+		}
+
+		return getusecticks() - t0;
+	};
+
+	uint64_t listhash{0xcbf29ce484222325ULL};
+	uint64_t gridhash{0xcbf29ce484222325ULL};
+	int listoverflows{0};
+	int gridoverflows{0};
+
+	clipbroadphase = 0;
+	start->restore();
+	const unsigned int listt = run(listhash, listoverflows);
+
+	clipbroadphase = 1;
+	start->restore();
+	const unsigned int gridt = run(gridhash, gridoverflows);
+
+	clipbroadphase = oldbroadphase;
+	original->restore();
+
+	buildprintf("{} actors for {} tics: sector lists {:.2f} ms, grid {:.2f} ms ({:.1f}x), results {}\n",
+			   movers.size(), tics, (double)listt / 1000.0, (double)gridt / 1000.0,
+			   (double)listt / std::max(1U, gridt), listhash == gridhash ? "match" : "DIFFER");
+	if (listoverflows > gridoverflows) {
+			// the lists' extra far away sprites can fill clipit[] and push out near ones
+		buildprintf("  {} moves ran out of clip lines on the sector lists, {} with the grid\n",
+				   listoverflows, gridoverflows);
+	}
+}
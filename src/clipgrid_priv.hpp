@@ -0,0 +1,46 @@
+#ifndef CLIPGRID_PRIV_H
+#define CLIPGRID_PRIV_H
+
+#include <span>
+
+/**
+ * Files a sprite that has just been put at the head of its sector's list
+ * @param spritenum the sprite
+ */
+void clipgridlink(short spritenum);
+
+/**
+ * Takes a sprite that is leaving its sector's list out of the grid
+ * @param spritenum the sprite
+ */
+void clipgridunlink(short spritenum);
+
+/**
+ * Gathers every sprite whose clipping extent may touch a box, ordered by
+ * sector and then as each sector's sprite list would give them
+ * @param xmin left edge of the box
+ * @param ymin top edge of the box
+ * @param xmax right edge of the box
+ * @param ymax bottom edge of the box
+ * @return the sprites, valid until the next call on this thread
+ */
+std::span<const short> clipgridgather(int xmin, int ymin, int xmax, int ymax);
+
+/**
+ * Picks the sprites of one sector out of what clipgridgather() returned
+ * @param gathered the gathered sprites
+ * @param sectnum the sector
+ * @return the sector's gathered sprites, in sprite list order
+ */
+std::span<const short> clipgridsector(std::span<const short> gathered, short sectnum);
+
+/**
+ * Moves actors around the map for a number of tics, once walking the sector
+ * sprite lists and once through the grid, and reports timings and whether
+ * both runs ended the same. The map's sprites are restored afterwards.
+ * @param actors number of blocking actors to add
+ * @param tics number of tics to simulate
+ */
+void clipgridbench(int actors, int tics);
+
+#endif
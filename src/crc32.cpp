@@ -1,6 +1,37 @@
 #include "crc32.hpp"
 
 #include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+# define CRC_PCLMUL 1
+# include <immintrin.h>
+# if defined(_MSC_VER)
+#  include <intrin.h>
+#  define CRC_PCLMUL_TARGET
+# else
+#  include <cpuid.h>
+#  define CRC_PCLMUL_TARGET __attribute__((target("pclmul,sse2")))
+# endif
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__ARM_FEATURE_CRC32) || defined(__APPLE__) || defined(__linux__))
+# define CRC_ARMV8 1
+# include <arm_acle.h>
+# if defined(__ARM_FEATURE_CRC32)
+#  define CRC_ARMV8_TARGET
+# elif defined(__clang__)
+#  define CRC_ARMV8_TARGET __attribute__((target("crc")))
+# else
+#  define CRC_ARMV8_TARGET __attribute__((target("+crc")))
+# endif
+# if defined(__linux__) && !defined(__ARM_FEATURE_CRC32)
+#  include <sys/auxv.h>
+#  include <asm/hwcap.h>
+# endif
+#endif
 
 /*
 // this table of numbers is borrowed from the InfoZip source.
@@ -78,8 +109,363 @@ constexpr std::array<unsigned int, 256> crc32table = []() {
   return crc32tbl;
 }();
 
+	// crc32slices[k][b] is the CRC of byte b followed by k zero bytes, so
+	// the bytes of a word can be looked up independently and combined
+constexpr auto crc32slices = []() {
+	std::array<std::array<unsigned int, 256>, 16> t{};
+
+	t[0] = crc32table;
+	for (std::size_t k{1}; k < t.size(); k++) {
+		for (std::size_t i{0}; i < 256; i++) {
+			t[k][i] = (t[k - 1][i] >> 8) ^ crc32table[t[k - 1][i] & 0xff];
+		}
+	}
+	return t;
+}();
+
+	// mmulti's CRC16: CCITT polynomial 0x1021, most significant bit first.
+	// Taking a block from its last byte back to its first makes it the
+	// remainder of the block read as one little endian number, times x^16.
+constexpr auto crc16slices = []() {
+	std::array<std::array<unsigned short, 256>, 16> t{};
+
+	for (unsigned int j{0}; j < 256; j++) {
+		unsigned int a{0};
+		for (unsigned int i{0}, k{j << 8}; i < 8; i++, k = (k << 1) & 0xffff) {
+			a = ((k ^ a) & 0x8000) ? (((a << 1) & 0xffff) ^ 0x1021) : ((a << 1) & 0xffff);
+		}
+		t[0][j] = (unsigned short)a;
+	}
+	for (std::size_t k{1}; k < t.size(); k++) {
+		for (std::size_t i{0}; i < 256; i++) {
+			t[k][i] = (unsigned short)(((t[k - 1][i] << 8) & 0xffff) ^ t[0][t[k - 1][i] >> 8]);
+		}
+	}
+	return t;
+}();
+
+inline std::uint32_t load32(const unsigned char *p)
+{
+	std::uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	if constexpr (std::endian::native == std::endian::big) v = std::byteswap(v);
+	return v;
+}
+
+inline std::uint64_t load64(const unsigned char *p)
+{
+	std::uint64_t v;
+	std::memcpy(&v, p, sizeof(v));
+	if constexpr (std::endian::native == std::endian::big) v = std::byteswap(v);
+	return v;
+}
+
+unsigned int crc32bytewise(unsigned int crc, const unsigned char *blk, std::size_t len)
+{
+	while (len--) {
+		crc = crc32table[(crc ^ *(blk++)) & 0xffL] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+unsigned int crc32slice8(unsigned int crc, const unsigned char *blk, std::size_t len)
+{
+	const auto& t = crc32slices;
+
+	for (; len >= 8; len -= 8, blk += 8) {
+		const std::uint32_t a{load32(blk) ^ crc};
+		const std::uint32_t b{load32(blk + 4)};
+
+		crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^
+			t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+	}
+	return crc32bytewise(crc, blk, len);
+}
+
+unsigned int crc32slice16(unsigned int crc, const unsigned char *blk, std::size_t len)
+{
+	const auto& t = crc32slices;
+
+	for (; len >= 16; len -= 16, blk += 16) {
+		const std::uint32_t a{load32(blk) ^ crc};
+		const std::uint32_t b{load32(blk + 4)};
+		const std::uint32_t c{load32(blk + 8)};
+		const std::uint32_t d{load32(blk + 12)};
+
+		crc = t[15][a & 0xff] ^ t[14][(a >> 8) & 0xff] ^ t[13][(a >> 16) & 0xff] ^ t[12][a >> 24] ^
+			t[11][b & 0xff] ^ t[10][(b >> 8) & 0xff] ^ t[9][(b >> 16) & 0xff] ^ t[8][b >> 24] ^
+			t[7][c & 0xff] ^ t[6][(c >> 8) & 0xff] ^ t[5][(c >> 16) & 0xff] ^ t[4][c >> 24] ^
+			t[3][d & 0xff] ^ t[2][(d >> 8) & 0xff] ^ t[1][(d >> 16) & 0xff] ^ t[0][d >> 24];
+	}
+	return crc32bytewise(crc, blk, len);
+}
+
+unsigned short crc16bytewise(unsigned short crc, const unsigned char *blk, std::size_t len)
+{
+	while (len--) {
+		crc = (unsigned short)((crc << 8) ^ crc16slices[0][(crc >> 8) ^ blk[len]]);
+	}
+	return crc;
+}
+
+	// The CRC16 goes from the end of the block, so the last bytes of a word
+	// come first and the running CRC lines up with its top
+unsigned short crc16slice8(unsigned short crc, const unsigned char *blk, std::size_t len)
+{
+	const auto& t = crc16slices;
+
+	for (; len >= 8; len -= 8) {
+		const std::uint64_t w{load64(blk + len - 8) ^ ((std::uint64_t)crc << 48)};
+
+		crc = t[7][w >> 56] ^ t[6][(w >> 48) & 0xff] ^ t[5][(w >> 40) & 0xff] ^ t[4][(w >> 32) & 0xff] ^
+			t[3][(w >> 24) & 0xff] ^ t[2][(w >> 16) & 0xff] ^ t[1][(w >> 8) & 0xff] ^ t[0][w & 0xff];
+	}
+	return crc16bytewise(crc, blk, len);
+}
+
+unsigned short crc16slice16(unsigned short crc, const unsigned char *blk, std::size_t len)
+{
+	const auto& t = crc16slices;
+
+	for (; len >= 16; len -= 16) {
+		const std::uint64_t h{load64(blk + len - 8) ^ ((std::uint64_t)crc << 48)};
+		const std::uint64_t l{load64(blk + len - 16)};
+
+		crc = t[15][h >> 56] ^ t[14][(h >> 48) & 0xff] ^ t[13][(h >> 40) & 0xff] ^ t[12][(h >> 32) & 0xff] ^
+			t[11][(h >> 24) & 0xff] ^ t[10][(h >> 16) & 0xff] ^ t[9][(h >> 8) & 0xff] ^ t[8][h & 0xff] ^
+			t[7][l >> 56] ^ t[6][(l >> 48) & 0xff] ^ t[5][(l >> 40) & 0xff] ^ t[4][(l >> 32) & 0xff] ^
+			t[3][(l >> 24) & 0xff] ^ t[2][(l >> 16) & 0xff] ^ t[1][(l >> 8) & 0xff] ^ t[0][l & 0xff];
+	}
+	return crc16bytewise(crc, blk, len);
+}
+
+#if CRC_PCLMUL
+
+	// Folds 64 bytes at a time with carry-less multiplies, as zlib does
+	// (Intel's "Fast CRC Computation Using PCLMULQDQ"), and the last few
+	// bytes with the tables. crc is the running value, not inverted.
+CRC_PCLMUL_TARGET
+unsigned int crc32pclmul(unsigned int crc, const unsigned char *blk, std::size_t len)
+{
+	alignas(16) static constexpr std::uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static constexpr std::uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static constexpr std::uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static constexpr std::uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+	if (len < 64) {
+		return crc32slice16(crc, blk, len);
+	}
+
+	const std::size_t tail{len & 15};
+	len -= tail;
+
+	__m128i x1 = _mm_loadu_si128((const __m128i *)(blk + 0x00));
+	__m128i x2 = _mm_loadu_si128((const __m128i *)(blk + 0x10));
+	__m128i x3 = _mm_loadu_si128((const __m128i *)(blk + 0x20));
+	__m128i x4 = _mm_loadu_si128((const __m128i *)(blk + 0x30));
+	__m128i x0 = _mm_load_si128((const __m128i *)k1k2);
+	__m128i x5;
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	blk += 64;
+	len -= 64;
+
+	for (; len >= 64; len -= 64, blk += 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		const __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		const __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		const __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(blk + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(blk + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(blk + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(blk + 0x30)));
+	}
+
+		// Fold the four lanes into one, then any 16 byte blocks left
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	for (const __m128i next : { x2, x3, x4 }) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+	}
+	for (; len >= 16; len -= 16, blk += 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)blk)), x5);
+	}
+
+		// 128 bits down to 64, then Barrett reduction to 32
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	crc = (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+	return crc32slice16(crc, blk, tail);
+}
+
+	// x^n mod the CRC16 polynomial
+constexpr std::uint64_t crc16xpow(int n)
+{
+	unsigned int r{1};
+
+	while (n--) {
+		r <<= 1;
+		if (r & 0x10000) r ^= 0x11021;
+	}
+	return r;
+}
+
+	// Multiplies the two halves of x by the x^n mod P for their place in k
+CRC_PCLMUL_TARGET
+inline __m128i crc16fold(__m128i x, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x01), _mm_clmulepi64_si128(x, k, 0x10));
+}
+
+	// The block read as a little endian number is folded down 64 bytes at a
+	// time from its top end, each step multiplying what's folded so far by
+	// x^512 modulo the polynomial. The last 16 bytes left go through the
+	// tables, and so do any bytes below the 16 byte blocks.
+CRC_PCLMUL_TARGET
+unsigned short crc16pclmul(unsigned short crc, const unsigned char *blk, std::size_t len)
+{
+	if (len < 64) {
+		return crc16slice16(crc, blk, len);
+	}
+
+	const std::size_t head{len & 15};
+	const unsigned char *p = blk + len;
+	static constexpr std::uint64_t x512{crc16xpow(512)}, x576{crc16xpow(576)};
+	static constexpr std::uint64_t x128{crc16xpow(128)}, x192{crc16xpow(192)};
+	const __m128i k4 = _mm_set_epi64x((long long)x512, (long long)x576);
+	const __m128i k1 = _mm_set_epi64x((long long)x128, (long long)x192);
+	std::size_t blocks{(len - head) >> 4};
+
+	__m128i x3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p - 16)), _mm_set_epi64x((long long)crc << 48, 0));
+	__m128i x2 = _mm_loadu_si128((const __m128i *)(p - 32));
+	__m128i x1 = _mm_loadu_si128((const __m128i *)(p - 48));
+	__m128i x0 = _mm_loadu_si128((const __m128i *)(p - 64));
+	p -= 64;
+	blocks -= 4;
+
+	for (; blocks >= 4; blocks -= 4, p -= 64) {
+		x3 = _mm_xor_si128(crc16fold(x3, k4), _mm_loadu_si128((const __m128i *)(p - 16)));
+		x2 = _mm_xor_si128(crc16fold(x2, k4), _mm_loadu_si128((const __m128i *)(p - 32)));
+		x1 = _mm_xor_si128(crc16fold(x1, k4), _mm_loadu_si128((const __m128i *)(p - 48)));
+		x0 = _mm_xor_si128(crc16fold(x0, k4), _mm_loadu_si128((const __m128i *)(p - 64)));
+	}
+
+	x2 = _mm_xor_si128(crc16fold(x3, k1), x2);
+	x1 = _mm_xor_si128(crc16fold(x2, k1), x1);
+	x0 = _mm_xor_si128(crc16fold(x1, k1), x0);
+	for (; blocks > 0; blocks--, p -= 16) {
+		x0 = _mm_xor_si128(crc16fold(x0, k1), _mm_loadu_si128((const __m128i *)(p - 16)));
+	}
+
+	alignas(16) unsigned char folded[16];
+	_mm_store_si128((__m128i *)folded, x0);
+	return crc16slice16(crc16slice16(0, folded, sizeof(folded)), blk, head);
+}
+
+bool havepclmul()
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	return (regs[2] & (1 << 1)) && (regs[3] & (1 << 26));
+#else
+	unsigned int a, b, c, d;
+	return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_PCLMUL) && (d & bit_SSE2);
+#endif
+}
+
+#endif	// CRC_PCLMUL
+
+#if CRC_ARMV8
+
+	// The ARMv8 CRC32 instructions use this polynomial and bit order
+CRC_ARMV8_TARGET
+unsigned int crc32armv8(unsigned int crc, const unsigned char *blk, std::size_t len)
+{
+	for (; len >= 8; len -= 8, blk += 8) {
+		std::uint64_t v;
+		std::memcpy(&v, blk, sizeof(v));
+		crc = __crc32d(crc, v);
+	}
+	while (len--) {
+		crc = __crc32b(crc, *(blk++));
+	}
+	return crc;
+}
+
+bool havearmv8crc()
+{
+#if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+	return true;
+#else
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
+
+#endif	// CRC_ARMV8
+
+	// Table ways first, then the hardware ones this machine has
+const std::vector<crcmethod>& methods()
+{
+	static const std::vector<crcmethod> list = []() {
+		std::vector<crcmethod> l{
+			{ "bytewise", crc32bytewise, crc16bytewise },
+			{ "slice-by-8", crc32slice8, crc16slice8 },
+			{ "slice-by-16", crc32slice16, crc16slice16 },
+		};
+#if CRC_PCLMUL
+		if (havepclmul()) l.push_back({ "pclmul", crc32pclmul, crc16pclmul });
+#endif
+#if CRC_ARMV8
+		if (havearmv8crc()) l.push_back({ "armv8 crc", crc32armv8, nullptr });
+#endif
+		return l;
+	}();
+	return list;
+}
+
+template<typename F>
+F fastest(F crcmethod::*way)
+{
+	F f{nullptr};
+
+	for (const auto& m : methods()) {
+		if (m.*way) f = m.*way;
+	}
+	return f;
+}
+
 } // namespace
 
+std::span<const crcmethod> crcmethods()
+{
+	return methods();
+}
+
 unsigned int crc32once(unsigned char *blk, unsigned int len)
 {
 	unsigned int crc;
@@ -99,13 +485,9 @@ void crc32init(unsigned int *crcvar)
 
 void crc32block(unsigned int *crcvar, unsigned char *blk, unsigned int len)
 {
-	unsigned int crc = *crcvar;
-  
-	while (len--) {
-    crc = crc32table[(crc ^ *(blk++)) & 0xffL] ^ (crc >> 8);
-  }
+	static const auto crc32 = fastest(&crcmethod::crc32);
 
-	*crcvar = crc;
+	*crcvar = crc32(*crcvar, blk, len);
 }
 
 unsigned int crc32finish(unsigned int *crcvar)
@@ -114,3 +496,9 @@ unsigned int crc32finish(unsigned int *crcvar)
 	return *crcvar;
 }
 
+unsigned short crc16back(unsigned short crc, const unsigned char *blk, std::size_t len)
+{
+	static const auto crc16 = fastest(&crcmethod::crc16back);
+
+	return crc16(crc, blk, len);
+}
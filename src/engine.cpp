@@ -25,12 +25,19 @@
 #include "algo_utils.hpp"
 
 #include "engine_priv.hpp"
+#include "sectindex_priv.hpp"
+#include "clipgrid_priv.hpp"
+#include "topology_priv.hpp"
+#include "pvs_priv.hpp"
+#include "workpool.hpp"
 #if USE_POLYMOST
 # include "polymost_priv.hpp"
 # if USE_OPENGL
 #  include "hightile_priv.hpp"
+#  include "polymostbatch.hpp"
 #  include "polymosttex_priv.hpp"
 #  include "polymosttexcache.hpp"
+#  include "mdcache.hpp"
 #  include "mdsprite_priv.hpp"
 # endif
 # ifdef _WIN32
@@ -44,10 +51,13 @@
 #include <cassert>
 #include <cmath>
 #include <csignal>
+#include <functional>
 #include <numbers>
 #include <numeric>
+#include <random>
 #include <span>
 #include <utility>
+#include <vector>
 
 void loadvoxel(int voxindex) { std::ignore = voxindex; }
 
@@ -69,14 +79,6 @@ void *pic{nullptr};
 int lastageclock;
 std::array<int, MAXTILES> tilefileoffs;
 
-static constexpr std::array<int, 2048> reciptable = []() {
-	std::array<int, 2048> rectable;
-	std::ranges::generate(rectable, [n = 0]() mutable {
-				return divscalen<30>(2048L, (n++) + 2048);
-			});
-	return rectable;
-}();
-
 int fpuasm;
 
 std::array<short, MAXXDIM> umost;
@@ -306,10 +308,8 @@ inline int getclipmask(int a, int b, int c, int d)
 #else	// __GNUC__ && __i386__
 
 inline int krecipasm(int i)
-{ // Ken did this
-	const float f = (float)i;
-	i = *(int *)&f;
-	return((reciptable[(i>>12)&2047]>>(((i-0x3f800000)>>23)&31))^(i>>31));
+{
+	return kreciplane(i);
 }
 
 
@@ -328,6 +328,10 @@ std::array<int, MAXWALLSB> yb2;
 std::array<int, MAXWALLSB> rx2;
 std::array<int, MAXWALLSB> ry2;
 
+	// view space wall positions of the sectors scanned this frame
+std::array<int, MAXWALLS> wallviewx;
+std::array<int, MAXWALLS> wallviewy;
+
 std::array<short, MAXYSAVES> smost;
 short smostcnt;
 std::array<short, MAXWALLSB> smoststart;
@@ -378,20 +382,7 @@ constexpr std::array<unsigned char, 8> coldist = {
 
 std::array<int, 27> colscan;
 
-short clipnum;
-std::array<short, 4> hitwalls;
-
-struct linetype {
-	int x1;
-	int y1;
-	int x2;
-	int y2;
-};
-
-std::array<linetype, MAXCLIPNUM> clipit;
-std::array<short, MAXCLIPNUM> clipsectorlist;
-short clipsectnum;
-std::array<short, MAXCLIPNUM> clipobjectval;
+clipcontext defaultclipcontext;	// for the context-free collision functions
 
 struct permfifotype
 {
@@ -462,6 +453,32 @@ inline int getpalookup(int davis, int dashade)
 }
 
 
+namespace {
+
+std::array<int, MAXWALLS> wallrelx;	// transformsectorwalls() scratch
+std::array<int, MAXWALLS> wallrely;
+
+/**
+ * Puts all of a sector's walls into view space in one batch, as scansector()
+ * would have done one at a time, with the vector set fixarrays picked
+ * @param startwall the sector's first wall
+ * @param endwall one past its last wall
+ */
+void transformsectorwalls(int startwall, int endwall)
+{
+	const int n = endwall - startwall;
+
+	for (int i{0}; i < n; ++i) {
+		wallrelx[i] = wall[startwall + i].pt.x - globalpos.x;
+		wallrely[i] = wall[startwall + i].pt.y - globalpos.y;
+	}
+
+	dmulscalen<6>(&wallviewx[startwall], wallrely.data(), cosglobalang, wallrelx.data(), -singlobalang, n);
+	dmulscalen<6>(&wallviewy[startwall], wallrelx.data(), cosviewingrangeglobalang, wallrely.data(), sinviewingrangeglobalang, n);
+}
+
+} // namespace
+
 //
 // scansector (internal)
 //
@@ -478,8 +495,8 @@ void scansector(short sectnum)
 	int y2;
 	int xp1;
 	int yp1;
-	int xp2{0};
-	int yp2{0};
+	int xp2;
+	int yp2;
 	int templong;
 	short z;
 	short zz;
@@ -528,6 +545,7 @@ void scansector(short sectnum)
 		startwall = g_sector[sectnum].wallptr;
 		endwall = startwall + g_sector[sectnum].wallnum;
 		scanfirst = numscans;
+		transformsectorwalls(startwall, endwall);
 		for(z=startwall,wal=&wall[z];z<endwall;z++,wal++)
 		{
 			const short nextsectnum = wal->nextsector;
@@ -542,21 +560,22 @@ void scansector(short sectnum)
 					templong = determ(pt1, pt2);
 					if (((unsigned)templong+262144) < 524288)
 						if (mulscalen<5>(templong,templong) <= (pt2.x - pt1.x)*(pt2.x - pt1.x)+(pt2.y - pt1.y) * (pt2.y - pt1.y))
-							sectorborder[sectorbordercnt++] = nextsectnum;
+							if ((pvsviewsect < 0) || pvsvisible(pvsviewsect, nextsectnum))
+								sectorborder[sectorbordercnt++] = nextsectnum;
 				}
 
-			if ((z == startwall) || (wall[z-1].point2 != z))
+			xp1 = wallviewx[z];
+			yp1 = wallviewy[z];
+			if ((wal->point2 >= startwall) && (wal->point2 < endwall))
 			{
-				xp1 = dmulscalen<6>(pt1.y,cosglobalang,-pt1.x,singlobalang);
-				yp1 = dmulscalen<6>(pt1.x,cosviewingrangeglobalang,pt1.y,sinviewingrangeglobalang);
+				xp2 = wallviewx[wal->point2];
+				yp2 = wallviewy[wal->point2];
 			}
 			else
 			{
-				xp1 = xp2;
-				yp1 = yp2;
+				xp2 = dmulscalen<6>(pt2.y,cosglobalang,-pt2.x,singlobalang);
+				yp2 = dmulscalen<6>(pt2.x,cosviewingrangeglobalang,pt2.y,sinviewingrangeglobalang);
 			}
-			xp2 = dmulscalen<6>(pt2.y,cosglobalang,-pt2.x,singlobalang);
-			yp2 = dmulscalen<6>(pt2.x,cosviewingrangeglobalang,pt2.y,sinviewingrangeglobalang);
 			if ((yp1 < 256) && (yp2 < 256)) goto skipitaddwall;
 
 				//If wall's NOT facing you
@@ -6188,6 +6207,7 @@ int insertspritesect(short sectnum)
 	headspritesect[sectnum] = blanktouse;
 
 	sprite[blanktouse].sectnum = sectnum;
+	clipgridlink(blanktouse);
 
 	return blanktouse;
 }
@@ -6227,6 +6247,8 @@ int deletespritesect(short deleteme)
 	if (sprite[deleteme].sectnum == MAXSECTORS)
 		return(-1);
 
+	clipgridunlink(deleteme);
+
 	if (headspritesect[sprite[deleteme].sectnum] == deleteme)
 		headspritesect[sprite[deleteme].sectnum] = nextspritesect[deleteme];
 
@@ -6386,8 +6408,9 @@ bool rintersect(int x1, int y1, int z1, int vx, int vy, int vz, int x3,
 //
 // keepaway (internal)
 //
-void keepaway (int *x, int *y, int w)
+void keepaway (const clipcontext& ctx, int *x, int *y, int w)
 {
+	const auto& clipit = ctx.clipit;
 	const int x1 = clipit[w].x1;
 	const int dx = clipit[w].x2 - x1;
 	const int y1 = clipit[w].y1;
@@ -6414,8 +6437,10 @@ void keepaway (int *x, int *y, int w)
 //
 // raytrace (internal)
 //
-int raytrace(int x3, int y3, int *x4, int *y4)
+int raytrace(const clipcontext& ctx, int x3, int y3, int *x4, int *y4)
 {
+	const auto& clipit = ctx.clipit;
+	const auto clipnum = ctx.clipnum;
 	int x1;
 	int y1;
 	int x2;
@@ -6603,6 +6628,7 @@ bool initengine()
 		mdinit();
 	
 	PTCacheLoadIndex();
+	MDCacheLoadIndex();
 #endif
 
 	return true;
@@ -6620,10 +6646,12 @@ void uninitengine()
 	polymost_glreset();
 	PTClear();
 	PTCacheUnloadIndex();
+	MDCacheUnloadIndex();
 	hicinit();
 	freeallmodels();
 #endif
 
+	uninitworkpool();
 	uninitsystem();
 
 	if (logfile) {
@@ -6676,6 +6704,8 @@ void initspritelists()
 
 	prevspritestat[0] = -1;
 	nextspritestat[MAXSPRITES-1] = -1;
+
+	updatespriteclip(-1);
 }
 
 
@@ -6775,6 +6805,8 @@ void drawrooms(int daposx, int daposy, int daposz,
 		if (globalcursectnum < 0) globalcursectnum = i;
 	}
 
+	pvsviewsect = (!inpreparemirror && pvsready() && (inside(globalpos.x, globalpos.y, globalcursectnum) == 1)) ? globalcursectnum : -1;
+
 	globparaceilclip = true;
 	globparaflorclip = true;
 
@@ -6856,33 +6888,33 @@ void drawrooms(int daposx, int daposy, int daposz,
 }
 
 
-//
-// drawmasks
-//
-void drawmasks()
-{
-	int i;
-	int j;
-	int k;
-	int l;
-	int gap;
-	int xs;
-	int ys;
-	int xp;
-	int yp;
-	int yoff;
-	int yspan;
+namespace {
 
-	for(i=spritesortcnt-1;i>=0;i--)
+std::array<unsigned int, MAXSPRITESONSCREEN> masksortkey, masksortkeyscratch;
+std::array<short, MAXSPRITESONSCREEN> masksortorder, masksortorderscratch;
+std::array<spritetype*, MAXSPRITESONSCREEN> masksortsprite;
+std::array<int, MAXSPRITESONSCREEN> masksortx;
+std::array<short, MAXSPRITESONSCREEN> maskcolumnorder;	// sprites by screen column, once a masked wall needs them
+std::array<int, MAXXDIM + 2> maskcolumnstart;
+std::array<short, MAXSPRITESONSCREEN> maskbehindwall;
+std::array<unsigned char, MAXSPRITESONSCREEN> maskspritedrawn;
+
+/**
+ * Works out each tsprite's screen column and depth, dropping face sprites
+ * that are behind the viewer or off the screen
+ */
+void projectmasks()
+{
+	for(int i=spritesortcnt-1;i>=0;i--)
 		tspriteptr[i] = &tsprite[i];
-	
-	for(i=spritesortcnt-1;i>=0;i--) {
-		xs = tspriteptr[i]->x-globalpos.x;
-		ys = tspriteptr[i]->y-globalpos.y;
-		yp = dmulscalen<6>(xs,cosviewingrangeglobalang,ys,sinviewingrangeglobalang);
-		
+
+	for(int i=spritesortcnt-1;i>=0;i--) {
+		const int xs = tspriteptr[i]->x-globalpos.x;
+		const int ys = tspriteptr[i]->y-globalpos.y;
+		const int yp = dmulscalen<6>(xs,cosviewingrangeglobalang,ys,sinviewingrangeglobalang);
+
 		if (yp > (4<<8)) {
-			xp = dmulscalen<6>(ys,cosglobalang,-xs,singlobalang);
+			const int xp = dmulscalen<6>(ys,cosglobalang,-xs,singlobalang);
 			if (mulscalen<24>(abs(xp+yp),xdimen) >= yp) goto killsprite;
 			spritesx[i] = scale(xp+yp,xdimen<<7,yp);
 		}
@@ -6899,63 +6931,255 @@ killsprite:
 		}
 		spritesy[i] = yp;
 	}
+}
 
-	gap = 1; while (gap < spritesortcnt) gap = (gap<<1)+1;
-	for(gap>>=1;gap>0;gap>>=1)      //Sort sprite list
-		for(i=0;i<spritesortcnt-gap;i++)
-			for(l=i;l>=0;l-=gap)
-			{
-				if (spritesy[l] <= spritesy[l+gap])
-					break;
-				
-				std::swap(tspriteptr[l], tspriteptr[l + gap]);
-				std::swap(spritesx[l], spritesx[l + gap]);
-				std::swap(spritesy[l], spritesy[l + gap]);
+/**
+ * Sorts tspriteptr[], spritesx[] and spritesy[] nearest first, keeping
+ * sprites of equal depth in the order they came
+ */
+void sortmasksbydepth()
+{
+	const int n = spritesortcnt;
+
+	if (n <= 64) {
+		for (int i{1}; i < n; ++i) {
+			auto *spr = tspriteptr[i];
+			const int sx = spritesx[i];
+			const int sy = spritesy[i];
+			int l{i};
+
+			for (; l > 0 && spritesy[l-1] > sy; --l) {
+				tspriteptr[l] = tspriteptr[l-1];
+				spritesx[l] = spritesx[l-1];
+				spritesy[l] = spritesy[l-1];
 			}
+			tspriteptr[l] = spr;
+			spritesx[l] = sx;
+			spritesy[l] = sy;
+		}
+		return;
+	}
+
+		// least significant byte first, skipping bytes every depth shares
+	std::array<std::array<int, 256>, 4> counts{};
+	unsigned int *keys = masksortkey.data();
+	unsigned int *keyscratch = masksortkeyscratch.data();
+	short *order = masksortorder.data();
+	short *orderscratch = masksortorderscratch.data();
+
+	for (int i{0}; i < n; ++i) {
+		const unsigned int key = (unsigned int)spritesy[i] ^ 0x80000000U;
+		keys[i] = key;
+		order[i] = (short)i;
+		for (int d{0}; d < 4; ++d) {
+			counts[d][(key >> (d * 8)) & 255]++;
+		}
+	}
+
+	for (int d{0}; d < 4; ++d) {
+		auto& count = counts[d];
+
+		if (count[(keys[0] >> (d * 8)) & 255] == n) {
+			continue;
+		}
+
+		int sum{0};
+		for (auto& c : count) {
+			const int t = c;
+			c = sum;
+			sum += t;
+		}
+		for (int i{0}; i < n; ++i) {
+			const int at = count[(keys[i] >> (d * 8)) & 255]++;
+			keyscratch[at] = keys[i];
+			orderscratch[at] = order[i];
+		}
+		std::swap(keys, keyscratch);
+		std::swap(order, orderscratch);
+	}
 
+	for (int i{0}; i < n; ++i) {
+		masksortsprite[i] = tspriteptr[order[i]];
+		masksortx[i] = spritesx[order[i]];
+	}
+	for (int i{0}; i < n; ++i) {
+		tspriteptr[i] = masksortsprite[i];
+		spritesx[i] = masksortx[i];
+		spritesy[i] = (int)(keys[i] ^ 0x80000000U);
+	}
+}
+
+/**
+ * Orders each run of sprites at the same depth by statnum, then by how far
+ * they are above or below the viewer, then by tsprite index. That key is
+ * total, so the order the depth sort left them in doesn't matter.
+ */
+void orderequaldepths()
+{
 	if (spritesortcnt > 0)
 		spritesy[spritesortcnt] = (spritesy[spritesortcnt-1]^1);
 
-	ys = spritesy[0]; i = 0;
-	for(j=1;j<=spritesortcnt;j++)
+	int ys = spritesy[0];
+	int i{0};
+	for(int j=1;j<=spritesortcnt;j++)
 	{
 		if (spritesy[j] == ys)
 			continue;
-		
+
 		ys = spritesy[j];
-		
+
 		if (j > i+1) {
-			for(k=i;k<j;k++) {
+			for(int k=i;k<j;k++) {
 				spritesz[k] = tspriteptr[k]->z;
 				if ((tspriteptr[k]->cstat&48) != 32)
 				{
-					yoff = (int)((signed char)((picanm[tspriteptr[k]->picnum]>>16)&255))+((int)tspriteptr[k]->yoffset);
+					const int yoff = (int)((signed char)((picanm[tspriteptr[k]->picnum]>>16)&255))+((int)tspriteptr[k]->yoffset);
 					spritesz[k] -= ((yoff*tspriteptr[k]->yrepeat)<<2);
-					yspan = (tilesizy[tspriteptr[k]->picnum]*tspriteptr[k]->yrepeat<<2);
+					const int yspan = (tilesizy[tspriteptr[k]->picnum]*tspriteptr[k]->yrepeat<<2);
 					if (!(tspriteptr[k]->cstat&128)) spritesz[k] -= (yspan>>1);
 					if (std::abs(spritesz[k]-globalpos.z) < (yspan>>1)) spritesz[k] = globalpos.z;
 				}
 			}
-			for(k=i+1;k<j;k++)
-				for(l=i;l<k;l++)
-					if (std::abs(spritesz[k]-globalpos.z) < std::abs(spritesz[l]-globalpos.z))
-					{
-						std::swap(tspriteptr[k], tspriteptr[l]);
-						std::swap(spritesx[k], spritesx[l]);
-						std::swap(spritesy[k], spritesy[l]);
-						std::swap(spritesz[k], spritesz[l]);
-					}
-			for(k=i+1;k<j;k++)
-				for(l=i;l<k;l++)
-					if (tspriteptr[k]->statnum < tspriteptr[l]->statnum)
-					{
-						std::swap(tspriteptr[k], tspriteptr[l]);
-						std::swap(spritesx[k], spritesx[l]);
-						std::swap(spritesy[k], spritesy[l]);
-					}
+			short *order = masksortorder.data();
+			for(int k=i;k<j;k++)
+				order[k-i] = (short)k;
+			std::sort(order, order+(j-i), [](short a, short b) {
+				if (tspriteptr[a]->statnum != tspriteptr[b]->statnum)
+					return tspriteptr[a]->statnum < tspriteptr[b]->statnum;
+				const int za = std::abs(spritesz[a]-globalpos.z);
+				const int zb = std::abs(spritesz[b]-globalpos.z);
+				if (za != zb)
+					return za < zb;
+				return tspriteptr[a] < tspriteptr[b];
+			});
+			for(int k=i;k<j;k++) {
+				masksortsprite[k-i] = tspriteptr[order[k-i]];
+				masksortx[k-i] = spritesx[order[k-i]];
+			}
+			for(int k=i;k<j;k++) {
+				tspriteptr[k] = masksortsprite[k-i];
+				spritesx[k] = masksortx[k-i];
+			}
 		}
 		i = j;
 	}
+}
+
+/**
+ * Draws the sorted sprites and the masked walls furthest first. Before a
+ * masked wall in front of the furthest sprite is drawn, every sprite
+ * behind it in its columns is drawn, found by bucketing the sprites by
+ * screen column rather than testing them all.
+ * @param drawspr called with each sprite's index into tspriteptr[]
+ * @param drawwall called with each masked wall's index into maskwall[]
+ */
+template<typename DrawSprite, typename DrawMaskWall>
+void interleavemasks(DrawSprite&& drawspr, DrawMaskWall&& drawwall)
+{
+	const int n = spritesortcnt;
+	const int columns = std::clamp(xdimen, 1, (int)MAXXDIM);
+	const auto column = [columns](int sx) { return std::clamp(sx>>8, 0, columns - 1); };
+	int top{n};			// sprites from here on are drawn
+	bool columnsready{false};
+
+	std::fill_n(maskspritedrawn.begin(), n, 0);
+
+	while ((top > 0) && (maskwallcnt > 0))  //While BOTH > 0
+	{
+		const int j = maskwall[maskwallcnt-1];
+
+		if (!spritewallfront(tspriteptr[top-1], (int) thewall[j])) {
+			drawspr(--top);
+			while ((top > 0) && maskspritedrawn[top-1]) {
+				top--;
+			}
+			continue;
+		}
+
+		if (!columnsready) {
+			std::fill_n(maskcolumnstart.begin(), columns + 2, 0);
+			for (int i{0}; i < n; ++i) {
+				maskcolumnstart[column(spritesx[i]) + 2]++;
+			}
+			for (int c{2}; c < columns + 2; ++c) {
+				maskcolumnstart[c] += maskcolumnstart[c - 1];
+			}
+			for (int i{0}; i < n; ++i) {
+				maskcolumnorder[maskcolumnstart[column(spritesx[i]) + 1]++] = (short)i;
+			}
+			columnsready = true;
+		}
+
+			//Check to see if any sprites behind the masked wall...
+		int firstcolumn;
+		int lastcolumn;
+		bool l;
+#if USE_POLYMOST
+		if (rendmode != rendmode_t::Classic) {
+			firstcolumn = (int)std::floor(std::clamp(dxb1[j], -1.0, (double)columns));
+			lastcolumn = (int)std::floor(std::clamp(dxb2[j], -1.0, (double)columns));
+		}
+		else
+#endif
+		{
+			firstcolumn = xb1[j];
+			lastcolumn = xb2[j];
+		}
+		firstcolumn = std::clamp(firstcolumn, 0, columns - 1);
+		lastcolumn = std::clamp(lastcolumn, 0, columns - 1);
+
+		int behind{0};
+
+		for (int c = maskcolumnstart[firstcolumn]; c < maskcolumnstart[lastcolumn + 1]; ++c) {
+			const short i = maskcolumnorder[c];
+
+			if ((i >= top-1) || maskspritedrawn[i]) {
+				continue;
+			}
+#if USE_POLYMOST
+			if (rendmode != rendmode_t::Classic)
+				l = dxb1[j] <= (double)spritesx[i]/256.0 && (double)spritesx[i]/256.0 <= dxb2[j];
+			else
+#endif
+				l = xb1[j] <= (spritesx[i]>>8) && (spritesx[i]>>8) <= xb2[j];
+			if (l && !spritewallfront(tspriteptr[i], (int) thewall[j])) {
+				maskbehindwall[behind++] = i;
+			}
+		}
+
+		std::sort(maskbehindwall.begin(), maskbehindwall.begin() + behind, std::greater<>{});
+		for (int k{0}; k < behind; ++k) {
+			drawspr(maskbehindwall[k]);
+			maskspritedrawn[maskbehindwall[k]] = 1;
+		}
+
+			//finally safe to draw the masked wall
+		drawwall(--maskwallcnt);
+	}
+	while (top > 0) {
+		if (!maskspritedrawn[--top]) {
+			drawspr(top);
+		}
+	}
+	while (maskwallcnt > 0) drawwall(--maskwallcnt);
+
+	spritesortcnt = 0;
+}
+
+} // namespace
+
+//
+// drawmasks
+//
+void drawmasks()
+{
+	int i;
+	int j;
+	int k;
+
+	projectmasks();
+	sortmasksbydepth();
+	orderequaldepths();
 
 	/*for(i=spritesortcnt-1;i>=0;i--)
 	{
@@ -6981,6 +7205,24 @@ killsprite:
 		//Need to store alpha flag with all textures before this works right!
 	if (rendmode != rendmode_t::Classic)
 	{
+#if USE_OPENGL
+		if (rendmode == rendmode_t::OpenGL && glbatchsprites)
+		{
+				//Opaque sprites can go in any order, so bring together those
+				//likely to share a texture and shading and be drawn as one
+			std::array<polymostbatchitem, MAXSPRITESONSCREEN> opaque;
+			int numopaque{0};
+
+			for(i=spritesortcnt-1;i>=0;i--)
+				if ((!(tspriteptr[i]->cstat&2)) && (!polymost_texmayhavealpha(tspriteptr[i]->picnum,tspriteptr[i]->pal)))
+					opaque[numopaque++] = { polymost_batchkey(tspriteptr[i]->picnum,tspriteptr[i]->pal,tspriteptr[i]->shade), spritesy[i], (short)i };
+
+			polymost_groupbatchitems(std::span(opaque.data(), numopaque));
+			for(const auto& item : std::span(opaque.data(), numopaque))
+				{ drawsprite(item.index); tspriteptr[item.index] = nullptr; }
+		}
+		else
+#endif
 		for(i=spritesortcnt-1;i>=0;i--)
 			if ((!(tspriteptr[i]->cstat&2))
 #if USE_OPENGL
@@ -7020,11 +7262,51 @@ killsprite:
 	}
 #endif
 
+	interleavemasks([](int i) { drawsprite(i); }, [](int i) { drawmaskwall(i); });
+
+#if USE_POLYMOST && USE_OPENGL
+	if (rendmode == rendmode_t::OpenGL)
+		polymost_flushbatch();
+#endif
+}
+
+
+//
+// masksortbench
+//
+namespace {
+
+	// drawmasks()'s sort before the radix sort, for masksortbench() to check against
+void shellsortmasks()
+{
+	int gap = 1; while (gap < spritesortcnt) gap = (gap<<1)+1;
+	for(gap>>=1;gap>0;gap>>=1)      //Sort sprite list
+		for(int i=0;i<spritesortcnt-gap;i++)
+			for(int l=i;l>=0;l-=gap)
+			{
+				if (spritesy[l] <= spritesy[l+gap])
+					break;
+
+				std::swap(tspriteptr[l], tspriteptr[l + gap]);
+				std::swap(spritesx[l], spritesx[l + gap]);
+				std::swap(spritesy[l], spritesy[l + gap]);
+			}
+}
+
+	// and its interleaving, which tests every sprite against each masked wall
+template<typename DrawSprite, typename DrawMaskWall>
+void scaninterleavemasks(DrawSprite&& drawspr, DrawMaskWall&& drawwall)
+{
+	int i;
+	int k;
+	int l;
+	int gap;
+
 	while ((spritesortcnt > 0) && (maskwallcnt > 0))  //While BOTH > 0
 	{
-		j = maskwall[maskwallcnt-1];
+		const int j = maskwall[maskwallcnt-1];
 		if (spritewallfront(tspriteptr[spritesortcnt - 1], (int) thewall[j]) == 0)
-			drawsprite(--spritesortcnt);
+			drawspr(--spritesortcnt);
 		else
 		{
 				//Check to see if any sprites behind the masked wall...
@@ -7040,7 +7322,7 @@ killsprite:
 					l = xb1[j] <= (spritesx[i]>>8) && (spritesx[i]>>8) <= xb2[j];
 				if (l && spritewallfront(tspriteptr[i], (int) thewall[j]) == 0)
 				{
-					drawsprite(i);
+					drawspr(i);
 					tspriteptr[i]->owner = -1;
 					k = i;
 					gap++;
@@ -7063,11 +7345,137 @@ killsprite:
 			}
 
 				//finally safe to draw the masked wall
-			drawmaskwall(--maskwallcnt);
+			drawwall(--maskwallcnt);
 		}
 	}
-	while (spritesortcnt > 0) drawsprite(--spritesortcnt);
-	while (maskwallcnt > 0) drawmaskwall(--maskwallcnt);
+	while (spritesortcnt > 0) drawspr(--spritesortcnt);
+	while (maskwallcnt > 0) drawwall(--maskwallcnt);
+}
+
+} // namespace
+
+void masksortbench(int sprites)
+{
+	if ((qsetmode != 200) || (numscans <= 0)) {
+		buildprintf("masksortbench: needs a 3D view drawn first\n");
+		return;
+	}
+
+	sprites = std::min(sprites, (int)MAXSPRITESONSCREEN);
+
+		// sprites scattered in front of the last view, a quarter of them stacked on
+		// others at the same depth, and masked walls picked from what it scanned
+	std::mt19937 rng(sprites);
+	std::vector<spritetype> sprs(sprites);
+	const int cosang = sintable[(globalang+512)&2047];
+	const int sinang = sintable[globalang&2047];
+
+	for (int i{0}; i < sprites; ++i) {
+		auto& spr = sprs[i];
+
+		if ((i > 0) && ((rng() & 3) == 0)) {
+			const auto& other = sprs[rng() % i];
+			spr.x = other.x;
+			spr.y = other.y;
+		} else {
+			const int depth = 512 + (int)(rng() % 32768);
+			const int across = (int)(rng() % (2 * depth + 1)) - depth;
+			spr.x = globalpos.x + mulscalen<14>(depth, cosang) - mulscalen<14>(across, sinang);
+			spr.y = globalpos.y + mulscalen<14>(depth, sinang) + mulscalen<14>(across, cosang);
+		}
+		spr.z = globalpos.z + (int)(rng() % 16384) - 8192;
+		spr.cstat = (rng() & 7) ? 0 : ((rng() & 1) ? 16 : 32);
+		spr.picnum = (short)(rng() % MAXTILES);
+		spr.xrepeat = spr.yrepeat = 64;
+		spr.statnum = (short)(rng() & 3);
+		spr.owner = (short)i;
+	}
+
+	const int walls = std::min<int>(64, numscans);
+	std::vector<short> walllist(walls);
+	for (auto& w : walllist) {
+		w = (short)(rng() % numscans);
+	}
+
+	const auto restore = [&]() {
+		std::ranges::copy(sprs, tsprite.begin());
+		std::ranges::copy(walllist, maskwall.begin());
+		std::fill_n(spritesx.begin(), sprites, 0);
+		spritesortcnt = sprites;
+		maskwallcnt = walls;
+		projectmasks();
+	};
+
+	std::vector<int> sorted[2], drawn[2];
+	std::vector<spritetype*> sortedptr;
+	std::vector<int> sortedx, sortedy;
+	const auto record = [&drawn](int run) {
+		return std::make_pair(
+			[&drawn, run](int i) { drawn[run].push_back((int)(tspriteptr[i] - tsprite.data())); },
+			[&drawn, run](int i) { drawn[run].push_back(-1 - i); });
+	};
+	const int runs{16};
+	unsigned int sorttime[2]{0, 0};
+	unsigned int interleavetime[2]{0, 0};
+	int visible{0};
+	int mismatches{0};
+
+	for (int r{0}; r < runs; ++r) {
+		for (int run{0}; run < 2; ++run) {
+			restore();
+			visible = spritesortcnt;
+
+			const unsigned int t = getusecticks();
+			if (run == 0) {
+				shellsortmasks();
+			} else {
+				sortmasksbydepth();
+			}
+			orderequaldepths();
+			sorttime[run] += getusecticks() - t;
+
+			sorted[run].clear();
+			for (int i{0}; i < spritesortcnt; ++i) {
+				sorted[run].push_back((int)(tspriteptr[i] - tsprite.data()));
+			}
+		}
+
+			// both interleave the same order, so their drawing can be compared exactly
+		sortedptr.assign(tspriteptr.begin(), tspriteptr.begin() + spritesortcnt);
+		sortedx.assign(spritesx.begin(), spritesx.begin() + spritesortcnt);
+		sortedy.assign(spritesy.begin(), spritesy.begin() + spritesortcnt);
+
+		for (int run{0}; run < 2; ++run) {
+			std::ranges::copy(sprs, tsprite.begin());
+			std::ranges::copy(walllist, maskwall.begin());
+			std::ranges::copy(sortedptr, tspriteptr.begin());
+			std::ranges::copy(sortedx, spritesx.begin());
+			std::ranges::copy(sortedy, spritesy.begin());
+			spritesortcnt = (int)sortedptr.size();
+			maskwallcnt = walls;
+			drawn[run].clear();
+
+			auto [drawspr, drawwall] = record(run);
+			const unsigned int t = getusecticks();
+			if (run == 0) {
+				scaninterleavemasks(drawspr, drawwall);
+			} else {
+				interleavemasks(drawspr, drawwall);
+			}
+			interleavetime[run] += getusecticks() - t;
+		}
+
+		mismatches += (sorted[0] != sorted[1]) + (drawn[0] != drawn[1]);
+	}
+
+	spritesortcnt = 0;
+	maskwallcnt = 0;
+
+	buildprintf("masksortbench: {} of {} sprites visible, {} masked walls, {} mismatches\n",
+			   visible, sprites, walls, mismatches);
+	buildprintf("masksortbench: sorting {:.1f} us before, {:.1f} us after; interleaving {:.1f} us before, {:.1f} us after\n",
+			   (double)sorttime[0] / runs, (double)sorttime[1] / runs,
+			   (double)interleavetime[0] / runs, (double)interleavetime[1] / runs);
 }
 
 
@@ -7552,6 +7960,8 @@ int loadboard(const std::string& filename, char fromwhere, int *daposx, int *dap
 	}
 
 		//Must be after loading sectors, etc!
+	updatesectorindex(-1);
+	updatetopology();
 	updatesector(*daposx, *daposy, dacursectnum);
 
 	kclose(fil);
@@ -8475,6 +8885,8 @@ int loadoldboard(const std::string& filename, char fromwhere, int *daposx, int *
 	}
 
 		//Must be after loading sectors, etc!
+	updatesectorindex(-1);
+	updatetopology();
 	updatesector(*daposx,*daposy,dacursectnum);
 
 	kclose(fil);
@@ -9314,7 +9726,7 @@ int qloadkvx(int voxindex, const std::string& filename)
 		voxfree(voxmodels[voxindex].get());
 		voxmodels[voxindex].reset();
 	}
-	voxmodels[voxindex] = voxload(filename.c_str());
+	voxloadqueue(voxindex, filename);
 #endif
 	return 0;
 }
@@ -9537,6 +9949,7 @@ int setsprite(short spritenum, int newx, int newy, int newz)
 	sprite[spritenum].x = newx;
 	sprite[spritenum].y = newy;
 	sprite[spritenum].z = newz;
+	updatespriteclip(spritenum);
 
 	short tempsectnum = sprite[spritenum].sectnum;
 
@@ -9561,6 +9974,7 @@ int setspritez(short spritenum, int newx, int newy, int newz)
 	sprite[spritenum].x = newx;
 	sprite[spritenum].y = newy;
 	sprite[spritenum].z = newz;
+	updatespriteclip(spritenum);
 
 	short tempsectnum = sprite[spritenum].sectnum;
 
@@ -9667,55 +10081,44 @@ int nextsectorneighborz(short sectnum, int thez, short topbottom, short directio
 
 	short sectortouse{ -1 };
 
-	std::ranges::subrange wallrange{&wall[g_sector[sectnum].wallptr],
-								    &wall[g_sector[sectnum].wallptr + g_sector[sectnum].wallnum]};
+	const auto consider = [&](short nextsect) {
+		const int testz = (topbottom == 1) ? g_sector[nextsect].floorz : g_sector[nextsect].ceilingz;
 
-	for(const auto& wal : wallrange)
-	{
-		if (wal.nextsector >= 0)
+		if (direction == 1)
 		{
-			if (topbottom == 1)
+			if ((testz > thez) && (testz < nextz))
 			{
-				const int testz = g_sector[wal.nextsector].floorz;
-
-				if (direction == 1)
-				{
-					if ((testz > thez) && (testz < nextz))
-					{
-						nextz = testz;
-						sectortouse = wal.nextsector;
-					}
-				}
-				else
-				{
-					if ((testz < thez) && (testz > nextz))
-					{
-						nextz = testz;
-						sectortouse = wal.nextsector;
-					}
-				}
+				nextz = testz;
+				sectortouse = nextsect;
 			}
-			else
+		}
+		else
+		{
+			if ((testz < thez) && (testz > nextz))
 			{
-				const int testz = g_sector[wal.nextsector].ceilingz;
-				if (direction == 1)
-				{
-					if ((testz > thez) && (testz < nextz))
-					{
-						nextz = testz;
-						sectortouse = wal.nextsector;
-					}
-				}
-				else
-				{
-					if ((testz < thez) && (testz > nextz))
-					{
-						nextz = testz;
-						sectortouse = wal.nextsector;
-					}
-				}
+				nextz = testz;
+				sectortouse = nextsect;
 			}
 		}
+	};
+
+	const auto& topo = maptopology();
+
+	if (topo.current(sectnum)) {
+		for (const auto& link : topo.neighbours(sectnum)) {
+			consider(link.sectnum);
+		}
+		return sectortouse;
+	}
+
+	std::ranges::subrange wallrange{&wall[g_sector[sectnum].wallptr],
+								    &wall[g_sector[sectnum].wallptr + g_sector[sectnum].wallnum]};
+
+	for(const auto& wal : wallrange)
+	{
+		if (wal.nextsector >= 0) {
+			consider(wal.nextsector);
+		}
 	}
 
 	return sectortouse;
@@ -9725,11 +10128,16 @@ int nextsectorneighborz(short sectnum, int thez, short topbottom, short directio
 //
 // cansee
 //
-bool cansee(int x1, int y1, int z1, short sect1, int x2, int y2, int z2, short sect2)
+bool cansee(clipcontext& ctx, int x1, int y1, int z1, short sect1, int x2, int y2, int z2, short sect2)
 {
+	auto& clipsectorlist = ctx.clipsectorlist;
+
 	if ((x1 == x2) && (y1 == y2)) {
 		return sect1 == sect2;
 	}
+	if (!pvsvisible(sect1, sect2)) {
+		return false;
+	}
 
 	const int x21 = x2 - x1;
 	const int y21 = y2 - y1;
@@ -9813,10 +10221,12 @@ bool cansee(int x1, int y1, int z1, short sect1, int x2, int y2, int z2, short s
 //
 // hitscan
 //
-int hitscan(int xs, int ys, int zs, short sectnum, int vx, int vy, int vz,
+int hitscan(clipcontext& ctx, int xs, int ys, int zs, short sectnum, int vx, int vy, int vz,
 	short *hitsect, short *hitwall, short *hitsprite,
 	int *hitx, int *hity, int *hitz, unsigned int cliptype)
 {
+	auto& clipsectorlist = ctx.clipsectorlist;
+
 	static constexpr int hitscangoalx = (1 << 29) - 1;
 	static constexpr int hitscangoaly = (1 << 29) - 1;
 
@@ -10229,13 +10639,94 @@ int hitscan(int xs, int ys, int zs, short sectnum, int vx, int vy, int vz,
 	return 0;
 }
 
+bool cansee(int x1, int y1, int z1, short sect1, int x2, int y2, int z2, short sect2)
+{
+	return cansee(defaultclipcontext, x1, y1, z1, sect1, x2, y2, z2, sect2);
+}
+
+int hitscan(int xs, int ys, int zs, short sectnum, int vx, int vy, int vz,
+	short *hitsect, short *hitwall, short *hitsprite,
+	int *hitx, int *hity, int *hitz, unsigned int cliptype)
+{
+	return hitscan(defaultclipcontext, xs, ys, zs, sectnum, vx, vy, vz,
+		hitsect, hitwall, hitsprite, hitx, hity, hitz, cliptype);
+}
+
+
+//
+// canseebatch / hitscanbatch
+//
+void canseebatch(std::span<const canseequery> queries, std::span<bool> results, int numthreads)
+{
+	parallelfor((int)queries.size(), 16, numthreads, [queries, results](int begin, int end) {
+		auto ctx = std::make_unique<clipcontext>();
+
+		for (int i{begin}; i < end; ++i) {
+			const auto& q = queries[i];
+			results[i] = cansee(*ctx, q.x1, q.y1, q.z1, q.sect1, q.x2, q.y2, q.z2, q.sect2);
+		}
+	});
+}
+
+void hitscanbatch(std::span<const hitscanquery> queries, std::span<hitscanresult> results, int numthreads)
+{
+	parallelfor((int)queries.size(), 4, numthreads, [queries, results](int begin, int end) {
+		auto ctx = std::make_unique<clipcontext>();
+
+		for (int i{begin}; i < end; ++i) {
+			const auto& q = queries[i];
+			auto& r = results[i];
+
+			r = {};
+			hitscan(*ctx, q.xs, q.ys, q.zs, q.sectnum, q.vx, q.vy, q.vz,
+				&r.hitsect, &r.hitwall, &r.hitsprite, &r.hitx, &r.hity, &r.hitz, q.cliptype);
+		}
+	});
+}
+
+void clipmovebatch(std::span<const clipmovequery> queries, std::span<clipmoveresult> results, int numthreads)
+{
+	parallelfor((int)queries.size(), 8, numthreads, [queries, results](int begin, int end) {
+		auto ctx = std::make_unique<clipcontext>();
+
+		for (int i{begin}; i < end; ++i) {
+			const auto& q = queries[i];
+			auto& r = results[i];
+
+			r.x = q.x;
+			r.y = q.y;
+			r.sectnum = q.sectnum;
+			r.retval = clipmove(*ctx, &r.x, &r.y, &q.z, &r.sectnum, q.xvect, q.yvect,
+				q.walldist, q.ceildist, q.flordist, q.cliptype);
+		}
+	});
+}
+
+void getzrangebatch(std::span<const getzrangequery> queries, std::span<getzrangeresult> results, int numthreads)
+{
+	parallelfor((int)queries.size(), 8, numthreads, [queries, results](int begin, int end) {
+		auto ctx = std::make_unique<clipcontext>();
+
+		for (int i{begin}; i < end; ++i) {
+			const auto& q = queries[i];
+			auto& r = results[i];
+
+			ctx->nonblocking = q.nonblocking;
+			getzrange(*ctx, q.x, q.y, q.z, q.sectnum, &r.ceilz, &r.ceilhit, &r.florz, &r.florhit,
+				q.walldist, q.cliptype);
+		}
+	});
+}
+
 
 //
 // neartag
 //
-int neartag(int xs, int ys, int zs, short sectnum, short ange, short *neartagsector, short *neartagwall,
+int neartag(clipcontext& ctx, int xs, int ys, int zs, short sectnum, short ange, short *neartagsector, short *neartagwall,
 	short *neartagsprite, int *neartaghitdist, int neartagrange, unsigned char tagsearch)
 {
+	auto& clipsectorlist = ctx.clipsectorlist;
+
 	walltype* wal;
 	walltype* wal2;
 	spritetype* spr;
@@ -10406,6 +10897,13 @@ int neartag(int xs, int ys, int zs, short sectnum, short ange, short *neartagsec
 	return 0;
 }
 
+int neartag(int xs, int ys, int zs, short sectnum, short ange, short *neartagsector, short *neartagwall,
+	short *neartagsprite, int *neartaghitdist, int neartagrange, unsigned char tagsearch)
+{
+	return neartag(defaultclipcontext, xs, ys, zs, sectnum, ange, neartagsector, neartagwall,
+		neartagsprite, neartaghitdist, neartagrange, tagsearch);
+}
+
 
 //
 // dragpoint
@@ -10414,6 +10912,7 @@ void dragpoint(short pt_highlight, int dax, int day)
 {
 	wall[pt_highlight].pt.x = dax;
 	wall[pt_highlight].pt.y = day;
+	updatesectorindex(sectorofwall(pt_highlight));
 
 	short cnt{MAXWALLS};
 	short tempshort{pt_highlight};    //search points CCW
@@ -10425,6 +10924,7 @@ void dragpoint(short pt_highlight, int dax, int day)
 			tempshort = wall[wall[tempshort].nextwall].point2;
 			wall[tempshort].pt.x = dax;
 			wall[tempshort].pt.y = day;
+			updatesectorindex(sectorofwall(tempshort));
 		}
 		else
 		{
@@ -10436,6 +10936,7 @@ void dragpoint(short pt_highlight, int dax, int day)
 					tempshort = wall[lastwall(tempshort)].nextwall;
 					wall[tempshort].pt.x = dax;
 					wall[tempshort].pt.y = day;
+					updatesectorindex(sectorofwall(tempshort));
 				}
 				else
 				{
@@ -10460,6 +10961,13 @@ int lastwall(short point)
 	if ((point > 0) && (wall[point - 1].point2 == point))
 		return point - 1;
 
+	if ((point >= 0) && (point < numwalls)) {
+		const int prev = maptopology().prevwall[point];
+
+		if ((prev >= 0) && (wall[prev].point2 == point))
+			return prev;
+	}
+
 	int i{point};
 
 	int cnt{MAXWALLS};
@@ -10492,13 +11000,62 @@ int lastwall(short point)
 
 int clipmoveboxtracenum = 3;
 
+namespace {
+
+//
+// Walks the sprites of each sector clipmove() and getzrange() reach, from the
+// sector lists or, with clipbroadphase on, from the sprites the clipping grid
+// finds near the query box
+//
+struct clipspritewalk {
+	bool usegrid;
+	std::span<const short> gathered;
+	std::span<const short> sprites;
+	int pos{0};
+
+	clipspritewalk(int xmin, int ymin, int xmax, int ymax)
+		: usegrid{clipbroadphase != 0}
+	{
+		if (usegrid) {
+			gathered = clipgridgather(xmin, ymin, xmax, ymax);
+		}
+	}
+
+	int first(short sectnum)
+	{
+		if (!usegrid) {
+			return headspritesect[sectnum];
+		}
+		sprites = clipgridsector(gathered, sectnum);
+		pos = 0;
+		return sprites.empty() ? -1 : sprites[0];
+	}
+
+	int next(int spritenum)
+	{
+		if (!usegrid) {
+			return nextspritesect[spritenum];
+		}
+		return (++pos < (int)sprites.size()) ? sprites[pos] : -1;
+	}
+};
+
+} // namespace
+
 //
 // clipmove
 //
-int clipmove (int *x, int *y, const int *z, short *sectnum,
+int clipmove (clipcontext& ctx, int *x, int *y, const int *z, short *sectnum,
 		 int xvect, int yvect,
 		 int walldist, int ceildist, int flordist, unsigned int cliptype)
 {
+	auto& clipit = ctx.clipit;
+	auto& clipobjectval = ctx.clipobjectval;
+	auto& clipnum = ctx.clipnum;
+	auto& clipsectorlist = ctx.clipsectorlist;
+	auto& clipsectnum = ctx.clipsectnum;
+	auto& hitwalls = ctx.hitwalls;
+
 	if (((xvect | yvect) == 0) || (*sectnum < 0)) {
 		return 0;
 	}
@@ -10527,6 +11084,12 @@ int clipmove (int *x, int *y, const int *z, short *sectnum,
 	const int dawalclipmask = cliptype & 65535;        //CLIPMASK0 = 0x00010001
 	const int dasprclipmask = cliptype >> 16;          //CLIPMASK1 = 0x01000040
 
+		//A sprite's clip lines can only be hit if they come within reach of the
+		//path traced below, which never strays further from the start than the
+		//move itself plus what keepaway() adds
+	const int reach = static_cast<int>(std::hypot(gx, gy)) + walldist + 32;
+	clipspritewalk walk(*x - reach, *y - reach, *x + reach, *y + reach);
+
 	clipsectorlist[0] = (*sectnum);
 
 	int clipsectcnt{0};
@@ -10634,7 +11197,7 @@ int clipmove (int *x, int *y, const int *z, short *sectnum,
 			}
 		}
 
-		for(int j = headspritesect[dasect]; j >= 0; j = nextspritesect[j])
+		for(int j = walk.first((short)dasect); j >= 0; j = walk.next(j))
 		{
 			auto* spr = &sprite[j];
 			const short cstat = spr->cstat;
@@ -10760,6 +11323,8 @@ int clipmove (int *x, int *y, const int *z, short *sectnum,
 
 						int dax = ((xspan>>1)+xoff) * xrepeat;
 						int day = ((yspan>>1)+yoff)*yrepeat;
+						std::array<int, 4> rxi;
+						std::array<int, 4> ryi;
 						rxi[0] = x1 + dmulscalen<16>(sinang,dax,cosang,day);
 						ryi[0] = y1 + dmulscalen<16>(sinang,day,-cosang,dax);
 						l = xspan*xrepeat;
@@ -10813,7 +11378,7 @@ int clipmove (int *x, int *y, const int *z, short *sectnum,
 		int intx{goalx};
 		int inty{goaly};
 
-		if ((hitwall = raytrace(*x, *y, &intx, &inty)) >= 0)
+		if ((hitwall = raytrace(ctx, *x, *y, &intx, &inty)) >= 0)
 		{
 			const int lx = clipit[hitwall].x2-clipit[hitwall].x1;
 			const int ly = clipit[hitwall].y2-clipit[hitwall].y1;
@@ -10844,7 +11409,7 @@ int clipmove (int *x, int *y, const int *z, short *sectnum,
 				}
 			}
 
-			keepaway(&goalx, &goaly, hitwall);
+			keepaway(ctx, &goalx, &goaly, hitwall);
 			xvect = ((goalx-intx)<<14);
 			yvect = ((goaly-inty)<<14);
 
@@ -10909,13 +11474,23 @@ int clipmove (int *x, int *y, const int *z, short *sectnum,
 	return retval;
 }
 
+int clipmove (int *x, int *y, const int *z, short *sectnum,
+		 int xvect, int yvect,
+		 int walldist, int ceildist, int flordist, unsigned int cliptype)
+{
+	return clipmove(defaultclipcontext, x, y, z, sectnum, xvect, yvect, walldist, ceildist, flordist, cliptype);
+}
+
 
 //
 // pushmove
 //
-int pushmove (int *x, int *y, const int *z, short *sectnum,
+int pushmove (clipcontext& ctx, int *x, int *y, const int *z, short *sectnum,
 		 int walldist, int ceildist, int flordist, unsigned int cliptype)
 {
+	auto& clipsectorlist = ctx.clipsectorlist;
+	auto& clipsectnum = ctx.clipsectnum;
+
 	if ((*sectnum) < 0)
 		return -1;
 
@@ -11076,6 +11651,12 @@ int pushmove (int *x, int *y, const int *z, short *sectnum,
 	return bad;
 }
 
+int pushmove (int *x, int *y, const int *z, short *sectnum,
+		 int walldist, int ceildist, int flordist, unsigned int cliptype)
+{
+	return pushmove(defaultclipcontext, x, y, z, sectnum, walldist, ceildist, flordist, cliptype);
+}
+
 
 //
 // updatesector[z]
@@ -11088,24 +11669,36 @@ void updatesector(int x, int y, short *sectnum)
 
 	if ((*sectnum >= 0) && (*sectnum < numsectors))
 	{
-		std::ranges::subrange wallrange{&wall[g_sector[*sectnum].wallptr],
-		                                &wall[g_sector[*sectnum].wallptr + g_sector[*sectnum].wallnum]};
+		const auto& topo = maptopology();
 
-		for(const auto& wal : wallrange)
-		{
-			const int i = wal.nextsector;
-			
-			if (i >= 0)
-				if (inside(x,y,(short)i) == 1)
-				{
-					*sectnum = i;
+		if (topo.current(*sectnum)) {
+			for (const auto& link : topo.neighbours(*sectnum)) {
+				if (inside(x, y, link.sectnum) == 1) {
+					*sectnum = link.sectnum;
 					return;
 				}
+			}
+		}
+		else {
+			std::ranges::subrange wallrange{&wall[g_sector[*sectnum].wallptr],
+			                                &wall[g_sector[*sectnum].wallptr + g_sector[*sectnum].wallnum]};
+
+			for(const auto& wal : wallrange)
+			{
+				const int i = wal.nextsector;
+				
+				if (i >= 0)
+					if (inside(x,y,(short)i) == 1)
+					{
+						*sectnum = i;
+						return;
+					}
+			}
 		}
 	}
 
-	for(int i = numsectors - 1; i >= 0; --i) {
-		if (inside(x, y, (short)i) == 1) {
+	for(const short i : sectindexcandidates(x, y)) {
+		if (inside(x, y, i) == 1) {
 			*sectnum = i;
 			return;
 		}
@@ -11124,29 +11717,41 @@ void updatesectorz(int x, int y, int z, short *sectnum)
 
 	if ((*sectnum >= 0) && (*sectnum < numsectors))
 	{
-		std::ranges::subrange wallrange{&wall[g_sector[*sectnum].wallptr],
-		                                &wall[g_sector[*sectnum].wallptr + g_sector[*sectnum].wallnum]};
+		const auto tryneighbour = [x, y, z, sectnum](short i) {
+			auto cfz = getzsofslope(i, x, y);
+			if ((z >= cfz.ceilz) && (z <= cfz.floorz))
+				if (inside(x,y,i) == 1)
+					{ *sectnum = i; return true; }
+			return false;
+		};
+		const auto& topo = maptopology();
 
-		for(const auto& wal : wallrange)
-		{
-			const int i = wal.nextsector;
+		if (topo.current(*sectnum)) {
+			for (const auto& link : topo.neighbours(*sectnum)) {
+				if (tryneighbour(link.sectnum)) {
+					return;
+				}
+			}
+		}
+		else {
+			std::ranges::subrange wallrange{&wall[g_sector[*sectnum].wallptr],
+			                                &wall[g_sector[*sectnum].wallptr + g_sector[*sectnum].wallnum]};
 
-			if (i >= 0)
+			for(const auto& wal : wallrange)
 			{
-				auto cfz = getzsofslope(i, x, y);
-				if ((z >= cfz.ceilz) && (z <= cfz.floorz))
-					if (inside(x,y,(short)i) == 1)
-						{ *sectnum = i; return; }
+				if ((wal.nextsector >= 0) && tryneighbour(wal.nextsector)) {
+					return;
+				}
 			}
 		}
 	}
 
-	for (int i = numsectors - 1; i >= 0; --i)
+	for (const short i : sectindexcandidates(x, y))
 	{
 		auto cfz = getzsofslope(i, x, y);
 
 		if ((z >= cfz.ceilz) && (z <= cfz.floorz)) {
-			if (inside(x, y, (short)i) == 1) {
+			if (inside(x, y, i) == 1) {
 				*sectnum = i;
 				return;
 			}
@@ -11196,10 +11801,13 @@ int krand()
 //
 // getzrange
 //
-void getzrange(int x, int y, int z, short sectnum,
+void getzrange(clipcontext& ctx, int x, int y, int z, short sectnum,
 		 int *ceilz, int *ceilhit, int *florz, int *florhit,
 		 int walldist, unsigned int cliptype)
 {
+	auto& clipsectorlist = ctx.clipsectorlist;
+	auto& clipsectnum = ctx.clipsectnum;
+
 	if (sectnum < 0)
 	{
 		*ceilz = 0x80000000;
@@ -11344,12 +11952,14 @@ void getzrange(int x, int y, int z, short sectnum,
 		clipsectcnt++;
 	} while (clipsectcnt < clipsectnum);
 
+	clipspritewalk walk(x - walldist - 6, y - walldist - 6, x + walldist + 6, y + walldist + 6);
+
 	for(short cnum{0}; cnum < clipsectnum; ++cnum)
 	{
-		for(short j = headspritesect[clipsectorlist[cnum]]; j >= 0; j = nextspritesect[j])
+		for(short j = walk.first(clipsectorlist[cnum]); j >= 0; j = walk.next(j))
 		{
 			auto* spr = &sprite[j];
-			const short cstat = spr->cstat;
+			const short cstat = (j == ctx.nonblocking) ? (short)(spr->cstat & ~1) : spr->cstat;
 			
 			if (cstat & dasprclipmask)
 			{
@@ -11507,6 +12117,13 @@ void getzrange(int x, int y, int z, short sectnum,
 	}
 }
 
+void getzrange(int x, int y, int z, short sectnum,
+		 int *ceilz, int *ceilhit, int *florz, int *florhit,
+		 int walldist, unsigned int cliptype)
+{
+	getzrange(defaultclipcontext, x, y, z, sectnum, ceilz, ceilhit, florz, florhit, walldist, cliptype);
+}
+
 
 //
 // setview
@@ -12192,6 +12809,12 @@ int sectorofwall(short theline)
 	if (i >= 0)
 		return wall[i].nextsector;
 
+	const auto& topo = maptopology();
+	i = topo.wallsect[theline];
+
+	if (topo.current(i) && (g_sector[i].wallptr <= theline) && (theline < g_sector[i].wallptr + g_sector[i].wallnum))
+		return i;
+
 	int gap = (numsectors >> 1);
 	i = gap;
 
@@ -12354,6 +12977,11 @@ int loopnumofsector(short sectnum, short wallnum)
 	int numloops{0};
 	const int startwall = g_sector[sectnum].wallptr;
 	const int endwall = startwall + g_sector[sectnum].wallnum;
+	const auto& topo = maptopology();
+
+	if (topo.current(sectnum)) {
+		return ((wallnum >= startwall) && (wallnum < endwall)) ? topo.wallloop[wallnum] : -1;
+	}
 
 	for(int i{startwall}; i < endwall; i++)
 	{
@@ -12447,6 +13075,8 @@ void setfirstwall(short sectnum, short newfirstwall)
 		if (wall[i].nextwall >= 0)
 			wall[wall[i].nextwall].nextwall = i;
 	}
+
+	updatetopology();
 }
 
 
@@ -4,13 +4,11 @@
 #include <array>
 #include <span>
 
-inline constexpr auto MAXCLIPNUM{1024};
 inline constexpr auto MAXPERMS{1024};
 inline constexpr auto MAXTILEFILES{256};
 inline constexpr auto MAXYSAVES = ((MAXXDIM * MAXSPRITES) >> 7);
 inline constexpr auto MAXNODESPERLINE{42};   //WARNING: This depends on MAXYSAVES & MAXYDIM!
 inline constexpr auto MAXWALLSB{4096};
-inline constexpr auto MAXCLIPDIST{1024};
 inline int startposx{0};
 inline int startposy{0};
 inline int startposz{0};
@@ -72,6 +70,7 @@ extern "C" short searchwall;
 inline short searchstat{-1};
 
 inline bool inpreparemirror{false};
+inline short pvsviewsect{-1};		// sector whose visible set culls this view's scan, or -1
 
 inline int curbrightness{0};
 inline bool gammabrightness{false};
@@ -114,6 +113,7 @@ inline std::array<palette_t, MAXPALOOKUPS> palookupfog{};
 int wallmost(std::span<short> mostbuf, int w, int sectnum, unsigned char dastat);
 int wallfront(int l1, int l2);
 int animateoffs(short tilenum, short fakevar);
+void masksortbench(int sprites);	// times drawmasks()'s depth sort and masked wall interleaving against the old loops
 
 
 #if defined(__WATCOMC__) && USE_ASM
@@ -0,0 +1,665 @@
+#include "build.hpp"
+
+#if USE_POLYMOST && USE_OPENGL
+
+#include "mdcache.hpp"
+#include "baselayer.hpp"
+#include "cache1d.hpp"
+#include "crc32.hpp"
+#include "glbuild.hpp"
+#include "polymost_priv.hpp"
+#include "hightile_priv.hpp"
+#include "polymosttex_priv.hpp"
+#include "mdsprite_priv.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <utility>
+#include <vector>
+
+/*
+ Model cache file format
+
+ Parsing a model file, and above all converting a voxel model to polygons,
+ takes far longer than reading the result back, so loaded models are kept in
+ a cache file between runs. Each entry holds a model the way the engine
+ keeps it in memory: MD2 and MD3 frames already decoded to the float arrays
+ the frame blender reads, voxel models already meshed. Loading one is a
+ check of the key followed by straight copies.
+
+ Entries are keyed by the name of the source file along with its length,
+ modification time and CRC-32, and are only ever appended. Length and time
+ settle whether a file on disk has changed, so for those only the first
+ MDCACHECRCLEN bytes go into the CRC, and a warm cache costs one short read.
+ Files inside groups have no time of their own and are CRCed whole. A newer entry for
+ the same file supersedes any older one.
+
+ STORAGE (model.cache):
+   signature  "BuildModelCache"
+   version    CACHEVER
+   ENTRIES...
+     kind      int32		MDCACHE_VOX/MD2/MD3
+     filename  char[MDCACHEFILENAMELEN]
+     length    int32		Length of the source file
+     mtime     int64		Modification time of the source file, 0 if in a group
+     crc       uint32		CRC-32 of the source file, or its first MDCACHECRCLEN bytes if on disk
+     datalen   int32		Length of the data that follows
+     data      char[datalen]
+
+ VOX data:
+     xsiz ysiz zsiz     int32
+     xpiv ypiv zpiv     float
+     is8bit             int32
+     qcnt               int32
+     qfacind            int32[7]
+     mytexx mytexy      int32
+     quads              voxrect_t[qcnt]
+     skin               int32[mytexx * mytexy]
+
+ MD2 data:
+     numskins numframes numverts numuv numtris framebytes skinxsiz skinysiz  int32
+     frames             char[numframes * framebytes]
+     uvs                md2uv_t[numuv]
+     tris               md2tri_t[numtris]
+     skin names         char[numskins * 64]
+     decoded frames     DECODED
+
+ MD3 data:
+     id vers flags numframes numtags numsurfs numskins eof  int32
+     nam                char[64]
+     frames             md3frame_t[numframes]
+     tags               md3tag_t[numtags]
+     SURFACES[numsurfs]
+       id flags numframes numshaders numverts numtris ofsend  int32
+       nam              char[64]
+       tris             md3tri_t[numtris]
+       shaders          md3shader_t[numshaders]
+       uvs              md3uv_t[numverts]
+       xyzn             md3xyzn_t[numframes * numverts]
+       decoded frames   DECODED
+
+ DECODED:
+     stride             int32
+     xyz                float[numframes * 3 * stride]
+
+ Values are stored in the machine's own byte order.
+ */
+
+namespace {
+
+constexpr auto MDCACHEFILENAMELEN{260};
+constexpr int CACHEVER{ 2 };
+constexpr int MDCACHECRCLEN{65536};
+constexpr std::array<int8_t, 16> cachesig = { 'B','u','i','l','d','M','o','d','e','l','C','a','c','h','e',CACHEVER };
+
+constexpr char CACHEFILE[] = "model.cache";
+
+enum {
+	MDCACHE_VOX = 1,
+	MDCACHE_MD2 = 2,
+	MDCACHE_MD3 = 3,
+};
+
+struct MDCacheIndex {
+	MDCacheKey key;
+	long offset;	// of the data
+	int datalen;
+};
+
+std::map<std::pair<int, std::string>, MDCacheIndex> cacheindex;
+
+bool cachedisabled{false};
+bool cachereplace{false};
+bool cachesuspended{false};
+
+struct {
+	int hits;
+	int misses;
+	int stores;
+	std::size_t hitbytes;
+} cachestats;
+
+/**
+ * Reads the data of an entry, if the cache has a current one
+ */
+bool mdcache_read(int kind, const std::string& filename, const MDCacheKey& key, std::vector<char>& data)
+{
+	if (cachedisabled || cachereplace || cachesuspended) {
+		return false;
+	}
+
+	const auto it = cacheindex.find({ kind, filename });
+
+	if (it == cacheindex.end() || it->second.key.length != key.length ||
+		it->second.key.mtime != key.mtime || it->second.key.crc != key.crc) {
+		cachestats.misses++;
+		return false;
+	}
+
+	std::FILE* fh = std::fopen(CACHEFILE, "rb");
+
+	if (!fh) {
+		cachedisabled = true;
+		buildprintf("MDCache: error opening {}, model cache disabled\n", CACHEFILE);
+		return false;
+	}
+
+	data.resize(it->second.datalen);
+
+	const bool ok = std::fseek(fh, it->second.offset, SEEK_SET) == 0 &&
+		(data.empty() || std::fread(data.data(), data.size(), 1, fh) == 1);
+
+	std::fclose(fh);
+
+	if (!ok) {
+		buildprintf("MDCache: corrupt model cache detected, cache will be replaced\n");
+		cachereplace = true;
+		return false;
+	}
+
+	cachestats.hits++;
+	cachestats.hitbytes += data.size();
+
+	return true;
+}
+
+/**
+ * Appends an entry to the cache, starting the file afresh if needed
+ */
+void mdcache_write(int kind, const std::string& filename, const MDCacheKey& key, const std::vector<char>& data)
+{
+	if (cachedisabled || cachesuspended || filename.size() >= MDCACHEFILENAMELEN) {
+		return;
+	}
+
+	std::FILE* fh{nullptr};
+
+	if (!cachereplace) {
+		fh = std::fopen(CACHEFILE, "r+b");
+	}
+
+	if (!fh) {
+		fh = std::fopen(CACHEFILE, "w+b");
+		if (!fh) {
+			buildprintf("MDCache: error creating {}, model cache disabled\n", CACHEFILE);
+			cachedisabled = true;
+			return;
+		}
+		if (std::fwrite(&cachesig[0], 16, 1, fh) != 1) {
+			goto fail;
+		}
+		cacheindex.clear();
+		cachereplace = false;
+	}
+
+	{
+		std::array<char, MDCACHEFILENAMELEN> name{};
+		const int32_t kind32 = kind;
+		const int32_t length = key.length;
+		const int64_t mtime = key.mtime;
+		const uint32_t crc = key.crc;
+		const int32_t datalen = (int32_t)data.size();
+
+		std::memcpy(&name[0], filename.c_str(), filename.size());
+
+		if (std::fseek(fh, 0, SEEK_END) != 0 ||
+			std::fwrite(&kind32, 4, 1, fh) != 1 ||
+			std::fwrite(&name[0], MDCACHEFILENAMELEN, 1, fh) != 1 ||
+			std::fwrite(&length, 4, 1, fh) != 1 ||
+			std::fwrite(&mtime, 8, 1, fh) != 1 ||
+			std::fwrite(&crc, 4, 1, fh) != 1 ||
+			std::fwrite(&datalen, 4, 1, fh) != 1) {
+			goto fail;
+		}
+
+		const long offset = std::ftell(fh);
+
+		if (!data.empty() && std::fwrite(data.data(), data.size(), 1, fh) != 1) {
+			goto fail;
+		}
+
+		cacheindex[{ kind, filename }] = { key, offset, datalen };
+		cachestats.stores++;
+	}
+
+	std::fclose(fh);
+	return;
+
+fail:
+	buildprintf("MDCache: error writing to {}, model cache disabled\n", CACHEFILE);
+	std::fclose(fh);
+	cachedisabled = true;
+}
+
+	//Reads values back in the order MDCacheWriter wrote them
+class MDCacheReader {
+public:
+	explicit MDCacheReader(const std::vector<char>& data) : data_(data) { }
+
+	template <typename T>
+	bool get(T* out, std::size_t count = 1)
+	{
+		const std::size_t len = sizeof(T) * count;
+
+		if (count > (data_.size() - pos_) / sizeof(T)) {
+			return false;
+		}
+		if (len) {
+			std::memcpy(out, &data_[pos_], len);
+		}
+		pos_ += len;
+		return true;
+	}
+
+		//reads a count, which mustn't be negative
+	bool getcount(int* out)
+	{
+		return get(out) && *out >= 0;
+	}
+
+	bool atend() const { return pos_ == data_.size(); }
+
+private:
+	const std::vector<char>& data_;
+	std::size_t pos_{0};
+};
+
+class MDCacheWriter {
+public:
+	template <typename T>
+	void put(const T* in, std::size_t count = 1)
+	{
+		const auto* p = reinterpret_cast<const char*>(in);
+		data.insert(data.end(), p, p + sizeof(T) * count);
+	}
+
+	std::vector<char> data;
+};
+
+void mdcache_putsoa(MDCacheWriter& wr, const mdframesoa& soa)
+{
+	wr.put(&soa.stride);
+	wr.put(soa.xyz, (std::size_t)soa.numframes * 3 * soa.stride);
+}
+
+bool mdcache_getsoa(MDCacheReader& rd, mdframesoa *soa, int numframes, int numverts)
+{
+	int stride;
+
+	if (!rd.get(&stride) || !mdsoaalloc(soa, numframes, numverts)) {
+		return false;
+	}
+	if (stride != soa->stride || !rd.get(soa->xyz, (std::size_t)numframes * 3 * stride)) {
+		mdsoafree(soa);
+		return false;
+	}
+	return true;
+}
+
+	//Copies a fixed-size name field into a string
+std::string mdcache_name(const std::array<char, 64>& nam)
+{
+	return { &nam[0], strnlen(&nam[0], nam.size()) };
+}
+
+} // namespace
+
+void MDCacheLoadIndex()
+{
+	std::array<char, MDCACHEFILENAMELEN> filename{};
+	std::array<int8_t, 16> sig;
+	int32_t kind;
+	MDCacheKey key;
+	int32_t datalen;
+
+	int total{0};
+	int dups{0};
+
+	cacheindex.clear();
+	cachereplace = false;
+	cachestats = {};
+
+	std::FILE* fh = std::fopen(CACHEFILE, "rb");
+
+	if (!fh) {
+		if (errno != ENOENT) {
+			buildprintf("MDCache: error opening {}, model cache disabled\n", CACHEFILE);
+			cachedisabled = true;
+		}
+		return;
+	}
+
+	if (std::fread(&sig[0], 16, 1, fh) != 1 || std::memcmp(&sig[0], &cachesig[0], 16)) {
+		buildprintf("MDCache: model cache will be replaced\n");
+		cachereplace = true;
+		std::fclose(fh);
+		return;
+	}
+
+	while (std::fread(&kind, 4, 1, fh) == 1) {
+		if (std::fread(&filename[0], MDCACHEFILENAMELEN, 1, fh) != 1 ||
+		    std::fread(&key.length, 4, 1, fh) != 1 ||
+		    std::fread(&key.mtime, 8, 1, fh) != 1 ||
+		    std::fread(&key.crc, 4, 1, fh) != 1 ||
+		    std::fread(&datalen, 4, 1, fh) != 1 ||
+		    datalen < 0 ||
+		    std::fseek(fh, datalen, SEEK_CUR) != 0) {
+			// truncated entry, so throw the whole cache away
+			buildprintf("MDCache: corrupt model cache detected, cache will be replaced\n");
+			cachereplace = true;
+			cacheindex.clear();
+			break;
+		}
+
+		filename[MDCACHEFILENAMELEN - 1] = 0;
+
+		auto [it, added] = cacheindex.insert_or_assign({ (int)kind, &filename[0] },
+			MDCacheIndex{ key, std::ftell(fh) - datalen, datalen });
+		if (!added) {
+			dups++;
+		}
+		total++;
+	}
+
+	std::fclose(fh);
+
+	buildprintf("MDCache: cache index loaded ({} entries, {} old entries skipped)\n", total, dups);
+}
+
+void MDCacheUnloadIndex()
+{
+	cacheindex.clear();
+}
+
+void MDCacheSuspend(bool suspend)
+{
+	cachesuspended = suspend;
+}
+
+bool MDCacheFileKey(int fil, const std::string& filename, MDCacheKey *key)
+{
+	if (cachedisabled || cachesuspended) {
+		return false;
+	}
+
+	std::vector<unsigned char> buf(MDCACHECRCLEN);
+	unsigned int crcvar;
+	int len;
+
+	key->length = kfilelength(fil);
+
+	// files inside groups have no time of their own, so they go by length and CRC
+	key->mtime = 0;
+
+	std::string where;
+	if (findfrompath(filename.c_str(), where) == 0) {
+		std::error_code ec;
+		const auto mtime = std::filesystem::last_write_time(where, ec);
+		if (!ec) {
+			key->mtime = mtime.time_since_epoch().count();
+		}
+	}
+
+	// with a time, the CRC only has to catch edits that kept the length and
+	// time, so the start of the file will do
+	crc32init(&crcvar);
+	klseek(fil, 0, SEEK_SET);
+	while ((len = kread(fil, buf.data(), (unsigned)buf.size())) > 0) {
+		crc32block(&crcvar, buf.data(), len);
+		if (key->mtime != 0) {
+			break;
+		}
+	}
+	key->crc = crc32finish(&crcvar);
+	klseek(fil, 0, SEEK_SET);
+
+	return true;
+}
+
+std::unique_ptr<voxmodel> MDCacheLoadVox(const std::string& filename, const MDCacheKey& key)
+{
+	std::vector<char> data;
+
+	if (!mdcache_read(MDCACHE_VOX, filename, key, data)) {
+		return nullptr;
+	}
+
+	auto vm = std::make_unique<voxmodel>();
+	MDCacheReader rd(data);
+
+	if (!rd.get(&vm->xsiz) || !rd.get(&vm->ysiz) || !rd.get(&vm->zsiz) ||
+		!rd.get(&vm->xpiv) || !rd.get(&vm->ypiv) || !rd.get(&vm->zpiv) ||
+		!rd.get(&vm->is8bit) || !rd.getcount(&vm->qcnt) ||
+		!rd.get(vm->qfacind.data(), vm->qfacind.size()) ||
+		!rd.getcount(&vm->mytexx) || !rd.getcount(&vm->mytexy)) {
+		return nullptr;
+	}
+
+	vm->quad.resize(vm->qcnt);
+	vm->mytex.resize((std::size_t)vm->mytexx * vm->mytexy);
+
+	if (!rd.get(vm->quad.data(), vm->quad.size()) ||
+		!rd.get(vm->mytex.data(), vm->mytex.size()) ||
+		!rd.atend()) {
+		return nullptr;
+	}
+
+	return vm;
+}
+
+void MDCacheStoreVox(const std::string& filename, const MDCacheKey& key, const voxmodel *vm)
+{
+	MDCacheWriter wr;
+
+	wr.put(&vm->xsiz);
+	wr.put(&vm->ysiz);
+	wr.put(&vm->zsiz);
+	wr.put(&vm->xpiv);
+	wr.put(&vm->ypiv);
+	wr.put(&vm->zpiv);
+	wr.put(&vm->is8bit);
+	wr.put(&vm->qcnt);
+	wr.put(vm->qfacind.data(), vm->qfacind.size());
+	wr.put(&vm->mytexx);
+	wr.put(&vm->mytexy);
+	wr.put(vm->quad.data(), vm->quad.size());
+	wr.put(vm->mytex.data(), vm->mytex.size());
+
+	mdcache_write(MDCACHE_VOX, filename, key, wr.data);
+}
+
+bool MDCacheLoadMD2(const std::string& filename, const MDCacheKey& key, md2model *m)
+{
+	std::vector<char> data;
+
+	if (!mdcache_read(MDCACHE_MD2, filename, key, data)) {
+		return false;
+	}
+
+	MDCacheReader rd(data);
+	md2model c{};
+
+	if (!rd.getcount(&c.numskins) || !rd.getcount(&c.numframes) || !rd.getcount(&c.numverts) ||
+		!rd.getcount(&c.numuv) || !rd.getcount(&c.numtris) || !rd.getcount(&c.framebytes) ||
+		!rd.get(&c.skinxsiz) || !rd.get(&c.skinysiz)) {
+		return false;
+	}
+
+	c.frames.resize((std::size_t)c.numframes * c.framebytes);
+	c.uvs.resize(c.numuv);
+	c.tris.resize(c.numtris);
+
+	std::vector<char> skinfn((std::size_t)c.numskins * 64);
+
+	if (!rd.get(c.frames.data(), c.frames.size()) ||
+		!rd.get(c.uvs.data(), c.uvs.size()) ||
+		!rd.get(c.tris.data(), c.tris.size()) ||
+		!rd.get(skinfn.data(), skinfn.size())) {
+		return false;
+	}
+
+	c.skinfn = (char *)std::calloc(c.numskins, 64);
+	if (!c.skinfn) {
+		return false;
+	}
+	std::memcpy(c.skinfn, skinfn.data(), skinfn.size());
+
+	if (!mdcache_getsoa(rd, &c.soa, c.numframes, c.numverts) || !rd.atend()) {
+		std::free(c.skinfn);
+		mdsoafree(&c.soa);
+		return false;
+	}
+
+	m->numskins = c.numskins;
+	m->numframes = c.numframes;
+	m->numverts = c.numverts;
+	m->numuv = c.numuv;
+	m->numtris = c.numtris;
+	m->framebytes = c.framebytes;
+	m->skinxsiz = c.skinxsiz;
+	m->skinysiz = c.skinysiz;
+	m->frames = std::move(c.frames);
+	m->uvs = std::move(c.uvs);
+	m->tris = std::move(c.tris);
+	m->skinfn = c.skinfn;
+	m->soa = c.soa;
+
+	return true;
+}
+
+void MDCacheStoreMD2(const std::string& filename, const MDCacheKey& key, const md2model *m)
+{
+	MDCacheWriter wr;
+
+	wr.put(&m->numskins);
+	wr.put(&m->numframes);
+	wr.put(&m->numverts);
+	wr.put(&m->numuv);
+	wr.put(&m->numtris);
+	wr.put(&m->framebytes);
+	wr.put(&m->skinxsiz);
+	wr.put(&m->skinysiz);
+	wr.put(m->frames.data(), m->frames.size());
+	wr.put(m->uvs.data(), m->uvs.size());
+	wr.put(m->tris.data(), m->tris.size());
+	wr.put(m->skinfn, (std::size_t)m->numskins * 64);
+	mdcache_putsoa(wr, m->soa);
+
+	mdcache_write(MDCACHE_MD2, filename, key, wr.data);
+}
+
+bool MDCacheLoadMD3(const std::string& filename, const MDCacheKey& key, md3model *m)
+{
+	std::vector<char> data;
+
+	if (!mdcache_read(MDCACHE_MD3, filename, key, data)) {
+		return false;
+	}
+
+	MDCacheReader rd(data);
+	md3head_t head{};
+	std::array<char, 64> nam;
+
+	if (!rd.get(&head.id) || !rd.get(&head.vers) || !rd.get(&head.flags) ||
+		!rd.getcount(&head.numframes) || !rd.getcount(&head.numtags) ||
+		!rd.getcount(&head.numsurfs) || !rd.get(&head.numskins) || !rd.get(&head.eof) ||
+		!rd.get(nam.data(), nam.size())) {
+		return false;
+	}
+
+	head.nam = mdcache_name(nam);
+	head.frames.resize(head.numframes);
+	head.tags.resize(head.numtags);
+	head.surfs.resize(head.numsurfs);
+
+	bool ok = rd.get(head.frames.data(), head.frames.size()) &&
+		rd.get(head.tags.data(), head.tags.size());
+
+	for (auto& s : head.surfs) {
+		if (!ok) {
+			break;
+		}
+
+		ok = rd.get(&s.id) && rd.get(&s.flags) && rd.getcount(&s.numframes) &&
+			rd.getcount(&s.numshaders) && rd.getcount(&s.numverts) && rd.getcount(&s.numtris) &&
+			rd.get(&s.ofsend) && rd.get(nam.data(), nam.size());
+		if (!ok) {
+			break;
+		}
+
+		s.nam = mdcache_name(nam);
+		md3surfalloc(&s);
+
+		ok = rd.get(s.tris.data(), s.numtris) &&
+			rd.get(s.shaders, s.numshaders) &&
+			rd.get(s.uv, s.numverts) &&
+			rd.get(s.xyzn, (std::size_t)s.numframes * s.numverts) &&
+			mdcache_getsoa(rd, &s.soa, s.numframes, s.numverts);
+	}
+
+	if (!ok || !rd.atend()) {
+		for (auto& s : head.surfs) {
+			mdsoafree(&s.soa);
+		}
+		return false;
+	}
+
+	m->numskins = head.numskins;
+	m->numframes = head.numframes;
+	m->head = std::move(head);
+
+	return true;
+}
+
+void MDCacheStoreMD3(const std::string& filename, const MDCacheKey& key, const md3model *m)
+{
+	MDCacheWriter wr;
+	std::array<char, 64> nam{};
+
+	wr.put(&m->head.id);
+	wr.put(&m->head.vers);
+	wr.put(&m->head.flags);
+	wr.put(&m->head.numframes);
+	wr.put(&m->head.numtags);
+	wr.put(&m->head.numsurfs);
+	wr.put(&m->head.numskins);
+	wr.put(&m->head.eof);
+	m->head.nam.copy(&nam[0], nam.size() - 1);
+	wr.put(nam.data(), nam.size());
+	wr.put(m->head.frames.data(), m->head.frames.size());
+	wr.put(m->head.tags.data(), m->head.tags.size());
+
+	for (const auto& s : m->head.surfs) {
+		wr.put(&s.id);
+		wr.put(&s.flags);
+		wr.put(&s.numframes);
+		wr.put(&s.numshaders);
+		wr.put(&s.numverts);
+		wr.put(&s.numtris);
+		wr.put(&s.ofsend);
+		nam.fill(0);
+		s.nam.copy(&nam[0], nam.size() - 1);
+		wr.put(nam.data(), nam.size());
+		wr.put(s.tris.data(), s.numtris);
+		wr.put(s.shaders, s.numshaders);
+		wr.put(s.uv, s.numverts);
+		wr.put(s.xyzn, (std::size_t)s.numframes * s.numverts);
+		mdcache_putsoa(wr, s.soa);
+	}
+
+	mdcache_write(MDCACHE_MD3, filename, key, wr.data);
+}
+
+void MDCachePrintStats()
+{
+	buildprintf("MDCache: {} entries in {}{}\n", cacheindex.size(), CACHEFILE,
+			   cachedisabled ? " (disabled)" : (cachereplace ? " (to be replaced)" : ""));
+	buildprintf("  {} models read ({} KB), {} not current, {} stored\n",
+			   cachestats.hits, cachestats.hitbytes / 1024, cachestats.misses, cachestats.stores);
+}
+
+#endif //USE_POLYMOST && USE_OPENGL
@@ -0,0 +1,107 @@
+#if (USE_POLYMOST == 0)
+#error Polymost not enabled.
+#endif
+#if (USE_OPENGL == 0)
+#error OpenGL not enabled.
+#endif
+
+#ifndef MDCACHE_H
+#define MDCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct md2model;
+struct md3model;
+struct voxmodel;
+
+/** what identifies the contents of a model file */
+struct MDCacheKey {
+	int length;
+	int64_t mtime;	// 0 if the file is inside a group
+	unsigned crc;	// of the whole file only if mtime is 0
+};
+
+/**
+ * Loads the model cache index into memory
+ */
+void MDCacheLoadIndex();
+
+/**
+ * Unloads the model cache index from memory
+ */
+void MDCacheUnloadIndex();
+
+/**
+ * Stops the cache being consulted or added to, so loading can be timed without it
+ * @param suspend true to stop, false to carry on
+ */
+void MDCacheSuspend(bool suspend);
+
+/**
+ * Works out what identifies the contents of a model file in the cache
+ * @param fil the file, opened with kopen4load; it is left at the start
+ * @param filename the name it was opened by
+ * @param key receives the length, modification time and CRC-32 of the file,
+ *            or of just its start when it has a modification time
+ * @return false if the cache is off or the file can't be read
+ */
+bool MDCacheFileKey(int fil, const std::string& filename, MDCacheKey *key);
+
+/**
+ * Loads the polygon mesh of a voxel model from the cache
+ * @param filename the voxel file
+ * @param key the key of the voxel file
+ * @return the mesh, or null if the cache has nothing current for the file
+ */
+std::unique_ptr<voxmodel> MDCacheLoadVox(const std::string& filename, const MDCacheKey& key);
+
+/**
+ * Stores the polygon mesh of a voxel model into the cache
+ * @param filename the voxel file
+ * @param key the key of the voxel file
+ * @param vm the mesh made by vox2poly
+ */
+void MDCacheStoreVox(const std::string& filename, const MDCacheKey& key, const voxmodel *vm);
+
+/**
+ * Loads the geometry, skin names and decoded frames of an MD2 model from the cache
+ * @param filename the model file
+ * @param key the key of the model file
+ * @param m the model to fill in
+ * @return false if the cache has nothing current for the file, with m left as it was
+ */
+bool MDCacheLoadMD2(const std::string& filename, const MDCacheKey& key, md2model *m);
+
+/**
+ * Stores an MD2 model into the cache
+ * @param filename the model file
+ * @param key the key of the model file
+ * @param m the model as md2load read it
+ */
+void MDCacheStoreMD2(const std::string& filename, const MDCacheKey& key, const md2model *m);
+
+/**
+ * Loads the frames, tags, surfaces and decoded frames of an MD3 model from the cache
+ * @param filename the model file
+ * @param key the key of the model file
+ * @param m the model to fill in
+ * @return false if the cache has nothing current for the file, with m left as it was
+ */
+bool MDCacheLoadMD3(const std::string& filename, const MDCacheKey& key, md3model *m);
+
+/**
+ * Stores an MD3 model into the cache
+ * @param filename the model file
+ * @param key the key of the model file
+ * @param m the model as md3load read it
+ */
+void MDCacheStoreMD3(const std::string& filename, const MDCacheKey& key, const md3model *m);
+
+/**
+ * Prints how many models came from the cache
+ */
+void MDCachePrintStats();
+
+#endif
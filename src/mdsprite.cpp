@@ -14,14 +14,27 @@
 #include "hightile_priv.hpp"
 #include "polymosttex_priv.hpp"
 #include "mdsprite_priv.hpp"
+#include "mdcache.hpp"
 #include "string_utils.hpp"
 #include "point.hpp"
+#include "workpool.hpp"
 
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cstdint>
 #include <memory>
+#include <new>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define MDSOA_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MDSOA_NEON
+#endif
+
 #if defined(_M_IX86) || defined(_M_AMD64) || defined(__i386) || defined(__x86_64)
 #define SHIFTMOD32(a) (a)
 #else
@@ -45,11 +58,8 @@ mdmodel **models = nullptr;
 namespace {
 
 int nummodelsalloced = 0;
-int maxmodelverts{0};
-int allocmodelverts{0};
 int maxelementvbo{0};
 int allocelementvbo{0};
-std::vector<point3d> vertlist; //temp array to store interpolated vertices for drawing
 struct polymostvboitem *elementvbo{nullptr};	 // 3 per triangle.
 
 } // namespace
@@ -57,6 +67,12 @@ struct polymostvboitem *elementvbo{nullptr};	 // 3 per triangle.
 mdmodel *mdload (const std::string&);
 void mdfree (mdmodel *);
 
+namespace {
+
+void mdresetblendcache();
+
+} // namespace
+
 void freeallmodels ()
 {
 	int i;
@@ -72,12 +88,7 @@ void freeallmodels ()
 	// TODO: Is this really necessary?
 	std::ranges::fill(tile2model, tile2model_t{});
 
-	// TODO: Same with this.
-	if (!vertlist.empty())
-	{
-		vertlist.clear();
-		allocmodelverts = maxmodelverts = 0;
-	}
+	mdresetblendcache();
 
 	if (elementvbo) {
 		std::free(elementvbo);
@@ -572,6 +583,198 @@ void updateanimation (md2model *m, spritetype *tspr)
 	m->interpol = ((float)(i&65535))/65536.F;
 }
 
+//------------------------------------- FRAME BLENDING BEGINS --------------------------------------
+
+	//Decoded frames are blended in model space, so the result only depends on the mesh, the
+	//frame pair and the interpolation factor. Sprite scale, flips and view scaling are folded
+	//into the modelview matrix instead, which lets actors in the same animation phase share
+	//one blended copy of the mesh per rendered frame.
+
+struct mdblendentry
+{
+	const mdframesoa *soa;
+	int cframe;
+	int nframe;
+	float interpol;
+	std::size_t ofs;	// into blendpool
+};
+
+std::vector<mdblendentry> blendentries;
+float *blendpool{nullptr};
+std::size_t blendpoolsiz{0};
+std::size_t blendpoolused{0};
+int blendframe{-1};
+
+struct {
+	unsigned int draws;		// meshes that asked for a blended frame
+	unsigned int direct;	// ... that needed no blend at all
+	unsigned int hits;		// ... that reused a blend from the same rendered frame
+	unsigned int blends;	// ... that were blended
+	unsigned int blendverts;
+	unsigned int frames;
+} blendstats;
+
+float *mdallocfloats(std::size_t n)
+{
+	return new (std::align_val_t{MDSOA_ALIGN}, std::nothrow) float[n];
+}
+
+void mdfreefloats(float *p)
+{
+	if (p) {
+		::operator delete[](p, std::align_val_t{MDSOA_ALIGN});
+	}
+}
+
+} // namespace
+
+bool mdsoaalloc(mdframesoa *soa, int numframes, int numverts)
+{
+	constexpr int vecfloats = MDSOA_ALIGN / sizeof(float);
+
+	soa->numframes = numframes;
+	soa->numverts = numverts;
+	soa->stride = (numverts + vecfloats - 1) & ~(vecfloats - 1);
+
+	const std::size_t n = (std::size_t)numframes * 3 * soa->stride;
+
+	soa->xyz = mdallocfloats(std::max(n, (std::size_t)1));
+	if (!soa->xyz) {
+		return false;
+	}
+	std::fill_n(soa->xyz, n, 0.F);
+
+	return true;
+}
+
+void mdsoafree(mdframesoa *soa)
+{
+	mdfreefloats(soa->xyz);
+	soa->xyz = nullptr;
+	soa->numframes = soa->numverts = soa->stride = 0;
+}
+
+namespace {
+
+/**
+ * out[i] = p0[i] + (p1[i] - p0[i]) * f
+ * @param n number of floats, a multiple of the SIMD width
+ */
+void mdlerpfloats(float *out, const float *p0, const float *p1, float f, std::size_t n)
+{
+	std::size_t i{0};
+
+#if defined(MDSOA_SSE)
+	const __m128 vf = _mm_set1_ps(f);
+
+	for (; i < n; i += 4) {
+		const __m128 a = _mm_load_ps(&p0[i]);
+		const __m128 b = _mm_load_ps(&p1[i]);
+		_mm_store_ps(&out[i], _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), vf)));
+	}
+#elif defined(MDSOA_NEON)
+	for (; i < n; i += 4) {
+		const float32x4_t a = vld1q_f32(&p0[i]);
+		const float32x4_t b = vld1q_f32(&p1[i]);
+		vst1q_f32(&out[i], vmlaq_n_f32(a, vsubq_f32(b, a), f));
+	}
+#endif
+
+	for (; i < n; i++) {
+		out[i] = p0[i] + (p1[i] - p0[i]) * f;
+	}
+}
+
+void mdresetblendcache()
+{
+	blendentries.clear();
+	blendpoolused = 0;
+	blendframe = -1;
+}
+
+/**
+ * Returns the model space vertex positions of a mesh between two frames, blending them
+ * unless an identical blend was already done during this rendered frame
+ * @param soa the decoded frames
+ * @param cframe the current frame
+ * @param nframe the next frame
+ * @param interpol how far from cframe to nframe, 0 to 1
+ * @param frame the rendered frame number the result is needed for
+ * @return three arrays of soa->stride floats, valid until the next call, or nullptr
+ */
+const float *mdblendframes(const mdframesoa *soa, int cframe, int nframe, float interpol, int frame)
+{
+	if (!soa->xyz || cframe < 0 || cframe >= soa->numframes || nframe < 0 || nframe >= soa->numframes) {
+		return nullptr;
+	}
+
+	const std::size_t framefloats = (std::size_t)3 * soa->stride;
+	const float *p0 = &soa->xyz[cframe * framefloats];
+	const float *p1 = &soa->xyz[nframe * framefloats];
+
+	blendstats.draws++;
+
+	if (interpol <= 0.F || cframe == nframe) {
+		blendstats.direct++;
+		return p0;
+	}
+
+	if (frame != blendframe) {
+		blendentries.clear();
+		blendpoolused = 0;
+		blendframe = frame;
+		blendstats.frames++;
+	}
+
+	for (const auto& e : blendentries) {
+		if (e.soa == soa && e.cframe == cframe && e.nframe == nframe && e.interpol == interpol) {
+			blendstats.hits++;
+			return &blendpool[e.ofs];
+		}
+	}
+
+	if (blendpoolused + framefloats > blendpoolsiz) {
+		const std::size_t newsiz = std::max(blendpoolsiz * 2, blendpoolused + framefloats);
+		float *newpool = mdallocfloats(newsiz);
+
+		if (!newpool) {
+			return nullptr;
+		}
+		if (blendpoolused) {
+			std::copy_n(blendpool, blendpoolused, newpool);
+		}
+		mdfreefloats(blendpool);
+		blendpool = newpool;
+		blendpoolsiz = newsiz;
+	}
+
+	float *out = &blendpool[blendpoolused];
+
+	mdlerpfloats(out, p0, p1, interpol, framefloats);
+	blendentries.push_back({ soa, cframe, nframe, interpol, blendpoolused });
+	blendpoolused += framefloats;
+
+	blendstats.blends++;
+	blendstats.blendverts += soa->numverts;
+
+	return out;
+}
+
+/**
+ * Scales the columns of a modelview matrix by the per-axis vertex scale of a model sprite
+ * @param mat the matrix
+ * @param ms scale of the model's x, y, z axes, which feed the vertex z, x, y
+ */
+void mdscalematrix(std::array<float, 16>& mat, const point3d& ms)
+{
+	for (int i{0}; i < 3; i++) {
+		mat[i] *= ms.y;
+		mat[4 + i] *= ms.z;
+		mat[8 + i] *= ms.x;
+	}
+}
+
+//-------------------------------------- FRAME BLENDING ENDS ---------------------------------------
 //--------------------------------------- MD2 LIBRARY BEGINS ---------------------------------------
 
 void md2free(md2model *m)
@@ -586,23 +789,47 @@ void md2free(md2model *m)
 	if (m->tex)
 		std::free(m->tex);
 
+	mdsoafree(&m->soa);
+
 	std::free(m);
 }
 
-md2model *md2load(int fil, const std::string& filnam)
+/**
+ * Decodes the byte-packed vertices of every MD2 frame into model space floats
+ */
+bool md2decodeframes(md2model *m)
 {
-	auto* m = (md2model *) std::calloc(1, sizeof(md2model));
-	
-	if (!m)
-		return nullptr;
+	if (!mdsoaalloc(&m->soa, m->numframes, m->numverts)) {
+		return false;
+	}
 
-	m->mdnum = 2;
-	m->scale = .01F;
+	for (int i{0}; i < m->numframes; i++) {
+		const auto* fr = (const md2frame_t *)&m->frames[i * m->framebytes];
+		const md2vert_t* c = &fr->verts[0];
+		float *x = &m->soa.xyz[(std::size_t)i * 3 * m->soa.stride];
+		float *y = x + m->soa.stride;
+		float *z = y + m->soa.stride;
+
+		for (int j{0}; j < m->numverts; j++) {
+			x[j] = ((float)c[j].v[1]) * fr->mul.y;
+			y[j] = ((float)c[j].v[2]) * fr->mul.z;
+			z[j] = ((float)c[j].v[0]) * fr->mul.x;
+		}
+	}
+
+	return true;
+}
 
+/**
+ * Reads the geometry and skin names of an MD2 file and decodes its frames
+ * @return false if the file is bad or memory runs out
+ */
+bool md2readfile(int fil, md2model *m)
+{
 	md2head_t head{};
 	kread(fil, (char *)&head, sizeof(md2head_t));
 
-	if ((head.id != 0x32504449) || (head.vers != 8)) { md2free(m); return(nullptr); } //"IDP2"
+	if ((head.id != 0x32504449) || (head.vers != 8)) { return false; } //"IDP2"
 
 	m->numskins = head.numskins;
 	m->numframes = head.numframes;
@@ -617,19 +844,19 @@ md2model *md2load(int fil, const std::string& filnam)
 	m->uvs.resize(m->numuv);
 	klseek(fil,head.ofsuv,SEEK_SET);
 	if (kread(fil,(char *)m->uvs.data(),m->numuv*sizeof(md2uv_t)) != m->numuv*sizeof(md2uv_t))
-		{ md2free(m); return(nullptr); }
+		{ return false; }
 
 	// TODO: Consider writing a container that can initialize from kread directly.
 	m->tris.resize(m->numtris);
 
 	klseek(fil,head.ofstris,SEEK_SET);
 	if (kread(fil,(char *)m->tris.data(), m->numtris*sizeof(md2tri_t)) != m->numtris*sizeof(md2tri_t))
-		{ md2free(m); return(nullptr); }
+		{ return false; }
 
-	m->frames.resize(m->numframes);
+	m->frames.resize(m->numframes*m->framebytes);
 	klseek(fil,head.ofsframes,SEEK_SET);
 	if (kread(fil,(char *)m->frames.data(),m->numframes*m->framebytes) != m->numframes*m->framebytes)
-		{ md2free(m); return(nullptr); }
+		{ return false; }
 
 #if B_BIG_ENDIAN != 0
 	{
@@ -647,6 +874,44 @@ md2model *md2load(int fil, const std::string& filnam)
 	}
 #endif
 
+	m->skinfn = (char *)std::calloc(m->numskins,64);
+	
+	if (!m->skinfn) {
+		return false;
+	}
+	
+	klseek(fil, head.ofsskins, SEEK_SET);
+
+	if (kread(fil,m->skinfn,64*m->numskins) != 64*m->numskins) {
+		return false;
+	}
+
+	return md2decodeframes(m);
+}
+
+md2model *md2load(int fil, const std::string& filnam)
+{
+	auto* m = (md2model *) std::calloc(1, sizeof(md2model));
+	
+	if (!m)
+		return nullptr;
+
+	m->mdnum = 2;
+	m->scale = .01F;
+
+	MDCacheKey key;
+	const bool cacheable = MDCacheFileKey(fil, filnam, &key);
+
+	if (!cacheable || !MDCacheLoadMD2(filnam, key, m)) {
+		if (!md2readfile(fil, m)) {
+			md2free(m);
+			return nullptr;
+		}
+		if (cacheable) {
+			MDCacheStoreMD2(filnam, key, m);
+		}
+	}
+
 	char st[BMAX_PATH];
 	
 	std::strcpy(st, filnam.c_str());
@@ -663,21 +928,7 @@ md2model *md2load(int fil, const std::string& filnam)
 
 	st[i] = 0;
 
-	std::strcpy(m->basepath.data(), st);
-
-	m->skinfn = (char *)std::calloc(m->numskins,64);
-	
-	if (!m->skinfn) {
-		md2free(m);
-		return nullptr;
-	}
-	
-	klseek(fil, head.ofsskins, SEEK_SET);
-
-	if (kread(fil,m->skinfn,64*m->numskins) != 64*m->numskins) {
-		md2free(m);
-		return nullptr;
-	}
+	m->basepath = st;
 
 	m->tex = (PTMHead **) std::calloc(m->numskins, sizeof(PTMHead *) * (HICEFFECTMASK + 1));
 	
@@ -686,7 +937,6 @@ md2model *md2load(int fil, const std::string& filnam)
 		return nullptr;
 	}
 
-	maxmodelverts = std::max(maxmodelverts, m->numverts);
 	maxelementvbo = std::max(maxelementvbo, m->numtris * 3);
 
 	return m;
@@ -717,19 +967,16 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 	const auto* f0 = (md2frame_t *)&m->frames[m->cframe*m->framebytes];
 	const auto* f1 = (md2frame_t *)&m->frames[m->nframe*m->framebytes];
 
-	float f = m->interpol;
-	float g = 1 - f;
+	const float* xyz = mdblendframes(&m->soa, m->cframe, m->nframe, m->interpol, numframes);
+	if (!xyz) return 0;
 
-	point3d m0{
-		.x = f0->mul.x * m->scale * g,
-		.y = f0->mul.y * m->scale * g,
-		.z = f0->mul.z * m->scale * g
-	};
+	float f = m->interpol;
+	float g;
 
-	point3d m1 {
-		.x = f1->mul.x * m->scale * f,
-		.y = f1->mul.y * m->scale * f,
-		.z = f1->mul.z * m->scale * f
+	point3d ms{
+		.x = m->scale,
+		.y = m->scale,
+		.z = m->scale
 	};
 
 	a0.x = f0->add.x*m->scale;
@@ -738,9 +985,6 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 	a0.y = (f1->add.y*m->scale-a0.y)*f+a0.y;
 	a0.z = f0->add.z*m->scale;
 	a0.z = (f1->add.z*m->scale-a0.z)*f+a0.z + m->zadd*m->scale;
-	
-	const md2vert_t* c0 = &f0->verts[0];
-	const md2vert_t* c1 = &f1->verts[0];
 
 	// Parkar: Moved up to be able to use k0 for the y-flipping code
 	float k0 = tspr->z;
@@ -752,29 +996,24 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 	// Parkar: Changed to use the same method as centeroriented sprites
 	if (globalorientation&8) //y-flipping
 	{
-		m0.z = -m0.z;
-		m1.z = -m1.z;
+		ms.z = -ms.z;
 		a0.z = -a0.z;
 		k0 -= static_cast<float>((tilesizy[tspr->picnum] * tspr->yrepeat) << 2);
 	}
 
 	if (globalorientation&4) {
-		m0.y = -m0.y;
-		m1.y = -m1.y;
+		ms.y = -ms.y;
 		a0.y = -a0.y;
 	} //x-flipping
 
 	f = ((float)tspr->xrepeat)/64*m->bscale;
-	m0.x *= f;
-	m1.x *= f;
+	ms.x *= f;
 	a0.x *= f;
 	f = -f;   // 20040610: backwards models aren't cool
-	m0.y *= f;
-	m1.y *= f;
+	ms.y *= f;
 	a0.y *= f;
 	f = (static_cast<float>(tspr->yrepeat))/64 * m->bscale;
-	m0.z *= f;
-	m1.z *= f;
+	ms.z *= f;
 	a0.z *= f;
 
 	// floor aligned
@@ -782,11 +1021,9 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 
 	if((globalorientation & 48) == 32)
 	{
-		m0.z = -m0.z;
-		m1.z = -m1.z;
+		ms.z = -ms.z;
 		a0.z = -a0.z;
-		m0.y = -m0.y;
-		m1.y = -m1.y;
+		ms.y = -ms.y;
 		a0.y = -a0.y;
 		f = a0.x;
 		a0.x = a0.z;
@@ -796,14 +1033,11 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 
 	f = (65536.0*512.0)/((float)xdimen*viewingrange);
 	g = 32.0/((float)xdimen*gxyaspect);
-	m0.y *= f;
-	m1.y *= f;
+	ms.y *= f;
 	a0.y = (((float)(tspr->x-globalpos.x))/  1024.0 + a0.y)*f;
-	m0.x *=-f;
-	m1.x *=-f;
+	ms.x *=-f;
 	a0.x = (((float)(k1     -globalpos.y))/ -1024.0 + a0.x)*-f;
-	m0.z *= g;
-	m1.z *= g;
+	ms.z *= g;
 	a0.z = (((float)(k0     -globalpos.z))/-16384.0 + a0.z)*g;
 
 	k0 = ((float)(tspr->x-globalpos.x))*f/1024.0;
@@ -855,16 +1089,13 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 
 	mat[3] = mat[7] = mat[11] = 0.F; mat[15] = 1.F;
 
+	mdscalematrix(mat, ms);
+
 // ------ Unnecessarily clean (lol) code to generate translation/rotation matrix for MD2 ends ------
 
-	for(i = 0; i < m->numverts; ++i) //interpolate (for animation) & transform to Build coords
-	{
-		vertlist.emplace_back(
-			point3d{((float)c0[i].v[1]) * m0.y + ((float)c1[i].v[1]) * m1.y,
-			        ((float)c0[i].v[2]) * m0.z + ((float)c1[i].v[2]) * m1.z,
-			        ((float)c0[i].v[0]) * m0.x + ((float)c1[i].v[0]) * m1.x}
-		);
-	}
+	const float* vx = xyz;	//interpolated (for animation) vertices, in Build coords order
+	const float* vy = vx + m->soa.stride;
+	const float* vz = vy + m->soa.stride;
 
 	ptmh = mdloadskin(m,tile2model[tspr->picnum].skinnum,globalpal,0);
 	if (!ptmh || !ptmh->glpic) return 0;
@@ -894,9 +1125,9 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 	for (i=0, vbi=0; i<m->numtris; i++, vbi+=3) {
 		const md2tri_t* tri = &m->tris[i];
 		for (j=2; j>=0; j--) {
-			elementvbo[vbi+j].v.x = vertlist[ tri->ivert[j] ].x;
-			elementvbo[vbi+j].v.y = vertlist[ tri->ivert[j] ].y;
-			elementvbo[vbi+j].v.z = vertlist[ tri->ivert[j] ].z;
+			elementvbo[vbi+j].v.x = vx[ tri->ivert[j] ];
+			elementvbo[vbi+j].v.y = vy[ tri->ivert[j] ];
+			elementvbo[vbi+j].v.z = vz[ tri->ivert[j] ];
 			elementvbo[vbi+j].t.s = (GLfloat)m->uvs[ tri->iuv[j] ].u / m->skinxsiz;
 			elementvbo[vbi+j].t.t = (GLfloat)m->uvs[ tri->iuv[j] ].v / m->skinysiz;
 		}
@@ -950,18 +1181,57 @@ int md2draw (md2model *m, spritetype *tspr, int method)
 
 void md3free (md3model *m);
 
-md3model *md3load (int fil)
+} // namespace
+
+void md3surfalloc(md3surf_t *s)
 {
-	auto* m = (md3model *)std::calloc(1,sizeof(md3model));
+	const std::array<std::size_t, 4> leng{
+		s->numtris * sizeof(md3tri_t),
+		s->numshaders * sizeof(md3shader_t),
+		s->numverts * sizeof(md3uv_t),
+		s->numframes * s->numverts * sizeof(md3xyzn_t)
+	};
 
-	if (!m) {
-		return nullptr;
+		//the four arrays share one allocation; each is a whole number of ints long, so all stay aligned
+	s->tris.resize((leng[0] + leng[1] + leng[2] + leng[3]) / sizeof(md3tri_t) + 1);
+	s->shaders = (md3shader_t*)(((intptr_t)s->tris.data()) + leng[0]);
+	s->uv      = (md3uv_t*)(((intptr_t)s->shaders) + leng[1]);
+	s->xyzn    = (md3xyzn_t*)(((intptr_t)s->uv) + leng[2]);
+}
+
+namespace {
+
+/**
+ * Converts the vertices of every frame of an MD3 surface to floats
+ */
+bool md3decodeframes(md3surf_t *s)
+{
+	if (!mdsoaalloc(&s->soa, s->numframes, s->numverts)) {
+		return false;
 	}
 
-	m->mdnum = 3;
-	m->tex = nullptr;
-	m->scale = .01F;
+	for (int i{0}; i < s->numframes; i++) {
+		const md3xyzn_t* v = &s->xyzn[i * s->numverts];
+		float *x = &s->soa.xyz[(std::size_t)i * 3 * s->soa.stride];
+		float *y = x + s->soa.stride;
+		float *z = y + s->soa.stride;
 
+		for (int j{0}; j < s->numverts; j++) {
+			x[j] = (float)v[j].y;
+			y[j] = (float)v[j].z;
+			z[j] = (float)v[j].x;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Reads the frames, tags and surfaces of an MD3 file and decodes its frames
+ * @return false if the file is bad or memory runs out
+ */
+bool md3readfile(int fil, md3model *m)
+{
 	md3filehead_t filehead{};
 	kread(fil, &filehead, sizeof(md3filehead_t));
 	m->head.id = filehead.id;
@@ -972,14 +1242,10 @@ md3model *md3load (int fil)
 	m->head.numtags = filehead.numtags;
 	m->head.numsurfs = filehead.numsurfs;
 	m->head.numskins = filehead.numskins;
-	filehead.frames = filehead.frames;
-	filehead.tags = filehead.tags;
-	filehead.surfs = filehead.surfs;
 	m->head.eof = filehead.eof;
 
 	if ((m->head.id != 0x33504449) && (m->head.vers != 15)) {
-		md3free(m);
-		return nullptr;
+		return false;
 	}//"IDP3"
 
 	m->numskins = m->head.numskins; //<- dead code?
@@ -1016,51 +1282,63 @@ md3model *md3load (int fil)
 		s.numshaders = filesurf.numshaders;
 		s.numverts = filesurf.numverts;
 		s.numtris = filesurf.numtris;
-		filesurf.tris = filesurf.tris;
-		filesurf.shaders = filesurf.shaders;
-		filesurf.uv = filesurf.uv;
-		filesurf.xyzn = filesurf.xyzn;
 		s.ofsend = filesurf.ofsend;
 
-		std::array<int, 4> offs{
-			ofsurf + filesurf.tris,
-			ofsurf + filesurf.shaders,
-			ofsurf + filesurf.uv,
-			ofsurf + filesurf.xyzn
-		};
-		std::array<std::size_t, 4> leng{
-			s.numtris * sizeof(md3tri_t),
-			s.numshaders * sizeof(md3shader_t),
-			s.numverts * sizeof(md3uv_t),
-			s.numframes * s.numverts * sizeof(md3xyzn_t)
-		};
-
-		s.tris.resize(leng[0] + leng[1] + leng[2] + leng[3]);
-		s.shaders = (md3shader_t*)(((intptr_t)s.tris.data()) + leng[0]);
-		s.uv      = (md3uv_t*)(((intptr_t)s.shaders) + leng[1]);
-		s.xyzn    = (md3xyzn_t*)(((intptr_t)s.uv) + leng[2]);
-
-		klseek(fil, offs[0], SEEK_SET);
-		kread(fil, s.tris.data(), leng[0]);
-		klseek(fil, offs[1], SEEK_SET);
-		kread(fil, s.shaders, leng[1]);
-		klseek(fil, offs[2], SEEK_SET);
-		kread(fil, s.uv, leng[2]);
-		klseek(fil, offs[3], SEEK_SET);
-		kread(fil, s.xyzn, leng[3]);
-
-		maxmodelverts = std::max(maxmodelverts, s.numverts);
-		maxelementvbo = std::max(maxelementvbo, s.numtris * 3);
+		md3surfalloc(&s);
+
+		klseek(fil, ofsurf + filesurf.tris, SEEK_SET);
+		kread(fil, s.tris.data(), s.numtris * sizeof(md3tri_t));
+		klseek(fil, ofsurf + filesurf.shaders, SEEK_SET);
+		kread(fil, s.shaders, s.numshaders * sizeof(md3shader_t));
+		klseek(fil, ofsurf + filesurf.uv, SEEK_SET);
+		kread(fil, s.uv, s.numverts * sizeof(md3uv_t));
+		klseek(fil, ofsurf + filesurf.xyzn, SEEK_SET);
+		kread(fil, s.xyzn, s.numframes * s.numverts * sizeof(md3xyzn_t));
+
+		if (!md3decodeframes(&s)) {
+			return false;
+		}
+
 		ofsurf += s.ofsend;
 	}
 
+	return true;
+}
+
+md3model *md3load (int fil, const std::string& filnam)
+{
+	auto* m = (md3model *)std::calloc(1,sizeof(md3model));
+
+	if (!m) {
+		return nullptr;
+	}
+
+	m->mdnum = 3;
+	m->tex = nullptr;
+	m->scale = .01F;
+
+	MDCacheKey key;
+	const bool cacheable = MDCacheFileKey(fil, filnam, &key);
+
+	if (!cacheable || !MDCacheLoadMD3(filnam, key, m)) {
+		if (!md3readfile(fil, m)) {
+			md3free(m);
+			return nullptr;
+		}
+		if (cacheable) {
+			MDCacheStoreMD3(filnam, key, m);
+		}
+	}
+
+	for (const auto& s : m->head.surfs) {
+		maxelementvbo = std::max(maxelementvbo, s.numtris * 3);
+	}
+
 	return m;
 }
 
 int md3draw (md3model *m, spritetype *tspr, int method)
 {
-	md3xyzn_t* v0;
-	md3xyzn_t* v1;
 	int i;
 	int j;
 	int k;
@@ -1082,17 +1360,12 @@ int md3draw (md3model *m, spritetype *tspr, int method)
 
 		//create current&next frame's vertex list from whole list
 
-	float f = m->interpol;
-	float g = 1 - f;
-	point3d m0{
-		.x = (1.0F / 64.0F) * m->scale * g,
-		.y = (1.0F / 64.0F) * m->scale * g,
-		.z = (1.0F / 64.0F) * m->scale * g
-	};
-	point3d m1{
-		.x = (1.0F / 64.0F) * m->scale * f,
-		.y = (1.0F / 64.0F) * m->scale * f,
-		.z = (1.0F / 64.0F) * m->scale * f
+	float f;
+	float g;
+	point3d ms{
+		.x = (1.0F / 64.0F) * m->scale,
+		.y = (1.0F / 64.0F) * m->scale,
+		.z = (1.0F / 64.0F) * m->scale
 	};
 	point3d a0{
 		.x = 0,
@@ -1108,39 +1381,32 @@ int md3draw (md3model *m, spritetype *tspr, int method)
     // Parkar: Changed to use the same method as centeroriented sprites
 	if (globalorientation&8) //y-flipping
 	{
-		m0.z = -m0.z;
-		m1.z = -m1.z;
+		ms.z = -ms.z;
 		a0.z = -a0.z;
 		k0 -= (float)((tilesizy[tspr->picnum]*tspr->yrepeat)<<2);
 	}
 	if (globalorientation&4) { //x-flipping
-		m0.y = -m0.y;
-		m1.y = -m1.y;
+		ms.y = -ms.y;
 		a0.y = -a0.y;
 	}
 
 	f = ((float)tspr->xrepeat)/64*m->bscale;
-	m0.x *= f;
-	m1.x *= f;
+	ms.x *= f;
 	a0.x *= f;
 	f = -f;   // 20040610: backwards models aren't cool
-	m0.y *= f;
-	m1.y *= f;
+	ms.y *= f;
 	a0.y *= f;
 	f = ((float)tspr->yrepeat)/64*m->bscale;
-	m0.z *= f;
-	m1.z *= f;
+	ms.z *= f;
 	a0.z *= f;
 
 	// floor aligned
 	auto k1 = static_cast<float>(tspr->y);
 	if((globalorientation & 48) == 32)
 	{
-		m0.z = -m0.z;
-		m1.z = -m1.z;
+		ms.z = -ms.z;
 		a0.z = -a0.z;
-		m0.y = -m0.y;
-		m1.y = -m1.y;
+		ms.y = -ms.y;
 		a0.y = -a0.y;
 		std::swap(a0.x, a0.z);
 		k1 += (float)((tilesizy[tspr->picnum]*tspr->yrepeat)>>3);
@@ -1148,14 +1414,11 @@ int md3draw (md3model *m, spritetype *tspr, int method)
 
 	f = (65536.0*512.0)/((float)xdimen*viewingrange);
 	g = 32.0/((float)xdimen*gxyaspect);
-	m0.y *= f;
-	m1.y *= f;
+	ms.y *= f;
 	a0.y = (((float)(tspr->x-globalpos.x))/  1024.0 + a0.y)*f;
-	m0.x *=-f;
-	m1.x *=-f;
+	ms.x *=-f;
 	a0.x = (((float)(k1     -globalpos.y))/ -1024.0 + a0.x)*-f;
-	m0.z *= g;
-	m1.z *= g;
+	ms.z *= g;
 	a0.z = (((float)(k0     -globalpos.z))/-16384.0 + a0.z)*g;
 
 	k0 = ((float)(tspr->x-globalpos.x))*f/1024.0;
@@ -1216,6 +1479,8 @@ int md3draw (md3model *m, spritetype *tspr, int method)
 	mat[11] = 0.F;
 	mat[15] = 1.F;
 
+	mdscalematrix(mat, ms);
+
 //------------
 	//bit 10 is an ugly hack in game.c\animatesprites telling MD2SPRITE
 	//to use Z-buffer hacks to hide overdraw problems with the shadows
@@ -1264,17 +1529,11 @@ int md3draw (md3model *m, spritetype *tspr, int method)
 
 	for(int surfi{0}; auto& s : m->head.surfs)
 	{
-		v0 = &s.xyzn[m->cframe * s.numverts];
-		v1 = &s.xyzn[m->nframe * s.numverts];
-
-		for(i = 0; i < s.numverts; ++i) //interpolate (for animation) & transform to Build coords
-		{
-			vertlist.emplace_back(
-				((float)v0[i].y)*m0.y + ((float)v1[i].y)*m1.y,
-				((float)v0[i].z)*m0.z + ((float)v1[i].z)*m1.z,
-				((float)v0[i].x)*m0.x + ((float)v1[i].x)*m1.x
-			);
-		}
+		//interpolate (for animation) & transform to Build coords
+		const float* vx = mdblendframes(&s.soa, m->cframe, m->nframe, m->interpol, numframes);
+		if (!vx) { ++surfi; continue; }
+		const float* vy = vx + s.soa.stride;
+		const float* vz = vy + s.soa.stride;
 
 #if 0
 		//precalc:
@@ -1299,9 +1558,9 @@ int md3draw (md3model *m, spritetype *tspr, int method)
 			{
 				k = s.tris[i].i[j];
 
-				elementvbo[vbi+j].v.x = vertlist[k].x;
-				elementvbo[vbi+j].v.y = vertlist[k].y;
-				elementvbo[vbi+j].v.z = vertlist[k].z;
+				elementvbo[vbi+j].v.x = vx[k];
+				elementvbo[vbi+j].v.y = vy[k];
+				elementvbo[vbi+j].v.z = vz[k];
 				elementvbo[vbi+j].t.s = s.uv[k].u;
 				elementvbo[vbi+j].t.t = s.uv[k].v;
 			}
@@ -1340,54 +1599,84 @@ void md3free (md3model *m)
 	if (m->tex)
 		std::free(m->tex);
 
+	for (auto& s : m->head.surfs)
+		mdsoafree(&s.soa);
+
 	std::free(m);
 }
 
 //---------------------------------------- MD3 LIBRARY ENDS ----------------------------------------
 //--------------------------------------- VOX LIBRARY BEGINS ---------------------------------------
 
-	//For loading/conversion only
-int xsiz;
-int ysiz;
-int zsiz;
-int yzsiz;
-int* vbit{nullptr}; //vbit: 1 bit per voxel: 0=air,1=solid
-float xpiv;
-float ypiv;
-float zpiv; //Might want to use more complex/unique names!
-int* vcolhashead{nullptr};
-int vcolhashsizm1;
-
+	//A voxel model on its way to becoming polygons. The loaders fill one in on the main
+	//thread; vox2poly then only touches its own voxconv, so several models can be
+	//converted at once.
 struct voxcol_t {
 	int p;
 	int c;
 	int n;
 };
 
-voxcol_t* vcol{nullptr};
-
-} // namespace
-
-int vnum{0};
-int vmax{0};
-
-namespace {
+struct voxconv
+{
+	std::string filnam;
+	MDCacheKey cachekey{};
+	bool cacheable{false};
+	bool is8bit{false};
+
+	int xsiz{0};
+	int ysiz{0};
+	int zsiz{0};
+	int zwords{0};	// 64-bit words per column of solid
+	float xpiv{0};
+	float ypiv{0};
+	float zpiv{0};
+	std::vector<uint64_t> solid;	// bit z of column (x,y): 0=air, 1=solid
+
+	std::vector<int> vcolhashead;	// colours of the surface voxels
+	int vcolhashsizm1{0};
+	std::vector<voxcol_t> vcol;
+
+		//skin packing
+	std::vector<int> shcnt;
+	int shcntp{0};
+	int gmaxx{0};
+	int gmaxy{0};
+	int garea{0};
+	int mytexo5{0};
+	unsigned int randseed{1};	// fixed, so a model always packs the same way
+};
 
 struct spoint2d {
 	short x{};
 	short y{};
 };
 
-int* shcntmal;
-int* shcnt{nullptr};
-int shcntp;
-int mytexo5;
-int gmaxx;
-int gmaxy;
-int garea;
-std::array<int, 33> pow2m1;
+	//A face of the voxel mesh, given by three corners the way addquad() expects them
+struct voxface {
+	int x0;
+	int y0;
+	int z0;
+	int x1;
+	int y1;
+	int z1;
+	int x2;
+	int y2;
+	int z2;
+	int face;
+};
+
+constexpr auto pow2m1 = []() {
+	std::array<int, 33> t{};
+	for (int i{0}; i < 32; i++) {
+		t[i] = (int)((1U << i) - 1);
+	}
+	t[32] = -1;
+	return t;
+}();
+
+} // namespace
 
-}
 	//pitch must equal xsiz * 4 <- FIXME: Codify this.
 unsigned int gloadtex(int *picbuf, int xsiz, int ysiz, int is8bit, int dapal)
 {
@@ -1433,60 +1722,89 @@ unsigned int gloadtex(int *picbuf, int xsiz, int ysiz, int is8bit, int dapal)
 
 namespace {
 
-int getvox(int x, int y, int z)
+int getvox(const voxconv& cv, int x, int y, int z)
 {
-	z += x*yzsiz + y*zsiz;
-	for(x=vcolhashead[(z*214013)&vcolhashsizm1];x>=0;x=vcol[x].n)
-		if (vcol[x].p == z) return(vcol[x].c);
+	z += (x * cv.ysiz + y) * cv.zsiz;
+	for(x=cv.vcolhashead[(z*214013)&cv.vcolhashsizm1];x>=0;x=cv.vcol[x].n)
+		if (cv.vcol[x].p == z) return(cv.vcol[x].c);
 	return(0x808080);
 }
 
-void putvox (int x, int y, int z, int col)
+void putvox (voxconv& cv, int x, int y, int z, int col)
+{
+	z += (x * cv.ysiz + y) * cv.zsiz;
+
+	const int h = ((z * 214013) & cv.vcolhashsizm1);
+
+	cv.vcol.push_back({ z, col, cv.vcolhashead[h] });
+	cv.vcolhashead[h] = (int)cv.vcol.size() - 1;
+}
+
+/**
+ * Sizes the solid bitfield and colour hash of a model about to be loaded
+ * @param hashsiz colour hash buckets, a power of two
+ * @return false if the dimensions are unusable
+ */
+bool voxalloc(voxconv& cv, int hashsiz)
 {
-	if (vnum >= vmax) {
-		vmax = std::max(vmax << 1, 4096);
-		vcol = (voxcol_t *) std::realloc(vcol, vmax * sizeof(voxcol_t));
+	if (cv.xsiz <= 0 || cv.ysiz <= 0 || cv.zsiz <= 0 ||
+		cv.xsiz > 1024 || cv.ysiz > 1024 || cv.zsiz > 1024) {
+		return false;
 	}
 
-	z += x * yzsiz + y * zsiz;
-	vcol[vnum].p = z;
-	z = ((z * 214013) & vcolhashsizm1);
-	vcol[vnum].c = col;
-	vcol[vnum].n = vcolhashead[z];
-	vcolhashead[z] = vnum++;
+	cv.zwords = (cv.zsiz + 63) >> 6;
+	cv.solid.assign((std::size_t)cv.xsiz * cv.ysiz * cv.zwords, 0);
+
+	cv.vcolhashsizm1 = hashsiz - 1;
+	cv.vcolhashead.assign(hashsiz, -1);
+
+	return true;
 }
-/*
-	//Set all bits in vbit from (x,y,z0) to (x,y,z1-1) to 0's
-void setzrange0 (int *lptr, int z0, int z1)
+
+uint64_t* voxcolumn(voxconv& cv, int x, int y)
 {
-	int z, ze;
-	if (!((z0^z1)&~31)) { lptr[z0>>5] &= (~(-(1<<SHIFTMOD32(z0))))|(-(1<<SHIFTMOD32(z1))); return; }
-	z = (z0>>5); ze = (z1>>5);
-	lptr[z] &=~(-(1<<SHIFTMOD32(z0))); for(z++;z<ze;z++) lptr[z] = 0;
-	lptr[z] &= (-(1<<SHIFTMOD32(z1)));
+	return &cv.solid[((std::size_t)x * cv.ysiz + y) * cv.zwords];
 }
-*/
-	//Set all bits in vbit from (x,y,z0) to (x,y,z1-1) to 1's
-void setzrange1 (int *lptr, int z0, int z1)
+
+const uint64_t* voxcolumn(const voxconv& cv, int x, int y)
 {
-	if (!((z0 ^ z1) & ~31)) {
-		lptr[z0 >> 5] |= (~(-(1 << SHIFTMOD32(z1)))) & (-(1 << SHIFTMOD32(z0)));
-		return;
-	}
-	
-	int z = (z0 >> 5);
-	const int ze = (z1 >> 5);
+	return &cv.solid[((std::size_t)x * cv.ysiz + y) * cv.zwords];
+}
 
-	lptr[z] |= (-(1 << SHIFTMOD32(z0)));
-	
-	for(z++; z < ze; z++) {
-		lptr[z] = -1;
+	//Set all bits of column (x,y) from z0 to z1-1 to 1's
+void setzrange1 (voxconv& cv, int x, int y, int z0, int z1)
+{
+	uint64_t* col = voxcolumn(cv, x, y);
+
+	z0 = std::max(z0, 0);
+	z1 = std::min(z1, cv.zsiz);
+
+	for (; z0 < z1 && (z0 & 63); z0++) {
+		col[z0 >> 6] |= 1ULL << (z0 & 63);
+	}
+	for (; z0 + 64 <= z1; z0 += 64) {
+		col[z0 >> 6] = ~0ULL;
+	}
+	for (; z0 < z1; z0++) {
+		col[z0 >> 6] |= 1ULL << (z0 & 63);
 	}
-	
-	lptr[z] |=~(-(1 << SHIFTMOD32(z1)));
 }
 
-int isrectfree (int x0, int y0, int dx, int dy, std::span<const int> rzbit)
+bool isolid(const voxconv& cv, int x, int y, int z)
+{
+	if ((unsigned int)x >= (unsigned int)cv.xsiz)
+		return false;
+	
+	if ((unsigned int)y >= (unsigned int)cv.ysiz)
+		return false;
+	
+	if ((unsigned int)z >= (unsigned int)cv.zsiz)
+		return false;
+
+	return (voxcolumn(cv, x, y)[z >> 6] >> (z & 63)) & 1;
+}
+
+int isrectfree (int x0, int y0, int dx, int dy, std::span<const int> rzbit, int mytexo5)
 {
 #if 0
 	int i, j, x;
@@ -1528,7 +1846,7 @@ int isrectfree (int x0, int y0, int dx, int dy, std::span<const int> rzbit)
 	return 1;
 }
 
-void setrect(int x0, int y0, int dx, int dy, std::span<int> rzbit)
+void setrect(int x0, int y0, int dx, int dy, std::span<int> rzbit, int mytexo5)
 {
 #if 0
 	int i, j, y;
@@ -1564,17 +1882,18 @@ void setrect(int x0, int y0, int dx, int dy, std::span<int> rzbit)
 #endif
 }
 
-void cntquad(int x0, int y0, int z0, int x1, int y1, int z1, int x2, int y2, int z2, int face, std::span<const spoint2d> shp, voxmodel* gvox)
+	//Same sequence as the MSVC rand(), but per model so conversions can run side by side
+int voxrand(voxconv& cv)
 {
-	std::ignore = x1;
-	std::ignore = y1;
-	std::ignore = z1;
-	std::ignore = face;
-	std::ignore = shp;
+	cv.randseed = cv.randseed * 214013 + 2531011;
+	return (int)((cv.randseed >> 16) & 32767);
+}
 
-	int x = std::abs(x2 - x0);
-	int y = std::abs(y2 - y0);
-	int z = std::abs(z2 - z0);
+void cntquad(voxconv& cv, const voxface& f, voxmodel* gvox)
+{
+	int x = std::abs(f.x2 - f.x0);
+	int y = std::abs(f.y2 - f.y0);
+	int z = std::abs(f.z2 - f.z0);
 
 	if (!x) {
 		x = z;
@@ -1589,26 +1908,37 @@ void cntquad(int x0, int y0, int z0, int x1, int y1, int z1, int x2, int y2, int
 		y = z;
 	}
 
-	shcnt[y * shcntp + x]++;
+	cv.shcnt[y * cv.shcntp + x]++;
 
-	if (x > gmaxx) {
-		gmaxx = x;
+	if (x > cv.gmaxx) {
+		cv.gmaxx = x;
 	}
-	if (y > gmaxy) {
-		gmaxy = y;
+	if (y > cv.gmaxy) {
+		cv.gmaxy = y;
 	}
 
-	garea += (x + (VOXBORDWIDTH << 1)) * (y + (VOXBORDWIDTH << 1));
+	cv.garea += (x + (VOXBORDWIDTH << 1)) * (y + (VOXBORDWIDTH << 1));
 	gvox->qcnt++;
 }
 
-void addquad (int x0, int y0, int z0, int x1, int y1, int z1, int x2, int y2, int z2, int face, std::span<const spoint2d> shp, voxmodel* gvox)
+void addquad (voxconv& cv, const voxface& f, std::span<const spoint2d> shp, voxmodel* gvox)
 {
 	int i;
 	int j;
 	int *lptr;
 	voxrect_t *qptr;
 
+	int x0 = f.x0;
+	int y0 = f.y0;
+	int z0 = f.z0;
+	int x1 = f.x1;
+	int y1 = f.y1;
+	int z1 = f.z1;
+	int x2 = f.x2;
+	int y2 = f.y2;
+	int z2 = f.z2;
+	const int face = f.face;
+
 	int x = std::abs(x2 - x0);
 	int y = std::abs(y2 - y0);
 	int z = std::abs(z2 - z0);
@@ -1632,7 +1962,7 @@ void addquad (int x0, int y0, int z0, int x1, int y1, int z1, int x2, int y2, in
 		i += 3;
 	}
 
-	z = shcnt[y * shcntp + x]++;
+	z = cv.shcnt[y * cv.shcntp + x]++;
 	lptr = &gvox->mytex[(shp[z].y+VOXBORDWIDTH)*gvox->mytexx+(shp[z].x+VOXBORDWIDTH)];
 
 	int nx{0};
@@ -1746,7 +2076,7 @@ void addquad (int x0, int y0, int z0, int x1, int y1, int z1, int x2, int y2, in
 					break;
 			}
 
-			lptr[xx] = getvox(nx, ny, nz);
+			lptr[xx] = getvox(cv, nx, ny, nz);
 		}
 	}
 
@@ -1808,23 +2138,192 @@ void addquad (int x0, int y0, int z0, int x1, int y1, int z1, int x2, int y2, in
 	++gvox->qcnt;
 }
 
-int isolid(int x, int y, int z)
+
+	//Index of the first clear bit at or after bit b of a row of 64-bit words
+int voxrunend(const uint64_t* row, int words, int b)
 {
-	if ((unsigned int)x >= (unsigned int)xsiz)
-		return 0;
-	
-	if ((unsigned int)y >= (unsigned int)ysiz)
-		return 0;
-	
-	if ((unsigned int)z >= (unsigned int)zsiz)
-		return 0;
+	int w = b >> 6;
+	uint64_t m = ~row[w] & (~0ULL << (b & 63));
 
-	z += x*yzsiz + y*zsiz;
-	
-	return vbit[z >> 5] & (1 << SHIFTMOD32(z));
+	while (!m) {
+		if (++w == words) {
+			return words << 6;
+		}
+		m = ~row[w];
+	}
+
+	return (w << 6) + std::countr_zero(m);
+}
+
+	//The bits from b0 to b1-1 that fall in word w
+uint64_t voxrunmask(int w, int b0, int b1)
+{
+	uint64_t m = ~0ULL;
+
+	if (w == (b0 >> 6)) {
+		m &= ~0ULL << (b0 & 63);
+	}
+	if (w == ((b1 - 1) >> 6)) {
+		m &= ~0ULL >> (63 - ((b1 - 1) & 63));
+	}
+
+	return m;
+}
+
+bool voxrunisset(const uint64_t* row, int b0, int b1)
+{
+	for (int w = b0 >> 6; w <= ((b1 - 1) >> 6); w++) {
+		const uint64_t m = voxrunmask(w, b0, b1);
+		if ((row[w] & m) != m) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void voxrunclear(uint64_t* row, int b0, int b1)
+{
+	for (int w = b0 >> 6; w <= ((b1 - 1) >> 6); w++) {
+		row[w] &= ~voxrunmask(w, b0, b1);
+	}
+}
+
+/**
+ * Covers the set bits of a plane with rectangles, 64 bits of a row at a time. Each
+ * rectangle takes the first run of set bits left in a row, then grows over the
+ * following rows for as long as they hold the whole run.
+ * @param rows numrows rows of words 64-bit words, cleared as they get covered
+ * @param emit called with rows r0 to r1-1 and bits b0 to b1-1 of every rectangle
+ */
+template <typename F>
+void voxgreedyplane(uint64_t* rows, int numrows, int words, F emit)
+{
+	for (int r{0}; r < numrows; r++) {
+		uint64_t* row = &rows[(std::size_t)r * words];
+
+		for (int w{0}; w < words; ) {
+			if (!row[w]) {
+				w++;
+				continue;
+			}
+
+			const int b0 = (w << 6) + std::countr_zero(row[w]);
+			const int b1 = voxrunend(row, words, b0);
+			int r1 = r + 1;
+
+			voxrunclear(row, b0, b1);
+			while (r1 < numrows && voxrunisset(&rows[(std::size_t)r1 * words], b0, b1)) {
+				voxrunclear(&rows[(std::size_t)r1 * words], b0, b1);
+				r1++;
+			}
+
+			emit(r, r1, b0, b1);
+		}
+	}
+}
+
+	//Solid voxels of column (x,y) whose neighbour in column (nx,ny) is air
+void voxexposed(const voxconv& cv, int x, int y, int nx, int ny, uint64_t* out)
+{
+	const uint64_t* col = voxcolumn(cv, x, y);
+
+	if ((unsigned int)nx >= (unsigned int)cv.xsiz || (unsigned int)ny >= (unsigned int)cv.ysiz) {
+		std::copy_n(col, cv.zwords, out);
+		return;
+	}
+
+	const uint64_t* ncol = voxcolumn(cv, nx, ny);
+
+	for (int w{0}; w < cv.zwords; w++) {
+		out[w] = col[w] & ~ncol[w];
+	}
+}
+
+	//Solid voxels of column (x,y) with air at z+dz, dz being -1 or 1
+void voxexposedz(const voxconv& cv, int x, int y, int dz, uint64_t* out)
+{
+	const uint64_t* col = voxcolumn(cv, x, y);
+
+	for (int w{0}; w < cv.zwords; w++) {
+		uint64_t n;
+
+		if (dz > 0) {
+			n = col[w] >> 1;
+			if (w + 1 < cv.zwords) n |= col[w + 1] << 63;
+		} else {
+			n = col[w] << 1;
+			if (w > 0) n |= col[w - 1] >> 63;
+		}
+		out[w] = col[w] & ~n;
+	}
+}
+
+/**
+ * Finds the visible faces of a model and merges them into rectangles, grouped by face
+ * in the order vox2poly's qfacind expects
+ */
+std::vector<voxface> voxmesh(const voxconv& cv)
+{
+	std::vector<voxface> faces;
+	std::vector<uint64_t> plane;
+	std::vector<uint64_t> col(cv.zwords);
+	const int ywords = (cv.ysiz + 63) >> 6;
+
+		//back & front: y planes, rows along x, bits along z
+	plane.resize((std::size_t)cv.xsiz * cv.zwords);
+	for (int i{-1}; i <= 1; i += 2) {
+		const int face = (i >= 0);
+		for (int y{0}; y < cv.ysiz; y++) {
+			for (int x{0}; x < cv.xsiz; x++) {
+				voxexposed(cv, x, y, x, y + i, &plane[(std::size_t)x * cv.zwords]);
+			}
+			voxgreedyplane(plane.data(), cv.xsiz, cv.zwords, [&](int x0, int x1, int z0, int z1) {
+				faces.push_back({ x0, y, z0, x1, y, z0, x1, y, z1, face });
+			});
+		}
+	}
+
+		//bottom & top: z planes, rows along x, bits along y
+	for (int i{-1}; i <= 1; i += 2) {
+		const int face = (i >= 0) + 2;
+		plane.assign((std::size_t)cv.zsiz * cv.xsiz * ywords, 0);
+		for (int x{0}; x < cv.xsiz; x++) {
+			for (int y{0}; y < cv.ysiz; y++) {
+				voxexposedz(cv, x, y, -i, col.data());
+				for (int w{0}; w < cv.zwords; w++) {
+					for (uint64_t m = col[w]; m; m &= m - 1) {
+						const int z = (w << 6) + std::countr_zero(m);
+						plane[((std::size_t)z * cv.xsiz + x) * ywords + (y >> 6)] |= 1ULL << (y & 63);
+					}
+				}
+			}
+		}
+		for (int z{0}; z < cv.zsiz; z++) {
+			voxgreedyplane(&plane[(std::size_t)z * cv.xsiz * ywords], cv.xsiz, ywords, [&](int x0, int x1, int y0, int y1) {
+				faces.push_back({ x0, y0, z, x1, y0, z, x1, y1, z, face });
+			});
+		}
+	}
+
+		//right & left: x planes, rows along y, bits along z
+	plane.assign((std::size_t)cv.ysiz * cv.zwords, 0);
+	for (int i{-1}; i <= 1; i += 2) {
+		const int face = (i >= 0) + 4;
+		for (int x{0}; x < cv.xsiz; x++) {
+			for (int y{0}; y < cv.ysiz; y++) {
+				voxexposed(cv, x, y, x - i, y, &plane[(std::size_t)y * cv.zwords]);
+			}
+			voxgreedyplane(plane.data(), cv.ysiz, cv.zwords, [&](int y0, int y1, int z0, int z1) {
+				faces.push_back({ x, y0, z0, x, y1, z0, x, y1, z1, face });
+			});
+		}
+	}
+
+	return faces;
 }
 
-std::unique_ptr<voxmodel> vox2poly()
+std::unique_ptr<voxmodel> vox2poly(voxconv& cv)
 {
 	int i;
 	int j;
@@ -1832,22 +2331,19 @@ std::unique_ptr<voxmodel> vox2poly()
 	int y;
 	int z;
 	int v;
-	int ov;
-	int oz = 0;
-	int cnt;
 	int sc;
 	int x0;
 	int y0;
 	int dx;
 	int dy;
-	void (*daquad)(int, int, int, int, int, int, int, int, int, int, std::span<const spoint2d>, voxmodel*);
 
-	auto gvox = std::make_unique_for_overwrite<voxmodel>();
+	auto gvox = std::make_unique<voxmodel>();
+	const std::vector<voxface> faces = voxmesh(cv);
 
 		//x is largest dimension, y is 2nd largest dimension
-	x = xsiz;
-	y = ysiz;
-	z = zsiz;
+	x = cv.xsiz;
+	y = cv.ysiz;
+	z = cv.zsiz;
 	if ((x < y) && (x < z))
 		x = z;
 	else if (y < z)
@@ -1859,138 +2355,98 @@ std::unique_ptr<voxmodel> vox2poly()
 		y = z;
 	}
 
-	shcntp = x; i = x*y*sizeof(int);
-	shcntmal = (int *)std::malloc(i); if (!shcntmal) { return(nullptr); }
-	std::memset(shcntmal,0,i); shcnt = &shcntmal[-shcntp-1];
-	gmaxx = gmaxy = garea = 0;
+	cv.shcntp = x;
+	cv.shcnt.assign((std::size_t)(y + 1) * x + 1, 0);
+	cv.gmaxx = cv.gmaxy = cv.garea = 0;
 
-	if (pow2m1[32] != -1) { for(i=0;i<32;i++) pow2m1[i] = (1<<i)-1; pow2m1[32] = -1; }
 	for(i=0;i<7;i++) gvox->qfacind[i] = -1;
 
-	i = (std::max(ysiz, zsiz) + 1) << 2;
-	std::vector<int> bx0(i << 1);
-	auto by0 = (int *)(((intptr_t)bx0.data())+i);
-
-	std::vector<spoint2d> shp;
-
-	// NOTE: First pass uses cntquad, so shp won't be accessed.
-	// Resizing of shp happens after this, so there shouldn't be any OOB.
-	for(cnt=0;cnt<2;cnt++)
-	{
-		if (!cnt) daquad = cntquad;
-			  else daquad = addquad;
-		gvox->qcnt = 0;
-
-		std::memset(by0,-1, (std::max(ysiz, zsiz) + 1) << 2);
-		v = 0;
-
-		for(i=-1;i<=1;i+=2)
-			for(y=0;y<ysiz;y++)
-				for(x=0;x<=xsiz;x++)
-					for(z=0;z<=zsiz;z++)
-					{
-						ov = v; v = (isolid(x,y,z) && (!isolid(x,y+i,z)));
-						if ((by0[z] >= 0) && ((by0[z] != oz) || (v >= ov)))
-							{ daquad(bx0[z],y,by0[z],x,y,by0[z],x,y,z,i>=0, shp, gvox.get()); by0[z] = -1; }
-						if (v > ov) oz = z; else if ((v < ov) && (by0[z] != oz)) { bx0[z] = x; by0[z] = oz; }
-					}
-
-		for(i=-1;i<=1;i+=2)
-			for(z=0;z<zsiz;z++)
-				for(x=0;x<=xsiz;x++)
-					for(y=0;y<=ysiz;y++)
-					{
-						ov = v; v = (isolid(x,y,z) && (!isolid(x,y,z-i)));
-						if ((by0[y] >= 0) && ((by0[y] != oz) || (v >= ov)))
-							{ daquad(bx0[y],by0[y],z,x,by0[y],z,x,y,z,(i>=0)+2, shp, gvox.get()); by0[y] = -1; }
-						if (v > ov) oz = y; else if ((v < ov) && (by0[y] != oz)) { bx0[y] = x; by0[y] = oz; }
-					}
-
-		for(i=-1;i<=1;i+=2)
-			for(x=0;x<xsiz;x++)
-				for(y=0;y<=ysiz;y++)
-					for(z=0;z<=zsiz;z++)
-					{
-						ov = v; v = (isolid(x,y,z) && (!isolid(x-i,y,z)));
-						if ((by0[z] >= 0) && ((by0[z] != oz) || (v >= ov)))
-							{ daquad(x,bx0[z],by0[z],x,y,by0[z],x,y,z,(i>=0)+4, shp, gvox.get()); by0[z] = -1; }
-						if (v > ov) oz = z; else if ((v < ov) && (by0[z] != oz)) { bx0[z] = y; by0[z] = oz; }
-					}
+	gvox->qcnt = 0;
+	for (const auto& f : faces) {
+		cntquad(cv, f, gvox.get());
+	}
 
-		if (!cnt)
+	std::vector<spoint2d> shp(gvox->qcnt);
+	sc = 0;
+	for(y=cv.gmaxy;y;y--)
+		for(x=cv.gmaxx;x>=y;x--)
 		{
-			shp.resize(gvox->qcnt);
-			sc = 0;
-			for(y=gmaxy;y;y--)
-				for(x=gmaxx;x>=y;x--)
-				{
-					i = shcnt[y*shcntp+x]; shcnt[y*shcntp+x] = sc; //shcnt changes from counter to head index
-					for(;i>0;i--) { shp[sc].x = x; shp[sc].y = y; sc++; }
-				}
+			i = cv.shcnt[y*cv.shcntp+x]; cv.shcnt[y*cv.shcntp+x] = sc; //shcnt changes from counter to head index
+			for(;i>0;i--) { shp[sc].x = x; shp[sc].y = y; sc++; }
+		}
 
-			for(gvox->mytexx=32;gvox->mytexx<(gmaxx+(VOXBORDWIDTH<<1));gvox->mytexx<<=1);
-			for(gvox->mytexy=32;gvox->mytexy<(gmaxy+(VOXBORDWIDTH<<1));gvox->mytexy<<=1);
-			while (gvox->mytexx*gvox->mytexy*8 < garea*9) //This should be sufficient to fit most skins...
-			{
+	for(gvox->mytexx=32;gvox->mytexx<(cv.gmaxx+(VOXBORDWIDTH<<1));gvox->mytexx<<=1);
+	for(gvox->mytexy=32;gvox->mytexy<(cv.gmaxy+(VOXBORDWIDTH<<1));gvox->mytexy<<=1);
+	while (gvox->mytexx*gvox->mytexy*8 < cv.garea*9) //This should be sufficient to fit most skins...
+	{
 skindidntfit:;
-				if (gvox->mytexx <= gvox->mytexy) gvox->mytexx <<= 1; else gvox->mytexy <<= 1;
-			}
-			mytexo5 = (gvox->mytexx>>5);
+		if (gvox->mytexx <= gvox->mytexy) gvox->mytexx <<= 1; else gvox->mytexy <<= 1;
+	}
+	cv.mytexo5 = (gvox->mytexx>>5);
 
-			i = (((gvox->mytexx*gvox->mytexy+31)>>5)<<2);
-			std::vector<int> zbit(i, 0);
+	i = (((gvox->mytexx*gvox->mytexy+31)>>5)<<2);
+	std::vector<int> zbit(i, 0);
 
-			v = gvox->mytexx*gvox->mytexy;
-			for(z=0;z<sc;z++)
-			{
-				dx = shp[z].x+(VOXBORDWIDTH<<1); dy = shp[z].y+(VOXBORDWIDTH<<1); i = v;
-				do
-				{
+	v = gvox->mytexx*gvox->mytexy;
+	for(z=0;z<sc;z++)
+	{
+		dx = shp[z].x+(VOXBORDWIDTH<<1); dy = shp[z].y+(VOXBORDWIDTH<<1); i = v;
+		do
+		{
 #if (VOXUSECHAR != 0)
-					x0 = (((rand()&32767)*(std::min(gvox->mytexx, 255)-dx))>>15);
-					y0 = (((rand()&32767)*(std::min(gvox->mytexy, 255)-dy))>>15);
+			x0 = (((voxrand(cv)&32767)*(std::min(gvox->mytexx, 255)-dx))>>15);
+			y0 = (((voxrand(cv)&32767)*(std::min(gvox->mytexy, 255)-dy))>>15);
 #else
-					x0 = (((rand()&32767)*(gvox->mytexx+1-dx))>>15);
-					y0 = (((rand()&32767)*(gvox->mytexy+1-dy))>>15);
+			x0 = (((voxrand(cv)&32767)*(gvox->mytexx+1-dx))>>15);
+			y0 = (((voxrand(cv)&32767)*(gvox->mytexy+1-dy))>>15);
 #endif
-					i--;
-					if (i < 0) //Time-out! Very slow if this happens... but at least it still works :P
+			i--;
+			if (i < 0) //Time-out! Very slow if this happens... but at least it still works :P
+			{
+					//Re-generate shp[].x/y (box sizes) from shcnt (now head indices) for next pass :/
+				j = 0;
+				for(y=cv.gmaxy;y;y--)
+					for(x=cv.gmaxx;x>=y;x--)
 					{
-							//Re-generate shp[].x/y (box sizes) from shcnt (now head indices) for next pass :/
-						j = 0;
-						for(y=gmaxy;y;y--)
-							for(x=gmaxx;x>=y;x--)
-							{
-								i = shcnt[y*shcntp+x];
-								for(;j<i;j++) { shp[j].x = x0; shp[j].y = y0; }
-								x0 = x;
-								y0 = y;
-							}
-						for(;j<sc;j++) { shp[j].x = x0; shp[j].y = y0; }
-
-						goto skindidntfit;
+						i = cv.shcnt[y*cv.shcntp+x];
+						for(;j<i;j++) { shp[j].x = x0; shp[j].y = y0; }
+						x0 = x;
+						y0 = y;
 					}
-				} while (!isrectfree(x0, y0, dx, dy, zbit));
-				while ((y0) && (isrectfree(x0, y0-1, dx, 1, zbit))) y0--;
-				while ((x0) && (isrectfree(x0-1, y0, 1, dy, zbit))) x0--;
-				setrect(x0, y0, dx, dy, zbit);
-				shp[z].x = x0;
-				shp[z].y = y0; //Overwrite size with top-left location
+				for(;j<sc;j++) { shp[j].x = x0; shp[j].y = y0; }
+
+				goto skindidntfit;
 			}
+		} while (!isrectfree(x0, y0, dx, dy, zbit, cv.mytexo5));
+		while ((y0) && (isrectfree(x0, y0-1, dx, 1, zbit, cv.mytexo5))) y0--;
+		while ((x0) && (isrectfree(x0-1, y0, 1, dy, zbit, cv.mytexo5))) x0--;
+		setrect(x0, y0, dx, dy, zbit, cv.mytexo5);
+		shp[z].x = x0;
+		shp[z].y = y0; //Overwrite size with top-left location
+	}
 
-			gvox->quad.resize(gvox->qcnt);
-			gvox->mytex.resize(gvox->mytexx * gvox->mytexy);
-		}
+	gvox->quad.resize(gvox->qcnt);
+	gvox->mytex.resize(gvox->mytexx * gvox->mytexy);
+
+	gvox->qcnt = 0;
+	for (const auto& f : faces) {
+		addquad(cv, f, shp, gvox.get());
 	}
 
+	gvox->xsiz = cv.xsiz;
+	gvox->ysiz = cv.ysiz;
+	gvox->zsiz = cv.zsiz;
+	gvox->xpiv = cv.xpiv;
+	gvox->ypiv = cv.ypiv;
+	gvox->zpiv = cv.zpiv;
+	gvox->is8bit = cv.is8bit;
+
 	return gvox;
 }
 
-int loadvox (const std::string& filnam)
+int loadvox (const std::string& filnam, voxconv& cv)
 {
 	int i;
-	int j;
-	int k;
 	int x;
 	int y;
 	int z;
@@ -2003,56 +2459,45 @@ int loadvox (const std::string& filnam)
 		return -1;
 	}
 
-	kread(fil, &xsiz, 4);
-	kread(fil, &ysiz, 4);
-	kread(fil, &zsiz, 4);
+	kread(fil, &cv.xsiz, 4);
+	kread(fil, &cv.ysiz, 4);
+	kread(fil, &cv.zsiz, 4);
 
-	xpiv = ((float)xsiz)*.5;
-	ypiv = ((float)ysiz)*.5;
-	zpiv = ((float)zsiz)*.5;
+	cv.xpiv = ((float)cv.xsiz)*.5;
+	cv.ypiv = ((float)cv.ysiz)*.5;
+	cv.zpiv = ((float)cv.zsiz)*.5;
 
 	klseek(fil,-768,SEEK_END);
 	for(i=0;i<256;i++)
 		{ kread(fil, c.data(), 3); pal[i] = (((int)c[0])<<18)+(((int)c[1])<<10)+(((int)c[2])<<2)+(i<<24); }
 	pal[255] = -1;
 
-	vcolhashsizm1 = 8192-1;
-	vcolhashead = (int *)std::malloc((vcolhashsizm1+1)*sizeof(int)); if (!vcolhashead) { kclose(fil); return(-1); }
-	std::memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(int));
-
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (int *)std::malloc(i); if (!vbit) { kclose(fil); return(-1); }
-	std::memset(vbit,0,i);
+	if (!voxalloc(cv, 8192)) { kclose(fil); return(-1); }
 
-	std::vector<unsigned char> tbuf(zsiz);
+	std::vector<unsigned char> tbuf(cv.zsiz);
 
 	klseek(fil,12,SEEK_SET);
-	for(x=0;x<xsiz;x++)
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	for(x=0;x<cv.xsiz;x++)
+		for(y=0;y<cv.ysiz;y++)
 		{
-			kread(fil, tbuf.data(), zsiz);
-			for(z=zsiz-1;z>=0;z--)
-				{ if (tbuf[z] != 255) { i = j+z; vbit[i>>5] |= (1<<SHIFTMOD32(i)); } }
+			uint64_t* col = voxcolumn(cv, x, y);
+			kread(fil, tbuf.data(), cv.zsiz);
+			for(z=cv.zsiz-1;z>=0;z--)
+				{ if (tbuf[z] != 255) col[z>>6] |= 1ULL<<(z&63); }
 		}
 
 	klseek(fil,12,SEEK_SET);
-	for(x=0;x<xsiz;x++)
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	for(x=0;x<cv.xsiz;x++)
+		for(y=0;y<cv.ysiz;y++)
 		{
-			kread(fil, tbuf.data(), zsiz);
-			for(z=0;z<zsiz;z++)
+			kread(fil, tbuf.data(), cv.zsiz);
+			for(z=0;z<cv.zsiz;z++)
 			{
 				if (tbuf[z] == 255) continue;
-				if ((!x) || (!y) || (!z) || (x == xsiz-1) || (y == ysiz-1) || (z == zsiz-1))
-					{ putvox(x,y,z,pal[tbuf[z]]); continue; }
-				k = j+z;
-				if ((!(vbit[(k-yzsiz)>>5]&(1<<SHIFTMOD32(k-yzsiz)))) ||
-					 (!(vbit[(k+yzsiz)>>5]&(1<<SHIFTMOD32(k+yzsiz)))) ||
-					 (!(vbit[(k- zsiz)>>5]&(1<<SHIFTMOD32(k- zsiz)))) ||
-					 (!(vbit[(k+ zsiz)>>5]&(1<<SHIFTMOD32(k+ zsiz)))) ||
-					 (!(vbit[(k-    1)>>5]&(1<<SHIFTMOD32(k-    1)))) ||
-					 (!(vbit[(k+    1)>>5]&(1<<SHIFTMOD32(k+    1)))))
-					{ putvox(x,y,z,pal[tbuf[z]]); continue; }
+				if ((!isolid(cv,x-1,y,z)) || (!isolid(cv,x+1,y,z)) ||
+					 (!isolid(cv,x,y-1,z)) || (!isolid(cv,x,y+1,z)) ||
+					 (!isolid(cv,x,y,z-1)) || (!isolid(cv,x,y,z+1)))
+					{ putvox(cv,x,y,z,pal[tbuf[z]]); continue; }
 			}
 		}
 
@@ -2060,10 +2505,9 @@ int loadvox (const std::string& filnam)
 	return 0;
 }
 
-int loadkvx (const std::string& filnam)
+int loadkvx (const std::string& filnam, voxconv& cv)
 {
 	int i;
-	int j;
 	int k;
 	int x;
 	int y;
@@ -2074,40 +2518,36 @@ int loadkvx (const std::string& filnam)
 	int mip1leng;
 	int ysizp1;
 	int fil;
+	int hashsiz;
 	std::array<unsigned char, 3> c;
 	unsigned char *cptr;
 
 	fil = kopen4load(filnam.c_str(),0); if (fil < 0) return(-1);
 	kread(fil,&mip1leng,4);
-	kread(fil,&xsiz,4);
-	kread(fil,&ysiz,4);
-	kread(fil,&zsiz,4);
+	kread(fil,&cv.xsiz,4);
+	kread(fil,&cv.ysiz,4);
+	kread(fil,&cv.zsiz,4);
 	kread(fil,&i,4);
-	xpiv = ((float)i)/256.0;
+	cv.xpiv = ((float)i)/256.0;
 	kread(fil,&i,4);
-	ypiv = ((float)i)/256.0;
+	cv.ypiv = ((float)i)/256.0;
 	kread(fil,&i,4);
-	zpiv = ((float)i)/256.0;
-	klseek(fil,(xsiz+1)<<2,SEEK_CUR);
-	ysizp1 = ysiz+1;
-	i = xsiz*ysizp1*sizeof(short);
+	cv.zpiv = ((float)i)/256.0;
+
+	for(hashsiz=4096;hashsiz<(mip1leng>>1);hashsiz<<=1) ; //approx to numvoxs!
+	if (!voxalloc(cv, hashsiz)) { kclose(fil); return(-1); }
+
+	klseek(fil,(cv.xsiz+1)<<2,SEEK_CUR);
+	ysizp1 = cv.ysiz+1;
+	i = cv.xsiz*ysizp1;
 	std::vector<unsigned short> xyoffs(i);
-	kread(fil, xyoffs.data(), i);
+	kread(fil, xyoffs.data(), i*sizeof(short));
 
 	klseek(fil,-768,SEEK_END);
 	for(i=0;i<256;i++)
 		{ kread(fil, c.data(), 3); pal[i] = (((int)c[0])<<18)+(((int)c[1])<<10)+(((int)c[2])<<2)+(i<<24); }
 
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (int *)std::malloc(i); if (!vbit) { kclose(fil); return(-1); }
-	std::memset(vbit,0,i);
-
-	for(vcolhashsizm1=4096;vcolhashsizm1<(mip1leng>>1);vcolhashsizm1<<=1) ;
-	vcolhashsizm1--; //approx to numvoxs!
-	vcolhashead = (int *)std::malloc((vcolhashsizm1+1)*sizeof(int)); if (!vcolhashead) { kclose(fil); return(-1); }
-	std::memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(int));
-
-	klseek(fil,28+((xsiz+1)<<2)+((ysizp1*xsiz)<<1),SEEK_SET);
+	klseek(fil,28+((cv.xsiz+1)<<2)+((ysizp1*cv.xsiz)<<1),SEEK_SET);
 
 	i = kfilelength(fil)-ktell(fil);
 	std::vector<unsigned char> tbuf(i);
@@ -2115,33 +2555,33 @@ int loadkvx (const std::string& filnam)
 	kclose(fil);
 
 	cptr = tbuf.data();
-	for(x=0;x<xsiz;x++) //Set surface voxels to 1 else 0
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	for(x=0;x<cv.xsiz;x++) //Set surface voxels to 1 else 0
+		for(y=0;y<cv.ysiz;y++)
 		{
 			i = xyoffs[x*ysizp1+y+1] - xyoffs[x*ysizp1+y]; if (!i) continue;
 			z1 = 0;
 			while (i)
 			{
 				z0 = (int)cptr[0]; k = (int)cptr[1]; cptr += 3;
-				if (!(cptr[-1]&16)) setzrange1(vbit,j+z1,j+z0);
+				if (!(cptr[-1]&16)) setzrange1(cv,x,y,z1,z0);
 				i -= k+3; z1 = z0+k;
-				setzrange1(vbit,j+z0,j+z1);
-				for(z=z0;z<z1;z++) putvox(x,y,z,pal[*cptr++]);
+				setzrange1(cv,x,y,z0,z1);
+				for(z=z0;z<z1;z++) putvox(cv,x,y,z,pal[*cptr++]);
 			}
 		}
 
 	return(0);
 }
 
-int loadkv6 (const std::string& filnam)
+int loadkv6 (const std::string& filnam, voxconv& cv)
 {
 	int i;
-	int j;
 	int x;
 	int y;
 	int numvoxs;
 	int z0;
 	int z1;
+	int hashsiz;
 	float f;
 	std::array<unsigned char, 8> c;
 
@@ -2158,43 +2598,37 @@ int loadkv6 (const std::string& filnam)
 		return -1; 
 	} //Kvxl
 
-	kread(fil, &xsiz, 4);
-	kread(fil, &ysiz, 4);
-	kread(fil, &zsiz, 4);
+	kread(fil, &cv.xsiz, 4);
+	kread(fil, &cv.ysiz, 4);
+	kread(fil, &cv.zsiz, 4);
     kread(fil, &f, 4);
-	xpiv = f;
+	cv.xpiv = f;
     kread(fil, &f, 4);
-	ypiv = f;
+	cv.ypiv = f;
     kread(fil, &f, 4);
-	zpiv = f;
+	cv.zpiv = f;
 	kread(fil, &numvoxs, 4);
 
-	std::vector<unsigned short> ylen(xsiz * ysiz);
-
-	klseek(fil,32+(numvoxs<<3)+(xsiz<<2),SEEK_SET);
-	kread(fil, ylen.data(), xsiz * ysiz);
-	klseek(fil,32,SEEK_SET);
+	for(hashsiz=4096;hashsiz<numvoxs;hashsiz<<=1) ;
+	if (!voxalloc(cv, hashsiz)) { kclose(fil); return(-1); }
 
-	yzsiz = ysiz*zsiz; i = ((xsiz*yzsiz+31)>>3);
-	vbit = (int *)std::malloc(i); if (!vbit) { kclose(fil); return(-1); }
-	std::memset(vbit,0,i);
+	std::vector<unsigned short> ylen(cv.xsiz * cv.ysiz);
 
-	for(vcolhashsizm1=4096;vcolhashsizm1<numvoxs;vcolhashsizm1<<=1) ;
-	vcolhashsizm1--;
-	vcolhashead = (int *)std::malloc((vcolhashsizm1+1)*sizeof(int)); if (!vcolhashead) { kclose(fil); return(-1); }
-	std::memset(vcolhashead,-1,(vcolhashsizm1+1)*sizeof(int));
+	klseek(fil,32+(numvoxs<<3)+(cv.xsiz<<2),SEEK_SET);
+	kread(fil, ylen.data(), cv.xsiz * cv.ysiz * sizeof(short));
+	klseek(fil,32,SEEK_SET);
 
-	for(x=0;x<xsiz;x++) {
-		for(y=0,j=x*yzsiz;y<ysiz;y++,j+=zsiz)
+	for(x=0;x<cv.xsiz;x++) {
+		for(y=0;y<cv.ysiz;y++)
 		{
-			z1 = zsiz;
-			for(i=ylen[x*ysiz+y];i>0;i--)
+			z1 = cv.zsiz;
+			for(i=ylen[x*cv.ysiz+y];i>0;i--)
 			{
 				kread(fil, c.data(), 8); //b,g,r,a,z_lo,z_hi,vis,dir
 				z0 = *(unsigned short *)&c[4];
-				if (!(c[6]&16)) setzrange1(vbit,j+z1,j+z0);
-				vbit[(j+z0)>>5] |= (1<<SHIFTMOD32(j+z0));
-				putvox(x,y,z0, (*(int *)&c[0]) & 0xffffff);
+				if (!(c[6]&16)) setzrange1(cv,x,y,z1,z0);
+				setzrange1(cv,x,y,z0,z0+1);
+				putvox(cv,x,y,z0, (*(int *)&c[0]) & 0xffffff);
 				z1 = z0+1;
 			}
 		}
@@ -2204,6 +2638,96 @@ int loadkv6 (const std::string& filnam)
 	return 0;
 }
 
+/**
+ * Reads a voxel file ready for vox2poly, unless the model cache already has its mesh
+ * @param filnam the file
+ * @param cv receives the voxels
+ * @param vm receives the mesh if it came from the cache
+ * @return -1 on failure, 0 if cv needs converting, 1 if vm was filled in
+ */
+int voxreadfile(const std::string& filnam, voxconv& cv, std::unique_ptr<voxmodel>& vm)
+{
+	auto* dot = std::strrchr(filnam.c_str(), '.');
+	
+	if (!dot)
+		return -1;
+
+	int (*loader)(const std::string&, voxconv&);
+
+    if (IsSameAsNoCase(dot, ".vox")) {
+		loader = loadvox;
+		cv.is8bit = true;
+	}
+	else if (IsSameAsNoCase(dot, ".kvx")) {
+		loader = loadkvx;
+		cv.is8bit = true;
+	}
+	else if (IsSameAsNoCase(dot, ".kv6")) {
+		loader = loadkv6;
+		cv.is8bit = false;
+	}
+	//else if (!strcasecmp(dot,".vxl")) { ret = loadvxl(filnam); is8bit = 0; }
+	else
+		return -1;
+
+	cv.filnam = filnam;
+
+	const int fil = kopen4load(filnam.c_str(), 0);
+	if (fil < 0) {
+		return -1;
+	}
+	cv.cacheable = MDCacheFileKey(fil, filnam, &cv.cachekey);
+	kclose(fil);
+
+	if (cv.cacheable) {
+		vm = MDCacheLoadVox(filnam, cv.cachekey);
+		if (vm) {
+			return 1;
+		}
+	}
+
+	return (loader(filnam, cv) < 0) ? -1 : 0;
+}
+
+/**
+ * Finishes off a freshly converted or cached voxel model
+ * @return false if out of memory
+ */
+bool voxinitmodel(voxmodel *vm)
+{
+	vm->mdnum = 1; //VOXel model id
+	vm->scale = vm->bscale = 1.0;
+
+	vm->texid = (unsigned int *)std::calloc(MAXPALOOKUPS,sizeof(unsigned int));
+
+	return vm->texid != nullptr;
+}
+
+/**
+ * Finishes a conversion on the main thread and remembers the mesh for next time
+ */
+std::unique_ptr<voxmodel> voxfinishmodel(const voxconv& cv, std::unique_ptr<voxmodel> vm)
+{
+	if (!vm || !voxinitmodel(vm.get())) {
+		return {};
+	}
+
+	if (cv.cacheable) {
+		MDCacheStoreVox(cv.filnam, cv.cachekey, vm.get());
+	}
+
+	return vm;
+}
+
+struct voxpending {
+	int voxindex;
+	std::unique_ptr<voxconv> cv;
+	std::unique_ptr<voxmodel> vm;
+};
+
+std::vector<voxpending> voxqueue;
+
+
 #if 0
 	//While this code works, it's way too slow and can only cause trouble.
 int loadvxl (const char *filnam)
@@ -2267,76 +2791,76 @@ void voxfree (voxmodel *m)
 
 std::unique_ptr<voxmodel> voxload(const std::string& filnam)
 {
-	auto* dot = std::strrchr(filnam.c_str(), '.');
-	
-	if (!dot)
-		return nullptr;
+	voxconv cv;
+	std::unique_ptr<voxmodel> vm;
 
-	bool is8bit{};
-    int ret{};
+	const int ret = voxreadfile(filnam, cv, vm);
 
-    if (IsSameAsNoCase(dot, ".vox")) {
-		ret = loadvox(filnam);
-		is8bit = true;
-	}
-	else if (IsSameAsNoCase(dot, ".kvx")) {
-		ret = loadkvx(filnam);
-		is8bit = true;
+	if (ret < 0) {
+		return nullptr;
 	}
-	else if (IsSameAsNoCase(dot, ".kv6")) {
-		ret = loadkv6(filnam);
-		is8bit = false;
+
+	if (ret > 0) {
+		if (!voxinitmodel(vm.get())) {
+			return nullptr;
+		}
+		return vm;
 	}
-	//else if (!strcasecmp(dot,".vxl")) { ret = loadvxl(filnam); is8bit = 0; }
-	else
-		return nullptr;
 
-	auto vm = [ret]() -> std::unique_ptr<voxmodel> {
-          if (ret >= 0)
-            return vox2poly();
-          else
-            return {};
-	    }();
-	
-	if (vm)
-	{
-		vm->mdnum = 1; //VOXel model id
-		vm->scale = vm->bscale = 1.0;
-		vm->xsiz = xsiz; vm->ysiz = ysiz; vm->zsiz = zsiz;
-		vm->xpiv = xpiv; vm->ypiv = ypiv; vm->zpiv = zpiv;
-		vm->is8bit = is8bit;
+	return voxfinishmodel(cv, vox2poly(cv));
+}
+
+void voxloadqueue(int voxindex, const std::string& filnam)
+{
+	auto cv = std::make_unique<voxconv>();
+	std::unique_ptr<voxmodel> vm;
+
+	std::erase_if(voxqueue, [voxindex](const voxpending& p) { return p.voxindex == voxindex; });
 
-		vm->texid = (unsigned int *)std::calloc(MAXPALOOKUPS,sizeof(unsigned int));
+	const int ret = voxreadfile(filnam, *cv, vm);
 
-		if (!vm->texid) {
-			voxfree(vm.get());
-			vm.reset();
+	if (ret > 0) {
+		if (voxinitmodel(vm.get())) {
+			voxmodels[voxindex] = std::move(vm);
 		}
 	}
-
-	if (shcntmal) {
-		std::free(shcntmal);
-		shcntmal = nullptr;
+	else if (ret == 0) {
+		voxqueue.push_back({ voxindex, std::move(cv), nullptr });
+		voxloadpending = true;
 	}
+}
 
-	if (vbit) {
-		std::free(vbit);
-		vbit = nullptr;
-	}
+void voxloadflush()
+{
+	voxloadpending = false;
 
-	if (vcol) {
-		std::free(vcol);
-		vcol = nullptr;
-		vnum = 0;
-		vmax = 0;
+	if (voxqueue.empty()) {
+		return;
 	}
-	
-	if (vcolhashead) {
-		std::free(vcolhashead);
-		vcolhashead = nullptr;
+
+	const auto t0 = getusecticks();
+
+		//biggest first, so one large model doesn't hold up the end of the batch
+	std::ranges::sort(voxqueue, std::ranges::greater{}, [](const voxpending& p) {
+		return (std::size_t)p.cv->xsiz * p.cv->ysiz * p.cv->zsiz;
+	});
+
+	const int numthreads = std::min(workpoolsize(), (int)voxqueue.size());
+
+	parallelfor((int)voxqueue.size(), 1, numthreads, [](int begin, int end) {
+		for (int i{begin}; i < end; i++) {
+			voxqueue[i].vm = vox2poly(*voxqueue[i].cv);
+		}
+	});
+
+	for (auto& p : voxqueue) {
+		voxmodels[p.voxindex] = voxfinishmodel(*p.cv, std::move(p.vm));
 	}
 
-	return vm;
+	buildprintf("Converted {} voxel models in {:.1f} ms on {} threads\n",
+			   voxqueue.size(), (float)(getusecticks() - t0) / 1000.F, numthreads);
+
+	voxqueue.clear();
 }
 
 namespace {
@@ -2643,7 +3167,17 @@ int voxloadbufs(voxmodel *m)
 //---------------------------------------- VOX LIBRARY ENDS ----------------------------------------
 //--------------------------------------- MD LIBRARY BEGINS  ---------------------------------------
 
-mdmodel *mdload (const std::string& filnam)
+namespace {
+
+	//Files mdload has read and the time it spent, for mdprintloadstats and mdbenchload
+std::vector<std::string> loadedfiles;
+
+struct {
+	int models;
+	unsigned int usecs;
+} loadstats;
+
+mdmodel *mdloadfile (const std::string& filnam)
 {
 	auto vm = (mdmodel*)voxload(filnam.c_str()).release();
 	
@@ -2665,7 +3199,7 @@ mdmodel *mdload (const std::string& filnam)
 			vm = (mdmodel*)md2load(fil, filnam);
 			break; //IDP2
 		case 0x33504449:
-			vm = (mdmodel*)md3load(fil);
+			vm = (mdmodel*)md3load(fil, filnam);
 			break; //IDP3
 		default:
 			vm = (mdmodel*)nullptr;
@@ -2677,14 +3211,28 @@ mdmodel *mdload (const std::string& filnam)
 	return vm;
 }
 
+} // namespace
+
+mdmodel *mdload (const std::string& filnam)
+{
+	const auto t0 = getusecticks();
+
+	mdmodel *vm = mdloadfile(filnam);
+
+	if (vm) {
+		loadstats.models++;
+		loadstats.usecs += getusecticks() - t0;
+		if (std::ranges::find(loadedfiles, filnam) == loadedfiles.end()) {
+			loadedfiles.push_back(filnam);
+		}
+	}
+
+	return vm;
+}
+
 // method: 0 = drawrooms projection, 1 = rotatesprite projection
 int mddraw (spritetype *tspr, int method)
 {
-	if (maxmodelverts > allocmodelverts)
-	{
-		vertlist.resize(maxmodelverts);
-		allocmodelverts = maxmodelverts;
-	}
 	if (maxelementvbo > allocelementvbo)
 	{
 		auto* vbo = static_cast<struct polymostvboitem *>(std::realloc(elementvbo, maxelementvbo * sizeof(struct polymostvboitem)));
@@ -2721,6 +3269,224 @@ int mddraw (spritetype *tspr, int method)
 	return 0;
 }
 
+void mdprintframestats ()
+{
+	const unsigned int frames = std::max(blendstats.frames, 1U);
+
+	buildprintf("Model frame blending: {} meshes drawn over {} frames\n", blendstats.draws, blendstats.frames);
+	buildprintf("  {} unblended, {} reused, {} blended ({} vertices, {} per frame)\n",
+			   blendstats.direct, blendstats.hits, blendstats.blends,
+			   blendstats.blendverts, blendstats.blendverts / frames);
+
+	blendstats = {};
+}
+
+namespace {
+
+	//The per-vertex interpolation md2draw/md3draw used before frames were decoded at load
+	//time, kept as a baseline for mdbenchframes
+void mdbenchlerpmd2(std::vector<point3d>& out, const md2model *m, int cframe, int nframe, float f)
+{
+	const auto* f0 = (const md2frame_t *)&m->frames[cframe*m->framebytes];
+	const auto* f1 = (const md2frame_t *)&m->frames[nframe*m->framebytes];
+	const md2vert_t* c0 = &f0->verts[0];
+	const md2vert_t* c1 = &f1->verts[0];
+	const float g = 1 - f;
+
+	out.clear();
+	for (int i{0}; i < m->numverts; ++i) {
+		out.emplace_back(
+			((float)c0[i].v[1]) * f0->mul.y * g + ((float)c1[i].v[1]) * f1->mul.y * f,
+			((float)c0[i].v[2]) * f0->mul.z * g + ((float)c1[i].v[2]) * f1->mul.z * f,
+			((float)c0[i].v[0]) * f0->mul.x * g + ((float)c1[i].v[0]) * f1->mul.x * f
+		);
+	}
+}
+
+void mdbenchlerpmd3(std::vector<point3d>& out, const md3surf_t *s, int cframe, int nframe, float f)
+{
+	const md3xyzn_t* v0 = &s->xyzn[cframe * s->numverts];
+	const md3xyzn_t* v1 = &s->xyzn[nframe * s->numverts];
+	const float g = 1 - f;
+
+	out.clear();
+	for (int i{0}; i < s->numverts; ++i) {
+		out.emplace_back(
+			((float)v0[i].y) * g + ((float)v1[i].y) * f,
+			((float)v0[i].z) * g + ((float)v1[i].z) * f,
+			((float)v0[i].x) * g + ((float)v1[i].x) * f
+		);
+	}
+}
+
+} // namespace
+
+void mdbenchframes (int numactors, int numframes)
+{
+	struct benchmesh {
+		const mdframesoa *soa;
+		const md2model *md2;
+		const md3surf_t *md3;
+	};
+	std::vector<std::vector<benchmesh>> meshes;		// one list per model
+
+	for (int i{0}; models && i < nextmodelid; i++) {
+		std::vector<benchmesh> mesh;
+
+		if (models[i]->mdnum == 2) {
+			const auto* m = (const md2model *)models[i];
+			mesh.push_back({ &m->soa, m, nullptr });
+		} else if (models[i]->mdnum == 3) {
+			for (const auto& s : ((const md3model *)models[i])->head.surfs) {
+				mesh.push_back({ &s.soa, nullptr, &s });
+			}
+		}
+		if (!mesh.empty() && mesh[0].soa->numframes > 0) {
+			meshes.push_back(std::move(mesh));
+		}
+	}
+
+	if (meshes.empty()) {
+		buildputs("mdbenchframes: no MD2 or MD3 models loaded\n");
+		return;
+	}
+
+		//Actors cycle through every frame of their model at 10 frames per second while the
+		//scene renders at 60 frames per second. Actors spawn in groups of four that stay in
+		//step, like a crowd of monsters woken together.
+	auto animate = [&](int actor, int frame, int *cframe, int *nframe, float *interpol) {
+		const int modelframes = meshes[actor % meshes.size()][0].soa->numframes;
+		const long long t = ((long long)frame * 1000 / 60 + (actor / 4) * 137) * 10 * 65536 / 1000;
+		const int i = (int)(t % ((long long)modelframes << 16));
+
+		*cframe = i >> 16;
+		*nframe = (*cframe + 1) % modelframes;
+		*interpol = ((float)(i & 65535)) / 65536.F;
+	};
+
+	const auto savedstats = blendstats;
+	std::vector<point3d> aos;
+	float *scratch{nullptr};
+	std::size_t scratchsiz{0};
+	volatile float sink{0.F};
+	unsigned int verts{0};
+	int cframe;
+	int nframe;
+	float interpol;
+
+	for (const auto& mesh : meshes) {
+		for (const auto& b : mesh) {
+			scratchsiz = std::max(scratchsiz, (std::size_t)3 * b.soa->stride);
+		}
+	}
+	scratch = mdallocfloats(scratchsiz);
+	if (!scratch) {
+		return;
+	}
+
+	unsigned int t0 = getusecticks();
+	for (int frame{0}; frame < numframes; frame++) {
+		for (int actor{0}; actor < numactors; actor++) {
+			animate(actor, frame, &cframe, &nframe, &interpol);
+			for (const auto& b : meshes[actor % meshes.size()]) {
+				if (b.md2) mdbenchlerpmd2(aos, b.md2, cframe, nframe, interpol);
+				else mdbenchlerpmd3(aos, b.md3, cframe, nframe, interpol);
+				sink = sink + aos[0].x;
+				verts += b.soa->numverts;
+			}
+		}
+	}
+	const unsigned int tlegacy = getusecticks() - t0;
+
+	t0 = getusecticks();
+	for (int frame{0}; frame < numframes; frame++) {
+		for (int actor{0}; actor < numactors; actor++) {
+			animate(actor, frame, &cframe, &nframe, &interpol);
+			for (const auto& b : meshes[actor % meshes.size()]) {
+				const std::size_t framefloats = (std::size_t)3 * b.soa->stride;
+				mdlerpfloats(scratch, &b.soa->xyz[cframe * framefloats],
+					&b.soa->xyz[nframe * framefloats], interpol, framefloats);
+				sink = sink + scratch[0];
+			}
+		}
+	}
+	const unsigned int tkernel = getusecticks() - t0;
+
+	mdresetblendcache();
+	blendstats = {};
+	t0 = getusecticks();
+	for (int frame{0}; frame < numframes; frame++) {
+		for (int actor{0}; actor < numactors; actor++) {
+			animate(actor, frame, &cframe, &nframe, &interpol);
+			for (const auto& b : meshes[actor % meshes.size()]) {
+				const float *xyz = mdblendframes(b.soa, cframe, nframe, interpol, frame);
+				if (xyz) sink = sink + xyz[0];
+			}
+		}
+	}
+	const unsigned int tcached = getusecticks() - t0;
+	const auto benchstats = blendstats;
+
+	mdresetblendcache();
+	blendstats = savedstats;
+	mdfreefloats(scratch);
+
+	const float perframe = 1.F / (float)std::max(numframes, 1);
+
+	buildprintf("mdbenchframes: {} actors over {} models, {} frames, {} vertices per frame\n",
+			   numactors, meshes.size(), numframes, (int)((float)verts * perframe));
+	buildprintf("  per-vertex lerp:    {:.1f} us/frame\n", (float)tlegacy * perframe);
+	buildprintf("  decoded frames:     {:.1f} us/frame\n", (float)tkernel * perframe);
+	buildprintf("  with shared blends: {:.1f} us/frame ({} of {} meshes reused a blend)\n",
+			   (float)tcached * perframe, benchstats.hits, benchstats.draws);
+}
+
+void mdprintloadstats ()
+{
+	buildprintf("Models: {} loaded in {:.1f} ms\n", loadstats.models, (float)loadstats.usecs / 1000.F);
+	MDCachePrintStats();
+}
+
+void mdbenchload ()
+{
+	if (loadedfiles.empty()) {
+		buildprintf("mdbenchload: no models have been loaded\n");
+		return;
+	}
+
+	auto timeload = [](bool usecache) {
+		MDCacheSuspend(!usecache);
+
+		const auto t0 = getusecticks();
+
+		for (const auto& fn : loadedfiles) {
+			mdmodel *vm = mdloadfile(fn);
+			if (!vm) {
+				continue;
+			}
+			if (vm->mdnum == 1) {
+				// voxload hands over a voxmodel made with new
+				voxfree((voxmodel *)vm);
+				delete (voxmodel *)vm;
+			} else {
+				mdfree(vm);
+			}
+		}
+
+		const auto t = getusecticks() - t0;
+
+		MDCacheSuspend(false);
+		return t;
+	};
+
+	const auto tcold = timeload(false);
+	const auto twarm = timeload(true);
+
+	buildprintf("mdbenchload: {} model files\n", loadedfiles.size());
+	buildprintf("  parsed:     {:.1f} ms\n", (float)tcold / 1000.F);
+	buildprintf("  from cache: {:.1f} ms\n", (float)twarm / 1000.F);
+}
+
 void mdfree (mdmodel *vm)
 {
 	if (vm->mdnum == 1) {
@@ -46,6 +46,28 @@ struct mdanim_t
 #define MDANIM_LOOP 0
 #define MDANIM_ONESHOT 1
 
+inline constexpr auto MDSOA_ALIGN{16};	// byte alignment of decoded frame arrays
+
+	//Vertex positions of every frame of a mesh, decoded once at load time. Each frame
+	//is three arrays of stride floats holding the Build x, y and z of every vertex.
+struct mdframesoa
+{
+	int numframes;
+	int numverts;
+	int stride;	// numverts rounded up to a whole number of SIMD vectors
+	float *xyz;	// numframes * 3 * stride floats, MDSOA_ALIGN aligned
+};
+
+/**
+ * Allocates the decoded frames of a mesh, zero filled
+ * @param soa the frame arrays to set up
+ * @param numframes number of frames
+ * @param numverts vertices per frame
+ * @return false if out of memory
+ */
+bool mdsoaalloc (mdframesoa *soa, int numframes, int numverts);
+void mdsoafree (mdframesoa *soa);
+
 
 	//This MD2 code is based on the source code from David Henry (tfc_duke(at)hotmail.com)
 	//   Was at http://tfc.duke.free.fr/us/tutorials/models/md2.htm
@@ -132,6 +154,7 @@ struct md2model
 	std::vector<char> frames;
 	std::vector<md2uv_t> uvs;
 	std::vector<md2tri_t> tris;
+	mdframesoa soa;
 	std::string basepath;
 	char *skinfn;   // pointer to first of numskins 64-char strings
 };
@@ -191,12 +214,13 @@ struct md3surf_t
 	md3uv_t *uv;          //file format: rel offs from md3surf
 	md3xyzn_t *xyzn;      //file format: rel offs from md3surf
 	int ofsend;
+	mdframesoa soa;
 };
 
 struct md3filesurf_t
 {
 	int id; //IDP3(0x33806873)
-	std::string nam; //ascz surface name
+	char nam[64]; //ascz surface name
 	int flags; //?
 	int numframes;
 	int numshaders;
@@ -349,10 +373,28 @@ void freeallmodels ();
 void clearskins ();
 void voxfree (voxmodel *m);
 std::unique_ptr<voxmodel> voxload (const std::string& filnam);
+
+	//Voxels loaded through voxloadqueue() are converted together, on the
+	//worker pool, the next time voxloadflush() is called
+inline bool voxloadpending{false};
+void voxloadqueue (int voxindex, const std::string& filnam);
+void voxloadflush ();
 int voxdraw (voxmodel *m, const spritetype *tspr, int method);
 
 void mdinit ();
 PTMHead * mdloadskin (md2model *m, int number, int pal, int surf);
 int mddraw (spritetype *, int method);
 
+/**
+ * Sizes the storage of an MD3 surface for its counts, pointing shaders, uv
+ * and xyzn into the same allocation as tris
+ * @param s the surface
+ */
+void md3surfalloc (md3surf_t *s);
+
+void mdprintframestats ();
+void mdbenchframes (int numactors, int numframes);
+void mdprintloadstats ();
+void mdbenchload ();
+
 #endif
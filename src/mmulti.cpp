@@ -71,73 +71,251 @@ int GetTickCount()
 
 #include "build.hpp"
 #include "mmulti.hpp"
+#include "mmulti_priv.hpp"
 #include "baselayer.hpp"
+#include "crc32.hpp"
 
 #include <algorithm>
 #include <array>
+#include <cerrno>
+#include <deque>
+#include <vector>
 
 namespace {
 
 constexpr auto MAXPAKSIZ{256}; //576
 
-constexpr auto PAKRATE{40};   //Packet rate/sec limit ... necessary?
+constexpr auto PAKRATE{40};   //Packet rate/sec to a peer when idle, and the least when busy
+constexpr auto MAXPAKRATE{200};	//Packet rate/sec to a peer at most, on the shortest round trips
+constexpr auto INITRTO{250};	//Retransmission timeout until a round trip is measured
+constexpr auto MINRTO{10};
+constexpr auto MAXRTO{2000};
+constexpr auto RTOGRANULARITY{5};
 #define SIMMIS 0     //Release:0  Test:100 Packets per 256 missed.
 #define SIMLAG 0     //Release:0  Test: 10 Packets to delay receipt
 constexpr auto PRESENCETIMEOUT{2000};
-#if (SIMLAG > 1)
-int simlagcnt[MAXPLAYERS];
-unsigned char simlagfif[MAXPLAYERS][SIMLAG+1][MAXPAKSIZ+2];
-#endif
 #if ((SIMMIS != 0) || (SIMLAG != 0))
 #pragma message("\n\nWARNING! INTENTIONAL PACKET LOSS SIMULATION IS ENABLED!\nREMEMBER TO CHANGE SIMMIS&SIMLAG to 0 before RELEASE!\n\n")
 #endif
 
-int tims;
-std::array<int, MAXPLAYERS> lastsendtims;
-std::array<int, MAXPLAYERS> lastrecvtims;
-std::array<int, MAXPLAYERS> prevlastrecvtims;
-std::array<unsigned char, MAXPAKSIZ> pakbuf;
-std::array<unsigned char, MAXPAKSIZ> playerslive;
-
 constexpr auto FIFSIZ{512}; //16384/40 = 6min:49sec
-int ipak[MAXPLAYERS][FIFSIZ];
-std::array<int, MAXPLAYERS> icnt0;
-int opak[MAXPLAYERS][FIFSIZ];
-std::array<int, MAXPLAYERS> ocnt0;
-std::array<int, MAXPLAYERS> ocnt1;
-std::array<unsigned char, 4194304> pakmem;
-int pakmemi{1};
+
+	//Messages waiting to be acknowledged, or to be handed to the game. A
+	//message sent to many peers is kept once for all their windows, and goes
+	//into datagrams without being copied again.
+struct pakslot {
+	int refs;
+	int leng;
+	std::array<unsigned char, MAXPAKSIZ> data;
+};
+constexpr auto MAXMESSLENG{MAXPAKSIZ - 2 - 4 - 4 - 4 - 2 - 1 - 32 - 2 - 4 - 2 - 2};	// the most one datagram carries
+
+	//When each message in opak was last put in a datagram, and how often
+struct pakflight {
+	int tims;
+	int sends;
+};
+
+	//Each peer's round trip estimate, RFC 6298 style, from the clock stamps
+	//datagrams carry and echo back, and what has passed between us
+struct peerlink {
+	int srtt8;			// smoothed round trip in milliseconds, scaled by 8
+	int rttvar4;		// and its variation, scaled by 4
+	int samples;
+	int stamp;			// clock stamp on the peer's latest datagram
+	int stampat;		// and when it came, by our clock
+	bool stamped;
+	bool ackpending;	// messages came that the peer hasn't heard we have
+	int ackedtims;		// when the latest sent of the messages acked went out
+	int resends;
+	int highest{-1};	// latest message index received
+	int duplicates;
+	int outoforder;		// messages that came after a later one
+	int badcrc;
+	int datagramssent;
+	int bytessent;
+	int datagramsread;
+	int bytesread;
+};
+
+	//Part of a datagram, gathered by the socket as it sends
+struct paksegment {
+	const unsigned char *data;
+	int leng;
+};
+
+	//A datagram built by dosendpackets(), pointing alternately into head for
+	//the framing and into pakpool for the messages
+constexpr auto MAXPAKSEGS{2 + 2 * (MAXPAKSIZ / 7)};
+struct pakdatagram {
+	int other;
+	int leng;
+	int nsegs;
+	std::array<paksegment, MAXPAKSEGS> segs;
+	std::array<unsigned char, MAXPAKSIZ> head;
+};
+
+#ifdef _WIN32
+using netmsg = WSAMSG;
+using netiovec = WSABUF;
+#else
+using netmsg = struct msghdr;
+using netiovec = struct iovec;
+#endif
+
+#if defined(__linux) || defined(_WIN32)
+constexpr auto NETCONTROLSIZ{CMSG_SPACE(sizeof(struct in_pktinfo)) + CMSG_SPACE(sizeof(struct in6_pktinfo))};
+#else
+constexpr auto NETCONTROLSIZ{CMSG_SPACE(sizeof(struct in_addr)) + CMSG_SPACE(sizeof(struct in6_pktinfo))};
+#endif
+
+	//A datagram as the socket handed it over, with where it came from
+struct pakreceived {
+	std::array<unsigned char, MAXPAKSIZ> data;
+	struct sockaddr_storage from;
+	std::array<char, 1024> control;
+	netiovec iov;
+	netmsg msg;
+	int leng;
+};
+#if defined(__linux)
+constexpr auto RECVBATCH{32};	// datagrams per recvmmsg()
+#else
+constexpr auto RECVBATCH{1};
+#endif
 
 constexpr auto NETPORT{0x5bd9};
-SOCKET mysock = -1;
-int domain{PF_UNSPEC};
-std::array<struct sockaddr_storage, MAXPLAYERS> otherhost;
-struct sockaddr_storage snatchhost;	// IPV4/6 address of peers
-struct in_addr replyfrom4[MAXPLAYERS], snatchreplyfrom4;		// our IPV4 address peers expect to hear from us on
-struct in6_addr replyfrom6[MAXPLAYERS], snatchreplyfrom6;	// our IPV6 address peers expect to hear from us on
-int netready = 0;
+
+} // namespace
+
+	//Everything mmulti keeps for one player. The process's own player keeps
+	//its place in the game in mmulti.hpp's globals; each player netloopbench
+	//simulates keeps it here, in own.
+struct mmulticontext {
+	struct {
+		int myconnectindex{0};
+		int numplayers{0};
+		int networkmode{-1};
+		int connecthead{0};
+		std::array<int, MAXMULTIPLAYERS> connectpoint2{};
+	} own;
+	int& myconnectindex;
+	int& numplayers;
+	int& networkmode;
+	int& connecthead;
+	std::array<int, MAXMULTIPLAYERS>& connectpoint2;
+
+	int tims{0};
+	std::array<int, MAXPLAYERS> lastsendtims{};
+	std::array<int, MAXPLAYERS> lastrecvtims{};
+	std::array<int, MAXPLAYERS> prevlastrecvtims{};
+	std::array<unsigned char, MAXPAKSIZ> pakbuf{};
+	std::array<unsigned char, MAXPAKSIZ> playerslive{};
+
+	int ipak[MAXPLAYERS][FIFSIZ]{};
+	std::array<int, MAXPLAYERS> icnt0{};
+	int opak[MAXPLAYERS][FIFSIZ]{};
+	std::array<int, MAXPLAYERS> ocnt0{};
+	std::array<int, MAXPLAYERS> ocnt1{};
+
+	std::deque<pakslot> pakpool;	// slot 0 stands for none in ipak and opak
+	std::vector<int> pakfree;
+	int paklast{0};	// the last message sent
+	std::vector<std::array<pakflight, FIFSIZ>> oflight;	// sized by initmultiplayers_reset()
+	std::array<peerlink, MAXPLAYERS> peers{};
+
+		//Sized by initmultiplayers_reset(), so a context never used stays small
+	std::vector<pakdatagram> sendqueue;	// for netflush() to send together
+	int sendqueued{0};
+	std::vector<pakreceived> recvqueue;	// for netread() to hand out one at a time
+	int recvcount{0};
+	int recvnext{0};
+
+	SOCKET mysock = -1;
+	int domain{PF_UNSPEC};
+	std::array<struct sockaddr_storage, MAXPLAYERS> otherhost{};
+	struct sockaddr_storage snatchhost{};	// IPV4/6 address of peers
+	struct in_addr replyfrom4[MAXPLAYERS]{}, snatchreplyfrom4{};		// our IPV4 address peers expect to hear from us on
+	struct in6_addr replyfrom6[MAXPLAYERS]{}, snatchreplyfrom6{};	// our IPV6 address peers expect to hear from us on
+	int netready = 0;
+
+	const mmultitransport *transport{nullptr};	// nullptr for the UDP socket
+	mmulticounters counters{};
+#if (SIMLAG > 1)
+	int simlagcnt[MAXPLAYERS]{};
+	unsigned char simlagfif[MAXPLAYERS][SIMLAG+1][MAXPAKSIZ+2]{};
+#endif
+
+	mmulticontext()
+		: myconnectindex{own.myconnectindex}, numplayers{own.numplayers}, networkmode{own.networkmode},
+		  connecthead{own.connecthead}, connectpoint2{own.connectpoint2}
+	{}
+	explicit mmulticontext(const mmultiplayer& globals)
+		: myconnectindex{globals.myconnectindex}, numplayers{globals.numplayers}, networkmode{globals.networkmode},
+		  connecthead{globals.connecthead}, connectpoint2{globals.connectpoint2}
+	{}
+};
+
+namespace {
+
+mmulticontext processcontext{ mmultiplayer{ ::myconnectindex, ::numplayers, ::networkmode, ::connecthead, ::connectpoint2 } };
+thread_local mmulticontext *ctx{&processcontext};	// whose state the calling thread works on
+
+
+int nettime()
+{
+	if (ctx->transport) return ctx->transport->ticks();
+#ifdef _WIN32
+	return (int)::GetTickCount64();
+#else
+	return GetTickCount();
+#endif
+}
 
 int lookuphost(const char *name, struct sockaddr *host, int warnifmany);
 int issameaddress(struct sockaddr const *a, struct sockaddr const *b);
 const char *presentaddress(struct sockaddr const *a);
 void savesnatchhost(int other);
+void identifysender(int *other);
+
+void countsent(int other, int bufsiz)
+{
+	ctx->counters.datagramssent++;
+	ctx->counters.bytessent += bufsiz;
+	ctx->peers[other].datagramssent++;
+	ctx->peers[other].bytessent += bufsiz;
+}
+
+void countread(int other, int bufsiz)
+{
+	ctx->counters.datagramsread++;
+	ctx->counters.bytesread += bufsiz;
+	ctx->peers[other].datagramsread++;
+	ctx->peers[other].bytesread += bufsiz;
+}
 
 } // namespace
 
 void netuninit ()
 {
+	if (ctx->transport) {
+		ctx->transport->uninit();
+		ctx->domain = PF_UNSPEC;
+		return;
+	}
+
 #ifdef _WIN32
-	if (mysock != INVALID_SOCKET) closesocket(mysock);
+	if (ctx->mysock != INVALID_SOCKET) closesocket(ctx->mysock);
 	WSACleanup();
-	mysock = INVALID_SOCKET;
+	ctx->mysock = INVALID_SOCKET;
 
 	WSASendMsgPtr = nullptr;
 	WSARecvMsgPtr = nullptr;
 #else
-	if (mysock >= 0) close(mysock);
-	mysock = -1;
+	if (ctx->mysock >= 0) close(ctx->mysock);
+	ctx->mysock = -1;
 #endif
-	domain = PF_UNSPEC;
+	ctx->domain = PF_UNSPEC;
 }
 
 int netinit (int portnum)
@@ -150,32 +328,39 @@ int netinit (int portnum)
 	unsigned int off = 0, on = 1;
 #endif
 
+	if (ctx->transport) {
+		ctx->domain = PF_INET6;
+		if (ctx->transport->init(portnum)) return 1;
+		ctx->domain = PF_UNSPEC;
+		return 0;
+	}
+
 #ifdef _WIN32
 	if (WSAStartup(0x202, &ws) != 0) return(0);
 #endif
 
 #ifdef USE_IPV6
-	domain = PF_INET6;
+	ctx->domain = PF_INET6;
 #else
-	domain = PF_INET;
+	ctx->domain = PF_INET;
 #endif
 
-	while (domain != PF_UNSPEC) {
+	while (ctx->domain != PF_UNSPEC) {
 		// Tidy up from last cycle.
 #ifdef _WIN32
-		if (mysock != INVALID_SOCKET) closesocket(mysock);
+		if (ctx->mysock != INVALID_SOCKET) closesocket(ctx->mysock);
 		WSASendMsgPtr = nullptr;
 		WSARecvMsgPtr = nullptr;
 #else
-		if (mysock >= 0) close(mysock);
+		if (ctx->mysock >= 0) close(ctx->mysock);
 #endif
 
-		mysock = socket(domain, SOCK_DGRAM, 0);
-		if (IS_INVALID_SOCKET(mysock)) {
-			if (domain == PF_INET6) {
+		ctx->mysock = socket(ctx->domain, SOCK_DGRAM, 0);
+		if (IS_INVALID_SOCKET(ctx->mysock)) {
+			if (ctx->domain == PF_INET6) {
 				// Retry for IPV4.
 				std::printf("mmulti warning: could not create IPV6 socket, trying for IPV4.\n");
-				domain = PF_INET;
+				ctx->domain = PF_INET;
 				continue;
 			} else {
 				// No IPV4 is a total loss.
@@ -188,13 +373,13 @@ int netinit (int portnum)
 		DWORD len;
 		GUID sendguid = WSAID_WSASENDMSG;
 		GUID recvguid = WSAID_WSARECVMSG;
-		if (WSAIoctl(mysock, SIO_GET_EXTENSION_FUNCTION_POINTER,
+		if (WSAIoctl(ctx->mysock, SIO_GET_EXTENSION_FUNCTION_POINTER,
 				&sendguid, sizeof(sendguid), &WSASendMsgPtr, sizeof(WSASendMsgPtr),
 				&len, nullptr, nullptr) == SOCKET_ERROR) {
 			std::printf("mmulti error: could not get sendmsg entry point.\n");
 			break;
 		}
-		if (WSAIoctl(mysock, SIO_GET_EXTENSION_FUNCTION_POINTER,
+		if (WSAIoctl(ctx->mysock, SIO_GET_EXTENSION_FUNCTION_POINTER,
 				&recvguid, sizeof(recvguid), &WSARecvMsgPtr, sizeof(WSARecvMsgPtr),
 				&len, nullptr, nullptr) == SOCKET_ERROR) {
 			std::printf("mmulti error: could not get recvmsg entry point.\n");
@@ -204,9 +389,9 @@ int netinit (int portnum)
 
 		// Set non-blocking IO on the socket.
 #ifdef _WIN32
-		if (ioctlsocket(mysock, FIONBIO, &on) != 0)
+		if (ioctlsocket(ctx->mysock, FIONBIO, &on) != 0)
 #else
-		if (ioctl(mysock, FIONBIO, &on) != 0)
+		if (ioctl(ctx->mysock, FIONBIO, &on) != 0)
 #endif
 		{
 			std::printf("mmulti error: could not enable non-blocking IO on socket.\n");
@@ -214,19 +399,19 @@ int netinit (int portnum)
 		}
 
 		// Allow local address reuse.
-		if (setsockopt(mysock, SOL_SOCKET, SO_REUSEADDR, static_cast<const char*>((void *)&on), sizeof(on)) != 0) {
+		if (setsockopt(ctx->mysock, SOL_SOCKET, SO_REUSEADDR, static_cast<const char*>((void *)&on), sizeof(on)) != 0) {
 			std::printf("mmulti error: could not enable local address reuse on socket.\n");
 			break;
 		}
 
 		// Request that we receive IPV4 packet info.
 #if defined(__linux) || defined(_WIN32)
-		if (setsockopt(mysock, IPPROTO_IP, IP_PKTINFO, static_cast<const char*>((void *)&on), sizeof(on)) != 0)
+		if (setsockopt(ctx->mysock, IPPROTO_IP, IP_PKTINFO, static_cast<const char*>((void *)&on), sizeof(on)) != 0)
 #else
-		if (domain == PF_INET && setsockopt(mysock, IPPROTO_IP, IP_RECVDSTADDR, &on, sizeof(on)) != 0)
+		if (ctx->domain == PF_INET && setsockopt(ctx->mysock, IPPROTO_IP, IP_RECVDSTADDR, &on, sizeof(on)) != 0)
 #endif
 		{
-			if (domain == PF_INET) {
+			if (ctx->domain == PF_INET) {
 				std::printf("mmulti error: could not enable IPV4 packet info on socket.\n");
 				break;
 			} else {
@@ -234,16 +419,16 @@ int netinit (int portnum)
 			}
 		}
 
-		if (domain == PF_INET6) {
+		if (ctx->domain == PF_INET6) {
 			// Allow dual-stack IPV4/IPV6 on the socket.
-			if (setsockopt(mysock, IPPROTO_IPV6, IPV6_V6ONLY, static_cast<const char*>((void *)&off), sizeof(off)) != 0) {
+			if (setsockopt(ctx->mysock, IPPROTO_IPV6, IPV6_V6ONLY, static_cast<const char*>((void *)&off), sizeof(off)) != 0) {
 				std::printf("mmulti warning: could not enable dual-stack socket, retrying for IPV4.\n");
-				domain = PF_INET;
+				ctx->domain = PF_INET;
 				continue;
 			}
 
 			// Request that we receive IPV6 packet info.
-			if (setsockopt(mysock, IPPROTO_IPV6, IPV6_RECVPKTINFO, static_cast<const char*>((void *)&on), sizeof(on)) != 0) {
+			if (setsockopt(ctx->mysock, IPPROTO_IPV6, IPV6_RECVPKTINFO, static_cast<const char*>((void *)&on), sizeof(on)) != 0) {
 				std::printf("mmulti error: could not enable IPV6 packet info on socket.\n");
 				break;
 			}
@@ -253,9 +438,9 @@ int netinit (int portnum)
 			host.sin6_family = AF_INET6;
 			host.sin6_port = htons(portnum);
 			host.sin6_addr = in6addr_any;
-			if (bind(mysock, (struct sockaddr *)&host, sizeof(host)) != 0) {
+			if (bind(ctx->mysock, (struct sockaddr *)&host, sizeof(host)) != 0) {
 				// Retry for IPV4.
-				domain = PF_INET;
+				ctx->domain = PF_INET;
 				continue;
 			}
 		} else {
@@ -264,7 +449,7 @@ int netinit (int portnum)
 			host.sin_family = AF_INET;
 			host.sin_port = htons(portnum);
 			host.sin_addr.s_addr = INADDR_ANY;
-			if (bind(mysock, (struct sockaddr *)&host, sizeof(host)) != 0) {
+			if (bind(ctx->mysock, (struct sockaddr *)&host, sizeof(host)) != 0) {
 				// No IPV4 is a total loss.
 				break;
 			}
@@ -279,128 +464,159 @@ int netinit (int portnum)
 	return 0;
 }
 
-int netsend (int other, void *dabuf, int bufsiz) //0:buffer full... can't send
+namespace {
+
+void netmsgsetup(netmsg *msg, void *name, int namelen, netiovec *iov, int niov, char *control, int controllen)
 {
-    #if defined(__linux) || defined(_WIN32)
-	char msg_control[CMSG_SPACE(sizeof(struct in_pktinfo)) + CMSG_SPACE(sizeof(struct in6_pktinfo))];
-	#else
-	char msg_control[CMSG_SPACE(sizeof(struct in_addr)) + CMSG_SPACE(sizeof(struct in6_pktinfo))];
-	#endif
-	if (otherhost[other].ss_family == AF_UNSPEC) return(0);
-
-	if (otherhost[other].ss_family != domain) {
-#ifdef MMULTI_DEBUG_SENDRECV_WIRE
-		debugprintf("mmulti debug send error: tried sending to a different protocol family\n");
+#ifdef _WIN32
+	msg->name = (LPSOCKADDR)name;
+	msg->namelen = namelen;
+	msg->lpBuffers = iov;
+	msg->dwBufferCount = niov;
+	msg->Control.buf = control;
+	msg->Control.len = controllen;
+	msg->dwFlags = 0;
+#else
+	msg->msg_name = name;
+	msg->msg_namelen = namelen;
+	msg->msg_iov = iov;
+	msg->msg_iovlen = niov;
+	msg->msg_control = control;
+	msg->msg_controllen = controllen;
+	msg->msg_flags = 0;
 #endif
-		return 0;
-	}
+}
 
-	if (IS_INVALID_SOCKET(mysock)) {
-#ifdef MMULTI_DEBUG_SENDRECV_WIRE
-		debugprintf("mmulti debug send error: invalid socket\n");
+void netiovsetup(netiovec *iov, const void *data, int leng)
+{
+#ifdef _WIN32
+	iov->buf = (CHAR *)data;
+	iov->len = leng;
+#else
+	iov->iov_base = (void *)data;
+	iov->iov_len = leng;
 #endif
-		return 0;
-	}
+}
 
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
-	{
-		int i;
-		const unsigned char *pakbuf = dabuf;
-		debugprintf("mmulti debug send: "); for(i=0;i<bufsiz;i++) debugprintf("%02x ",pakbuf[i]); debugprintf("\n");
-	}
+void netdebugwire(const char *what, const paksegment *segs, int nsegs)
+{
+	debugprintf("mmulti debug %s: ", what);
+	for(int s=0;s<nsegs;s++)
+		for(int i=0;i<segs[s].leng;i++) debugprintf("%02x ",segs[s].data[i]);
+	debugprintf("\n");
+}
 #endif
 
-#ifdef _WIN32
-	WSABUF iovec;
-	WSAMSG msg;
-	WSACMSGHDR *cmsg;
-	DWORD len = 0;
+	// Whether a datagram to a peer could go out at all
+bool netcansend(int other)
+{
+	if (ctx->otherhost[other].ss_family == AF_UNSPEC) return false;
 
-	iovec.buf = static_cast<CHAR*>(dabuf);
-	iovec.len = bufsiz;
-	msg.name = (LPSOCKADDR)&otherhost[other];
-	if (otherhost[other].ss_family == AF_INET) {
-		msg.namelen = sizeof(struct sockaddr_in);
-	} else {
-		msg.namelen = sizeof(struct sockaddr_in6);
+	if (ctx->otherhost[other].ss_family != ctx->domain) {
+#ifdef MMULTI_DEBUG_SENDRECV_WIRE
+		debugprintf("mmulti debug send error: tried sending to a different protocol family\n");
+#endif
+		return false;
 	}
-	msg.lpBuffers = &iovec;
-	msg.dwBufferCount = 1;
-	msg.Control.buf = msg_control;
-	msg.Control.len = sizeof(msg_control);
-	msg.dwFlags = 0;
-#else
-	struct iovec iovec;
-	struct msghdr msg;
-	struct cmsghdr *cmsg;
-	int len;
 
-	iovec.iov_base = dabuf;
-	iovec.iov_len = bufsiz;
-	msg.msg_name = &otherhost[other];
-	if (otherhost[other].ss_family == AF_INET) {
-		msg.msg_namelen = sizeof(struct sockaddr_in);
-	} else {
-		msg.msg_namelen = sizeof(struct sockaddr_in6);
-	}
-	msg.msg_iov = &iovec;
-	msg.msg_iovlen = 1;
-	msg.msg_control = msg_control;
-	msg.msg_controllen = sizeof(msg_control);
-	msg.msg_flags = 0;
+	if (!ctx->transport && IS_INVALID_SOCKET(ctx->mysock)) {
+#ifdef MMULTI_DEBUG_SENDRECV_WIRE
+		debugprintf("mmulti debug send error: invalid socket\n");
 #endif
+		return false;
+	}
+
+	return true;
+}
+
+	// Addresses a datagram to a peer, asking for it to leave from our address
+	// they last heard from us on. The socket gathers the segments as it sends.
+void netaddress(int other, netmsg *msg, netiovec *iov, const paksegment *segs, int nsegs, char *msg_control)
+{
+	int len = 0;
 
-	len = 0;
-	std::memset(msg_control, 0, sizeof(msg_control));
+	for(int i=0;i<nsegs;i++) netiovsetup(&iov[i], segs[i].data, segs[i].leng);
+	netmsgsetup(msg, &ctx->otherhost[other],
+		ctx->otherhost[other].ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6),
+		iov, nsegs, msg_control, NETCONTROLSIZ);
+	std::memset(msg_control, 0, NETCONTROLSIZ);
 
-	cmsg = CMSG_FIRSTHDR(&msg);
+	auto *cmsg = CMSG_FIRSTHDR(msg);
 #if !defined(__APPLE__) && !defined(__HAIKU__)
 	// OS X doesn't implement setting the UDP4 source. We'll
 	// just have to cross our fingers.
-	if (replyfrom4[other].s_addr != INADDR_ANY) {
+	if (ctx->replyfrom4[other].s_addr != INADDR_ANY) {
 		cmsg->cmsg_level = IPPROTO_IP;
 #if defined(__linux) || defined(_WIN32)
 		cmsg->cmsg_type = IP_PKTINFO;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
 		#ifdef _WIN32
-		((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_addr = replyfrom4[other];
+		((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_addr = ctx->replyfrom4[other];
 		#else
-		((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_spec_dst = replyfrom4[other];
+		((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_spec_dst = ctx->replyfrom4[other];
 		#endif
 		len += CMSG_SPACE(sizeof(struct in_pktinfo));
 #else
 		cmsg->cmsg_type = IP_SENDSRCADDR;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
-		*(struct in_addr *)CMSG_DATA(cmsg) = replyfrom4[other];
+		*(struct in_addr *)CMSG_DATA(cmsg) = ctx->replyfrom4[other];
 		len += CMSG_SPACE(sizeof(struct in_addr));
 #endif
-		cmsg = CMSG_NXTHDR(&msg, cmsg);
+		cmsg = CMSG_NXTHDR(msg, cmsg);
 	}
 #endif
-	if (!IN6_IS_ADDR_UNSPECIFIED(&replyfrom6[other])) {
+	if (!IN6_IS_ADDR_UNSPECIFIED(&ctx->replyfrom6[other])) {
 		cmsg->cmsg_level = IPPROTO_IPV6;
 		cmsg->cmsg_type = IPV6_PKTINFO;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
-		((struct in6_pktinfo *)CMSG_DATA(cmsg))->ipi6_addr = replyfrom6[other];
+		((struct in6_pktinfo *)CMSG_DATA(cmsg))->ipi6_addr = ctx->replyfrom6[other];
 		len += CMSG_SPACE(sizeof(struct in6_pktinfo));
-		cmsg = CMSG_NXTHDR(&msg, cmsg);
 	}
 #ifdef _WIN32
-	msg.Control.len = len;
+	msg->Control.len = len;
 	if (len == 0) {
-		msg.Control.buf = nullptr;
+		msg->Control.buf = nullptr;
 	}
 #else
-	msg.msg_controllen = len;
+	msg->msg_controllen = len;
 	if (len == 0) {
-		msg.msg_control = nullptr;
+		msg->msg_control = nullptr;
 	}
 #endif
+}
+
+int netsendv(int other, const paksegment *segs, int nsegs, int bufsiz) //0:buffer full... can't send
+{
+	if (!netcansend(other)) return 0;
+
+#ifdef MMULTI_DEBUG_SENDRECV_WIRE
+	netdebugwire("send", segs, nsegs);
+#endif
+
+	if (ctx->transport) {
+		std::array<unsigned char, MAXPAKSIZ> gathered;
+		int k = 0;
+		for(int i=0;i<nsegs;i++) {
+			std::memcpy(&gathered[k], segs[i].data, segs[i].leng); k += segs[i].leng;
+		}
+		ctx->counters.sendcalls++;
+		if (!ctx->transport->send((struct sockaddr *)&ctx->otherhost[other], gathered.data(), k)) return 0;
+		countsent(other, bufsiz);
+		return 1;
+	}
 
+	std::array<netiovec, MAXPAKSEGS> iov;
+	netmsg msg;
+	char msg_control[NETCONTROLSIZ];
+
+	netaddress(other, &msg, iov.data(), segs, nsegs, msg_control);
+	ctx->counters.sendcalls++;
 #ifdef _WIN32
-	if (WSASendMsgPtr(mysock, &msg, 0, &len, nullptr, nullptr) == SOCKET_ERROR)
+	DWORD len = 0;
+	if (WSASendMsgPtr(ctx->mysock, &msg, 0, &len, nullptr, nullptr) == SOCKET_ERROR)
 #else
-	if ((len = (int)sendmsg(mysock, &msg, 0)) < 0)
+	if (sendmsg(ctx->mysock, &msg, 0) < 0)
 #endif
 	{
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
@@ -409,59 +625,146 @@ int netsend (int other, void *dabuf, int bufsiz) //0:buffer full... can't send
 		return 0;
 	}
 
+	countsent(other, bufsiz);
 	return 1;
 }
 
-int netread (int *other, void *dabuf, int bufsiz) //0:no packets in buffer
+	// Sends the datagrams dosendpackets() queued, in one system call where
+	// the platform has one for many
+void netflush()
 {
-	char msg_control[1024];
-	int i;
+#if defined(__linux)
+	if (!ctx->transport && ctx->sendqueued > 1) {
+		std::array<struct mmsghdr, MAXPLAYERS> mmsg;
+		std::array<std::array<netiovec, MAXPAKSEGS>, MAXPLAYERS> iov;
+		std::array<std::array<char, NETCONTROLSIZ>, MAXPLAYERS> msg_control;
+		std::array<int, MAXPLAYERS> bufsiz;
+		std::array<int, MAXPLAYERS> others;
+		int n = 0;
+
+		for(int i=0;i<ctx->sendqueued;i++) {
+			const auto& d = ctx->sendqueue[i];
+			if (!netcansend(d.other)) continue;
+#ifdef MMULTI_DEBUG_SENDRECV_WIRE
+			netdebugwire("send", d.segs.data(), d.nsegs);
+#endif
+			netaddress(d.other, &mmsg[n].msg_hdr, iov[n].data(), d.segs.data(), d.nsegs, msg_control[n].data());
+			others[n] = d.other;
+			bufsiz[n++] = d.leng;
+		}
 
-	if (IS_INVALID_SOCKET(mysock)) {
+		for(int sent=0;sent<n;) {
+			ctx->counters.sendcalls++;
+			const int r = sendmmsg(ctx->mysock, &mmsg[sent], n - sent, 0);
+			if (r <= 0) {
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
-		debugprintf("mmulti debug recv error: invalid socket\n");
+				debugprintf("mmulti debug send error: %s\n", strerror(errno));
 #endif
-		return 0;
+					// A full socket takes none of the rest either. Anything else,
+					// like an unreachable peer, only loses the datagram it stopped
+					// at, as it would sent on its own.
+				if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+				sent++;
+				continue;
+			}
+			for(int i=sent;i<sent+r;i++) countsent(others[i], bufsiz[i]);
+			sent += r;
+		}
+
+		ctx->sendqueued = 0;
+		return;
 	}
+#endif
 
-#ifdef _WIN32
-	WSABUF iovec;
-	WSAMSG msg;
-	WSACMSGHDR *cmsg;
-	DWORD len = 0;
+	for(int i=0;i<ctx->sendqueued;i++) {
+		const auto& d = ctx->sendqueue[i];
+		netsendv(d.other, d.segs.data(), d.nsegs, d.leng);
+	}
+	ctx->sendqueued = 0;
+}
+
+	// Refills recvqueue from the socket, returning how many datagrams came
+int netreceive()
+{
+	for (auto& r : ctx->recvqueue) {
+		netiovsetup(&r.iov, r.data.data(), MAXPAKSIZ);
+		netmsgsetup(&r.msg, &r.from, sizeof(r.from), &r.iov, 1, r.control.data(), (int)r.control.size());
+		r.leng = 0;
+	}
 
-	iovec.buf = static_cast<CHAR*>(dabuf);
-	iovec.len = bufsiz;
-	msg.name = (LPSOCKADDR)&snatchhost;
-	msg.namelen = sizeof(snatchhost);
-	msg.lpBuffers = &iovec;
-	msg.dwBufferCount = 1;
-	msg.Control.buf = msg_control;
-	msg.Control.len = sizeof(msg_control);
-	msg.dwFlags = 0;
-
-	if (WSARecvMsgPtr(mysock, &msg, &len, nullptr, nullptr) == SOCKET_ERROR) return 0;
+	ctx->counters.readcalls++;
+#if defined(__linux)
+	std::array<struct mmsghdr, RECVBATCH> mmsg;
+	for(int i=0;i<RECVBATCH;i++) {
+		mmsg[i].msg_hdr = ctx->recvqueue[i].msg;
+		mmsg[i].msg_len = 0;
+	}
+
+	const int n = recvmmsg(ctx->mysock, mmsg.data(), RECVBATCH, 0, nullptr);
+	if (n <= 0) return 0;
+	for(int i=0;i<n;i++) {
+		ctx->recvqueue[i].msg = mmsg[i].msg_hdr;
+		ctx->recvqueue[i].leng = (int)mmsg[i].msg_len;
+	}
+	return n;
+#elif defined(_WIN32)
+	DWORD len = 0;
+	if (WSARecvMsgPtr(ctx->mysock, &ctx->recvqueue[0].msg, &len, nullptr, nullptr) == SOCKET_ERROR) return 0;
+	ctx->recvqueue[0].leng = (int)len;
+	return 1;
 #else
-	struct iovec iovec;
-	struct msghdr msg;
-	struct cmsghdr *cmsg;
+	const int len = (int)recvmsg(ctx->mysock, &ctx->recvqueue[0].msg, 0);
+	if (len < 0) return 0;
+	ctx->recvqueue[0].leng = len;
+	return 1;
+#endif
+}
+
+} // namespace
+
+int netsend (int other, void *dabuf, int bufsiz) //0:buffer full... can't send
+{
+	const paksegment seg{ static_cast<const unsigned char *>(dabuf), bufsiz };
+	return netsendv(other, &seg, 1, bufsiz);
+}
+
+int netread (int *other, unsigned char **dabuf) //0:no packets in buffer, else length
+{
 	int len;
 
-	iovec.iov_base = dabuf;
-	iovec.iov_len = bufsiz;
-	msg.msg_name = &snatchhost;
-	msg.msg_namelen = sizeof(snatchhost);
-	msg.msg_iov = &iovec;
-	msg.msg_iovlen = 1;
-	msg.msg_control = msg_control;
-	msg.msg_controllen = sizeof(msg_control);
-	msg.msg_flags = 0;
-
-	if ((len = (int)recvmsg(mysock, &msg, 0)) < 0) return 0;
+	if (ctx->transport) {
+		auto& r = ctx->recvqueue[0];
+		ctx->counters.readcalls++;
+		len = ctx->transport->read((struct sockaddr *)&ctx->snatchhost, r.data.data(), MAXPAKSIZ);
+		if (len <= 0) return 0;
+
+		std::memset(&ctx->snatchreplyfrom4, 0, sizeof(ctx->snatchreplyfrom4));
+		std::memset(&ctx->snatchreplyfrom6, 0, sizeof(ctx->snatchreplyfrom6));
+		identifysender(other);
+		countread(*other, len);
+		*dabuf = r.data.data();
+		return len;
+	}
+
+	if (IS_INVALID_SOCKET(ctx->mysock)) {
+#ifdef MMULTI_DEBUG_SENDRECV_WIRE
+		debugprintf("mmulti debug recv error: invalid socket\n");
 #endif
+		return 0;
+	}
+
+		// Hand out what the last system call brought before making another
+	if (ctx->recvnext >= ctx->recvcount) {
+		ctx->recvnext = 0;
+		ctx->recvcount = netreceive();
+	}
+	if (ctx->recvnext >= ctx->recvcount) return 0;
+	auto& r = ctx->recvqueue[ctx->recvnext++];
+	len = r.leng;
 	if (len == 0) return 0;
 
-	if (snatchhost.ss_family != domain) {
+	std::memcpy(&ctx->snatchhost, &r.from, sizeof(ctx->snatchhost));
+	if (ctx->snatchhost.ss_family != ctx->domain) {
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
 		debugprintf("mmulti debug recv error: received from a different protocol family\n");
 #endif
@@ -475,61 +778,67 @@ int netread (int *other, void *dabuf, int bufsiz) //0:no packets in buffer
 	// Decode the message headers to record what of our IP addresses the
 	// packet came in on. We reply on that same address so the peer knows
 	// who it came from.
-	std::memset(&snatchreplyfrom4, 0, sizeof(snatchreplyfrom4));
-	std::memset(&snatchreplyfrom6, 0, sizeof(snatchreplyfrom6));
-	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	std::memset(&ctx->snatchreplyfrom4, 0, sizeof(ctx->snatchreplyfrom4));
+	std::memset(&ctx->snatchreplyfrom6, 0, sizeof(ctx->snatchreplyfrom6));
+	for (auto *cmsg = CMSG_FIRSTHDR(&r.msg); cmsg; cmsg = CMSG_NXTHDR(&r.msg, cmsg)) {
 #if defined(__linux) || defined(_WIN32)
 		if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
-			snatchreplyfrom4 = ((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_addr;
+			ctx->snatchreplyfrom4 = ((struct in_pktinfo *)CMSG_DATA(cmsg))->ipi_addr;
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
-			debugprintf("mmulti debug recv: received at %s\n", inet_ntoa(snatchreplyfrom4));
+			debugprintf("mmulti debug recv: received at %s\n", inet_ntoa(ctx->snatchreplyfrom4));
 #endif
 		}
 #else
 		if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVDSTADDR) {
-			snatchreplyfrom4 = *(struct in_addr *)CMSG_DATA(cmsg);
+			ctx->snatchreplyfrom4 = *(struct in_addr *)CMSG_DATA(cmsg);
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
-			debugprintf("mmulti debug recv: received at %s\n", inet_ntoa(snatchreplyfrom4));
+			debugprintf("mmulti debug recv: received at %s\n", inet_ntoa(ctx->snatchreplyfrom4));
 #endif
 		}
 #endif
 		else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO) {
-			snatchreplyfrom6 = ((struct in6_pktinfo *)CMSG_DATA(cmsg))->ipi6_addr;
+			ctx->snatchreplyfrom6 = ((struct in6_pktinfo *)CMSG_DATA(cmsg))->ipi6_addr;
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
 			char addr[INET6_ADDRSTRLEN+1];
-			debugprintf("mmulti debug recv: received at %s\n", inet_ntop(AF_INET6, &snatchreplyfrom6, addr, sizeof(addr)));
+			debugprintf("mmulti debug recv: received at %s\n", inet_ntop(AF_INET6, &ctx->snatchreplyfrom6, addr, sizeof(addr)));
 #endif
 		}
 	}
 
 #ifdef MMULTI_DEBUG_SENDRECV_WIRE
 	{
-		const unsigned char *pakbuf = dabuf;
-		debugprintf("mmulti debug recv: ");
-		for(i=0;i<len;i++) debugprintf("%02x ",pakbuf[i]);
-		debugprintf("\n");
+		const paksegment seg{ r.data.data(), len };
+		netdebugwire("recv", &seg, 1);
 	}
 #endif
 
-	(*other) = myconnectindex;
-	for(i=0;i<MAXPLAYERS;i++) {
-		if (issameaddress((struct sockaddr *)&snatchhost, (struct sockaddr *)&otherhost[i]))
-			{ (*other) = i; break; }
-	}
+	identifysender(other);
+	countread(*other, len);
+	*dabuf = r.data.data();
 
 #if (SIMLAG > 1)
-	i = simlagcnt[*other]%(SIMLAG+1);
-	*(short *)&simlagfif[*other][i][0] = bufsiz; std::memcpy(&simlagfif[*other][i][2],dabuf,bufsiz);
-	simlagcnt[*other]++; if (simlagcnt[*other] < SIMLAG+1) return(0);
-	i = simlagcnt[*other]%(SIMLAG+1);
-	bufsiz = *(short *)&simlagfif[*other][i][0]; std::memcpy(dabuf,&simlagfif[*other][i][2],bufsiz);
+	int i = ctx->simlagcnt[*other]%(SIMLAG+1);
+	*(short *)&ctx->simlagfif[*other][i][0] = len; std::memcpy(&ctx->simlagfif[*other][i][2],*dabuf,len);
+	ctx->simlagcnt[*other]++; if (ctx->simlagcnt[*other] < SIMLAG+1) return(0);
+	i = ctx->simlagcnt[*other]%(SIMLAG+1);
+	len = *(short *)&ctx->simlagfif[*other][i][0]; *dabuf = &ctx->simlagfif[*other][i][2];
 #endif
 
-	return(1);
+	return(len);
 }
 
 namespace {
 
+	// Finds which player snatchhost belongs to, or myconnectindex if nobody
+void identifysender(int *other)
+{
+	(*other) = ctx->myconnectindex;
+	for(int i=0;i<MAXPLAYERS;i++) {
+		if (issameaddress((struct sockaddr *)&ctx->snatchhost, (struct sockaddr *)&ctx->otherhost[i]))
+			{ (*other) = i; break; }
+	}
+}
+
 int issameaddress(struct sockaddr const *a, struct sockaddr const *b) {
 	if (a->sa_family != b->sa_family) {
 		// Different families.
@@ -580,32 +889,118 @@ const char *presentaddress(struct sockaddr const *a) {
 
 //--------------------------------------------------------------------------------------------------
 
-int crctab16[256];
-void initcrc16 ()
+	// The CRC runs from the last byte back to the first, so a message spread
+	// over segments is done from its last segment back
+unsigned short getcrc16 (const unsigned char *buffer, int bufleng)
+{
+	return crc16back(0, buffer, (std::size_t)std::max(bufleng, 0));
+}
+unsigned short getcrc16 (const paksegment *segs, int nsegs)
+{
+	unsigned short j = 0;
+
+	for(int s=nsegs-1;s>=0;s--)
+		j = crc16back(j, segs[s].data, (std::size_t)std::max(segs[s].leng, 0));
+	return j;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+int pakalloc(const unsigned char *data, int leng)
 {
-	int i;
-	int j;
-	int k;
-	int a;
-	for(j=0;j<256;j++)
-	{
-		for(i=7,k=(j<<8),a=0;i>=0;i--,k=((k<<1)&65535))
-		{
-			if ((k^a)&0x8000) a = ((a<<1)&65535)^0x1021;
-							 else a = ((a<<1)&65535);
-		}
-		crctab16[j] = (a&65535);
+	int slot;
+
+	if (!ctx->pakfree.empty()) {
+		slot = ctx->pakfree.back();
+		ctx->pakfree.pop_back();
+	} else {
+		slot = (int)ctx->pakpool.size();
+		ctx->pakpool.emplace_back();
 	}
+	ctx->pakpool[slot].refs = 1;
+	ctx->pakpool[slot].leng = leng;
+	std::memcpy(ctx->pakpool[slot].data.data(), data, leng);
+	return slot;
 }
-#define updatecrc16(crc,dat) crc = (((crc<<8)&65535)^crctab16[((((unsigned short)crc)>>8)&65535)^dat])
-unsigned short getcrc16 (const unsigned char *buffer, int bufleng)
+
+	// Lets go of a window's reference to a message, and clears it
+void pakdrop(int& slot)
 {
-	int i;
-	int j;
+	if (!slot) return;
+	if (--ctx->pakpool[slot].refs == 0) ctx->pakfree.push_back(slot);
+	slot = 0;
+}
+
+	// Puts a message from the pool at the end of a player's send window
+void pakqueue(int other, int slot)
+{
+	pakdrop(ctx->opak[other][ctx->ocnt1[other]&(FIFSIZ-1)]);	// only if the window overflowed
+	ctx->opak[other][ctx->ocnt1[other]&(FIFSIZ-1)] = slot;
+	ctx->oflight[other][ctx->ocnt1[other]&(FIFSIZ-1)] = {};
+	ctx->ocnt1[other]++;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+void rttsample(int other, int rtt)
+{
+	auto& peer = ctx->peers[other];
+
+	rtt = std::max(rtt, 0);
+	if (!peer.samples) {
+		peer.srtt8 = rtt << 3;
+		peer.rttvar4 = rtt << 1;
+	} else {
+		const int err = rtt - (peer.srtt8 >> 3);
+		peer.srtt8 += err;
+		peer.rttvar4 += std::abs(err) - (peer.rttvar4 >> 2);
+	}
+	peer.samples++;
+}
+
+	// Least time between datagrams to a peer: a quarter round trip, so acks
+	// and resends keep up on short links without flooding long ones
+int sendinterval(int other)
+{
+	if (!ctx->peers[other].samples) return 1000/PAKRATE;
+	return std::clamp((ctx->peers[other].srtt8 >> 3) / 4, 1000/MAXPAKRATE, 1000/PAKRATE);
+}
 
-	j = 0;
-	for(i=bufleng-1;i>=0;i--) updatecrc16(j,buffer[i]);
-	return((unsigned short)(j&65535));
+	// How long a message goes unacknowledged before it's taken for lost. The
+	// peer may hold its ack for up to a send interval of its own.
+int retransmittimeout(int other)
+{
+	if (!ctx->peers[other].samples) return INITRTO;
+	return std::clamp((ctx->peers[other].srtt8 >> 3) + std::max(ctx->peers[other].rttvar4, RTOGRANULARITY) + sendinterval(other),
+		MINRTO, MAXRTO);
+}
+
+	// Whether an outgoing message needs putting in a datagram: it never has
+	// been, or it looks lost because the timeout passed, backing off on each
+	// resend, or because one sent after it was acked a while ago
+bool pakdue(int other, int i, int rto)
+{
+	const int slot = ctx->opak[other][i&(FIFSIZ-1)];
+	if (!slot || !ctx->pakpool[slot].leng) return false;
+
+	const auto& flight = ctx->oflight[other][i&(FIFSIZ-1)];
+	if (!flight.sends) return true;
+
+	const auto& peer = ctx->peers[other];
+	const int age = ctx->tims - flight.tims;
+	if (age >= (rto << std::min(flight.sends - 1, 3))) return true;
+	return flight.tims - peer.ackedtims < 0 && age >= (peer.srtt8 >> 3) + (peer.rttvar4 >> 2) + RTOGRANULARITY;
+}
+
+	// Records a peer's acknowledgement of a message
+void pakacked(int other, int i)
+{
+	auto& slot = ctx->opak[other][i&(FIFSIZ-1)];
+	if (!slot) return;
+
+	const int sent = ctx->oflight[other][i&(FIFSIZ-1)].tims;
+	if (sent - ctx->peers[other].ackedtims > 0) ctx->peers[other].ackedtims = sent;
+	pakdrop(slot);
 }
 
 } // namespace
@@ -616,34 +1011,39 @@ namespace {
 
 void initmultiplayers_reset()
 {
-	initcrc16();
-	std::ranges::fill(icnt0, 0);
-	std::ranges::fill(ocnt0, 0);
-	std::ranges::fill(ocnt1, 0);
-	std::memset(ipak,0,sizeof(ipak));
-	//std::memset(opak,0,sizeof(opak)); //Don't need to init opak
-	//std::memset(pakmem,0,sizeof(pakmem)); //Don't need to init pakmem
+	std::ranges::fill(ctx->icnt0, 0);
+	std::ranges::fill(ctx->ocnt0, 0);
+	std::ranges::fill(ctx->ocnt1, 0);
+	std::memset(ctx->ipak,0,sizeof(ctx->ipak));
+	std::memset(ctx->opak,0,sizeof(ctx->opak));
+	ctx->pakpool.assign(1, pakslot{});
+	ctx->pakfree.clear();
+	ctx->paklast = 0;
+	ctx->sendqueue.resize(MAXPLAYERS);
+	ctx->sendqueued = 0;
+	ctx->recvqueue.resize(RECVBATCH);
+	ctx->recvcount = ctx->recvnext = 0;
+	ctx->counters = {};
+	ctx->oflight.assign(MAXPLAYERS, {});
+	std::ranges::fill(ctx->peers, peerlink{});
 #if (SIMLAG > 1)
-	std::memset(simlagcnt,0,sizeof(simlagcnt));
+	std::memset(ctx->simlagcnt,0,sizeof(ctx->simlagcnt));
 #endif
 
-#if (__WIN32__)
-	lastsendtims[0] = ::GetTickCount64();
-#else
-	lastsendtims[0] = GetTickCount();
-#endif
+	ctx->lastsendtims[0] = nettime();
 
-	std::ranges::fill(lastsendtims, lastsendtims[0]);
-	std::ranges::fill(prevlastrecvtims, 0);
-	std::ranges::fill(lastrecvtims, 0);
-	std::ranges::fill(connectpoint2, -1);
-	std::ranges::fill_n(playerslive.begin(), MAXPLAYERS, 0);
+	std::ranges::fill(ctx->lastsendtims, ctx->lastsendtims[0]);
+	for (auto& peer : ctx->peers) peer.ackedtims = ctx->lastsendtims[0];
+	std::ranges::fill(ctx->prevlastrecvtims, 0);
+	std::ranges::fill(ctx->lastrecvtims, 0);
+	std::ranges::fill(ctx->connectpoint2, -1);
+	std::ranges::fill_n(ctx->playerslive.begin(), MAXPLAYERS, 0);
 
-	connecthead = 0;
-	numplayers = 1;
-	myconnectindex = 0;
+	ctx->connecthead = 0;
+	ctx->numplayers = 1;
+	ctx->myconnectindex = 0;
 
-	std::memset(&otherhost[0], 0, sizeof(otherhost));
+	std::memset(&ctx->otherhost[0], 0, sizeof(ctx->otherhost));
 }
 
 } // namespace
@@ -752,8 +1152,8 @@ int initmultiplayersparms(int argc, char const * const argv[])
 				netuninit();
 				return 0;
 			} else {
-				myconnectindex = daindex++;
-				std::printf("mmulti: This machine is player %d\n", myconnectindex);
+				ctx->myconnectindex = daindex++;
+				std::printf("mmulti: This machine is player %d\n", ctx->myconnectindex);
 			}
 			continue;
 		}
@@ -763,7 +1163,7 @@ int initmultiplayersparms(int argc, char const * const argv[])
 			netuninit();
 			return 0;
 		} else {
-			std::memcpy(&otherhost[daindex], &resolvhost, sizeof(resolvhost));
+			std::memcpy(&ctx->otherhost[daindex], &resolvhost, sizeof(resolvhost));
 			std::printf("mmulti: Player %d at %s (%s)\n", daindex,
 				presentaddress((struct sockaddr *)&resolvhost), argv[i]);
 			daindex++;
@@ -771,24 +1171,24 @@ int initmultiplayersparms(int argc, char const * const argv[])
 	}
 
 	if ((danetmode == 255) && (daindex)) { danumplayers = 2; danetmode = MMULTI_MODE_MS; } //an IP w/o /n# defaults to /n0
-	if ((danumplayers >= 2) && (daindex) && (danetmode == MMULTI_MODE_MS)) myconnectindex = 1;
+	if ((danumplayers >= 2) && (daindex) && (danetmode == MMULTI_MODE_MS)) ctx->myconnectindex = 1;
 	if (daindex > danumplayers) danumplayers = daindex;
 	else if (danumplayers == 0) danumplayers = 1;
 
-	if (danetmode == MMULTI_MODE_MS && myconnectindex == 0) {
+	if (danetmode == MMULTI_MODE_MS && ctx->myconnectindex == 0) {
 		std::printf("mmulti: This machine is master\n");
 	}
 
-	networkmode = danetmode;
-	numplayers = danumplayers;
+	ctx->networkmode = danetmode;
+	ctx->numplayers = danumplayers;
 
-	connecthead = 0;
-	for(i=0;i<numplayers-1;i++) connectpoint2[i] = i+1;
-	connectpoint2[numplayers-1] = -1;
+	ctx->connecthead = 0;
+	for(i=0;i<ctx->numplayers-1;i++) ctx->connectpoint2[i] = i+1;
+	ctx->connectpoint2[ctx->numplayers-1] = -1;
 
-	netready = 0;
+	ctx->netready = 0;
 
-	if (((danetmode == MMULTI_MODE_MS) && (numplayers >= 2)) || (numplayers == 2)) {
+	if (((danetmode == MMULTI_MODE_MS) && (ctx->numplayers >= 2)) || (ctx->numplayers == 2)) {
 		return 1;
 	} else {
 		netuninit();
@@ -804,96 +1204,92 @@ int initmultiplayerscycle()
 
 	getpacket(&i, nullptr);
 
-#if (__WIN32__)
-	tims = ::GetTickCount64();
-#else
-    tims = GetTickCount();
-#endif
-	if (networkmode == MMULTI_MODE_MS && myconnectindex == connecthead)
+	ctx->tims = nettime();
+	if (ctx->networkmode == MMULTI_MODE_MS && ctx->myconnectindex == ctx->connecthead)
 	{
 		// The master waits for all players to check in.
-		for(i=numplayers-1;i>0;i--) {
-			if (i == myconnectindex) continue;
-			if (otherhost[i].ss_family == AF_UNSPEC) {
+		for(i=ctx->numplayers-1;i>0;i--) {
+			if (i == ctx->myconnectindex) continue;
+			if (ctx->otherhost[i].ss_family == AF_UNSPEC) {
 				// There's a slot to be filled.
 				dnetready = 0;
-			} else if (lastrecvtims[i] == 0) {
+			} else if (ctx->lastrecvtims[i] == 0) {
 				// There's a player who hasn't checked in.
 				dnetready = 0;
-			} else if (prevlastrecvtims[i] != lastrecvtims[i]) {
-				if (!playerslive[i]) {
+			} else if (ctx->prevlastrecvtims[i] != ctx->lastrecvtims[i]) {
+				if (!ctx->playerslive[i]) {
 					std::printf("mmulti: Player %d is here\n", i);
-					playerslive[i] = 1;
+					ctx->playerslive[i] = 1;
 				}
-				prevlastrecvtims[i] = lastrecvtims[i];
-			} else if (tims - lastrecvtims[i] > PRESENCETIMEOUT) {
-				if (playerslive[i]) {
+				ctx->prevlastrecvtims[i] = ctx->lastrecvtims[i];
+			} else if (ctx->tims - ctx->lastrecvtims[i] > PRESENCETIMEOUT) {
+				if (ctx->playerslive[i]) {
 					std::printf("mmulti: Player %d has gone\n", i);
-					playerslive[i] = 0;
+					ctx->playerslive[i] = 0;
 				}
-				prevlastrecvtims[i] = lastrecvtims[i];
+				ctx->prevlastrecvtims[i] = ctx->lastrecvtims[i];
 				dnetready = 0;
 			}
 		}
 	}
 	else
 	{
-		if (networkmode == MMULTI_MODE_MS) {
+		if (ctx->networkmode == MMULTI_MODE_MS) {
 			// As a slave, we send the master pings. The netready flag gets
 			// set by getpacket() and is sent by the master when it is OK
 			// to launch.
 			dnetready = 0;
-			i = connecthead;
+			i = ctx->connecthead;
 
 		} else {
 			// In peer-to-peer mode we send pings to our peer group members
 			// and wait for them all to check in. The netready flag is set
 			// when everyone responds together within the timeout.
-			i = numplayers - 1;
+			i = ctx->numplayers - 1;
 		}
 		while (1) {
-			if (i != myconnectindex) {
-				if (tims < lastsendtims[i]) lastsendtims[i] = tims;
-				if (tims >= lastsendtims[i]+250) //1000/PAKRATE)
+			if (i != ctx->myconnectindex) {
+				if (ctx->tims < ctx->lastsendtims[i]) ctx->lastsendtims[i] = ctx->tims;
+				if (ctx->tims >= ctx->lastsendtims[i]+250) //1000/PAKRATE)
 				{
 #ifdef MMULTI_DEBUG_SENDRECV
 					debugprintf("mmulti debug: sending player %d a ping\n", i);
 #endif
 
-					lastsendtims[i] = tims;
+					ctx->lastsendtims[i] = ctx->tims;
 
 						//   short crc16ofs;       //offset of crc16
 						//   int icnt0;           //-1 (special packet for MMULTI.C's player collection)
 						//   ...
 						//   unsigned short crc16; //CRC16 of everything except crc16
 					k = 2;
-					*(int *)&pakbuf[k] = -1; k += 4;
-					pakbuf[k++] = 0xaa;
-					*(unsigned short *)&pakbuf[0] = (unsigned short)k;
-					*(unsigned short *)&pakbuf[k] = getcrc16(&pakbuf[0], k); k += 2;
-					netsend(i, &pakbuf[0], k);
+					*(int *)&ctx->pakbuf[k] = -1; k += 4;
+					ctx->pakbuf[k++] = 0xaa;
+					*(unsigned short *)&ctx->pakbuf[0] = (unsigned short)k;
+					*(unsigned short *)&ctx->pakbuf[k] = getcrc16(&ctx->pakbuf[0], k); k += 2;
+					netsend(i, &ctx->pakbuf[0], k);
 				}
 
-				if (lastrecvtims[i] == 0) {
+				if (ctx->lastrecvtims[i] == 0) {
 					// There's a player who hasn't checked in.
 					dnetready = 0;
-				} else if (prevlastrecvtims[i] != lastrecvtims[i]) {
-					if (!playerslive[i]) {
+				} else if (ctx->prevlastrecvtims[i] != ctx->lastrecvtims[i]) {
+					if (!ctx->playerslive[i]) {
 						std::printf("mmulti: Player %d is here\n", i);
-						playerslive[i] = 1;
+						ctx->playerslive[i] = 1;
 					}
-					prevlastrecvtims[i] = lastrecvtims[i];
-				} else if (prevlastrecvtims[i] - tims > PRESENCETIMEOUT) {
-					if (playerslive[i]) {
+					ctx->prevlastrecvtims[i] = ctx->lastrecvtims[i];
+				} else if (ctx->prevlastrecvtims[i] - ctx->tims > PRESENCETIMEOUT) {
+					if (ctx->playerslive[i]) {
 						std::printf("mmulti: Player %d has gone\n", i);
-						playerslive[i] = 0;
+						ctx->playerslive[i] = 0;
 					}
-					prevlastrecvtims[i] = lastrecvtims[i];
+					ctx->prevlastrecvtims[i] = ctx->lastrecvtims[i];
 					dnetready = 0;
 				}
 			}
 
-			if (networkmode == MMULTI_MODE_MS) {
+			if (ctx->networkmode == MMULTI_MODE_MS) {
 				break;
 			} else {
 				if (--i < 0) break;
@@ -901,9 +1297,9 @@ int initmultiplayerscycle()
 		}
 	}
 
-	netready = netready || dnetready;
+	ctx->netready = ctx->netready || dnetready;
 
-	return !netready;
+	return !ctx->netready;
 }
 
 void initmultiplayers (int argc, char const * const argv[])
@@ -929,6 +1325,8 @@ int lookuphost(const char *name, struct sockaddr *host, int warnifmany)
 	int port = 0;
 	int found = 0;
 
+	if (ctx->transport) return ctx->transport->lookup(name, host);
+
 	// ipv6 for future thought:
 	//  [2001:db8::1]:1234
 
@@ -949,8 +1347,8 @@ int lookuphost(const char *name, struct sockaddr *host, int warnifmany)
 
 	std::memset(&hints, 0, sizeof(hints));
 	hints.ai_flags = AI_ADDRCONFIG;
-	hints.ai_family = domain;
-	if (domain == PF_INET6) {
+	hints.ai_family = ctx->domain;
+	if (ctx->domain == PF_INET6) {
 		hints.ai_flags |= AI_V4MAPPED;
 	}
 	hints.ai_socktype = SOCK_DGRAM;
@@ -984,18 +1382,24 @@ int lookuphost(const char *name, struct sockaddr *host, int warnifmany)
 
 } // namespace
 
-void dosendpackets (int other)
+void dosendpackets (int other) //queues the datagram for netflush()
 {
 	int i;
 	int j;
 	int k;
+	int h;
+	int h0;
 
-	if (otherhost[other].ss_family == AF_UNSPEC) return;
+	if (ctx->otherhost[other].ss_family == AF_UNSPEC) return;
 
 		//Packet format:
 		//   short crc16ofs;       //offset of crc16
 		//   int icnt0;           //earliest unacked packet
-		//   char ibits[32];       //ack status of packets icnt0<=i<icnt0+256
+		//   int tims;            //sender's clock, for the round trip time
+		//   int echotims;        //the receiver's latest tims the sender has
+		//   short echohold;       //how long the sender has had it, -1 for none
+		//   char ibytes;          //length of ibits, up to 32
+		//   char ibits[ibytes];   //ack status of packets icnt0<=i<icnt0+ibytes*8
 		//   while (short leng)    //leng: !=0 for packet, 0 for no more packets
 		//   {
 		//      int ocnt;         //index of following packet data
@@ -1004,51 +1408,104 @@ void dosendpackets (int other)
 		//   unsigned short crc16; //CRC16 of everything except crc16
 
 
-#if defined _WIN32
-	tims = ::GetTickCount64();
-#else
-	tims = GetTickCount();
-#endif
-
-	if (tims < lastsendtims[other]) lastsendtims[other] = tims;
-	if (tims < lastsendtims[other]+1000/PAKRATE) return;
-	lastsendtims[other] = tims;
-
-	k = 2;
-	*(int *)&pakbuf[k] = icnt0[other]; k += 4;
-	std::memset(&pakbuf[k],0,32);
-	for(i=icnt0[other];i<icnt0[other]+256;i++)
-		if (ipak[other][i&(FIFSIZ-1)])
-			pakbuf[((i-icnt0[other])>>3)+k] |= (1<<((i-icnt0[other])&7));
-	k += 32;
-
-	while ((ocnt0[other] < ocnt1[other]) && (!opak[other][ocnt0[other]&(FIFSIZ-1)])) ocnt0[other]++;
-	for(i=ocnt0[other];i<ocnt1[other];i++)
+	ctx->tims = nettime();
+	auto& peer = ctx->peers[other];
+	const int rto = retransmittimeout(other);
+
+	while ((ctx->ocnt0[other] < ctx->ocnt1[other]) && (!ctx->opak[other][ctx->ocnt0[other]&(FIFSIZ-1)])) ctx->ocnt0[other]++;
+
+		//Go at the faster pace only with something to say
+	bool busy = peer.ackpending;
+	for(i=ctx->ocnt0[other];i<ctx->ocnt1[other] && !busy;i++) busy = pakdue(other, i, rto);
+
+	if (ctx->tims < ctx->lastsendtims[other]) ctx->lastsendtims[other] = ctx->tims;
+	if (ctx->tims < ctx->lastsendtims[other]+(busy ? sendinterval(other) : 1000/PAKRATE)) return;
+	ctx->lastsendtims[other] = ctx->tims;
+
+	auto& d = ctx->sendqueue[ctx->sendqueued++];
+	auto& head = d.head;
+	d.other = other;
+	d.nsegs = 0;
+
+	h = 2;
+	*(int *)&head[h] = ctx->icnt0[other]; h += 4;
+	*(int *)&head[h] = ctx->tims; h += 4;
+	*(int *)&head[h] = peer.stamp; h += 4;
+	j = peer.stamped ? ctx->tims - peer.stampat : -1;
+	*(short *)&head[h] = (short)((j >= 0 && j <= 32767) ? j : -1); h += 2;
+	for(i=0,j=0;i<256;i++)
+		if (ctx->ipak[other][(ctx->icnt0[other]+i)&(FIFSIZ-1)]) j = (i>>3)+1;
+	head[h++] = (unsigned char)j;
+	std::memset(&head[h],0,j);
+	for(i=0;i<(j<<3);i++)
+		if (ctx->ipak[other][(ctx->icnt0[other]+i)&(FIFSIZ-1)])
+			head[(i>>3)+h] |= (1<<(i&7));
+	h += j;
+	peer.ackpending = false;
+	k = h; h0 = 0;
+
+	for(i=ctx->ocnt0[other];i<ctx->ocnt1[other];i++)
 	{
-		j = *(short *)&pakmem[opak[other][i&(FIFSIZ-1)]]; if (!j) continue; //packet already acked
-		if (k+6+j+4 > (int)sizeof(pakbuf)) break;
-
-		*(unsigned short *)&pakbuf[k] = (unsigned short)j; k += 2;
-		*(int *)&pakbuf[k] = i; k += 4;
-		std::memcpy(&pakbuf[k],&pakmem[opak[other][i&(FIFSIZ-1)]+2],j); k += j;
+		if (!pakdue(other, i, rto)) continue;
+		const auto& slot = ctx->pakpool[ctx->opak[other][i&(FIFSIZ-1)]];
+		j = slot.leng;
+		if (k+6+j+4 > MAXPAKSIZ) break;
+
+		auto& flight = ctx->oflight[other][i&(FIFSIZ-1)];
+		if (flight.sends) peer.resends++;
+		flight.tims = ctx->tims;
+		flight.sends++;
+
+		*(unsigned short *)&head[h] = (unsigned short)j; h += 2;
+		*(int *)&head[h] = i; h += 4;
+		d.segs[d.nsegs++] = { &head[h0], h-h0 }; h0 = h;
+		d.segs[d.nsegs++] = { slot.data.data(), j };
+		k += 6+j;
+		ctx->counters.messagecopies++;
 	}
-	*(unsigned short *)&pakbuf[k] = 0; k += 2;
-	*(unsigned short *)&pakbuf[0] = (unsigned short)k;
-	*(unsigned short *)&pakbuf[k] = getcrc16(&pakbuf[0], k); k += 2;
-	netsend(other, &pakbuf[0], k);
+	*(unsigned short *)&head[h] = 0; h += 2; k += 2;
+	*(unsigned short *)&head[0] = (unsigned short)k;
+	d.segs[d.nsegs++] = { &head[h0], h-h0 }; h0 = h;
+	*(unsigned short *)&head[h] = getcrc16(d.segs.data(), d.nsegs); h += 2; k += 2;
+	d.segs[d.nsegs++] = { &head[h0], h-h0 };
+	d.leng = k;
 }
 
 void sendpacket (int other, const unsigned char *bufptr, int messleng)
 {
-	if (numplayers < 2) return;
+	if (ctx->numplayers < 2) return;
+
+	if (messleng > MAXMESSLENG) {
+		std::printf("mmulti error: a %d byte message is too long to send\n", messleng);
+		return;
+	}
 
-	if (pakmemi+messleng+2 > (int)sizeof(pakmem)) pakmemi = 1;
-	opak[other][ocnt1[other]&(FIFSIZ-1)] = pakmemi;
-	*(short *)&pakmem[pakmemi] = messleng;
-	std::memcpy(&pakmem[pakmemi+2],bufptr,messleng); pakmemi += messleng+2;
-	ocnt1[other]++;
+		//The master sends every slave the same message in turn, so share it
+	if (ctx->paklast && ctx->pakpool[ctx->paklast].refs > 0 && ctx->pakpool[ctx->paklast].leng == messleng &&
+			!std::memcmp(ctx->pakpool[ctx->paklast].data.data(), bufptr, messleng)) {
+		ctx->pakpool[ctx->paklast].refs++;
+	} else {
+		ctx->paklast = pakalloc(bufptr, messleng);
+	}
+	ctx->counters.messagessent++;
 
-	dosendpackets(other);
+	if (other >= 0) {
+		pakqueue(other, ctx->paklast);
+		dosendpackets(other);
+	} else {
+			//A broadcast: every other player's window takes a reference to
+			//the one copy, and the datagrams go out in one netflush()
+		for (int i{ctx->connecthead}; i >= 0; i = ctx->connectpoint2[i]) {
+			if (i == ctx->myconnectindex) continue;
+			ctx->pakpool[ctx->paklast].refs++;
+			pakqueue(i, ctx->paklast);
+		}
+		ctx->pakpool[ctx->paklast].refs--;
+		for (int i{ctx->connecthead}; i >= 0; i = ctx->connectpoint2[i]) {
+			if (i != ctx->myconnectindex) dosendpackets(i);
+		}
+	}
+	netflush();
 }
 
 	//passing bufptr == 0 enables receive&sending raw packets but does not return any received packets
@@ -1062,27 +1519,34 @@ int getpacket (int *retother, unsigned char *bufptr)
 	int crc16ofs;
 	int messleng;
 	int other;
+	unsigned char *pak;
 	static int warned = 0;
 
-	if (numplayers < 2) return(0);
+	if (ctx->numplayers < 2) return(0);
 
-	if (netready)
+	if (ctx->netready)
 	{
-		for(i=connecthead;i>=0;i=connectpoint2[i])
+		for(i=ctx->connecthead;i>=0;i=ctx->connectpoint2[i])
 		{
-			if (i != myconnectindex) dosendpackets(i);
-			if ((networkmode == MMULTI_MODE_MS) && (myconnectindex != connecthead)) break; //slaves in M/S mode only send to master
+			if (i != ctx->myconnectindex) dosendpackets(i);
+			if ((ctx->networkmode == MMULTI_MODE_MS) && (ctx->myconnectindex != ctx->connecthead)) break; //slaves in M/S mode only send to master
 		}
+		netflush();
 	}
 
-	tims = GetTickCount();
+	ctx->tims = nettime();
+	if (ctx == &processcontext) netstatslogtick(ctx->tims);
 
-	while (netread(&other, &pakbuf[0], sizeof(pakbuf)))
+	while (netread(&other, &pak))
 	{
 			//Packet format:
 			//   short crc16ofs;       //offset of crc16
 			//   int icnt0;           //earliest unacked packet
-			//   char ibits[32];       //ack status of packets icnt0<=i<icnt0+256
+			//   int tims;            //sender's clock, for the round trip time
+			//   int echotims;        //the receiver's latest tims the sender has
+			//   short echohold;       //how long the sender has had it, -1 for none
+			//   char ibytes;          //length of ibits, up to 32
+			//   char ibits[ibytes];   //ack status of packets icnt0<=i<icnt0+ibytes*8
 			//   while (short leng)    //leng: !=0 for packet, 0 for no more packets
 			//   {
 			//      int ocnt;         //index of following packet data
@@ -1090,18 +1554,20 @@ int getpacket (int *retother, unsigned char *bufptr)
 			//   }
 			//   unsigned short crc16; //CRC16 of everything except crc16
 		k = 0;
-		crc16ofs = (int)(*(unsigned short *)&pakbuf[k]); k += 2;
+		crc16ofs = (int)(*(unsigned short *)&pak[k]); k += 2;
 
-		if (crc16ofs+2 > (int)sizeof(pakbuf)) {
+		if (crc16ofs+2 > MAXPAKSIZ) {
 #ifdef MMULTI_DEBUG_SENDRECV
 			debugprintf("mmulti debug: wrong-sized packet from %d\n", other);
 #endif
-		} else if (getcrc16(&pakbuf[0], crc16ofs) != (*(unsigned short *)&pakbuf[crc16ofs])) {
+		} else if (getcrc16(&pak[0], crc16ofs) != (*(unsigned short *)&pak[crc16ofs])) {
+			ctx->counters.badcrc++;
+			ctx->peers[other].badcrc++;
 #ifdef MMULTI_DEBUG_SENDRECV
 			debugprintf("mmulti debug: bad crc in packet from %d\n", other);
 #endif
 		} else {
-			ic0 = *(int *)&pakbuf[k]; k += 4;
+			ic0 = *(int *)&pak[k]; k += 4;
 			if (ic0 == -1)
 			{
 				// Peers send each other 0xaa and respond with 0xab containing their opinion
@@ -1109,22 +1575,22 @@ int getpacket (int *retother, unsigned char *bufptr)
 
 				// Slave sends 0xaa to Master at initmultiplayerscycle() and waits for 0xab response.
 				// Master responds to slave with 0xab whenever it receives a 0xaa - even if during game!
-				if (pakbuf[k] == 0xaa)
+				if (pak[k] == 0xaa)
 				{
 					int sendother = -1;
 #ifdef MMULTI_DEBUG_SENDRECV
-					const char *addr = presentaddress((struct sockaddr *)&snatchhost);
+					const char *addr = presentaddress((struct sockaddr *)&ctx->snatchhost);
 #endif
 
-					if (networkmode == MMULTI_MODE_MS) {
+					if (ctx->networkmode == MMULTI_MODE_MS) {
 						// Master-slave.
-						if (other == myconnectindex && myconnectindex == connecthead) {
+						if (other == ctx->myconnectindex && ctx->myconnectindex == ctx->connecthead) {
 							// This the master and someone new is calling. Find them a place.
 #ifdef MMULTI_DEBUG_SENDRECV
 							debugprintf("mmulti debug: got ping from new host %s\n", addr);
 #endif
-							for (other = 1; other < numplayers; other++) {
-								if (otherhost[other].ss_family == PF_UNSPEC) {
+							for (other = 1; other < ctx->numplayers; other++) {
+								if (ctx->otherhost[other].ss_family == PF_UNSPEC) {
 									sendother = other;
 #ifdef MMULTI_DEBUG_SENDRECV
 									debugprintf("mmulti debug: giving %s player %d\n", addr, other);
@@ -1141,7 +1607,7 @@ int getpacket (int *retother, unsigned char *bufptr)
 						}
 					} else {
 						// Peer-to-peer mode.
-						if (other == myconnectindex) {
+						if (other == ctx->myconnectindex) {
 #ifdef MMULTI_DEBUG_SENDRECV
 							debugprintf("mmulti debug: got ping from unknown host %s\n", addr);
 #endif
@@ -1155,7 +1621,7 @@ int getpacket (int *retother, unsigned char *bufptr)
 
 					if (sendother >= 0) {
 						savesnatchhost(sendother);
-						lastrecvtims[sendother] = tims;
+						ctx->lastrecvtims[sendother] = ctx->tims;
 
 							//   short crc16ofs;        //offset of crc16
 							//   int icnt0;             //-1 (special packet for MMULTI.C's player collection)
@@ -1165,115 +1631,131 @@ int getpacket (int *retother, unsigned char *bufptr)
 							//   char netready;
 							//   unsigned short crc16;  //CRC16 of everything except crc16
 						k = 2;
-						*(int *)&pakbuf[k] = -1; k += 4;
-						pakbuf[k++] = 0xab;
-						pakbuf[k++] = (char)sendother;
-						pakbuf[k++] = (char)numplayers;
-						pakbuf[k++] = (char)netready;
-						*(unsigned short *)&pakbuf[0] = (unsigned short)k;
-						*(unsigned short *)&pakbuf[k] = getcrc16(&pakbuf[0], k); k += 2;
-						netsend(sendother, &pakbuf[0], k);
+						*(int *)&ctx->pakbuf[k] = -1; k += 4;
+						ctx->pakbuf[k++] = 0xab;
+						ctx->pakbuf[k++] = (char)sendother;
+						ctx->pakbuf[k++] = (char)ctx->numplayers;
+						ctx->pakbuf[k++] = (char)ctx->netready;
+						*(unsigned short *)&ctx->pakbuf[0] = (unsigned short)k;
+						*(unsigned short *)&ctx->pakbuf[k] = getcrc16(&ctx->pakbuf[0], k); k += 2;
+						netsend(sendother, &ctx->pakbuf[0], k);
 					}
 				}
-				else if (pakbuf[k] == 0xab)
+				else if (pak[k] == 0xab)
 				{
-					if (networkmode == MMULTI_MODE_MS) {
+					if (ctx->networkmode == MMULTI_MODE_MS) {
 						// Master-slave.
-						if (((unsigned int)pakbuf[k+1] < (unsigned int)pakbuf[k+2]) &&
-							 ((unsigned int)pakbuf[k+2] < (unsigned int)MAXPLAYERS) &&
-							 other == connecthead)
+						if (((unsigned int)pak[k+1] < (unsigned int)pak[k+2]) &&
+							 ((unsigned int)pak[k+2] <= (unsigned int)MAXPLAYERS) &&
+							 other == ctx->connecthead)
 						{
 #ifdef MMULTI_DEBUG_SENDRECV
 								debugprintf("mmulti debug: master gave us player %d in a %d player game\n",
-									(int)pakbuf[k+1], (int)pakbuf[k+2]);
+									(int)pak[k+1], (int)pak[k+2]);
 #endif
 
-							if ((int)pakbuf[k+1] != myconnectindex ||
-									(int)pakbuf[k+2] != numplayers)
+							if ((int)pak[k+1] != ctx->myconnectindex ||
+									(int)pak[k+2] != ctx->numplayers)
 							{
-								myconnectindex = (int)pakbuf[k+1];
-								numplayers = (int)pakbuf[k+2];
+								ctx->myconnectindex = (int)pak[k+1];
+								ctx->numplayers = (int)pak[k+2];
 
-								connecthead = 0;
-								for(i=0;i<numplayers-1;i++) connectpoint2[i] = i+1;
-								connectpoint2[numplayers-1] = -1;
+								ctx->connecthead = 0;
+								for(i=0;i<ctx->numplayers-1;i++) ctx->connectpoint2[i] = i+1;
+								ctx->connectpoint2[ctx->numplayers-1] = -1;
 							}
 
-							netready = netready || (int)pakbuf[k+3];
+							ctx->netready = ctx->netready || (int)pak[k+3];
 
-							savesnatchhost(connecthead);
-							lastrecvtims[connecthead] = tims;
+							savesnatchhost(ctx->connecthead);
+							ctx->lastrecvtims[ctx->connecthead] = ctx->tims;
 						}
 					} else {
 						// Peer-to-peer. Verify that our peer's understanding of the
 						// order and player count matches with ours.
-						if (myconnectindex != (int)pakbuf[k+1] ||
-								numplayers != (int)pakbuf[k+2]) {
+						if (ctx->myconnectindex != (int)pak[k+1] ||
+								ctx->numplayers != (int)pak[k+2]) {
 							if (!warned) {
-								const char *addr = presentaddress((struct sockaddr *)&snatchhost);
+								const char *addr = presentaddress((struct sockaddr *)&ctx->snatchhost);
 								std::printf("mmulti error: host %s (peer %d) believes this machine is "
 									"player %d in a %d-player game! The game will not start until "
 									"every machine is in agreement.\n",
-									addr, other, (int)pakbuf[k+1], (int)pakbuf[k+2]);
+									addr, other, (int)pak[k+1], (int)pak[k+2]);
 							}
 							warned = 1;
 						} else {
 							savesnatchhost(other);
-							lastrecvtims[other] = tims;
+							ctx->lastrecvtims[other] = ctx->tims;
 						}
 					}
 				}
 			}
 			else
 			{
-				if (other == myconnectindex) {
+				if (other == ctx->myconnectindex) {
 #ifdef MMULTI_DEBUG_SENDRECV
 					debugprintf("mmulti debug: got a packet from unknown host %s\n",
-								presentaddress((struct sockaddr *)&snatchhost));
+								presentaddress((struct sockaddr *)&ctx->snatchhost));
 					return 0;
 #endif
 				}
-				if (ocnt0[other] < ic0) ocnt0[other] = ic0;
-				for(i = ic0;i < std::min(ic0 + 256, ocnt1[other]); i++)
-					if (pakbuf[((i-ic0)>>3)+k]&(1<<((i-ic0)&7)))
-						opak[other][i&(FIFSIZ-1)] = 0;
-				k += 32;
-
-				messleng = (int)(*(unsigned short *)&pakbuf[k]); k += 2;
+				auto& peer = ctx->peers[other];
+				j = *(int *)&pak[k]; k += 4;
+				if (!peer.stamped || j - peer.stamp > 0) {
+					peer.stamp = j;
+					peer.stampat = ctx->tims;
+					peer.stamped = true;
+				}
+				j = *(int *)&pak[k]; k += 4;
+				i = *(short *)&pak[k]; k += 2;
+				if (i >= 0) rttsample(other, ctx->tims - j - i);
+
+				for(;(ctx->ocnt0[other] < ic0) && (ctx->ocnt0[other] < ctx->ocnt1[other]);ctx->ocnt0[other]++)
+					pakacked(other, ctx->ocnt0[other]);
+				if (ctx->ocnt0[other] < ic0) ctx->ocnt0[other] = ic0;
+				j = std::min((int)pak[k], 32); k++;
+				for(i = ic0;i < std::min(ic0 + (j<<3), ctx->ocnt1[other]); i++)
+					if (pak[((i-ic0)>>3)+k]&(1<<((i-ic0)&7)))
+						pakacked(other, i);
+				k += j;
+
+				messleng = (int)(*(unsigned short *)&pak[k]); k += 2;
+				if (messleng) peer.ackpending = true;	// even for messages we had, as our ack went astray
 				while (messleng)
 				{
-					j = *(int *)&pakbuf[k]; k += 4;
-					if ((j >= icnt0[other]) && (!ipak[other][j&(FIFSIZ-1)]))
+					if (k+4+messleng > crc16ofs) break;	// malformed, but the crc matched
+					j = *(int *)&pak[k]; k += 4;
+					if ((j >= ctx->icnt0[other]) && (!ctx->ipak[other][j&(FIFSIZ-1)]))
 					{
-						if (pakmemi+messleng+2 > (int)sizeof(pakmem)) pakmemi = 1;
-						ipak[other][j&(FIFSIZ-1)] = pakmemi;
-						*(short *)&pakmem[pakmemi] = messleng;
-						std::memcpy(&pakmem[pakmemi+2],&pakbuf[k],messleng); pakmemi += messleng+2;
+						ctx->ipak[other][j&(FIFSIZ-1)] = pakalloc(&pak[k], messleng);
+						if (j < peer.highest) peer.outoforder++;
 					}
+					else peer.duplicates++;
+					peer.highest = std::max(peer.highest, j);
 					k += messleng;
-					messleng = (int)(*(unsigned short *)&pakbuf[k]); k += 2;
+					messleng = (int)(*(unsigned short *)&pak[k]); k += 2;
 				}
 
-				lastrecvtims[other] = tims;
+				ctx->lastrecvtims[other] = ctx->tims;
 			}
 		}
 	}
 
 		//Return next valid packet from any player
 	if (!bufptr) return(0);
-	for(i=connecthead;i>=0;i=connectpoint2[i])
+	for(i=ctx->connecthead;i>=0;i=ctx->connectpoint2[i])
 	{
-		if (i != myconnectindex)
+		if (i != ctx->myconnectindex)
 		{
-			j = ipak[i][icnt0[i]&(FIFSIZ-1)];
-			if (j)
+			auto& slot = ctx->ipak[i][ctx->icnt0[i]&(FIFSIZ-1)];
+			if (slot)
 			{
-				messleng = *(short *)&pakmem[j]; std::memcpy(bufptr,&pakmem[j+2],messleng);
-				*retother = i; ipak[i][icnt0[i]&(FIFSIZ-1)] = 0; icnt0[i]++;
+				messleng = ctx->pakpool[slot].leng; std::memcpy(bufptr,ctx->pakpool[slot].data.data(),messleng);
+				*retother = i; pakdrop(slot); ctx->icnt0[i]++;
 				return(messleng);
 			}
 		}
-		if ((networkmode == MMULTI_MODE_MS) && (myconnectindex != connecthead)) break; //slaves in M/S mode only send to master
+		if ((ctx->networkmode == MMULTI_MODE_MS) && (ctx->myconnectindex != ctx->connecthead)) break; //slaves in M/S mode only send to master
 	}
 
 	return(0);
@@ -1285,17 +1767,71 @@ void flushpackets()
 	getpacket(&i, nullptr);	// Process acks but no messages, do retransmission.
 }
 
+void mmulti_settransport(const mmultitransport *newtransport)
+{
+	ctx->transport = newtransport;
+}
+
+mmulticontext *mmulti_newcontext()
+{
+	return new mmulticontext;
+}
+
+void mmulti_deletecontext(mmulticontext *context)
+{
+	delete context;
+}
+
+void mmulti_setcontext(mmulticontext *context)
+{
+	ctx = context ? context : &processcontext;
+}
+
+mmultiplayer mmulti_player()
+{
+	return { ctx->myconnectindex, ctx->numplayers, ctx->networkmode, ctx->connecthead, ctx->connectpoint2 };
+}
+
+const mmulticounters& mmulti_counters()
+{
+	return ctx->counters;
+}
+
+mmultipeerstats mmulti_peerstats(int other)
+{
+	mmultipeerstats stats{};
+	const auto& peer = ctx->peers[other];
+
+	stats.rtt = peer.samples ? peer.srtt8 >> 3 : -1;
+	stats.rttvar = peer.samples ? peer.rttvar4 >> 2 : -1;
+	stats.rto = retransmittimeout(other);
+	stats.interval = sendinterval(other);
+	for(int i=ctx->ocnt0[other];i<ctx->ocnt1[other];i++)
+		if (ctx->opak[other][i&(FIFSIZ-1)]) stats.unacked++;
+	for(int i=0;i<FIFSIZ;i++)
+		if (ctx->ipak[other][i]) stats.unread++;
+	stats.resends = peer.resends;
+	stats.duplicates = peer.duplicates;
+	stats.outoforder = peer.outoforder;
+	stats.badcrc = peer.badcrc;
+	stats.datagramssent = peer.datagramssent;
+	stats.bytessent = peer.bytessent;
+	stats.datagramsread = peer.datagramsread;
+	stats.bytesread = peer.bytesread;
+	return stats;
+}
+
 namespace {
 
 // Records the IP address of a peer, along with our IPV4 and/or IPV6 addresses
 // their packet came in on. We send our reply from the same address.
 void savesnatchhost(int other)
 {
-	if (other == myconnectindex) return;
+	if (other == ctx->myconnectindex) return;
 
-	std::memcpy(&otherhost[other], &snatchhost, sizeof(snatchhost));
-	replyfrom4[other] = snatchreplyfrom4;
-	replyfrom6[other] = snatchreplyfrom6;
+	std::memcpy(&ctx->otherhost[other], &ctx->snatchhost, sizeof(ctx->snatchhost));
+	ctx->replyfrom4[other] = ctx->snatchreplyfrom4;
+	ctx->replyfrom6[other] = ctx->snatchreplyfrom6;
 }
 
 } // namespace
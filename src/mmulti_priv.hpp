@@ -0,0 +1,152 @@
+#ifndef MMULTI_PRIV_H
+#define MMULTI_PRIV_H
+
+#include "mmulti.hpp"
+
+#include <string>
+
+struct sockaddr;
+
+	// Carries mmulti's datagrams in place of its UDP socket. Addresses are
+	// still sockaddrs, so the transport must hand out ones the player
+	// collection can tell apart.
+struct mmultitransport {
+	int (*init)(int portnum);	// 1 on success
+	void (*uninit)();
+	int (*lookup)(const char *name, struct sockaddr *host);	// 1 if found
+	int (*send)(const struct sockaddr *host, const void *dabuf, int bufsiz);	// 0:can't send
+	int (*read)(struct sockaddr *host, void *dabuf, int bufsiz);	// length, 0:no packets
+	int (*ticks)();	// milliseconds
+};
+
+	// Traffic through the calling thread's mmulti since initmultiplayers
+struct mmulticounters {
+	int datagramssent;
+	int bytessent;
+	int datagramsread;
+	int bytesread;
+	int badcrc;
+	int messagessent;	// sendpacket() calls
+	int messagecopies;	// messages put in datagrams, counting every resend
+	int sendcalls;		// system or transport calls made to send and to
+	int readcalls;		// read, where many datagrams can share one
+};
+
+	// How the calling thread's reliable channel to a peer is doing
+struct mmultipeerstats {
+	int rtt;		// smoothed round trip in milliseconds, -1 until measured
+	int rttvar;		// and its mean deviation
+	int rto;		// retransmission timeout
+	int interval;	// least time between datagrams when busy
+	int unacked;	// messages waiting for the peer's acknowledgement
+	int unread;		// messages from the peer waiting for getpacket()
+	int resends;	// messages put in a datagram more than once
+	int duplicates;	// messages that came again
+	int outoforder;	// messages that came after a later one
+	int badcrc;
+	int datagramssent;
+	int bytessent;
+	int datagramsread;
+	int bytesread;
+};
+
+	// Where one player is in the game, which for the process's own player
+	// is mmulti.hpp's globals
+struct mmultiplayer {
+	int& myconnectindex;
+	int& numplayers;
+	int& networkmode;
+	int& connecthead;
+	std::array<int, MAXMULTIPLAYERS>& connectpoint2;
+};
+
+	// Everything mmulti keeps for one player. Each thread works on the
+	// process's own player unless pointed at another with mmulti_setcontext(),
+	// so simulated players can each run in a thread of their own.
+struct mmulticontext;
+
+/**
+ * Makes the state for a simulated player, with no network started
+ * @return the state, for mmulti_deletecontext() to free
+ */
+mmulticontext *mmulti_newcontext();
+
+/**
+ * Frees the state of a simulated player once no thread works on it
+ * @param context the state
+ */
+void mmulti_deletecontext(mmulticontext *context);
+
+/**
+ * Points the calling thread's mmulti calls at a player's state
+ * @param context the state, or nullptr for the process's own player
+ */
+void mmulti_setcontext(mmulticontext *context);
+
+/**
+ * Reports where the calling thread's player is in the game
+ * @return references to its myconnectindex, numplayers and the rest
+ */
+mmultiplayer mmulti_player();
+
+/**
+ * Sends the calling thread's mmulti traffic through another transport
+ * @param transport the transport, or nullptr for the UDP socket
+ */
+void mmulti_settransport(const mmultitransport *transport);
+
+/**
+ * Reports the calling thread's mmulti traffic
+ * @return the counters
+ */
+const mmulticounters& mmulti_counters();
+
+/**
+ * Reports on the calling thread's reliable channel to a peer
+ * @param other the peer's connection index
+ * @return the stats
+ */
+mmultipeerstats mmulti_peerstats(int other);
+
+/**
+ * Prints the process's own player's stats for each peer, and the game's
+ * figures from netgamestats
+ */
+void netstatsprint();
+
+/**
+ * Starts or stops the process's own player appending its stats to a CSV file,
+ * a row for each peer every interval
+ * @param filename the file, or empty to stop
+ * @param interval milliseconds between rows
+ * @return 0 on success, -1 if the file won't open
+ */
+int netstatslog(const std::string& filename, int interval);
+
+/**
+ * Writes the CSV rows when an interval has passed. getpacket() calls this
+ * for the process's own player.
+ * @param tims mmulti's clock in milliseconds
+ */
+void netstatslogtick(int tims);
+
+	// Simulated network conditions for the loopback transport
+struct mmultiloopconfig {
+	int latency{30};	// one way, in milliseconds
+	int jitter{10};		// extra delay of up to this many milliseconds
+	int loss{2};		// percentages of datagrams dropped, delivered twice
+	int duplicate{1};	// and held back by another latency
+	int reorder{2};
+	unsigned int seed{1};
+};
+
+/**
+ * Plays master/slave games between simulated players, each running
+ * mmulti in a thread of its own over an in-process network, and reports
+ * bandwidth, resends and input lag
+ * @param players number of players, or 0 for 2, 4, 8 and 16
+ * @param config the simulated network
+ */
+void netloopbench(int players, const mmultiloopconfig& config);
+
+#endif
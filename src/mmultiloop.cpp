@@ -0,0 +1,429 @@
+// In-process loopback transport for mmulti, and a benchmark that plays
+// simulated master/slave games over it.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#endif
+
+#include "build.hpp"
+#include "mmulti.hpp"
+#include "mmulti_priv.hpp"
+#include "baselayer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <charconv>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+	//A datagram in flight
+struct loopdatagram {
+	int arrival;		// simulated milliseconds
+	int from;
+	unsigned int seq;	// per sender, so arrivals at the same time keep a reproducible order
+	std::vector<unsigned char> data;
+};
+
+	//The simulated network: one clock, and an inbox per player kept as a heap
+	//with the earliest arrival on top
+struct loopnetwork {
+	mmultiloopconfig config;
+	std::atomic<int> clock{0};
+	std::array<std::mutex, MAXMULTIPLAYERS> lock;
+	std::array<std::vector<loopdatagram>, MAXMULTIPLAYERS> inbox;
+	std::array<bool, MAXMULTIPLAYERS> open{};
+	std::array<std::mt19937, MAXMULTIPLAYERS> rng;	// each sender's dice
+	std::array<unsigned int, MAXMULTIPLAYERS> seq{};
+};
+
+loopnetwork *loopnet{nullptr};
+thread_local int loopnode{-1};		// the player this thread simulates
+
+bool laterdatagram(const loopdatagram& a, const loopdatagram& b)
+{
+	return std::tie(a.arrival, a.from, a.seq) > std::tie(b.arrival, b.from, b.seq);
+}
+
+	//Players are told apart by the port of an IPV6 loopback address
+void loopaddress(int node, struct sockaddr *host)
+{
+	auto *a = (struct sockaddr_in6 *)host;
+
+	std::memset(a, 0, sizeof(*a));
+	a->sin6_family = AF_INET6;
+	a->sin6_addr = in6addr_loopback;
+	a->sin6_port = htons((unsigned short)(1 + node));
+}
+
+int loopinit(int portnum)
+{
+	std::ignore = portnum;
+
+	const std::scoped_lock guard(loopnet->lock[loopnode]);
+	loopnet->inbox[loopnode].clear();
+	loopnet->open[loopnode] = true;
+	return 1;
+}
+
+void loopuninit()
+{
+	const std::scoped_lock guard(loopnet->lock[loopnode]);
+	loopnet->inbox[loopnode].clear();
+	loopnet->open[loopnode] = false;
+}
+
+	//Players are named loop0, loop1, ...
+int looplookup(const char *name, struct sockaddr *host)
+{
+	const std::string_view namev{name};
+	int node{-1};
+
+	if (!namev.starts_with("loop")) return 0;
+	std::from_chars(namev.data() + 4, namev.data() + namev.size(), node);
+	if (node < 0 || node >= MAXMULTIPLAYERS) return 0;
+
+	loopaddress(node, host);
+	return 1;
+}
+
+int loopsend(const struct sockaddr *host, const void *dabuf, int bufsiz)
+{
+	if (host->sa_family != AF_INET6) return 0;
+
+	const int to = ntohs(((const struct sockaddr_in6 *)host)->sin6_port) - 1;
+	if (to < 0 || to >= MAXMULTIPLAYERS) return 0;
+
+	const auto& config = loopnet->config;
+	auto& rng = loopnet->rng[loopnode];
+	std::uniform_int_distribution<int> percent(0, 99);
+	std::uniform_int_distribution<int> jitter(0, std::max(config.jitter, 0));
+
+		//The dice are always rolled the same number of times, so one link's
+		//conditions don't change the fate of the next datagram on another
+	const bool lost = percent(rng) < config.loss;
+	const int copies = percent(rng) < config.duplicate ? 2 : 1;
+	std::array<int, 2> delay;
+	for (auto& d : delay) {
+		d = config.latency + jitter(rng);
+		if (percent(rng) < config.reorder) d += config.latency;
+	}
+
+	if (lost) return 1;	// as far as the sender knows, it went
+
+	const std::scoped_lock guard(loopnet->lock[to]);
+	if (!loopnet->open[to]) return 1;
+
+	auto& inbox = loopnet->inbox[to];
+	for (int i{0}; i < copies; i++) {
+			//Never deliver in the step it was sent, whichever thread reads first
+		const int arrival = loopnet->clock + std::max(delay[i], 1);
+		const auto *data = (const unsigned char *)dabuf;
+
+		inbox.push_back({ arrival, loopnode, loopnet->seq[loopnode]++, std::vector<unsigned char>(data, data + bufsiz) });
+		std::push_heap(inbox.begin(), inbox.end(), laterdatagram);
+	}
+	return 1;
+}
+
+int loopread(struct sockaddr *host, void *dabuf, int bufsiz)
+{
+	const std::scoped_lock guard(loopnet->lock[loopnode]);
+	auto& inbox = loopnet->inbox[loopnode];
+
+	if (inbox.empty() || inbox.front().arrival > loopnet->clock) return 0;
+
+	std::pop_heap(inbox.begin(), inbox.end(), laterdatagram);
+	const loopdatagram dg = std::move(inbox.back());
+	inbox.pop_back();
+
+	const int len = std::min((int)dg.data.size(), bufsiz);
+	std::memcpy(dabuf, dg.data.data(), len);
+	loopaddress(dg.from, host);
+	return len;
+}
+
+int loopticks()
+{
+	return loopnet->clock;
+}
+
+constexpr mmultitransport looptransport{
+	loopinit, loopuninit, looplookup, loopsend, loopread, loopticks
+};
+
+//--------------------------------------------------------------------------------------------------
+
+constexpr auto LOOPTICKMS{25};			// kenbuild's MOVESPERSECOND is 40
+constexpr auto LOOPGAMEMS{20000};		// time spent sending inputs
+constexpr auto LOOPDRAINMS{2000};		// and then letting the last ones arrive
+constexpr auto LOOPHANDSHAKEMS{30000};	// give up if players haven't all checked in by then
+constexpr auto LOOPMSGSIZ{256};
+
+	//What each simulated player reports when the game ends
+struct loopresult {
+	mmulticounters counters{};
+	std::vector<int> lag;	// input to simulation, in milliseconds
+	int readyat{-1};
+	int rtt{0};				// mean over the peers, as measured by mmulti
+};
+
+	//Shared between the players' threads, and only changed by the barrier's
+	//completion step while they all wait
+struct loopgame {
+	int numplayers{0};
+	std::atomic<int> numready{0};
+	bool playing{false};
+	bool done{false};
+	int start{0};
+};
+
+	//Run once every player has finished a millisecond
+struct loopstep {
+	loopgame *game;
+
+	void operator()() noexcept
+	{
+		loopnet->clock++;
+		if (!game->playing) {
+			if (game->numready == game->numplayers) {
+				game->playing = true;
+				game->start = loopnet->clock;
+			} else if (loopnet->clock >= LOOPHANDSHAKEMS) {
+				game->done = true;
+			}
+		} else if (loopnet->clock >= game->start + LOOPGAMEMS + LOOPDRAINMS) {
+			game->done = true;
+		}
+	}
+};
+using loopbarrier = std::barrier<loopstep>;
+
+	//A player's input changes a few of fvel, svel, avel and bits each tick,
+	//much like someone steering with the mouse and tapping keys
+int makeinput(std::mt19937& rng, unsigned char *buf, unsigned char *flags)
+{
+	std::uniform_int_distribution<int> percent(0, 99);
+	std::uniform_int_distribution<int> byte(0, 255);
+	static constexpr std::array<int, 4> odds{ 30, 20, 40, 10 };
+	int j{0};
+
+	*flags = 0;
+	for (int f{0}; f < (int)odds.size(); f++) {
+		if (percent(rng) < odds[f]) {
+			*flags |= (unsigned char)(1 << f);
+			buf[j++] = (unsigned char)byte(rng);
+			if (f == 3) buf[j++] = (unsigned char)byte(rng);
+		}
+	}
+	return j;
+}
+
+	//One player's side of a kenbuild style master/slave game. Slaves send
+	//their input to the master each tick; the master moves everyone each
+	//tick and sends all the inputs back out. Each input is tagged with the
+	//tick it was made on, a byte kenbuild doesn't send (1 to 255, or 0 for
+	//none yet). A slave's input lag runs from making an input until the
+	//master's broadcast of it arrives, as that is when the slave can move.
+void loopplayer(int node, loopgame& game, loopbarrier& sync, loopresult& result)
+{
+	const std::string players{"-n0:" + std::to_string(game.numplayers)};
+	const char *args[2]{ players.c_str(), "loop0" };
+	std::mt19937 inputrng(loopnet->config.seed * 7919 + node);
+	std::array<unsigned char, LOOPMSGSIZ> buf;
+	std::array<int, 256> sentat{};
+	std::array<int, MAXMULTIPLAYERS> stamp{};
+	mmulticounters base{};
+	int lasttick{-1};
+	int laststamp{-1};
+	int other;
+	int len;
+	bool ready{false};
+
+	loopnode = node;
+	loopnet->rng[node].seed(loopnet->config.seed * MAXMULTIPLAYERS + node);
+	loopnet->seq[node] = 0;
+
+	mmulticontext *context = mmulti_newcontext();
+	mmulti_setcontext(context);
+	mmulti_settransport(&looptransport);
+	const mmultiplayer me = mmulti_player();
+
+	const bool ok = initmultiplayersparms(node == 0 ? 1 : 2, args);
+
+	while (!game.done) {
+		if (!ok) {
+			// Nothing to do but keep the others company.
+		} else if (!game.playing) {
+			if (!ready) {
+				if (!initmultiplayerscycle()) {
+					ready = true;
+					result.readyat = loopnet->clock;
+					game.numready++;
+				}
+			} else {
+				flushpackets();
+			}
+		} else {
+			if (lasttick < 0) base = mmulti_counters();
+
+			while ((len = getpacket(&other, buf.data())) > 0) {
+				if (buf[0] == 1 && me.myconnectindex == me.connecthead) {
+					stamp[other] = buf[len - 1];
+				} else if (buf[0] == 0 && me.myconnectindex != me.connecthead) {
+					const int mystamp = buf[len - me.numplayers + me.myconnectindex];
+					if (mystamp && mystamp != laststamp) {
+						result.lag.push_back(loopnet->clock - sentat[mystamp]);
+						laststamp = mystamp;
+					}
+				}
+			}
+
+			const int tick = (loopnet->clock - game.start) / LOOPTICKMS;
+			if (tick != lasttick && loopnet->clock - game.start < LOOPGAMEMS) {
+				lasttick = tick;
+
+				if (me.myconnectindex != me.connecthead) {
+					buf[0] = 1;
+					len = 2 + makeinput(inputrng, &buf[2], &buf[1]);
+					buf[len++] = (unsigned char)(tick % 255 + 1);
+					sentat[tick % 255 + 1] = loopnet->clock;
+					sendpacket(me.connecthead, buf.data(), len);
+				} else {
+					int k = ((me.numplayers + 1) >> 1) + 1;
+					buf[0] = 0;
+					std::fill_n(&buf[1], k - 1, 0);
+					for (int i{me.connecthead}; i >= 0; i = me.connectpoint2[i]) {
+						unsigned char flags;
+						k += makeinput(inputrng, &buf[k], &flags);
+						buf[1 + (i >> 1)] |= (unsigned char)((flags & 15) << ((i & 1) << 2));
+					}
+					for (int i{me.connecthead}; i >= 0; i = me.connectpoint2[i]) {
+						buf[k++] = (unsigned char)stamp[i];
+					}
+					for (int i{me.connectpoint2[me.connecthead]}; i >= 0; i = me.connectpoint2[i]) {
+						sendpacket(i, buf.data(), k);
+					}
+				}
+			}
+		}
+
+		sync.arrive_and_wait();
+	}
+
+	const auto& end = mmulti_counters();
+	result.counters = {
+		end.datagramssent - base.datagramssent, end.bytessent - base.bytessent,
+		end.datagramsread - base.datagramsread, end.bytesread - base.bytesread,
+		end.badcrc - base.badcrc,
+		end.messagessent - base.messagessent, end.messagecopies - base.messagecopies,
+		end.sendcalls - base.sendcalls, end.readcalls - base.readcalls,
+	};
+	if (ok && game.playing) {
+		int peers{0};
+		for (int i{me.connecthead}; i >= 0; i = me.connectpoint2[i]) {
+			if (i == me.myconnectindex) continue;
+			result.rtt += std::max(mmulti_peerstats(i).rtt, 0);
+			peers++;
+			if (me.myconnectindex != me.connecthead) break;
+		}
+		if (peers) result.rtt /= peers;
+	}
+
+	uninitmultiplayers();
+	mmulti_setcontext(nullptr);
+	mmulti_deletecontext(context);
+	loopnode = -1;
+}
+
+void loopbenchgame(int players, const mmultiloopconfig& config)
+{
+	loopnetwork net;
+	loopgame game;
+	std::vector<loopresult> results(players);
+	std::vector<std::thread> threads;
+
+	net.config = config;
+	loopnet = &net;
+	game.numplayers = players;
+
+	loopbarrier sync(players, loopstep{ &game });
+
+	const unsigned int t0 = getusecticks();
+	for (int i{0}; i < players; i++) {
+		threads.emplace_back(loopplayer, i, std::ref(game), std::ref(sync), std::ref(results[i]));
+	}
+	for (auto& t : threads) {
+		t.join();
+	}
+	const unsigned int twall = getusecticks() - t0;
+	loopnet = nullptr;
+
+	if (!game.playing) {
+		buildprintf("  {:7}  players never all checked in\n", players);
+		return;
+	}
+
+	int handshake{0};
+	int badcrc{0};
+	long long slavebytes{0};
+	long long datagrams{0};
+	long long messages{0};
+	long long copies{0};
+	std::vector<int> lag;
+	for (const auto& r : results) {
+		handshake = std::max(handshake, r.readyat);
+		badcrc += r.counters.badcrc;
+		datagrams += r.counters.datagramssent;
+		messages += r.counters.messagessent;
+		copies += r.counters.messagecopies;
+		lag.insert(lag.end(), r.lag.begin(), r.lag.end());
+	}
+	for (int i{1}; i < players; i++) {
+		slavebytes += results[i].counters.bytessent;
+	}
+	std::ranges::sort(lag);
+
+	const float seconds = (float)(LOOPGAMEMS + LOOPDRAINMS) / 1000.F;
+	const int lagavg = lag.empty() ? 0 : (int)(std::accumulate(lag.begin(), lag.end(), 0LL) / (long long)lag.size());
+	const int lag99 = lag.empty() ? 0 : lag[lag.size() * 99 / 100];
+
+	buildprintf("  {:7}  {:6} ms  {:6} ms  {:6.1f} kB/s  {:6.1f} kB/s  {:7.1f}  {:10.2f}  {:>6}/{:<3} ms  {:7}  {:5.2f} s\n",
+		players, handshake, results[0].rtt,
+		(float)results[0].counters.bytessent / seconds / 1024.F,
+		(float)slavebytes / (float)(players - 1) / seconds / 1024.F,
+		(float)datagrams / (float)players / seconds,
+		messages ? (float)copies / (float)messages : 0.F,
+		lagavg, lag99, badcrc, (float)twall / 1000000.F);
+}
+
+} // namespace
+
+void netloopbench(int players, const mmultiloopconfig& config)
+{
+	buildprintf("netloopbench: {} ms latency, {} ms jitter, {}% lost, {}% duplicated, {}% reordered, {} s games\n",
+		config.latency, config.jitter, config.loss, config.duplicate, config.reorder, (LOOPGAMEMS + LOOPDRAINMS) / 1000);
+	buildprintf("  players  handshake  master rtt   master out    slave out  dgram/s  copies/msg  input lag avg/99%  bad crc     wall\n");
+
+	if (players > 0) {
+		loopbenchgame(players, config);
+	} else {
+		for (int i : { 2, 4, 8, 16 }) {
+			loopbenchgame(i, config);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+// Per peer network stats for the console, and as a CSV log.
+
+#include "build.hpp"
+#include "mmulti.hpp"
+#include "mmulti_priv.hpp"
+#include "baselayer.hpp"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+	//Only the process's own player logs; getpacket() doesn't call
+	//netstatslogtick() for simulated ones
+std::FILE *statsfile{nullptr};
+int statsinterval{1000};
+int statslast{0};
+bool statsstarted{false};
+
+} // namespace
+
+void netstatsprint()
+{
+	if (numplayers < 2) {
+		buildprintf("netstats: not in a multiplayer game\n");
+		return;
+	}
+
+	buildprintf("netstats: player {} of {}, {} inputs waiting, input lag {} ticks, {} sync errors\n",
+		myconnectindex, numplayers, netgamestats.fifodepth[myconnectindex], netgamestats.inputlag, netgamestats.syncerrors);
+	buildprintf("  peer   rtt/var    rto  unacked  unread    sent      kB    read      kB  resent   dup  late   crc  fifo\n");
+	for (int i{connecthead}; i >= 0; i = connectpoint2[i]) {
+		if (i == myconnectindex) continue;
+
+		const auto s = mmulti_peerstats(i);
+		buildprintf("  {:4}  {:4}/{:<4}  {:4}  {:7}  {:6}  {:6}  {:6.1f}  {:6}  {:6.1f}  {:6}  {:4}  {:4}  {:4}  {:4}\n",
+			i, s.rtt, s.rttvar, s.rto, s.unacked, s.unread,
+			s.datagramssent, (float)s.bytessent / 1024.F, s.datagramsread, (float)s.bytesread / 1024.F,
+			s.resends, s.duplicates, s.outoforder, s.badcrc, netgamestats.fifodepth[i]);
+	}
+}
+
+int netstatslog(const std::string& filename, int interval)
+{
+	if (statsfile) {
+		std::fclose(statsfile);
+		statsfile = nullptr;
+	}
+	if (filename.empty()) {
+		return 0;
+	}
+
+	statsfile = std::fopen(filename.c_str(), "a");
+	if (!statsfile) {
+		return -1;
+	}
+	statsinterval = interval;
+	statsstarted = false;
+
+	std::fseek(statsfile, 0, SEEK_END);
+	if (std::ftell(statsfile) == 0) {
+		fmt::print(statsfile, "ms,player,peer,rtt,rttvar,rto,unacked,unread,datagramssent,bytessent,"
+			"datagramsread,bytesread,resends,duplicates,outoforder,badcrc,fifodepth,inputlag,syncerrors\n");
+	}
+	return 0;
+}
+
+void netstatslogtick(int tims)
+{
+	if (!statsfile) {
+		return;
+	}
+	if (statsstarted && tims - statslast < statsinterval) {
+		return;
+	}
+	statsstarted = true;
+	statslast = tims;
+
+	for (int i{connecthead}; i >= 0; i = connectpoint2[i]) {
+		if (i == myconnectindex) {
+			fmt::print(statsfile, "{},{},{},,,,,,,,,,,,,,{},{},{}\n", tims, myconnectindex, i,
+				netgamestats.fifodepth[i], netgamestats.inputlag, netgamestats.syncerrors);
+			continue;
+		}
+
+		const auto s = mmulti_peerstats(i);
+		fmt::print(statsfile, "{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{},{}\n", tims, myconnectindex, i,
+			s.rtt, s.rttvar, s.rto, s.unacked, s.unread, s.datagramssent, s.bytessent,
+			s.datagramsread, s.bytesread, s.resends, s.duplicates, s.outoforder, s.badcrc,
+			netgamestats.fifodepth[i], netgamestats.inputlag, netgamestats.syncerrors);
+	}
+	std::fflush(statsfile);
+}
@@ -76,6 +76,7 @@ Low priority:
 #include "osd.hpp"
 #include "engine_priv.hpp"
 #include "polymost_priv.hpp"
+#include "pvs_priv.hpp"
 #include "polymost_fs_vs_aux.hpp"
 #include "string_utils.hpp"
 
@@ -83,12 +84,16 @@ Low priority:
 # include "glbuild_fs_vs.hpp"
 # include "hightile_priv.hpp"
 # include "polymosttex_priv.hpp"
+# include "polymostbatch.hpp"
+# include "polymosttexatlas.hpp"
 # include "polymosttexcache.hpp"
 # include "mdsprite_priv.hpp"
 #endif
 
+#include <algorithm>
 #include <charconv>
 #include <cmath>
+#include <memory>
 #include <numeric>
 #include <span>
 #include <string_view>
@@ -97,12 +102,12 @@ Low priority:
 
 int usegoodalpha{0};
 
+	//A vertical strip of the screen still open between its ceiling (cy) and floor (fy)
+	//edges, from x to the x of the next strip. The last strip only marks the right end.
 struct vsptyp {
 	float x;
 	std::array<float, 2> cy;
 	std::array<float, 2> fy;
-	int n;
-	int p;
 	int tag;
 	int ctag;
 	int ftag;
@@ -123,10 +128,45 @@ float gtang{0.0F};
 namespace {
 
 constexpr auto VSPMAX{4096}; //<- careful!
-std::array<vsptyp, VSPMAX> vsp;
+std::array<vsptyp, VSPMAX> vsp;	// in order of x
 int vcnt;
 int gtag;
 
+struct {
+	unsigned int domosts;
+	unsigned int splits;	// strips split by domost
+	int maxvcnt;
+} moststats;
+
+	//Views recently drawn, for polymostbenchscan to replay
+struct mostview {
+	point3di pos;
+	short ang;
+	short cursectnum;
+	int horiz;
+	int cosang;
+	int sinang;
+	int cosvrang;
+	int sinvrang;
+	int visibility;
+	float tang;
+};
+
+constexpr auto MOSTVIEWS{256};
+std::array<mostview, MOSTVIEWS> mostviews;
+int mostviewcnt{0};
+bool mostnodraw{false};	// set while benchmarking, so nothing reaches OpenGL
+
+void mostrecordview()
+{
+	mostviews[mostviewcnt % MOSTVIEWS] = {
+		globalpos, globalang, globalcursectnum, globalhoriz,
+		cosglobalang, singlobalang, cosviewingrangeglobalang, sinviewingrangeglobalang,
+		globalvisibility, gtang
+	};
+	mostviewcnt++;
+}
+
 constexpr auto SCISDIST{1.0}; //1.0: Close plane clipping distance
 #define USEZBUFFER 1 //1:use zbuffer (slow, nice sprite rendering), 0:no zbuffer (fast, bad sprite rendering)
 constexpr auto LINTERPSIZ{4}; //log2 of interpolation size. 4:pretty fast&acceptable quality, 0:best quality/slow!
@@ -1111,7 +1151,7 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 	polymostcallcounts.drawpoly++;
 #endif
 
-	if (method == -1) {
+	if (method == -1 || mostnodraw) {
 		return;
 	}
 
@@ -1208,6 +1248,11 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 		PTHead * pth{nullptr};
 		struct polymostdrawpolycall draw;
 		std::array<polymostvboitem, MINVBOINDEXES> vboitem;
+		const bool batched = (method & METH_BATCHED) && glbatchsprites;
+		bool blend{false};
+
+		if (!batched)
+			polymost_flushbatch();
 
 		if (usehightile)
 			ptflags |= PTH_HIGHTILE;
@@ -1239,7 +1284,7 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 		}
 
 		if (!(method & (METH_MASKED | METH_TRANS))) {
-			glfunc.glDisable(GL_BLEND);
+			blend = false;
 			draw.alphacut = 0.F;
 		}
 		else {
@@ -1256,10 +1301,15 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 				alphac = 0.0;	// invalid textures ignore the alpha cutoff settings
 			}
 
-			glfunc.glEnable(GL_BLEND);
+			blend = true;
 			draw.alphacut = alphac;
 		}
 
+		if (!batched) {
+			if (blend) glfunc.glEnable(GL_BLEND);
+			else glfunc.glDisable(GL_BLEND);
+		}
+
 		draw.fogcolour.r = static_cast<float>(palookupfog[gfogpalnum].r) / 63.F;
 		draw.fogcolour.g = static_cast<float>(palookupfog[gfogpalnum].g) / 63.F;
 		draw.fogcolour.b = static_cast<float>(palookupfog[gfogpalnum].b) / 63.F;
@@ -1276,6 +1326,10 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 		ox2     = (double)1.0/(double)xx;
 		oy2     = (double)1.0/(double)yy;
 
+			//Small tiles may live in a cell of a shared atlas page
+		const double atlasu = (double)pth->pic[picidx]->atlasx * ox2;
+		const double atlasv = (double)pth->pic[picidx]->atlasy * oy2;
+
 		if (!dorot)
 		{
 			for(i=n-1;i>=0;i--)
@@ -1447,8 +1501,8 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 					vboitem[i].v.x = (ox-ghalfx)*r*grhalfxdown10x;
 					vboitem[i].v.y = (ghoriz-oy)*r*grhalfxdown10;
 					vboitem[i].v.z = r*(1.0/1024.0);
-					vboitem[i].t.s = (up*r-du0+uoffs)*ox2;
-					vboitem[i].t.t = vp*r*oy2;
+					vboitem[i].t.s = (up*r-du0+uoffs)*ox2 + atlasu;
+					vboitem[i].t.t = vp*r*oy2 + atlasv;
 				}
 				draw.indexcount = nn;
 				draw.elementcount = nn;
@@ -1469,14 +1523,18 @@ void drawpoly (std::span<const double> dpx, std::span<const double> dpy, int n,
 				vboitem[i].v.x = (px[i]-ghalfx)*r*grhalfxdown10x;
 				vboitem[i].v.y = (ghoriz-py[i])*r*grhalfxdown10;
 				vboitem[i].v.z = r*(1.0/1024.0);
-				vboitem[i].t.s = uu[i]*r*ox2;
-				vboitem[i].t.t = vv[i]*r*oy2;
+				vboitem[i].t.s = uu[i]*r*ox2 + atlasu;
+				vboitem[i].t.t = vv[i]*r*oy2 + atlasv;
 			}
 			draw.indexcount = n;
 			draw.elementcount = n;
 
-			glfunc.glDepthMask(GL_TRUE);
-			polymost_drawpoly_glcall(GL_TRIANGLE_FAN, &draw);
+			if (batched) {
+				polymost_batchpoly(draw, blend, std::span(vboitem.data(), n));
+			} else {
+				glfunc.glDepthMask(GL_TRUE);
+				polymost_drawpoly_glcall(GL_TRIANGLE_FAN, &draw);
+			}
 		}
 
 		return;
@@ -1837,7 +1895,7 @@ void initmosts (const double *px, const double *py, int n)
 	int k;
 	int imin;
 
-	vcnt = 1; //0 is dummy solid node
+	vcnt = 0;
 
 	if (n < 3)
 		return;
@@ -1854,7 +1912,7 @@ void initmosts (const double *px, const double *py, int n)
 	{
 		if (px[i] < px[j])
 		{
-			if ((vcnt > 1) && (px[i] <= vsp[vcnt-1].x)) vcnt--;
+			if ((vcnt > 0) && (px[i] <= vsp[vcnt-1].x)) vcnt--;
 			vsp[vcnt].x = px[i];
 			vsp[vcnt].cy[0] = py[i];
 			k = j+1; if (k >= n) k = 0;
@@ -1867,7 +1925,7 @@ void initmosts (const double *px, const double *py, int n)
 		}
 		else if (px[j] < px[i])
 		{
-			if ((vcnt > 1) && (px[j] <= vsp[vcnt-1].x)) vcnt--;
+			if ((vcnt > 0) && (px[j] <= vsp[vcnt-1].x)) vcnt--;
 			vsp[vcnt].x = px[j];
 			vsp[vcnt].fy[0] = py[j];
 			k = i-1; if (k < 0) k = n-1;
@@ -1880,7 +1938,7 @@ void initmosts (const double *px, const double *py, int n)
 		}
 		else
 		{
-			if ((vcnt > 1) && (px[i] <= vsp[vcnt-1].x)) vcnt--;
+			if ((vcnt > 0) && (px[i] <= vsp[vcnt-1].x)) vcnt--;
 			vsp[vcnt].x = px[i];
 			vsp[vcnt].cy[0] = py[i];
 			vsp[vcnt].fy[0] = py[j];
@@ -1899,58 +1957,37 @@ void initmosts (const double *px, const double *py, int n)
 
 	for(i=0;i<vcnt;i++)
 	{
-		vsp[i].cy[1] = vsp[i+1].cy[0]; vsp[i].ctag = i;
-		vsp[i].fy[1] = vsp[i+1].fy[0]; vsp[i].ftag = i;
-		vsp[i].n = i+1; vsp[i].p = i-1;
+		vsp[i].cy[1] = vsp[i+1].cy[0]; vsp[i].ctag = i+1;
+		vsp[i].fy[1] = vsp[i+1].fy[0]; vsp[i].ftag = i+1;
 	}
-	vsp[vcnt-1].n = 0; vsp[0].p = vcnt-1;
-	gtag = vcnt;
-
-		//VSPMAX-1 is dummy empty node
-	for(i=vcnt;i<VSPMAX;i++) { vsp[i].n = i+1; vsp[i].p = i-1; }
-	vsp[VSPMAX-1].n = vcnt; vsp[vcnt].p = VSPMAX-1;
+	gtag = vcnt+1;
 }
 
-void vsdel(int i) {
-	//Delete i
-	const int pi = vsp[i].p;
-	const int ni = vsp[i].n;
-	vsp[ni].p = pi;
-	vsp[pi].n = ni;
-
-	//Add i to empty list
-	vsp[i].n = vsp[VSPMAX - 1].n;
-	vsp[i].p = VSPMAX - 1;
-	vsp[vsp[VSPMAX - 1].n].p = i;
-	vsp[VSPMAX - 1].n = i;
+	//Returns the first strip that ends right of x
+int vsfind (float x)
+{
+	if (vcnt < 2)
+		return 0;
+
+	const auto it = std::upper_bound(vsp.begin() + 1, vsp.begin() + vcnt, x,
+		[](float x, const vsptyp& v) { return x < v.x; });
+
+	return (int)(it - vsp.begin()) - 1;
 }
 
+	//Splits strip i in two, returning the index of the right half
 int vsinsaft (int i)
 {
-	//i = next element from empty list
-	const int r = vsp[VSPMAX-1].n;
-	vsp[vsp[r].n].p = VSPMAX - 1;
-	vsp[VSPMAX-1].n = vsp[r].n;
-
-	vsp[r] = vsp[i]; //copy i to r
-
-	//insert r after i
-	vsp[r].p = i;
-	vsp[r].n = vsp[i].n;
-	vsp[vsp[i].n].p = r;
-	vsp[i].n = r;
+	std::copy_backward(vsp.begin() + i, vsp.begin() + vcnt, vsp.begin() + vcnt + 1);
+	vcnt++;
 
-	return r;
+	return i + 1;
 }
 
 int testvisiblemost (float x0, float x1)
 {
-	int newi;
-
-	for(int i = vsp[0].n; i; i = newi) { // TODO: Is this right?
-		newi = vsp[i].n;
-
-		if ((x0 < vsp[newi].x) && (vsp[i].x < x1) && (vsp[i].ctag >= 0)) {
+	for(int i = vsfind(x0); (i < vcnt - 1) && (vsp[i].x < x1); i++) {
+		if (vsp[i].ctag >= 0) {
 			return 1;
 		}
 	}
@@ -1984,7 +2021,6 @@ void domost (float x0, float y0, float x1, float y1, int polymethod)
 	int k;
 	int z;
 	int ni;
-	int vcnt{ 0 };
 	int scnt;
 	int newi;
 	int dir;
@@ -1993,6 +2029,7 @@ void domost (float x0, float y0, float x1, float y1, int polymethod)
 #ifdef DEBUGGINGAIDS
 	polymostcallcounts.domost++;
 #endif
+	moststats.domosts++;
 	polymethod |= METH_LAYERS;
 
 	if (x0 < x1)
@@ -2012,13 +2049,15 @@ void domost (float x0, float y0, float x1, float y1, int polymethod)
 	}
 
 	slop = (y1-y0)/(x1-x0);
-	
-	for(i=vsp[0].n;i;i=newi)
+
+		//Only the strips overlapping x0..x1 need visiting; i always moves past the
+		//pieces of a split strip, so it lands on the next original one
+	for(i=vsfind(x0);(i<vcnt-1)&&(vsp[i].x<x1);)
 	{
-		newi = vsp[i].n;
+		newi = i+1;
 		nx0 = vsp[i].x;
 		nx1 = vsp[newi].x;
-		if ((x0 >= nx1) || (nx0 >= x1) || (vsp[i].ctag <= 0)) continue;
+		if ((x0 >= nx1) || (nx0 >= x1) || (vsp[i].ctag <= 0)) { i = newi; continue; }
 		dx = nx1-nx0;
 		cy[0] = vsp[i].cy[0];
 		cv[0] = vsp[i].cy[1]-cy[0];
@@ -2079,21 +2118,22 @@ void domost (float x0, float y0, float x1, float y1, int polymethod)
 		}
 
 		vsp[i].tag = vsp[newi].tag = -1;
-		for(z=0;z<=scnt;z++,i=vcnt)
+		moststats.splits += scnt;
+		for(z=0;z<=scnt;z++,i++)
 		{
 			if (z < scnt)
 			{
-				vcnt = vsinsaft(i);
+				ni = vsinsaft(i);
 				t = (spx[z]-nx0)/dx;
 				vsp[i].cy[1] = t*cv[0] + cy[0];
 				vsp[i].fy[1] = t*cv[1] + cy[1];
-				vsp[vcnt].x = spx[z];
-				vsp[vcnt].cy[0] = vsp[i].cy[1];
-				vsp[vcnt].fy[0] = vsp[i].fy[1];
-				vsp[vcnt].tag = spt[z];
+				vsp[ni].x = spx[z];
+				vsp[ni].cy[0] = vsp[i].cy[1];
+				vsp[ni].fy[0] = vsp[i].fy[1];
+				vsp[ni].tag = spt[z];
 			}
 
-			ni = vsp[i].n; if (!ni) continue; //this 'if' fixes many bugs!
+			ni = i+1;
 			dx0 = vsp[i].x; if (x0 > dx0) continue;
 			dx1 = vsp[ni].x; if (x1 < dx1) continue;
 			ny0 = (dx0-x0)*slop + y0;
@@ -2242,21 +2282,27 @@ void domost (float x0, float y0, float x1, float y1, int polymethod)
 	}
 
 	gtag++;
+	moststats.maxvcnt = std::max(moststats.maxvcnt, vcnt);
 
 		//Combine neighboring vertical strips with matching collinear top&bottom edges
 		//This prevents x-splits from propagating through the entire scan
-	i = vsp[0].n;
-	
-	while (i) {
-		ni = vsp[i].n;
-		if ((vsp[i].cy[0] >= vsp[i].fy[0]) && (vsp[i].cy[1] >= vsp[i].fy[1])) { vsp[i].ctag = vsp[i].ftag = -1; }
-		if ((vsp[i].ctag == vsp[ni].ctag) && (vsp[i].ftag == vsp[ni].ftag)) {
-			vsp[i].cy[1] = vsp[ni].cy[1];
-			vsp[i].fy[1] = vsp[ni].fy[1];
-			vsdel(ni);
+		//Strips are compacted in place: i is the strip being grown, ni the next one read.
+		//The right end marker keeps its own tags, so nothing merges into it.
+	if (vcnt > 0) {
+		i = 0;
+
+		for (ni = 1; ni < vcnt; ni++) {
+			if ((vsp[i].cy[0] >= vsp[i].fy[0]) && (vsp[i].cy[1] >= vsp[i].fy[1])) { vsp[i].ctag = vsp[i].ftag = -1; }
+			if ((vsp[i].ctag == vsp[ni].ctag) && (vsp[i].ftag == vsp[ni].ftag)) {
+				vsp[i].cy[1] = vsp[ni].cy[1];
+				vsp[i].fy[1] = vsp[ni].fy[1];
+			}
+			else if (++i != ni) {
+				vsp[i] = vsp[ni];
+			}
 		}
-		else
-			i = ni;
+
+		vcnt = i+1;
 	}
 }
 
@@ -3434,6 +3480,52 @@ int polymost_bunchfront (int b1, int b2)
 	return wallfront(i, b2f);
 }
 
+std::array<double, MAXWALLS> wallrelx;	// polymost_transformsectorwalls() scratch
+std::array<double, MAXWALLS> wallrely;
+std::array<double, MAXWALLS> wallviewx;	// view space wall positions of the sectors scanned this frame
+std::array<double, MAXWALLS> wallviewy;
+
+/**
+ * Puts all of a sector's walls into view space in one batch, as
+ * polymost_scansector() would have done one at a time
+ * @param startwall the sector's first wall
+ * @param endwall one past its last wall
+ */
+void polymost_transformsectorwalls(int startwall, int endwall)
+{
+	const int n = endwall - startwall;
+	int i{0};
+
+	for (; i < n; ++i) {
+		wallrelx[i] = (double)(wall[startwall + i].pt.x - globalpos.x);
+		wallrely[i] = (double)(wall[startwall + i].pt.y - globalpos.y);
+	}
+
+	double *viewx = &wallviewx[startwall];
+	double *viewy = &wallviewy[startwall];
+	i = 0;
+
+#if defined(PRAGMAS_SSE2)
+	const __m128d cosang = _mm_set1_pd((double)cosglobalang);
+	const __m128d sinang = _mm_set1_pd((double)singlobalang);
+	const __m128d cosvr = _mm_set1_pd((double)cosviewingrangeglobalang);
+	const __m128d sinvr = _mm_set1_pd((double)sinviewingrangeglobalang);
+	const __m128d sixtyfour = _mm_set1_pd(64.0);
+
+	for (; i + 2 <= n; i += 2) {
+		const __m128d x = _mm_loadu_pd(&wallrelx[i]);
+		const __m128d y = _mm_loadu_pd(&wallrely[i]);
+		_mm_storeu_pd(&viewx[i], _mm_div_pd(_mm_sub_pd(_mm_mul_pd(y, cosang), _mm_mul_pd(x, sinang)), sixtyfour));
+		_mm_storeu_pd(&viewy[i], _mm_div_pd(_mm_add_pd(_mm_mul_pd(x, cosvr), _mm_mul_pd(y, sinvr)), sixtyfour));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		viewx[i] = (wallrely[i]*(double)cosglobalang             - wallrelx[i]*(double)singlobalang            )/64.0;
+		viewy[i] = (wallrelx[i]*(double)cosviewingrangeglobalang + wallrely[i]*(double)sinviewingrangeglobalang)/64.0;
+	}
+}
+
 void polymost_scansector (int sectnum)
 {
 	double d;
@@ -3496,8 +3588,7 @@ void polymost_scansector (int sectnum)
 		startwall = g_sector[sectnum].wallptr;
 		endwall = g_sector[sectnum].wallnum+startwall;
 		scanfirst = numscans;
-		xp2 = 0;
-		yp2 = 0;
+		polymost_transformsectorwalls(startwall, endwall);
 		for(z=startwall,wal=&wall[z];z<endwall;z++,wal++)
 		{
 			wal2 = &wall[wal->point2];
@@ -3510,22 +3601,21 @@ void polymost_scansector (int sectnum)
 			if ((nextsectnum >= 0) && (!(wal->cstat&32)) && (!(gotsector[nextsectnum >> 3] & pow2char[nextsectnum & 7])))
 			{
 				d = (double)x1*(double)y2 - (double)x2*(double)y1; xp1 = (double)(x2-x1); yp1 = (double)(y2-y1);
-				if (d*d <= (xp1*xp1 + yp1*yp1)*(SCISDIST*SCISDIST*260.0))
+				if ((d*d <= (xp1*xp1 + yp1*yp1)*(SCISDIST*SCISDIST*260.0)) &&
+					((pvsviewsect < 0) || pvsvisible(pvsviewsect, nextsectnum)))
 					sectorborder[sectorbordercnt++] = nextsectnum;
 			}
 
-			if ((z == startwall) || (wall[z-1].point2 != z))
-			{
-				xp1 = ((double)y1*(double)cosglobalang             - (double)x1*(double)singlobalang            )/64.0;
-				yp1 = ((double)x1*(double)cosviewingrangeglobalang + (double)y1*(double)sinviewingrangeglobalang)/64.0;
+			xp1 = wallviewx[z];
+			yp1 = wallviewy[z];
+			if ((wal->point2 >= startwall) && (wal->point2 < endwall)) {
+				xp2 = wallviewx[wal->point2];
+				yp2 = wallviewy[wal->point2];
 			}
 			else {
-				xp1 = xp2;
-				yp1 = yp2;
+				xp2 = ((double)y2*(double)cosglobalang             - (double)x2*(double)singlobalang            )/64.0;
+				yp2 = ((double)x2*(double)cosviewingrangeglobalang + (double)y2*(double)sinviewingrangeglobalang)/64.0;
 			}
-
-			xp2 = ((double)y2*(double)cosglobalang             - (double)x2*(double)singlobalang            )/64.0;
-			yp2 = ((double)x2*(double)cosviewingrangeglobalang + (double)y2*(double)sinviewingrangeglobalang)/64.0;
 			
 			if ((yp1 >= SCISDIST) || (yp2 >= SCISDIST))
 				if ((double)xp1*(double)yp2 < (double)xp2*(double)yp1) //if wall is facing you...
@@ -3566,9 +3656,11 @@ void polymost_scansector (int sectnum)
 	} while (sectorbordercnt > 0);
 }
 
-} // namespace
-
-void polymost_drawrooms()
+/**
+ * Works out the visible sectors and draws their walls, ceilings and floors
+ * @return false if the view has no area
+ */
+bool polymost_scanrooms()
 {
 	int i;
 	int j;
@@ -3592,50 +3684,6 @@ void polymost_drawrooms()
 	double sy[6];
 	static unsigned char tempbuf[MAXWALLS];
 
-	if (rendmode == rendmode_t::Classic)
-		return;
-
-	frameoffset = frameplace + windowy1*bytesperline + windowx1;
-
-#if USE_OPENGL
-	if (rendmode == rendmode_t::OpenGL)
-	{
-		resizeglcheck();
-
-		//glfunc.glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-		glfunc.glEnable(GL_DEPTH_TEST);
-		glfunc.glDepthFunc(GL_ALWAYS); //NEVER,LESS,(,L)EQUAL,GREATER,(NOT,G)EQUAL,ALWAYS
-
-		//glfunc.glPolygonOffset(1,1); //Supposed to make sprites pasted on walls or floors not disappear
-#if (USE_OPENGL == USE_GLES2)
-		glfunc.glDepthRangef(0.00001f,1.f); //<- this is more widely supported than glPolygonOffset
-#else
-		glfunc.glDepthRange(0.00001,1.0); //<- this is more widely supported than glPolygonOffset
-#endif
-
-		 //Enable this for OpenGL red-blue glasses mode :)
-		if (glredbluemode)
-		{
-			static int grbfcnt = 0; grbfcnt++;
-			if (redblueclearcnt < numpages) { redblueclearcnt++; glfunc.glColorMask(1,1,1,1); glfunc.glClear(GL_COLOR_BUFFER_BIT); }
-			if (grbfcnt&1)
-			{
-				glfunc.glViewport(windowx1-16,yres-(windowy2+1),windowx2-(windowx1-16)+1,windowy2-windowy1+1);
-				glfunc.glColorMask(1,0,0,1);
-				globalpos.x += singlobalang/1024;
-				globalpos.y -= cosglobalang/1024;
-			}
-			else
-			{
-				glfunc.glViewport(windowx1,yres-(windowy2+1),windowx2+16-windowx1+1,windowy2-windowy1+1);
-				glfunc.glColorMask(0,1,1,1);
-				globalpos.x -= singlobalang/1024;
-				globalpos.y += cosglobalang/1024;
-			}
-		}
-	}
-#endif
-
 		//Polymost supports true look up/down :) Here, we convert horizon to angle.
 		//gchang&gshang are cos&sin of this angle (respectively)
 	gyxscale = ((double)xdimenscale)/131072.0;
@@ -3705,7 +3753,7 @@ void polymost_drawrooms()
 			pz2[n2] = SCISDIST; n2++;
 		}
 	}
-	if (n2 < 3) return;
+	if (n2 < 3) return false;
 	for(i=0;i<n2;i++)
 	{
 		r = ghalfx / pz2[i];
@@ -3790,6 +3838,8 @@ void polymost_drawrooms()
 		if (globalcursectnum < 0) globalcursectnum = i;
 	}
 
+	pvsviewsect = (!inpreparemirror && pvsready() && (inside(globalpos.x, globalpos.y, globalcursectnum) == 1)) ? globalcursectnum : -1;
+
 	polymost_scansector(globalcursectnum);
 
 	if (inpreparemirror)
@@ -3835,6 +3885,145 @@ void polymost_drawrooms()
 		bunchfirst[closest] = bunchfirst[numbunches];
 		bunchlast[closest] = bunchlast[numbunches];
 	}
+
+	return true;
+}
+
+/**
+ * Times polymost_scanrooms over the recently drawn views, with drawing turned off
+ * @param passes how many times to go over the views
+ */
+void polymost_benchscan(int passes)
+{
+	const int numviews = std::min(mostviewcnt, MOSTVIEWS);
+
+	if (!numviews) {
+		buildprintf("polymostbenchscan: no views have been drawn yet\n");
+		return;
+	}
+
+	mostview saved;
+	const auto savedtsprite = std::make_unique<decltype(tsprite)>(tsprite);
+	const auto savedmaskwall = std::make_unique<decltype(maskwall)>(maskwall);
+	const auto savedgotsector = std::make_unique<decltype(gotsector)>(gotsector);
+	const int savedspritesortcnt = spritesortcnt;
+	const short savedmaskwallcnt = maskwallcnt;
+	const short savedsearchit = searchit;
+	const bool savedautomapping = automapping;
+
+	auto setview = [](const mostview& v) {
+		globalpos = v.pos;
+		globalang = v.ang;
+		globalcursectnum = v.cursectnum;
+		globalhoriz = v.horiz;
+		cosglobalang = v.cosang;
+		singlobalang = v.sinang;
+		cosviewingrangeglobalang = v.cosvrang;
+		sinviewingrangeglobalang = v.sinvrang;
+		globalvisibility = v.visibility;
+		gtang = v.tang;
+	};
+
+	saved = { globalpos, globalang, globalcursectnum, globalhoriz,
+		cosglobalang, singlobalang, cosviewingrangeglobalang, sinviewingrangeglobalang,
+		globalvisibility, gtang };
+
+	searchit = 0;
+	automapping = false;
+	mostnodraw = true;
+	moststats = {};
+
+	const auto t0 = getusecticks();
+
+	for (int pass{0}; pass < passes; pass++) {
+		for (int v{0}; v < numviews; v++) {
+			setview(mostviews[v]);
+			std::memset(&gotsector[0], 0, (numsectors+7)>>3);
+			spritesortcnt = 0;
+			maskwallcnt = 0;
+			polymost_scanrooms();
+		}
+	}
+
+	const auto t = getusecticks() - t0;
+
+	mostnodraw = false;
+	setview(saved);
+	tsprite = *savedtsprite;
+	maskwall = *savedmaskwall;
+	gotsector = *savedgotsector;
+	spritesortcnt = savedspritesortcnt;
+	maskwallcnt = savedmaskwallcnt;
+	searchit = savedsearchit;
+	automapping = savedautomapping;
+
+	const float perview = 1.F / (float)(numviews * passes);
+
+	buildprintf("polymostbenchscan: {} views, {} passes\n", numviews, passes);
+	buildprintf("  {:.1f} us per view, {:.0f} domost calls and {:.0f} strip splits per view, at most {} strips\n",
+			   (float)t * perview, (float)moststats.domosts * perview,
+			   (float)moststats.splits * perview, moststats.maxvcnt);
+}
+
+} // namespace
+
+void polymost_drawrooms()
+{
+	if (rendmode == rendmode_t::Classic)
+		return;
+
+	frameoffset = frameplace + windowy1*bytesperline + windowx1;
+
+	if (!inpreparemirror) {
+		mostrecordview();
+	}
+
+#if USE_OPENGL
+	if (rendmode == rendmode_t::OpenGL)
+	{
+		resizeglcheck();
+
+		if (voxloadpending) {
+			voxloadflush();
+		}
+
+		//glfunc.glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+		glfunc.glEnable(GL_DEPTH_TEST);
+		glfunc.glDepthFunc(GL_ALWAYS); //NEVER,LESS,(,L)EQUAL,GREATER,(NOT,G)EQUAL,ALWAYS
+
+		//glfunc.glPolygonOffset(1,1); //Supposed to make sprites pasted on walls or floors not disappear
+#if (USE_OPENGL == USE_GLES2)
+		glfunc.glDepthRangef(0.00001f,1.f); //<- this is more widely supported than glPolygonOffset
+#else
+		glfunc.glDepthRange(0.00001,1.0); //<- this is more widely supported than glPolygonOffset
+#endif
+
+		 //Enable this for OpenGL red-blue glasses mode :)
+		if (glredbluemode)
+		{
+			static int grbfcnt = 0; grbfcnt++;
+			if (redblueclearcnt < numpages) { redblueclearcnt++; glfunc.glColorMask(1,1,1,1); glfunc.glClear(GL_COLOR_BUFFER_BIT); }
+			if (grbfcnt&1)
+			{
+				glfunc.glViewport(windowx1-16,yres-(windowy2+1),windowx2-(windowx1-16)+1,windowy2-windowy1+1);
+				glfunc.glColorMask(1,0,0,1);
+				globalpos.x += singlobalang/1024;
+				globalpos.y -= cosglobalang/1024;
+			}
+			else
+			{
+				glfunc.glViewport(windowx1,yres-(windowy2+1),windowx2+16-windowx1+1,windowy2-windowy1+1);
+				glfunc.glColorMask(0,1,1,1);
+				globalpos.x -= singlobalang/1024;
+				globalpos.y += cosglobalang/1024;
+			}
+		}
+	}
+#endif
+
+	if (!polymost_scanrooms())
+		return;
+
 #if USE_OPENGL
 	if (rendmode == rendmode_t::OpenGL)
 	{
@@ -4132,6 +4321,7 @@ void polymost_drawsprite (int snum)
 	// FIXME: Does rendmode need to be checked every time?
 	while (rendmode == rendmode_t::OpenGL && !(spriteext[tspr->owner].flags&SPREXT_NOTMD)) {
 		if (usemodels && tile2model[tspr->picnum].modelid >= 0 && tile2model[tspr->picnum].framenum >= 0) {
+			polymost_flushbatch();
 			if (mddraw(tspr, 0)) {
 				if (automapping) show2dsprite[spritenum >> 3] |= pow2char[spritenum & 7];
 				return;
@@ -4139,6 +4329,7 @@ void polymost_drawsprite (int snum)
 			break;	// else, render as flat sprite
 		}
 		if (usevoxels && (tspr->cstat&48)!=48 && tiletovox[tspr->picnum] >= 0 && voxmodels[ tiletovox[tspr->picnum] ]) {
+			polymost_flushbatch();
 			if (voxdraw(voxmodels[ tiletovox[tspr->picnum] ].get(), tspr, 0)) {
 				if (automapping) show2dsprite[spritenum >> 3] |= pow2char[spritenum & 7];
 				return;
@@ -4146,6 +4337,7 @@ void polymost_drawsprite (int snum)
 			break;	// else, render as flat sprite
 		}
 		if ((tspr->cstat&48)==48 && voxmodels[ tspr->picnum ]) {
+			polymost_flushbatch();
 			voxdraw(voxmodels[ tspr->picnum ].get(), tspr, 0);
 			if (automapping) show2dsprite[spritenum >> 3] |= pow2char[spritenum & 7];
 			return;
@@ -4200,7 +4392,7 @@ void polymost_drawsprite (int snum)
 				if (py[2] > sy0) py[2] = py[3] = sy0;
 			}
 
-			drawpoly(px,py,4,method);
+			drawpoly(px,py,4,method|METH_BATCHED);
 			break;
 		case 1: //Wall sprite
 
@@ -4411,7 +4603,7 @@ void polymost_drawsprite (int snum)
 				guo = ((float)tilesizx[globalpicnum])*gdo - guo;
 			}
 
-			drawpoly(px,py,npoints,method);
+			drawpoly(px,py,npoints,method|METH_BATCHED);
 			break;
 
 		case 3: //Voxel sprite
@@ -5112,10 +5304,14 @@ int polymost_drawtilescreen (int tilex, int tiley, int wallnum, int dimen)
 
 	float xdimepad;
 	float ydimepad;
+	float xdimeofs{0.F};
+	float ydimeofs{0.F};
 
 	if (pth) {
 		xdimepad = (float)pth->pic[PTHPIC_BASE]->tsizx / (float)pth->pic[PTHPIC_BASE]->sizx;
 		ydimepad = (float)pth->pic[PTHPIC_BASE]->tsizy / (float)pth->pic[PTHPIC_BASE]->sizy;
+		xdimeofs = (float)pth->pic[PTHPIC_BASE]->atlasx / (float)pth->pic[PTHPIC_BASE]->sizx;
+		ydimeofs = (float)pth->pic[PTHPIC_BASE]->atlasy / (float)pth->pic[PTHPIC_BASE]->sizy;
 	} else {
 		xdimepad = 1.0;
 		ydimepad = 1.0;
@@ -5146,26 +5342,26 @@ int polymost_drawtilescreen (int tilex, int tiley, int wallnum, int dimen)
 	vboitem[0].v.x = (GLfloat)tilex;
 	vboitem[0].v.y = (GLfloat)tiley;
 	vboitem[0].v.z = 0.F;
-	vboitem[0].t.s = 0.F;
-	vboitem[0].t.t = 0.F;
+	vboitem[0].t.s = xdimeofs;
+	vboitem[0].t.t = ydimeofs;
 
 	vboitem[1].v.x = (GLfloat)tilex+scx;
 	vboitem[1].v.y = (GLfloat)tiley;
 	vboitem[1].v.z = 0.F;
-	vboitem[1].t.s = xdimepad;
-	vboitem[1].t.t = 0.F;
+	vboitem[1].t.s = xdimeofs + xdimepad;
+	vboitem[1].t.t = ydimeofs;
 
 	vboitem[2].v.x = (GLfloat)tilex+scx;
 	vboitem[2].v.y = (GLfloat)tiley+scy;
 	vboitem[2].v.z = 0.F;
-	vboitem[2].t.s = xdimepad;
-	vboitem[2].t.t = ydimepad;
+	vboitem[2].t.s = xdimeofs + xdimepad;
+	vboitem[2].t.t = ydimeofs + ydimepad;
 
 	vboitem[3].v.x = (GLfloat)tilex;
 	vboitem[3].v.y = (GLfloat)tiley+scy;
 	vboitem[3].v.z = 0.F;
-	vboitem[3].t.s = 0.F;
-	vboitem[3].t.t = ydimepad;
+	vboitem[3].t.s = xdimeofs;
+	vboitem[3].t.t = ydimeofs + ydimepad;
 
 	draw.indexcount = 4;
 	draw.indexes = nullptr;
@@ -5648,6 +5844,71 @@ int osdcmd_forcetexcacherebuild(const osdfuncparm_t *parm)
 	return OSDCMD_OK;
 }
 
+int osdcmd_gltexatlasstats(const osdfuncparm_t *parm)
+{
+	std::ignore = parm;
+	PTAtlasPrintStats();
+	return OSDCMD_OK;
+}
+
+int osdcmd_mdframestats(const osdfuncparm_t *parm)
+{
+	std::ignore = parm;
+	mdprintframestats();
+	return OSDCMD_OK;
+}
+
+int osdcmd_mdbenchframes(const osdfuncparm_t *parm)
+{
+	int numactors{64};
+	int numframes{600};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), numactors);
+	}
+	if (parm->parms.size() > 1) {
+		const std::string_view parmv{parm->parms[1]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), numframes);
+	}
+	if (numactors < 1 || numframes < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	mdbenchframes(numactors, numframes);
+	return OSDCMD_OK;
+}
+
+int osdcmd_spritebatchbench(const osdfuncparm_t *parm)
+{
+	int sprites{2000};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), sprites);
+	}
+	if (sprites < 1 || sprites > MAXSPRITESONSCREEN * 8) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	polymost_batchbench(sprites);
+	return OSDCMD_OK;
+}
+
+int osdcmd_mdloadstats(const osdfuncparm_t *parm)
+{
+	std::ignore = parm;
+	mdprintloadstats();
+	return OSDCMD_OK;
+}
+
+int osdcmd_mdbenchload(const osdfuncparm_t *parm)
+{
+	std::ignore = parm;
+	mdbenchload();
+	return OSDCMD_OK;
+}
+
 } // namespace
 
 #endif //USE_OPENGL
@@ -5728,6 +5989,19 @@ int osdcmd_polymostvars(const osdfuncparm_t *parm)
 		else glusetexcache = (val != 0);
 		return OSDCMD_OK;
 	}
+	else if (IsSameAsNoCase(parm->name, "glusetexatlas")) {
+		if (showval) { buildprintf("glusetexatlas is {}\n", glusetexatlas); }
+		else if (glusetexatlas != (val != 0)) {
+			glusetexatlas = (val != 0);
+			polymost_texinvalidateall();
+		}
+		return OSDCMD_OK;
+	}
+	else if (IsSameAsNoCase(parm->name, "glbatchsprites")) {
+		if (showval) { buildprintf("glbatchsprites is {}\n", glbatchsprites); }
+		else glbatchsprites = (val != 0);
+		return OSDCMD_OK;
+	}
 	else if (IsSameAsNoCase(parm->name, "glmultisample")) {
 		if (showval) {
 			if (!glmultisample) buildprintf("glmultisample is {} (off)\n", glmultisample);
@@ -5765,6 +6039,22 @@ int osdcmd_polymostvars(const osdfuncparm_t *parm)
 	return OSDCMD_SHOWHELP;
 }
 
+int osdcmd_polymostbenchscan(const osdfuncparm_t *parm)
+{
+	int passes{10};
+
+	if (parm->parms.size() > 0) {
+		const std::string_view parmv{parm->parms[0]};
+		std::from_chars(parmv.data(), parmv.data() + parmv.size(), passes);
+	}
+	if (passes < 1) {
+		return OSDCMD_SHOWHELP;
+	}
+
+	polymost_benchscan(passes);
+	return OSDCMD_OK;
+}
+
 } // namespace
 
 void polymost_initosdfuncs()
@@ -5787,6 +6077,14 @@ void polymost_initosdfuncs()
 	OSD_RegisterFunction("glsampleshading","glsampleshading: enable/disable OpenGL sample multisampling",osdcmd_polymostvars);
 	OSD_RegisterFunction("polymosttexverbosity","polymosttexverbosity: sets the level of chatter during texture loading. 0 = none, 1 = errors (default), 2 = all",osdcmd_polymostvars);
 	OSD_RegisterFunction("forcetexcacherebuild","forcetexcacherebuild: invalidates the compressed texture cache", osdcmd_forcetexcacherebuild);
+	OSD_RegisterFunction("glusetexatlas","glusetexatlas: enable/disable packing small ART tiles into shared textures",osdcmd_polymostvars);
+	OSD_RegisterFunction("gltexatlasstats","gltexatlasstats: shows the occupancy of the small tile texture atlas",osdcmd_gltexatlasstats);
+	OSD_RegisterFunction("glbatchsprites","glbatchsprites: enable/disable drawing runs of similar face and floor sprites together",osdcmd_polymostvars);
+	OSD_RegisterFunction("spritebatchbench","spritebatchbench [sprites]: counts and times the draw submissions for a crowd of sprites with and without batching, and checks an atlas eviction draws the queued sprites first",osdcmd_spritebatchbench);
+	OSD_RegisterFunction("mdframestats","mdframestats: shows how many model frame blends were shared since last asked",osdcmd_mdframestats);
+	OSD_RegisterFunction("mdbenchframes","mdbenchframes [actors] [frames]: times model frame blending for a crowd of the loaded models",osdcmd_mdbenchframes);
+	OSD_RegisterFunction("mdloadstats","mdloadstats: shows the time spent loading models and how many came from the model cache",osdcmd_mdloadstats);
+	OSD_RegisterFunction("mdbenchload","mdbenchload: times reloading every loaded model file with and without the model cache",osdcmd_mdbenchload);
 #ifdef SHADERDEV
 	OSD_RegisterFunction("debugreloadshaders","debugreloadshaders: reloads the OpenGL shaders",osdcmd_debugreloadshaders);
 #endif
@@ -5796,6 +6094,7 @@ void polymost_initosdfuncs()
 	OSD_RegisterFunction("debugshowcallcounts","debugshowcallcounts: display rendering call counts",osdcmd_polymostvars);
 #endif
 #endif	//USE_OPENGL
+	OSD_RegisterFunction("polymostbenchscan","polymostbenchscan [passes]: times the visibility scan over the last views drawn, without drawing",osdcmd_polymostbenchscan);
 }
 
 #endif	//USE_POLYMOST
@@ -32,6 +32,7 @@ enum {
     METH_LAYERS  = 8,       // when given to drawpoly, renders the additional texture layers
     METH_POW2XSPLIT = 16,   // when given to drawpoly, splits polygons for non-2^x-capable GL devices
     METH_ROTATESPRITE = 32, // when given to drawpoly, use the rotatesprite projection matrix
+    METH_BATCHED = 64,      // when given to drawpoly, may be drawn later with similar polygons
 };
 
 #if USE_OPENGL
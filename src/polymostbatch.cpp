@@ -0,0 +1,289 @@
+#include "build.hpp"
+
+#if USE_POLYMOST && USE_OPENGL
+
+#include "baselayer.hpp"
+#include "glbuild_priv.hpp"
+#include "polymost_priv.hpp"
+#include "polymostbatch.hpp"
+#include "hightile_priv.hpp"
+#include "polymosttex_priv.hpp"
+#include "polymosttexatlas.hpp"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t PTBATCH_MAXVERTS{3 * 16384};	// must stay within GLushort indexes
+
+bool samecolour(const coltypef& a, const coltypef& b)
+{
+	return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+bool samestate(const polymostdrawpolycall& a, const polymostdrawpolycall& b)
+{
+	return a.texture0 == b.texture0 && a.texture1 == b.texture1 &&
+		a.alphacut == b.alphacut && a.fogdensity == b.fogdensity &&
+		samecolour(a.colour, b.colour) && samecolour(a.fogcolour, b.fogcolour) &&
+		a.modelview == b.modelview && a.projection == b.projection;
+}
+
+	//Polygons queued for one draw call, turned from fans into a triangle list
+	//so the ascending global index buffer can still be used
+class spritebatch {
+public:
+	template<typename Submit>
+	void add(const polymostdrawpolycall& d, bool b, std::span<const polymostvboitem> fan, Submit&& submit)
+	{
+		if (fan.size() < 3) {
+			return;
+		}
+
+		const std::size_t add{(fan.size() - 2) * 3};
+		if (!verts.empty() && (blend != b || !samestate(draw, d) || verts.size() + add > PTBATCH_MAXVERTS)) {
+			flush(submit);
+		}
+		if (verts.empty()) {
+			draw = d;
+			blend = b;
+		}
+
+		const std::size_t base{verts.size()};
+		verts.resize(base + add);
+		auto *out = &verts[base];
+		for (std::size_t i{1}; i + 1 < fan.size(); i++, out += 3) {
+			out[0] = fan[0];
+			out[1] = fan[i];
+			out[2] = fan[i + 1];
+		}
+	}
+
+	std::size_t queued() const { return verts.size(); }
+
+	template<typename Submit>
+	void flush(Submit&& submit)
+	{
+		if (verts.empty()) {
+			return;
+		}
+
+		draw.indexbuffer = 0;
+		draw.indexcount = (GLuint)verts.size();
+		draw.elementbuffer = 0;
+		draw.elementcount = (GLuint)verts.size();
+		draw.elementvbo = verts.data();
+		submit(draw, blend);
+		verts.clear();
+	}
+
+private:
+	std::vector<polymostvboitem> verts;
+	polymostdrawpolycall draw{};
+	bool blend{false};
+};
+
+spritebatch glbatch;
+
+void submitgl(const polymostdrawpolycall& draw, bool blend)
+{
+	if (blend) glfunc.glEnable(GL_BLEND);
+	else glfunc.glDisable(GL_BLEND);
+
+	glfunc.glDepthMask(GL_TRUE);
+	polymost_drawpoly_glcall(GL_TRIANGLES, &draw);
+}
+
+	//Where glbatch sends its draws; the bench counts them instead
+void (*glbatchsubmit)(const polymostdrawpolycall&, bool){submitgl};
+std::size_t glbatchcounted{0};
+
+void countgl(const polymostdrawpolycall& draw, bool)
+{
+	glbatchcounted += draw.elementcount;
+}
+
+} // namespace
+
+void polymost_groupbatchitems(std::span<polymostbatchitem> items)
+{
+	for (std::size_t i{1}; i < items.size(); i++) {
+		if (items[i].depth == items[i - 1].depth) {
+			items[i].key = items[i - 1].key;
+		}
+	}
+
+	std::stable_sort(items.begin(), items.end(), [](const polymostbatchitem& a, const polymostbatchitem& b) {
+		return a.key < b.key;
+	});
+}
+
+void polymost_batchpoly(const polymostdrawpolycall& draw, bool blend, std::span<const polymostvboitem> fan)
+{
+	glbatch.add(draw, blend, fan, glbatchsubmit);
+}
+
+void polymost_flushbatch()
+{
+	glbatch.flush(glbatchsubmit);
+}
+
+void polymost_batchbench(int sprites)
+{
+		//A particle-heavy scene: a handful of tiles in a couple of palettes and
+		//shades, a third of them translucent, some lying flat on the floor
+	struct benchsprite {
+		float x, y, z;		// view space centre
+		float xsiz, ysiz;
+		bool xflip, yflip;
+		bool floor;
+		int picnum, pal, shade;
+		bool trans;
+	};
+	std::mt19937 rng(sprites);
+	std::uniform_real_distribution<float> pos(-1.F, 1.F);
+	std::uniform_real_distribution<float> dist(0.05F, 1.F);
+	std::uniform_int_distribution<int> pick(0, 99);
+	std::vector<benchsprite> spr(sprites);
+
+	for (auto& s : spr) {
+		s.z = dist(rng);
+		s.x = pos(rng) * s.z;
+		s.y = pos(rng) * s.z;
+		s.xsiz = 0.01F + (float)pick(rng) / 2000.F;
+		s.ysiz = s.xsiz * (1.F + (float)(pick(rng) & 1));
+		s.xflip = pick(rng) & 1;
+		s.yflip = pick(rng) < 10;
+		s.floor = pick(rng) < 30;
+		s.picnum = 2000 + pick(rng) % 6;
+		s.pal = pick(rng) < 80 ? 0 : 2;
+		s.shade = pick(rng) % 4;
+		s.trans = pick(rng) < 33;
+	}
+
+		//Back to front, like drawmasks()
+	std::stable_sort(spr.begin(), spr.end(), [](const benchsprite& a, const benchsprite& b) { return a.z > b.z; });
+
+	std::vector<polymostbatchitem> opaque;
+	std::vector<short> order;
+	for (int i{0}; i < sprites; i++) {
+		if (!spr[i].trans) opaque.push_back({ polymost_batchkey(spr[i].picnum, spr[i].pal, spr[i].shade), (int)(spr[i].z * 65536.F), (short)i });
+	}
+	polymost_groupbatchitems(opaque);
+	for (const auto& item : opaque) order.push_back(item.index);
+	for (int i{0}; i < sprites; i++) {
+		if (spr[i].trans) order.push_back((short)i);
+	}
+
+	auto makedraw = [](const benchsprite& s, polymostdrawpolycall& draw) {
+		draw.texture0 = (GLuint)s.picnum;
+		draw.texture1 = 0;
+		draw.alphacut = s.trans ? 0.F : 0.32F;
+		draw.colour.r = draw.colour.g = draw.colour.b = (float)(32 - s.shade) / 32.F;
+		draw.colour.a = s.trans ? 0.66F : 1.F;
+		draw.fogcolour = { (float)s.pal, 0.F, 0.F, 1.F };
+		draw.fogdensity = 0.F;
+		draw.modelview = &gidentitymat[0][0];
+		draw.projection = &gdrawroomsprojmat[0][0];
+	};
+
+		//Per-instance position, size and flip go into the vertices
+	auto makefan = [](const benchsprite& s, std::array<polymostvboitem, 4>& fan) {
+		const float s0 = s.xflip ? 1.F : 0.F;
+		const float t0 = s.yflip ? 1.F : 0.F;
+		const float dy = s.floor ? 0.F : s.ysiz;
+		const float dz = s.floor ? s.ysiz : 0.F;
+
+		fan[0] = { { s.x - s.xsiz, s.y + dy, s.z - dz }, { s0, t0 } };
+		fan[1] = { { s.x + s.xsiz, s.y + dy, s.z - dz }, { 1.F - s0, t0 } };
+		fan[2] = { { s.x + s.xsiz, s.y - dy, s.z + dz }, { 1.F - s0, 1.F - t0 } };
+		fan[3] = { { s.x - s.xsiz, s.y - dy, s.z + dz }, { s0, 1.F - t0 } };
+	};
+
+		//Stands in for polymost_drawpoly_glcall(), copying the vertices as the
+		//upload to the vertex buffer would
+	std::vector<polymostvboitem> upload;
+	int calls{0};
+	unsigned int tris{0};
+	auto countsubmit = [&](const polymostdrawpolycall& draw, GLenum mode) {
+		upload.assign(draw.elementvbo, draw.elementvbo + draw.elementcount);
+		calls++;
+		tris += mode == GL_TRIANGLES ? draw.indexcount / 3 : draw.indexcount - 2;
+	};
+
+	constexpr int passes{100};
+	polymostdrawpolycall draw{};
+	std::array<polymostvboitem, 4> fan;
+
+		//One triangle fan per sprite in plain back to front order, as before
+	unsigned int t0 = getusecticks();
+	for (int p{0}; p < passes; p++) {
+		calls = 0;
+		tris = 0;
+		for (const auto& s : spr) {
+			makedraw(s, draw);
+			makefan(s, fan);
+			draw.indexcount = draw.elementcount = (GLuint)fan.size();
+			draw.elementvbo = fan.data();
+			countsubmit(draw, GL_TRIANGLE_FAN);
+		}
+	}
+	const unsigned int tsingle = getusecticks() - t0;
+	const int singlecalls = calls;
+	const unsigned int singletris = tris;
+
+	spritebatch batch;
+	auto batchsubmit = [&](const polymostdrawpolycall& draw, bool) { countsubmit(draw, GL_TRIANGLES); };
+	t0 = getusecticks();
+	for (int p{0}; p < passes; p++) {
+		calls = 0;
+		tris = 0;
+		for (short i : order) {
+			makedraw(spr[i], draw);
+			makefan(spr[i], fan);
+			batch.add(draw, true, fan, batchsubmit);
+		}
+		batch.flush(batchsubmit);
+	}
+	const unsigned int tbatched = getusecticks() - t0;
+
+		//Queues the sprites for real and has the atlas evict a page part way
+		//through, as it does when full. Every sprite queued by then must be
+		//drawn first, as their tiles may be on that page.
+	std::size_t queued{0};
+	bool evicted{false};
+	bool drawnfirst{true};
+	polymost_flushbatch();
+	glbatchsubmit = countgl;
+	glbatchcounted = 0;
+	for (short i : order) {
+		makedraw(spr[i], draw);
+		makefan(spr[i], fan);
+		polymost_batchpoly(draw, true, fan);
+		queued += (fan.size() - 2) * 3;
+		if (!evicted && queued >= (std::size_t)sprites * 3 && glbatch.queued() > 0) {
+			evicted = PTAtlasEvictOldest();
+			drawnfirst = evicted && glbatch.queued() == 0 && glbatchcounted == queued;
+		}
+	}
+	polymost_flushbatch();
+	glbatchsubmit = submitgl;
+
+	buildprintf("spritebatchbench: {} sprites, {} opaque\n", sprites, opaque.size());
+	buildprintf("  one per sprite: {} submissions, {} triangles, {:.1f} us/frame\n",
+			   singlecalls, singletris, (float)tsingle / (float)passes);
+	buildprintf("  batched:        {} submissions, {} triangles, {:.1f} us/frame\n",
+			   calls, tris, (float)tbatched / (float)passes);
+	if (!evicted) {
+		buildprintf("  atlas eviction:  skipped, the atlas has no pages\n");
+	} else if (drawnfirst) {
+		buildprintf("  atlas eviction:  queued sprites drawn first\n");
+	} else {
+		buildprintf("  atlas eviction:  FAILED, queued sprites left behind\n");
+	}
+}
+
+#endif //USE_POLYMOST && USE_OPENGL
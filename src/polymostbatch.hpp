@@ -0,0 +1,67 @@
+#if (USE_POLYMOST == 0)
+#error Polymost not enabled.
+#endif
+#if (USE_OPENGL == 0)
+#error OpenGL not enabled.
+#endif
+
+#ifndef POLYMOSTBATCH_H
+#define POLYMOSTBATCH_H
+
+#include <cstdint>
+#include <span>
+
+inline int glbatchsprites{1};
+
+/** a sprite about to be drawn, for grouping sprites by drawing state */
+struct polymostbatchitem {
+	std::uint32_t key;	// from polymost_batchkey()
+	int depth;			// sprites of equal depth stay in order
+	short index;		// caller's own reference
+};
+
+/**
+ * Packs the sprite properties that decide its drawing state into a key
+ * @param picnum the tile
+ * @param pal the palette
+ * @param shade the shade
+ * @return the key, equal for sprites likely to be drawn with the same state
+ */
+constexpr std::uint32_t polymost_batchkey(int picnum, int pal, int shade)
+{
+	return ((std::uint32_t)(picnum & 0xffff) << 16) | ((std::uint32_t)(pal & 0xff) << 8) | (std::uint32_t)(shade & 0xff);
+}
+
+/**
+ * Reorders opaque sprites so those sharing a key come together, keeping
+ * their order otherwise, and never separating or reordering sprites at
+ * the same depth
+ * @param items the sprites in drawing order
+ */
+void polymost_groupbatchitems(std::span<polymostbatchitem> items);
+
+/**
+ * Queues a sprite polygon to be drawn with the ones queued before it,
+ * drawing those first if their state differs
+ * @param draw the drawing state, as drawpoly() would have passed it
+ * @param blend whether blending is enabled
+ * @param fan the polygon's vertices, as a triangle fan
+ */
+void polymost_batchpoly(const polymostdrawpolycall& draw, bool blend, std::span<const polymostvboitem> fan);
+
+/**
+ * Draws any queued sprite polygons. Anything else drawing with OpenGL
+ * while sprites may be queued must call this first.
+ */
+void polymost_flushbatch();
+
+/**
+ * Sends made up face and floor sprite polygons through the batching, and
+ * through one submission each, counting and timing the submissions. Then
+ * queues them again and evicts an atlas page part way, checking the
+ * queued ones are drawn first.
+ * @param sprites number of sprites
+ */
+void polymost_batchbench(int sprites);
+
+#endif
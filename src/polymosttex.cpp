@@ -12,9 +12,11 @@
 #include "polymost_priv.hpp"
 #include "hightile_priv.hpp"
 #include "polymosttex_priv.hpp"
+#include "polymosttexatlas.hpp"
 #include "polymosttexcache.hpp"
 #include "polymosttexcompress.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <cstring>
@@ -456,6 +458,21 @@ std::string PTM_GetLoadTextureFileErrorString(int err)
 
 namespace {
 
+/**
+ * Releases the OpenGL texture behind a texture manager header, whether it
+ * owns the texture or borrows a cell of an atlas page
+ * @param ptm the texture manager header
+ */
+void ptm_dispose(PTMHead * ptm)
+{
+	if (ptm->atlaspage) {
+		PTAtlasRelease(ptm);
+	} else if (ptm->glpic) {
+		glfunc.glDeleteTextures(1, &ptm->glpic);
+		ptm->glpic = 0;
+	}
+}
+
 /**
  * Finds the pthash entry for a tile, possibly creating it if one doesn't exist
  * @param picnum tile number
@@ -549,14 +566,14 @@ PTHash * pt_findhash(int picnum, int palnum, unsigned short flags, int create)
 void pt_unload(PTHash * pth)
 {
 	for (int i{PTHPIC_SIZE - 1}; i >= 0; i--) {
-		if (pth->head.pic[i] && pth->head.pic[i]->glpic) {
-			glfunc.glDeleteTextures(1, &pth->head.pic[i]->glpic);
-			pth->head.pic[i]->glpic = 0;
+		if (pth->head.pic[i]) {
+			ptm_dispose(pth->head.pic[i]);
 		}
 	}
 }
 
 bool pt_load_art(PTHead* pth);
+bool pt_load_art_atlas(PTHead * pth, PTTexture * tex, PTTexture * fbtex);
 int pt_load_hightile(PTHead * pth);
 void pt_load_applyparameters(const PTHead * pth);
 
@@ -717,10 +734,22 @@ bool pt_load_art(PTHead * pth)
 	pth->flags &= ~(PTH_HASALPHA | PTH_SKYBOX);
 	pth->flags |= (PTH_NOCOMPRESS | PTH_NOMIPLEVEL);
 	tex.hasalpha = hasalpha;
+	fbtex.hasalpha = 1;
+
+	if (waloff[pth->picnum] && PTAtlasAccepts(tex.tsizx, tex.tsizy, pth->flags) &&
+		pt_load_art_atlas(pth, &tex, hasfullbright ? &fbtex : nullptr)) {
+		pt_load_applyparameters(pth);
+
+		std::free(tex.pic);
+		std::free(fbtex.pic);
+
+		return true;
+	}
 
     PTM_InitIdent(&id, pth);
     id.layer = PTHPIC_BASE;
 	pth->pic[PTHPIC_BASE] = PTM_GetHead(&id);
+	PTAtlasRelease(pth->pic[PTHPIC_BASE]);
 	pth->pic[PTHPIC_BASE]->tsizx = tex.tsizx;
 	pth->pic[PTHPIC_BASE]->tsizy = tex.tsizy;
 	pth->pic[PTHPIC_BASE]->sizx  = tex.sizx;
@@ -730,15 +759,18 @@ bool pt_load_art(PTHead * pth)
 	if (hasfullbright) {
         id.layer = PTHPIC_GLOW;
 		pth->pic[PTHPIC_GLOW] = PTM_GetHead(&id);
+		PTAtlasRelease(pth->pic[PTHPIC_GLOW]);
 		pth->pic[PTHPIC_GLOW]->tsizx = tex.tsizx;
 		pth->pic[PTHPIC_GLOW]->tsizy = tex.tsizy;
 		pth->pic[PTHPIC_GLOW]->sizx  = tex.sizx;
 		pth->pic[PTHPIC_GLOW]->sizy  = tex.sizy;
-		fbtex.hasalpha = 1;
 		ptm_uploadtexture(pth->pic[PTHPIC_GLOW], pth->flags, &fbtex, nullptr);
 	} else {
 		// it might be that after reloading an invalidated texture, the
 		// glow map might not be needed anymore, so release it
+		if (pth->pic[PTHPIC_GLOW] && pth->pic[PTHPIC_GLOW]->atlaspage) {
+			PTAtlasRelease(pth->pic[PTHPIC_GLOW]);
+		}
 		pth->pic[PTHPIC_GLOW] = nullptr;//FIXME should really call a disposal function
 	}
 	pt_load_applyparameters(pth);
@@ -753,6 +785,96 @@ bool pt_load_art(PTHead * pth)
 	return true;
 }
 
+/**
+ * Packs a small ART tile and its glow map into a shared atlas cell
+ * @param pth the header to populate
+ * @param tex the base texture as prepared by pt_load_art
+ * @param fbtex the fullbright texture, or null if the tile has none
+ * @return false if no atlas cell could be had
+ */
+bool pt_load_art_atlas(PTHead * pth, PTTexture * tex, PTTexture * fbtex)
+{
+	PTMIdent id;
+	PTAtlasSlot slot;
+	std::array<PTMHead*, PTATLAS_LAYERS> ptm = { nullptr, nullptr };
+	std::array<PTTexture*, PTATLAS_LAYERS> src = { tex, fbtex };
+
+	const int cellw = PTAtlasCellSize(tex->tsizx);
+	const int cellh = PTAtlasCellSize(tex->tsizy);
+
+	PTM_InitIdent(&id, pth);
+	id.layer = PTHPIC_BASE;
+	ptm[PTATLAS_BASE] = PTM_GetHead(&id);
+	if (fbtex) {
+		id.layer = PTHPIC_GLOW;
+		ptm[PTATLAS_GLOW] = PTM_GetHead(&id);
+	}
+
+	// an invalidated texture of unchanged size is refreshed in place
+	const bool reuse = PTAtlasReuse(ptm[PTATLAS_BASE], cellw, cellh, &slot);
+
+	// let go of any glow map not already sharing that cell before the
+	// base is moved, so no page gets emptied under a fresh allocation
+	if (pth->pic[PTHPIC_GLOW] && pth->pic[PTHPIC_GLOW] != ptm[PTATLAS_GLOW]) {
+		ptm_dispose(pth->pic[PTHPIC_GLOW]);
+	}
+	if (ptm[PTATLAS_GLOW] && !(reuse &&
+			ptm[PTATLAS_GLOW]->atlaspage == ptm[PTATLAS_BASE]->atlaspage &&
+			ptm[PTATLAS_GLOW]->atlasx == ptm[PTATLAS_BASE]->atlasx &&
+			ptm[PTATLAS_GLOW]->atlasy == ptm[PTATLAS_BASE]->atlasy)) {
+		ptm_dispose(ptm[PTATLAS_GLOW]);
+	}
+
+	if (!reuse) {
+		ptm_dispose(ptm[PTATLAS_BASE]);
+		if (!PTAtlasAlloc(cellw, cellh, &slot)) {
+			return false;
+		}
+	}
+
+	PTTexture cell;
+	cell.pic = (coltype *) std::malloc(cellw * cellh * sizeof(coltype));
+	if (!cell.pic) {
+		return false;
+	}
+
+	for (int layer{0}; layer < PTATLAS_LAYERS; ++layer) {
+		if (!ptm[layer]) {
+			continue;
+		}
+
+		// the tile goes in the middle of the cell, surrounded by transparency
+		// that ptm_fixtransparency tints to match the tile's edges
+		cell.sizx = cell.tsizx = cellw;
+		cell.sizy = cell.tsizy = cellh;
+		std::fill_n(cell.pic, cellw * cellh, coltype{});
+		for (int y{0}; y < tex->tsizy; ++y) {
+			std::memcpy(&cell.pic[(y + PTATLAS_PADDING) * cellw + PTATLAS_PADDING],
+				&src[layer]->pic[y * src[layer]->sizx], tex->tsizx * sizeof(coltype));
+		}
+		ptm_fixtransparency(&cell, 1);
+
+		for (int level{0}; ; ++level) {
+			PTAtlasUpload(&slot, layer, level, cell.pic);
+			if (level == PTATLAS_MIPLEVELS) {
+				break;
+			}
+			ptm_mipscale(&cell);
+			ptm_fixtransparency(&cell, 1);
+		}
+
+		PTAtlasAssign(ptm[layer], &slot, layer, tex->tsizx, tex->tsizy);
+		ptm[layer]->flags = src[layer]->hasalpha ? PTH_HASALPHA : 0;
+	}
+
+	std::free(cell.pic);
+
+	pth->pic[PTHPIC_BASE] = ptm[PTATLAS_BASE];
+	pth->pic[PTHPIC_GLOW] = ptm[PTATLAS_GLOW];
+
+	return true;
+}
+
 /**
  * Load a Hightile texture into an OpenGL texture
  * @param pth the header to populate
@@ -1392,6 +1514,8 @@ void PTReset()
 			pth = pth->next;
 		}
 	}
+
+	PTAtlasClear();
 }
 
 /**
@@ -1416,6 +1540,8 @@ void PTClear()
 		pthashhead[i] = nullptr;
 	}
 
+	PTAtlasClear();
+
 	for (i=PTMHASHHEADSIZ-1; i>=0; i--) {
 		ptmh = ptmhashhead[i];
 		while (ptmh) {
@@ -1454,6 +1580,10 @@ PTHead* PT_GetHead(int picnum, int palnum, unsigned short flags, int peek)
 		pth = pth->deferto;
 	}
 
+	if (pth->head.pic[PTHPIC_BASE]) {
+		PTAtlasTouch(pth->head.pic[PTHPIC_BASE]);
+	}
+
 	return &pth->head;
 }
 
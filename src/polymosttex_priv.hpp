@@ -34,6 +34,11 @@ struct PTMHead {
 	int flags;
 	int sizx, sizy;		// padded texture dimensions
 	int tsizx, tsizy;		// true texture dimensions
+
+	int atlaspage;		// 1 + atlas page the texture is packed into, or 0 if glpic is its own
+	int atlaslayer;		// PTATLAS_BASE or PTATLAS_GLOW
+	int atlasx, atlasy;	// texel offset of the texture within its atlas page
+	int atlasw, atlash;	// atlas cell dimensions, including padding
 };
 
 /** identifying information for a PolymostTex texture manager entry */
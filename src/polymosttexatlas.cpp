@@ -0,0 +1,376 @@
+#include "build.hpp"
+
+#if USE_POLYMOST && USE_OPENGL
+
+#include "baselayer.hpp"
+#include "glbuild_priv.hpp"
+#include "polymost_priv.hpp"
+#include "polymostbatch.hpp"
+#include "hightile_priv.hpp"
+#include "polymosttex_priv.hpp"
+#include "polymosttexatlas.hpp"
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <vector>
+
+/*
+ PolymostTex texture atlas
+
+ Small clamped ART tiles (HUD digits, font glyphs, small sprites) are packed
+ into shared pages so consecutive draws of different tiles do not need a
+ texture bind each. Pages are filled with a shelf packer: cells are placed
+ left to right along horizontal shelves, and each new shelf opens below the
+ last one. Every cell carries a transparent border of PTATLAS_PADDING texels
+ and is aligned to the same, so the first PTATLAS_MIPLEVELS mipmap levels of
+ a cell never sample its neighbours. Pages are limited to those levels.
+
+ When every page is full, the least recently drawn page is evicted whole;
+ its residents are marked dirty and get packed again when next used. That
+ page may well have been drawn this frame, by sprites still queued to be
+ drawn together, so queued sprites are drawn before a page is evicted or
+ has texels uploaded into it.
+ */
+
+namespace {
+
+struct PTAtlasShelf {
+	int y;
+	int h;
+	int x;		// next free column
+};
+
+struct PTAtlasPage {
+	std::array<GLuint, PTATLAS_LAYERS> glpic{};
+	std::vector<PTAtlasShelf> shelves;
+	std::vector<PTMHead*> residents;
+	int nexty{0};		// top of the unused region below the shelves
+	int allocarea{0};	// texels handed out to cells
+	int livearea{0};	// texels of cells still referenced by a texture
+	int lastused{0};	// numframes when a resident was last drawn
+};
+
+std::vector<PTAtlasPage> atlaspages;
+int atlaspagesiz{0};
+
+struct {
+	int allocs;
+	int reuses;
+	int evictions;
+	int failures;
+} atlasstats;
+
+void ptatlas_resetpage(PTAtlasPage& page)
+{
+	page.shelves.clear();
+	page.residents.clear();
+	page.nexty = 0;
+	page.allocarea = 0;
+	page.livearea = 0;
+}
+
+/**
+ * Creates the texture for one layer of a page, with every level transparent
+ */
+void ptatlas_createlayer(PTAtlasPage& page, int layer)
+{
+	const std::vector<coltype> blank(atlaspagesiz * atlaspagesiz);
+
+	glfunc.glGenTextures(1, &page.glpic[layer]);
+	glfunc.glBindTexture(GL_TEXTURE_2D, page.glpic[layer]);
+	glfunc.glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, PTATLAS_MIPLEVELS);
+
+	for (int level{0}; level <= PTATLAS_MIPLEVELS; ++level) {
+		glfunc.glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA,
+			atlaspagesiz >> level, atlaspagesiz >> level, 0, GL_RGBA,
+			GL_UNSIGNED_BYTE, (const GLvoid *) &blank[0]);
+	}
+}
+
+/**
+ * Throws every resident out of a page and empties it
+ */
+void ptatlas_evict(PTAtlasPage& page)
+{
+	polymost_flushbatch();
+
+	for (auto* ptm : page.residents) {
+		ptm->glpic = 0;
+		ptm->atlaspage = 0;
+		ptm->atlasx = ptm->atlasy = 0;
+		ptm->flags |= PTH_DIRTY;
+	}
+
+	ptatlas_resetpage(page);
+	atlasstats.evictions++;
+}
+
+/**
+ * Places a cell on the shortest shelf that takes it, opening a new shelf
+ * if none does or if the best one would waste more than half its height
+ */
+bool ptatlas_shelfalloc(PTAtlasPage& page, int w, int h, PTAtlasSlot* slot)
+{
+	PTAtlasShelf* best{nullptr};
+
+	for (auto& shelf : page.shelves) {
+		if (shelf.h < h || shelf.x + w > atlaspagesiz) {
+			continue;
+		}
+		if (!best || shelf.h < best->h) {
+			best = &shelf;
+		}
+	}
+
+	if (best && best->h > h * 2 && page.nexty + h <= atlaspagesiz) {
+		best = nullptr;
+	}
+
+	if (!best) {
+		if (page.nexty + h > atlaspagesiz || w > atlaspagesiz) {
+			return false;
+		}
+		page.shelves.push_back({ page.nexty, h, 0 });
+		page.nexty += h;
+		best = &page.shelves.back();
+	}
+
+	slot->x = best->x;
+	slot->y = best->y;
+	slot->w = w;
+	slot->h = h;
+	best->x += w;
+	page.allocarea += w * h;
+
+	return true;
+}
+
+/**
+ * Evicts the least recently drawn page
+ * @return the index of the page
+ */
+int ptatlas_evictoldest()
+{
+	int i{0};
+
+	for (int j{1}; j < (int)atlaspages.size(); ++j) {
+		if (atlaspages[j].lastused < atlaspages[i].lastused) {
+			i = j;
+		}
+	}
+	if (polymosttexverbosity >= 2) {
+		buildprintf("PolymostTex: atlas full, evicting page {} ({} textures)\n",
+				   i, atlaspages[i].residents.size());
+	}
+	ptatlas_evict(atlaspages[i]);
+
+	return i;
+}
+
+} // namespace
+
+bool PTAtlasAccepts(int tsizx, int tsizy, unsigned short flags)
+{
+#if (USE_OPENGL == USE_GLES2)
+	// GLES2 cannot limit the mipmap chain of a page
+	std::ignore = tsizx;
+	std::ignore = tsizy;
+	std::ignore = flags;
+	return false;
+#else
+	if (!glusetexatlas) {
+		return false;
+	}
+	// repeating textures wrap around their own edges, which a shared page can't do
+	if (!(flags & PTH_CLAMPED) || (flags & (PTH_HIGHTILE | PTH_SKYBOX))) {
+		return false;
+	}
+	return tsizx > 0 && tsizy > 0 &&
+		tsizx <= PTATLAS_MAXTILESIZ && tsizy <= PTATLAS_MAXTILESIZ;
+#endif
+}
+
+int PTAtlasCellSize(int tsiz)
+{
+	return (tsiz + 2 * PTATLAS_PADDING + PTATLAS_PADDING - 1) & ~(PTATLAS_PADDING - 1);
+}
+
+bool PTAtlasAlloc(int w, int h, PTAtlasSlot* slot)
+{
+	if (atlaspagesiz == 0) {
+		atlaspagesiz = PTATLAS_PAGESIZ;
+		if (glinfo.maxtexsize > 0) {
+			atlaspagesiz = std::min(atlaspagesiz, static_cast<int>(glinfo.maxtexsize));
+		}
+	}
+
+	for (int i{0}; i < (int)atlaspages.size(); ++i) {
+		if (ptatlas_shelfalloc(atlaspages[i], w, h, slot)) {
+			slot->page = i;
+			atlasstats.allocs++;
+			return true;
+		}
+	}
+
+	int i;
+
+	if ((int)atlaspages.size() < PTATLAS_MAXPAGES) {
+		atlaspages.emplace_back();
+		i = (int)atlaspages.size() - 1;
+		ptatlas_createlayer(atlaspages[i], PTATLAS_BASE);
+	} else {
+		i = ptatlas_evictoldest();
+	}
+
+	if (!ptatlas_shelfalloc(atlaspages[i], w, h, slot)) {
+		atlasstats.failures++;
+		return false;
+	}
+
+	slot->page = i;
+	atlasstats.allocs++;
+	return true;
+}
+
+bool PTAtlasReuse(const PTMHead* ptm, int w, int h, PTAtlasSlot* slot)
+{
+	if (!ptm->atlaspage || ptm->atlaslayer != PTATLAS_BASE ||
+		ptm->atlasw != w || ptm->atlash != h) {
+		return false;
+	}
+
+	slot->page = ptm->atlaspage - 1;
+	slot->x = ptm->atlasx - PTATLAS_PADDING;
+	slot->y = ptm->atlasy - PTATLAS_PADDING;
+	slot->w = w;
+	slot->h = h;
+	atlasstats.reuses++;
+
+	return true;
+}
+
+void PTAtlasUpload(const PTAtlasSlot* slot, int layer, int level, const coltype* pic)
+{
+	PTAtlasPage& page = atlaspages[slot->page];
+
+	if (page.glpic[layer] == 0) {
+		ptatlas_createlayer(page, layer);
+	}
+
+	polymost_flushbatch();
+	glfunc.glBindTexture(GL_TEXTURE_2D, page.glpic[layer]);
+	glfunc.glTexSubImage2D(GL_TEXTURE_2D, level,
+		slot->x >> level, slot->y >> level, slot->w >> level, slot->h >> level,
+		GL_RGBA, GL_UNSIGNED_BYTE, (const GLvoid *) pic);
+}
+
+void PTAtlasAssign(PTMHead* ptm, const PTAtlasSlot* slot, int layer, int tsizx, int tsizy)
+{
+	PTAtlasPage& page = atlaspages[slot->page];
+	const bool resident = (ptm->atlaspage == slot->page + 1);
+
+	ptm->glpic = page.glpic[layer];
+	ptm->sizx = atlaspagesiz;
+	ptm->sizy = atlaspagesiz;
+	ptm->tsizx = tsizx;
+	ptm->tsizy = tsizy;
+	ptm->atlaspage = slot->page + 1;
+	ptm->atlaslayer = layer;
+	ptm->atlasx = slot->x + PTATLAS_PADDING;
+	ptm->atlasy = slot->y + PTATLAS_PADDING;
+	ptm->atlasw = slot->w;
+	ptm->atlash = slot->h;
+
+	if (!resident) {
+		page.residents.push_back(ptm);
+		if (layer == PTATLAS_BASE) {
+			page.livearea += slot->w * slot->h;
+		}
+	}
+	page.lastused = numframes;
+}
+
+void PTAtlasRelease(PTMHead* ptm)
+{
+	if (!ptm->atlaspage) {
+		return;
+	}
+
+	PTAtlasPage& page = atlaspages[ptm->atlaspage - 1];
+
+	std::erase(page.residents, ptm);
+	if (ptm->atlaslayer == PTATLAS_BASE) {
+		page.livearea -= ptm->atlasw * ptm->atlash;
+	}
+
+	ptm->glpic = 0;
+	ptm->atlaspage = 0;
+	ptm->atlasx = ptm->atlasy = 0;
+
+	if (page.residents.empty()) {
+		// shelves can't return single cells, but an empty page is free again
+		ptatlas_resetpage(page);
+	}
+}
+
+void PTAtlasTouch(const PTMHead* ptm)
+{
+	if (ptm->atlaspage) {
+		atlaspages[ptm->atlaspage - 1].lastused = numframes;
+	}
+}
+
+bool PTAtlasEvictOldest()
+{
+	if (atlaspages.empty()) {
+		return false;
+	}
+
+	ptatlas_evictoldest();
+	return true;
+}
+
+void PTAtlasClear()
+{
+	polymost_flushbatch();
+
+	for (auto& page : atlaspages) {
+		for (auto* ptm : page.residents) {
+			ptm->glpic = 0;
+			ptm->atlaspage = 0;
+			ptm->atlasx = ptm->atlasy = 0;
+		}
+		for (auto& glpic : page.glpic) {
+			if (glpic) {
+				glfunc.glDeleteTextures(1, &glpic);
+			}
+		}
+	}
+
+	atlaspages.clear();
+	atlaspagesiz = 0;
+}
+
+void PTAtlasPrintStats()
+{
+	buildprintf("PolymostTex atlas: {} of {} pages of {}x{}\n",
+			   atlaspages.size(), PTATLAS_MAXPAGES, atlaspagesiz, atlaspagesiz);
+	buildprintf("  {} allocations, {} reuses, {} evictions, {} failures\n",
+			   atlasstats.allocs, atlasstats.reuses, atlasstats.evictions, atlasstats.failures);
+
+	const float pagearea = (float)atlaspagesiz * (float)atlaspagesiz;
+
+	for (int i{0}; i < (int)atlaspages.size(); ++i) {
+		const auto& page = atlaspages[i];
+
+		buildprintf("  page {}: {} textures on {} shelves, {:.1f}% allocated, {:.1f}% live, {:.1f}% unshelved, last drawn frame {}\n",
+				   i, page.residents.size(), page.shelves.size(),
+				   100.F * (float)page.allocarea / pagearea,
+				   100.F * (float)page.livearea / pagearea,
+				   100.F * (float)(atlaspagesiz - page.nexty) / (float)atlaspagesiz,
+				   page.lastused);
+	}
+}
+
+#endif //USE_POLYMOST && USE_OPENGL
@@ -0,0 +1,118 @@
+#if (USE_POLYMOST == 0)
+#error Polymost not enabled.
+#endif
+#if (USE_OPENGL == 0)
+#error OpenGL not enabled.
+#endif
+
+#ifndef POLYMOSTTEXATLAS_H
+#define POLYMOSTTEXATLAS_H
+
+inline constexpr auto PTATLAS_PAGESIZ{1024};	// width and height of an atlas page
+inline constexpr auto PTATLAS_MAXPAGES{4};		// pages allowed before the least recently used is evicted
+inline constexpr auto PTATLAS_MAXTILESIZ{64};	// tiles larger than this keep their own texture
+inline constexpr auto PTATLAS_MIPLEVELS{2};		// mipmap levels guaranteed not to bleed between cells
+inline constexpr auto PTATLAS_PADDING{1 << PTATLAS_MIPLEVELS};	// transparent border around each cell
+
+// layers of an atlas page, matching the PTHPIC_BASE/PTHPIC_GLOW layers of a tile
+enum {
+	PTATLAS_BASE = 0,
+	PTATLAS_GLOW = 1,
+	PTATLAS_LAYERS = 2,
+};
+
+inline int glusetexatlas{1};
+
+/** a cell allocated from an atlas page */
+struct PTAtlasSlot {
+	int page;
+	int x, y;	// top-left corner of the cell, including padding
+	int w, h;	// cell dimensions, including padding
+};
+
+/**
+ * Decides whether an ART texture is small and simple enough to share an atlas page
+ * @param tsizx true texture width
+ * @param tsizy true texture height
+ * @param flags PTH_* flags of the texture header
+ * @return true if the texture may be packed into an atlas
+ */
+bool PTAtlasAccepts(int tsizx, int tsizy, unsigned short flags);
+
+/**
+ * Returns the cell dimension needed to hold a texture dimension with
+ * padding and mipmap alignment
+ * @param tsiz the true texture dimension
+ * @return the cell dimension
+ */
+int PTAtlasCellSize(int tsiz);
+
+/**
+ * Allocates a cell from the atlas, evicting the least recently used page
+ * if every page is full
+ * @param w cell width
+ * @param h cell height
+ * @param slot receives the cell
+ * @return true on success
+ */
+bool PTAtlasAlloc(int w, int h, PTAtlasSlot* slot);
+
+/**
+ * Recovers the cell a texture already occupies if it is the right size
+ * @param ptm the texture header
+ * @param w cell width wanted
+ * @param h cell height wanted
+ * @param slot receives the cell
+ * @return true if the existing cell can be reused
+ */
+bool PTAtlasReuse(const PTMHead* ptm, int w, int h, PTAtlasSlot* slot);
+
+/**
+ * Uploads one mipmap level of a cell's texels
+ * @param slot the cell
+ * @param layer PTATLAS_BASE or PTATLAS_GLOW
+ * @param level the mipmap level, up to PTATLAS_MIPLEVELS
+ * @param pic (slot->w >> level) x (slot->h >> level) RGBA texels
+ */
+void PTAtlasUpload(const PTAtlasSlot* slot, int layer, int level, const coltype* pic);
+
+/**
+ * Makes a texture header refer to a cell of the atlas
+ * @param ptm the texture header
+ * @param slot the cell
+ * @param layer PTATLAS_BASE or PTATLAS_GLOW
+ * @param tsizx true texture width
+ * @param tsizy true texture height
+ */
+void PTAtlasAssign(PTMHead* ptm, const PTAtlasSlot* slot, int layer, int tsizx, int tsizy);
+
+/**
+ * Detaches a texture header from its atlas cell
+ * @param ptm the texture header
+ */
+void PTAtlasRelease(PTMHead* ptm);
+
+/**
+ * Records that a texture header is in use, for page eviction purposes
+ * @param ptm the texture header
+ */
+void PTAtlasTouch(const PTMHead* ptm);
+
+/**
+ * Evicts the least recently used page as a full atlas would, drawing
+ * any queued sprites first
+ * @return false if there are no pages
+ */
+bool PTAtlasEvictOldest();
+
+/**
+ * Deletes all atlas pages
+ */
+void PTAtlasClear();
+
+/**
+ * Prints atlas occupancy statistics
+ */
+void PTAtlasPrintStats();
+
+#endif
@@ -0,0 +1,75 @@
+// The array fixed point methods, and picking which to use from what the
+// CPU has. The SSE4.1 and AVX2 ones are built in files of their own.
+
+#include "pragmasarrays_priv.hpp"
+
+#include <vector>
+
+#if PRAGMAS_X86 && defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+namespace {
+
+constexpr fixarraymethod fixarraysc{fixarraymethodof<scalarlanes>("C")};
+
+#if PRAGMAS_X86
+
+bool havesse41()
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	return (regs[2] & (1 << 19)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+	// which also needs the OS to be saving the YMM registers
+bool haveavx2()
+{
+#if defined(_MSC_VER)
+	int regs[4];
+	__cpuid(regs, 1);
+	if (!(regs[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif	// PRAGMAS_X86
+
+	// Plain C first, then the vector sets this machine has
+const std::vector<fixarraymethod>& methods()
+{
+	static const std::vector<fixarraymethod> list = []() {
+		std::vector<fixarraymethod> l{ fixarraysc };
+#if PRAGMAS_X86
+		if (havesse41()) l.push_back(fixarrayssse41);
+		if (haveavx2()) l.push_back(fixarraysavx2);
+#elif defined(__ARM_NEON)
+		l.push_back(fixarraymethodof<neonlanes>("NEON"));
+#endif
+		return l;
+	}();
+	return list;
+}
+
+} // namespace
+
+const fixarraymethod *fixarrays{&fixarraysc};
+
+std::span<const fixarraymethod> fixarraymethods()
+{
+	return methods();
+}
+
+void initfixarrays()
+{
+	fixarrays = &methods().back();
+}
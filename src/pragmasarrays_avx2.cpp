@@ -0,0 +1,14 @@
+// The array fixed point methods for AVX2, only used once
+// pragmasarrays.cpp has found the CPU has it
+
+#include "pragmasarrays_priv.hpp"
+
+#if PRAGMAS_X86
+
+#if !defined(__AVX2__) && !defined(_MSC_VER)
+#error pragmasarrays_avx2.cpp must be built with -mavx2
+#endif
+
+extern const fixarraymethod fixarraysavx2{fixarraymethodof<avx2lanes>("AVX2")};
+
+#endif
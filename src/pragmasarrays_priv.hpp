@@ -0,0 +1,359 @@
+// The array versions of the fixed point functions in pragmas.hpp, written
+// once over the lanes of each vector set and built once per set, each in
+// a file of its own built for that set.
+//
+// Those files are built with flags the CPU running them may not have, so
+// nothing here may use an inline function from elsewhere: the linker could
+// keep their copy of it for everyone. Everything is in an anonymous
+// namespace, and the scalar parts are done here rather than with pragmas.hpp.
+
+#ifndef __pragmasarrays_priv_h__
+#define __pragmasarrays_priv_h__
+
+#include "pragmas.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PRAGMAS_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+	// The methods built for the x86 sets, for pragmasarrays.cpp to pick from
+	// once it has asked the CPU
+#if PRAGMAS_X86
+extern const fixarraymethod fixarrayssse41;
+extern const fixarraymethod fixarraysavx2;
+#endif
+
+namespace {
+
+	// reciptable without calling std::array's inline members
+constexpr const int *recips{reciptable.data()};
+
+	// No vector set: the kernels below are only their scalar loops
+struct scalarlanes {
+	using half = void;
+	static constexpr int lanes{1};
+	static constexpr bool gathers{false};
+};
+
+//
+// Each set has lanes of 32 bit values, and may name a narrower set as half
+// to finish what's left over before the scalar loop does. Most sectors have
+// under eight walls, so the wall pre-pass in engine.cpp lives on these
+// leftovers, and factors common to every element are only broadcast when
+// there's a full vector to use them on.
+// Each set keeps 64 bit products, so every lane gives exactly what the
+// scalar version does, overflow included. As only bits shift to shift+31
+// of each sum survive, logical shifts do for the arithmetic ones.
+//
+
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && PRAGMAS_X86)
+
+struct sse41lanes {
+	using vec = __m128i;
+	using half = void;
+	static constexpr int lanes{4};
+	static constexpr bool gathers{false};
+
+	static vec load(const int *p) { return _mm_loadu_si128((const __m128i *)p); }
+	static vec set(int v) { return _mm_set1_epi32(v); }
+	static void store(int *p, vec v) { _mm_storeu_si128((__m128i *)p, v); }
+
+		// sums of signed products, as 64 bit sums of lanes 0 and 2 and of lanes 1 and 3
+	struct sum {
+		__m128i even{_mm_setzero_si128()};
+		__m128i odd{_mm_setzero_si128()};
+
+		void add(__m128i a, __m128i b)
+		{
+			even = _mm_add_epi64(even, _mm_mul_epi32(a, b));
+			odd = _mm_add_epi64(odd, _mm_mul_epi32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)));
+		}
+
+		__m128i scale(int shift) const
+		{
+			return _mm_blend_epi16(_mm_srl_epi64(even, _mm_cvtsi32_si128(shift)),
+								   _mm_sll_epi64(odd, _mm_cvtsi32_si128(32 - shift)), 0xCC);
+		}
+	};
+};
+
+#endif
+
+#if defined(__AVX2__) || (defined(_MSC_VER) && PRAGMAS_X86)
+
+struct avx2lanes {
+	using vec = __m256i;
+	using half = sse41lanes;
+	static constexpr int lanes{8};
+	static constexpr bool gathers{true};
+
+	static vec load(const int *p) { return _mm256_loadu_si256((const __m256i *)p); }
+	static vec set(int v) { return _mm256_set1_epi32(v); }
+	static void store(int *p, vec v) { _mm256_storeu_si256((__m256i *)p, v); }
+
+		// sums of signed products, as 64 bit sums of the even lanes and of the odd lanes
+	struct sum {
+		__m256i even{_mm256_setzero_si256()};
+		__m256i odd{_mm256_setzero_si256()};
+
+		void add(__m256i a, __m256i b)
+		{
+			even = _mm256_add_epi64(even, _mm256_mul_epi32(a, b));
+			odd = _mm256_add_epi64(odd, _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)));
+		}
+
+		__m256i scale(int shift) const
+		{
+			return _mm256_blend_epi32(_mm256_srl_epi64(even, _mm_cvtsi32_si128(shift)),
+									  _mm256_sll_epi64(odd, _mm_cvtsi32_si128(32 - shift)), 0xAA);
+		}
+	};
+
+	static vec krecip(vec i)
+	{
+		const __m256i f = _mm256_castps_si256(_mm256_cvtepi32_ps(i));
+		const __m256i index = _mm256_and_si256(_mm256_srli_epi32(f, 12), _mm256_set1_epi32(2047));
+		const __m256i shift = _mm256_and_si256(_mm256_srli_epi32(_mm256_sub_epi32(f, _mm256_set1_epi32(0x3f800000)), 23),
+											   _mm256_set1_epi32(31));
+
+			// the table holds positive values only, so a logical shift will do
+		return _mm256_xor_si256(_mm256_srlv_epi32(_mm256_i32gather_epi32(recips, index, 4), shift),
+								_mm256_srai_epi32(f, 31));
+	}
+};
+
+#endif
+
+#if defined(__ARM_NEON)
+
+struct neonlanes {
+	using vec = int32x4_t;
+	using half = void;
+	static constexpr int lanes{4};
+	static constexpr bool gathers{false};
+
+	static vec load(const int *p) { return vld1q_s32(p); }
+	static vec set(int v) { return vdupq_n_s32(v); }
+	static void store(int *p, vec v) { vst1q_s32(p, v); }
+
+		// sums of signed products, as 64 bit sums of lanes 0 and 1 and of lanes 2 and 3
+	struct sum {
+		int64x2_t low{vdupq_n_s64(0)};
+		int64x2_t high{vdupq_n_s64(0)};
+
+		void add(int32x4_t a, int32x4_t b)
+		{
+			low = vmlal_s32(low, vget_low_s32(a), vget_low_s32(b));
+			high = vmlal_s32(high, vget_high_s32(a), vget_high_s32(b));
+		}
+
+		int32x4_t scale(int shift) const
+		{
+			const int64x2_t by = vdupq_n_s64(-shift);
+
+			return vcombine_s32(vmovn_s64(vshlq_s64(low, by)), vmovn_s64(vshlq_s64(high, by)));
+		}
+	};
+};
+
+#endif
+
+inline int fixscale(std::int64_t sum, int shift)
+{
+	return (int)(sum >> shift);
+}
+
+inline int fixkrecip(int i)
+{
+	float f;
+	int fi;
+
+	f = (float)i;
+	std::memcpy(&fi, &f, sizeof(fi));
+	return (recips[(fi>>12)&2047]>>(((fi-0x3f800000)>>23)&31))^(fi>>31);
+}
+
+template<typename L>
+void mulscalearray(int *out, const int *eax, const int *edx, int count, int shift)
+{
+	int i{0};
+
+	if constexpr (L::lanes > 1) {
+		for (; i + L::lanes <= count; i += L::lanes) {
+			typename L::sum sum;
+			sum.add(L::load(&eax[i]), L::load(&edx[i]));
+			L::store(&out[i], sum.scale(shift));
+		}
+	}
+	if constexpr (!std::is_void_v<typename L::half>) {
+		mulscalearray<typename L::half>(&out[i], &eax[i], &edx[i], count - i, shift);
+	} else {
+		for (; i < count; ++i) {
+			out[i] = fixscale((std::int64_t)eax[i] * edx[i], shift);
+		}
+	}
+}
+
+template<typename L>
+void mulscalebyarray(int *out, const int *eax, int edx, int count, int shift)
+{
+	int i{0};
+
+	if constexpr (L::lanes > 1) {
+		if (count >= L::lanes) {
+			const auto vedx = L::set(edx);
+
+			for (; i + L::lanes <= count; i += L::lanes) {
+				typename L::sum sum;
+				sum.add(L::load(&eax[i]), vedx);
+				L::store(&out[i], sum.scale(shift));
+			}
+		}
+	}
+	if constexpr (!std::is_void_v<typename L::half>) {
+		mulscalebyarray<typename L::half>(&out[i], &eax[i], edx, count - i, shift);
+	} else {
+		for (; i < count; ++i) {
+			out[i] = fixscale((std::int64_t)eax[i] * edx, shift);
+		}
+	}
+}
+
+template<typename L>
+void dmulscalearray(int *out, const int *eax, const int *edx, const int *esi, const int *edi, int count, int shift)
+{
+	int i{0};
+
+	if constexpr (L::lanes > 1) {
+		for (; i + L::lanes <= count; i += L::lanes) {
+			typename L::sum sum;
+			sum.add(L::load(&eax[i]), L::load(&edx[i]));
+			sum.add(L::load(&esi[i]), L::load(&edi[i]));
+			L::store(&out[i], sum.scale(shift));
+		}
+	}
+	if constexpr (!std::is_void_v<typename L::half>) {
+		dmulscalearray<typename L::half>(&out[i], &eax[i], &edx[i], &esi[i], &edi[i], count - i, shift);
+	} else {
+		for (; i < count; ++i) {
+			out[i] = fixscale((std::int64_t)eax[i] * edx[i] + (std::int64_t)esi[i] * edi[i], shift);
+		}
+	}
+}
+
+template<typename L>
+void dmulscalebyarray(int *out, const int *eax, int edx, const int *esi, int edi, int count, int shift)
+{
+	int i{0};
+
+	if constexpr (L::lanes > 1) {
+		if (count >= L::lanes) {
+			const auto vedx = L::set(edx);
+			const auto vedi = L::set(edi);
+
+			for (; i + L::lanes <= count; i += L::lanes) {
+				typename L::sum sum;
+				sum.add(L::load(&eax[i]), vedx);
+				sum.add(L::load(&esi[i]), vedi);
+				L::store(&out[i], sum.scale(shift));
+			}
+		}
+	}
+	if constexpr (!std::is_void_v<typename L::half>) {
+		dmulscalebyarray<typename L::half>(&out[i], &eax[i], edx, &esi[i], edi, count - i, shift);
+	} else {
+		for (; i < count; ++i) {
+			out[i] = fixscale((std::int64_t)eax[i] * edx + (std::int64_t)esi[i] * edi, shift);
+		}
+	}
+}
+
+template<typename L>
+void tmulscalearray(int *out, const int *eax, const int *edx, const int *ebx, const int *ecx,
+					const int *esi, const int *edi, int count, int shift)
+{
+	int i{0};
+
+	if constexpr (L::lanes > 1) {
+		for (; i + L::lanes <= count; i += L::lanes) {
+			typename L::sum sum;
+			sum.add(L::load(&eax[i]), L::load(&edx[i]));
+			sum.add(L::load(&ebx[i]), L::load(&ecx[i]));
+			sum.add(L::load(&esi[i]), L::load(&edi[i]));
+			L::store(&out[i], sum.scale(shift));
+		}
+	}
+	if constexpr (!std::is_void_v<typename L::half>) {
+		tmulscalearray<typename L::half>(&out[i], &eax[i], &edx[i], &ebx[i], &ecx[i], &esi[i], &edi[i], count - i, shift);
+	} else {
+		for (; i < count; ++i) {
+			out[i] = fixscale((std::int64_t)eax[i] * edx[i] + (std::int64_t)ebx[i] * ecx[i] +
+							  (std::int64_t)esi[i] * edi[i], shift);
+		}
+	}
+}
+
+template<typename L>
+void tmulscalebyarray(int *out, const int *eax, int edx, const int *ebx, int ecx,
+					  const int *esi, int edi, int count, int shift)
+{
+	int i{0};
+
+	if constexpr (L::lanes > 1) {
+		if (count >= L::lanes) {
+			const auto vedx = L::set(edx);
+			const auto vecx = L::set(ecx);
+			const auto vedi = L::set(edi);
+
+			for (; i + L::lanes <= count; i += L::lanes) {
+				typename L::sum sum;
+				sum.add(L::load(&eax[i]), vedx);
+				sum.add(L::load(&ebx[i]), vecx);
+				sum.add(L::load(&esi[i]), vedi);
+				L::store(&out[i], sum.scale(shift));
+			}
+		}
+	}
+	if constexpr (!std::is_void_v<typename L::half>) {
+		tmulscalebyarray<typename L::half>(&out[i], &eax[i], edx, &ebx[i], ecx, &esi[i], edi, count - i, shift);
+	} else {
+		for (; i < count; ++i) {
+			out[i] = fixscale((std::int64_t)eax[i] * edx + (std::int64_t)ebx[i] * ecx +
+							  (std::int64_t)esi[i] * edi, shift);
+		}
+	}
+}
+
+	// vectorised only where there are gathers and per lane shifts
+template<typename L>
+void kreciparray(int *out, const int *num, int count)
+{
+	int i{0};
+
+	if constexpr (L::gathers) {
+		for (; i + L::lanes <= count; i += L::lanes) {
+			L::store(&out[i], L::krecip(L::load(&num[i])));
+		}
+	}
+	for (; i < count; ++i) {
+		out[i] = fixkrecip(num[i]);
+	}
+}
+
+template<typename L>
+constexpr fixarraymethod fixarraymethodof(const char *name)
+{
+	return { name, mulscalearray<L>, mulscalebyarray<L>, dmulscalearray<L>, dmulscalebyarray<L>,
+			 tmulscalearray<L>, tmulscalebyarray<L>, kreciparray<L> };
+}
+
+} // namespace
+
+#endif
@@ -0,0 +1,14 @@
+// The array fixed point methods for SSE4.1, only used once
+// pragmasarrays.cpp has found the CPU has it
+
+#include "pragmasarrays_priv.hpp"
+
+#if PRAGMAS_X86
+
+#if !defined(__SSE4_1__) && !defined(_MSC_VER)
+#error pragmasarrays_sse41.cpp must be built with -msse4.1
+#endif
+
+extern const fixarraymethod fixarrayssse41{fixarraymethodof<sse41lanes>("SSE4.1")};
+
+#endif
@@ -0,0 +1,162 @@
+// Checks and times each method of the array versions of the fixed point
+// functions in pragmas.hpp against the scalar ones. Kept apart from pragmas.cpp, which
+// the tools link on its own.
+
+#include "build.hpp"
+#include "baselayer.hpp"
+#include "pragmas.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr std::array<int, 12> edgevalues{ 0, 1, -1, 2, -2, 65536, -65536, 16384, -16384,
+										  INT_MAX, INT_MIN, INT_MIN + 1 };
+
+struct BenchArrays {
+	std::vector<int> a, b, c, d, e, f;
+	std::vector<int> scalar, vector;
+};
+
+struct BenchResult {
+	int mismatches{0};
+	unsigned int scalart{0};
+	unsigned int vectort{0};
+};
+
+/**
+ * Fills an array with random values, every eighth one taken from edgevalues
+ * @param shift how far to shift the values right, keeping sums of products
+ *              inside 64 bits so the scalar versions are well defined
+ */
+void fillvalues(std::vector<int>& v, std::mt19937& rng, int shift)
+{
+	for (auto& x : v) {
+		x = (rng() & 7) ? (int)rng() : edgevalues[rng() % edgevalues.size()];
+		x >>= shift;
+	}
+}
+
+/**
+ * Times a scalar loop and its array version and counts where they differ
+ */
+template<typename S, typename V>
+void runop(BenchArrays& arrays, BenchResult& result, S&& scalar, V&& vector)
+{
+	const int count = (int)arrays.scalar.size();
+
+	unsigned int t = getusecticks();
+	for (int i{0}; i < count; ++i) {
+		arrays.scalar[i] = scalar(i);
+	}
+	result.scalart += getusecticks() - t;
+
+	t = getusecticks();
+	vector(arrays.vector.data(), count);
+	result.vectort += getusecticks() - t;
+
+	for (int i{0}; i < count; ++i) {
+		result.mismatches += (arrays.scalar[i] != arrays.vector[i]);
+	}
+}
+
+template<std::uint8_t N>
+void benchshift(BenchArrays& w, std::mt19937& rng, std::array<BenchResult, 8>& results)
+{
+	const int *a = w.a.data(), *b = w.b.data(), *c = w.c.data();
+	const int *d = w.d.data(), *e = w.e.data(), *f = w.f.data();
+	const int k1 = (int)rng(), k2 = (int)rng() >> 1, k3 = (int)rng() >> 1;
+
+	// mulscale can't overflow, dmulscale only when both products are INT_MIN squared
+	fillvalues(w.a, rng, 0);
+	fillvalues(w.b, rng, 0);
+	fillvalues(w.c, rng, 1);
+	fillvalues(w.d, rng, 0);
+	runop(w, results[0], [&](int i) { return mulscalen<N>(a[i], b[i]); },
+		  [&](int *out, int n) { mulscalen<N>(out, a, b, n); });
+	runop(w, results[1], [&](int i) { return mulscalen<N>(a[i], k1); },
+		  [&](int *out, int n) { mulscalen<N>(out, a, k1, n); });
+	runop(w, results[2], [&](int i) { return dmulscalen<N>(a[i], b[i], c[i], d[i]); },
+		  [&](int *out, int n) { dmulscalen<N>(out, a, b, c, d, n); });
+	runop(w, results[3], [&](int i) { return dmulscalen<N>(a[i], k1, c[i], k2); },
+		  [&](int *out, int n) { dmulscalen<N>(out, a, k1, c, k2, n); });
+
+	fillvalues(w.a, rng, 1);
+	fillvalues(w.b, rng, 1);
+	fillvalues(w.c, rng, 1);
+	fillvalues(w.d, rng, 1);
+	fillvalues(w.e, rng, 1);
+	fillvalues(w.f, rng, 1);
+	runop(w, results[4], [&](int i) { return tmulscalen<N>(a[i], b[i], c[i], d[i], e[i], f[i]); },
+		  [&](int *out, int n) { tmulscalen<N>(out, a, b, c, d, e, f, n); });
+	runop(w, results[5], [&](int i) { return tmulscalen<N>(a[i], k2, c[i], k3, e[i], k2 >> 1); },
+		  [&](int *out, int n) { tmulscalen<N>(out, a, k2, c, k3, e, k2 >> 1, n); });
+
+	// leave out the divisors that fault
+	for (auto& x : w.b) {
+		if (x == 0 || x == -1) {
+			x = 3;
+		}
+	}
+	runop(w, results[6], [&](int i) { return divscalen<N>(a[i], b[i]); },
+		  [&](int *out, int n) { divscalen<N>(out, a, b, n); });
+}
+
+} // namespace
+
+void pragmasbench(int count)
+{
+	static constexpr std::array<std::string_view, 8> names{ "mulscale", "mulscale by one factor",
+		"dmulscale", "dmulscale by common factors", "tmulscale", "tmulscale by common factors",
+		"divscale", "krecip" };
+
+	BenchArrays w;
+	for (auto *v : { &w.a, &w.b, &w.c, &w.d, &w.e, &w.f, &w.scalar, &w.vector }) {
+		v->resize(count);
+	}
+
+	const fixarraymethod *inuse = fixarrays;
+
+	buildprintf("Fixed point arrays: using {}\n", inuse->name);
+
+		// each method the CPU has, on the same values
+	for (const auto& m : fixarraymethods()) {
+		std::mt19937 rng(count);
+		std::array<BenchResult, 8> results{};
+
+		fixarrays = &m;
+
+		benchshift<0>(w, rng, results);
+		benchshift<1>(w, rng, results);
+		benchshift<6>(w, rng, results);
+		benchshift<8>(w, rng, results);
+		benchshift<16>(w, rng, results);
+		benchshift<24>(w, rng, results);
+		benchshift<30>(w, rng, results);
+		benchshift<32>(w, rng, results);
+
+		fillvalues(w.a, rng, 0);
+		runop(w, results[7], [&](int i) { return kreciplane(w.a[i]); },
+			  [&](int *out, int n) { krecip(out, w.a.data(), n); });
+
+		buildprintf(" {}:\n", m.name);
+		for (std::size_t i{0}; i < names.size(); ++i) {
+			const int elements = (i == 7) ? count : count * 8;
+
+			if (i == 6 && &m != &fixarraymethods().front()) {
+				continue;	// divscale is the same scalar loop for every method
+			}
+			buildprintf("  {:<28} {} mismatches, scalar {:.2f} ns, array {:.2f} ns per element ({:.1f}x)\n",
+					   names[i], results[i].mismatches,
+					   1000.0 * results[i].scalart / std::max(1, elements),
+					   1000.0 * results[i].vectort / std::max(1, elements),
+					   (double)results[i].scalart / std::max(1U, results[i].vectort));
+		}
+	}
+
+	fixarrays = inuse;
+}
@@ -0,0 +1,539 @@
+#include "build.hpp"
+#include "baselayer.hpp"
+#include "cache1d.hpp"
+#include "compat.hpp"
+#include "crc32.hpp"
+#include "engine_priv.hpp"
+#include "pvs_priv.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <numbers>
+#include <random>
+#include <vector>
+
+/*
+ Potentially visible sets
+
+ For each sector, the set of sectors that might be seen from anywhere inside
+ it, worked out by flowing lines of sight through the map's portals (walls
+ with a nextsector). Each portal admits the lines that cross it from front
+ to back, which for lines sorted into PVSBINS ranges of direction is one
+ range of offsets per direction. A sector is reached when some line gets
+ through every portal on the way there. Every line reaching a sector by any
+ path is folded into one range per direction, and a sector's neighbours are
+ revisited whenever its ranges grow. That finds every sector a line can
+ reach, and some more.
+
+ Walls with cstat 32 count as portals, since games may clear the bit later,
+ and the order a line meets the portals in is ignored. That keeps the sets
+ true for cansee(), which follows every wall its segment crosses. It also
+ keeps them true for scansector(), which only ever looks through portals in
+ the order they come.
+
+ The sets only help where something would otherwise look at a sector
+ without knowing it can be seen: cansee() between sectors that can't see
+ each other, and scansector() adding neighbours because the viewer is
+ nearly in line with one of their walls. The renderer's other sectors are
+ found through portals that are actually on screen, and the sets never cull
+ those.
+
+ Sets are made by buildpvs() or read from a file written by savepvs(). The
+ file is checked against a checksum of the map's walls and sectors.
+ updatesectorindex() passes moved sectors on here, and every sector that
+ could see one stops being culled from until the sets are rebuilt or
+ loaded again.
+ */
+
+namespace {
+
+constexpr int PVSBINS{128};			// ranges of line direction
+constexpr int PVSVERSION{1};
+constexpr char PVSMAGIC[8]{ 'B', 'U', 'I', 'L', 'D', 'P', 'V', 'S' };
+constexpr int PVSMAXVISITS{4096};	// per sector of the map, before a source gives up and sees everything it reaches
+
+struct OffsetRange {
+	float lo;
+	float hi;		// empty if lo > hi
+};
+
+struct {
+	int numsectors{0};			// numsectors when made
+	int rowwords{0};			// words per sector's set
+	unsigned int mapcrc{0};
+	std::vector<uint64_t> sets;
+	std::vector<uint64_t> moved;		// sectors whose walls moved since
+	std::vector<unsigned char> stale;	// sectors whose set no longer holds
+	bool present{false};
+} pvs;
+
+std::atomic<bool> pvsactive{false};		// sets are present and match the map
+std::atomic<bool> pvschecked{true};		// pvsactive is up to date
+std::mutex pvscheck;
+
+unsigned int mapchecksum()
+{
+	unsigned int crc;
+	crc32init(&crc);
+
+	const int counts[2]{ numsectors, numwalls };
+	crc32block(&crc, (unsigned char *)counts, sizeof(counts));
+
+	for (int i{0}; i < numsectors; ++i) {
+		const short shape[2]{ g_sector[i].wallptr, g_sector[i].wallnum };
+		crc32block(&crc, (unsigned char *)shape, sizeof(shape));
+	}
+	for (int i{0}; i < numwalls; ++i) {
+		const int shape[5]{ wall[i].pt.x, wall[i].pt.y, wall[i].point2, wall[i].nextwall, wall[i].nextsector };
+		crc32block(&crc, (unsigned char *)shape, sizeof(shape));
+	}
+
+	return crc32finish(&crc);
+}
+
+bool setbit(std::vector<uint64_t>& bits, int row, int sectnum)
+{
+	auto& word = bits[(std::size_t)row * pvs.rowwords + (sectnum >> 6)];
+	const uint64_t bit = uint64_t{1} << (sectnum & 63);
+	const bool was = (word & bit) != 0;
+
+	word |= bit;
+	return was;
+}
+
+bool testbit(const std::vector<uint64_t>& bits, int row, int sectnum)
+{
+	return (bits[(std::size_t)row * pvs.rowwords + (sectnum >> 6)] >> (sectnum & 63)) & 1;
+}
+
+void resetpvs(int sectors)
+{
+	pvs.numsectors = sectors;
+	pvs.rowwords = (sectors + 63) >> 6;
+	pvs.sets.assign((std::size_t)sectors * pvs.rowwords, 0);
+	pvs.moved.assign(pvs.rowwords, 0);
+	pvs.stale.assign(sectors, 0);
+}
+
+/**
+ * The offsets a point takes along the normal of lines heading anywhere
+ * between two directions
+ */
+void pointoffsets(double x, double y, double a1, double a2, double& lo, double& hi)
+{
+	// the offset is y*cos(a) - x*sin(a) = r*cos(a + b)
+	const double r = std::hypot(x, y);
+	const double b = std::atan2(x, y);
+	const double o1 = y * std::cos(a1) - x * std::sin(a1);
+	const double o2 = y * std::cos(a2) - x * std::sin(a2);
+	const auto within = [a1, a2](double a) {
+		a = std::remainder(a - a1, 2.0 * std::numbers::pi);
+		if (a < 0.0) {
+			a += 2.0 * std::numbers::pi;
+		}
+		return a <= a2 - a1;
+	};
+
+	lo = std::min(lo, std::min(o1, o2));
+	hi = std::max(hi, std::max(o1, o2));
+	if (within(-b)) {
+		hi = std::max(hi, r);
+	}
+	if (within(std::numbers::pi - b)) {
+		lo = std::min(lo, -r);
+	}
+}
+
+/**
+ * Works out each portal's offset range per direction bin, relative to a
+ * point near the middle of the map
+ * @return PVSBINS ranges per wall, empty for walls that aren't portals
+ */
+std::vector<OffsetRange> portalranges()
+{
+	int minx{INT_MAX}, miny{INT_MAX}, maxx{INT_MIN}, maxy{INT_MIN};
+
+	for (int i{0}; i < numwalls; ++i) {
+		minx = std::min(minx, wall[i].pt.x);
+		miny = std::min(miny, wall[i].pt.y);
+		maxx = std::max(maxx, wall[i].pt.x);
+		maxy = std::max(maxy, wall[i].pt.y);
+	}
+
+	const double ox = ((double)minx + maxx) / 2.0;
+	const double oy = ((double)miny + maxy) / 2.0;
+	const double binwidth = 2.0 * std::numbers::pi / PVSBINS;
+	std::vector<OffsetRange> ranges((std::size_t)numwalls * PVSBINS, { 1.F, -1.F });
+
+	for (int i{0}; i < numwalls; ++i) {
+		if (wall[i].nextsector < 0 || wall[i].nextsector >= numsectors ||
+			wall[i].point2 < 0 || wall[i].point2 >= numwalls) {
+			continue;
+		}
+
+		const double x1 = wall[i].pt.x - ox, y1 = wall[i].pt.y - oy;
+		const double x2 = wall[wall[i].point2].pt.x - ox, y2 = wall[wall[i].point2].pt.y - oy;
+		const double ex = x2 - x1, ey = y2 - y1;
+		const double len = std::hypot(ex, ey);
+
+		for (int b{0}; b < PVSBINS; ++b) {
+			const double a1 = b * binwidth;
+			const double a2 = a1 + binwidth;
+			const double am = a1 + binwidth / 2.0;
+
+			// lines crossing front to back have cos(a)*ey - sin(a)*ex > 0, which
+			// can change by at most len*binwidth/2 across the bin
+			if (std::cos(am) * ey - std::sin(am) * ex <= -len * binwidth) {
+				continue;
+			}
+
+			double lo{std::numeric_limits<double>::max()};
+			double hi{std::numeric_limits<double>::lowest()};
+
+			pointoffsets(x1, y1, a1, a2, lo, hi);
+			pointoffsets(x2, y2, a1, a2, lo, hi);
+
+			// leave room for rounding here and in the integer tests using the sets
+			const double slack = 2.0 + (std::abs(lo) + std::abs(hi)) * 1e-6;
+			ranges[(std::size_t)i * PVSBINS + b] = { (float)(lo - slack), (float)(hi + slack) };
+		}
+	}
+
+	return ranges;
+}
+
+} // namespace
+
+bool pvsready()
+{
+	if (!pvschecked.load(std::memory_order_acquire)) {
+		std::lock_guard lock(pvscheck);
+		if (!pvschecked.load(std::memory_order_relaxed)) {
+			pvsactive = pvs.present && pvs.numsectors == numsectors && pvs.mapcrc == mapchecksum();
+			pvschecked.store(true, std::memory_order_release);
+		}
+	}
+
+	return usepvs && pvsactive.load(std::memory_order_relaxed);
+}
+
+void pvsmoved(short sectnum)
+{
+	if (sectnum < 0) {
+		pvschecked = false;
+		return;
+	}
+	if (!pvsactive || sectnum >= pvs.numsectors || setbit(pvs.moved, 0, sectnum)) {
+		return;
+	}
+
+	for (int s{0}; s < pvs.numsectors; ++s) {
+		if (testbit(pvs.sets, s, sectnum)) {
+			pvs.stale[s] = 1;
+		}
+	}
+}
+
+bool pvsvisible(short fromsect, short tosect)
+{
+	if (!pvsready()) {
+		return true;
+	}
+	if (fromsect < 0 || fromsect >= pvs.numsectors || tosect < 0 || tosect >= pvs.numsectors) {
+		return true;
+	}
+	if (pvs.stale[fromsect]) {
+		return true;
+	}
+
+	return testbit(pvs.sets, fromsect, tosect);
+}
+
+void buildpvs()
+{
+	const unsigned int t = getusecticks();
+	const auto ranges = portalranges();
+
+	resetpvs(numsectors);
+
+	std::vector<OffsetRange> reach((std::size_t)numsectors * PVSBINS);
+	std::vector<unsigned char> queued(numsectors, 0);
+	std::vector<short> queue;
+	std::vector<short> touched;
+	int fallbacks{0};
+
+	for (int s{0}; s < numsectors; ++s) {
+		std::fill_n(&reach[(std::size_t)s * PVSBINS], PVSBINS,
+			OffsetRange{ std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max() });
+		queue.assign(1, (short)s);
+		touched.assign(1, (short)s);
+		queued[s] = 1;
+		setbit(pvs.sets, s, s);
+
+		int visits{0};
+		std::size_t head{0};
+
+		while (head < queue.size()) {
+			const short sect = queue[head++];
+			queued[sect] = 0;
+
+			if (++visits > PVSMAXVISITS) {
+				break;
+			}
+
+			const auto& sec = g_sector[sect];
+			const OffsetRange *from = &reach[(std::size_t)sect * PVSBINS];
+
+			for (int w = sec.wallptr; w < sec.wallptr + sec.wallnum; ++w) {
+				const short next = wall[w].nextsector;
+
+				if (next < 0 || next >= numsectors) {
+					continue;
+				}
+
+				const OffsetRange *portal = &ranges[(std::size_t)w * PVSBINS];
+				OffsetRange *to = &reach[(std::size_t)next * PVSBINS];
+				const bool first = !setbit(pvs.sets, s, next);
+				bool grew{false};
+
+				if (first) {
+					std::fill_n(to, PVSBINS, OffsetRange{ 1.F, -1.F });
+					touched.push_back(next);
+				}
+
+				for (int b{0}; b < PVSBINS; ++b) {
+					const float lo = std::max(from[b].lo, portal[b].lo);
+					const float hi = std::min(from[b].hi, portal[b].hi);
+
+					if (lo > hi) {
+						continue;
+					}
+					if (to[b].lo > to[b].hi) {
+						to[b] = { lo, hi };
+						grew = true;
+					} else if (lo < to[b].lo || hi > to[b].hi) {
+						to[b] = { std::min(lo, to[b].lo), std::max(hi, to[b].hi) };
+						grew = true;
+					}
+				}
+
+				if (first && !grew) {
+					// nothing gets through after all
+					pvs.sets[(std::size_t)s * pvs.rowwords + (next >> 6)] &= ~(uint64_t{1} << (next & 63));
+				} else if (grew && !queued[next]) {
+					queued[next] = 1;
+					queue.push_back(next);
+				}
+			}
+		}
+
+		if (visits > PVSMAXVISITS) {
+			// too many ways around, so see whatever the portals lead to
+			fallbacks++;
+			queue.assign(1, (short)s);
+			for (std::size_t i{0}; i < queue.size(); ++i) {
+				const auto& sec = g_sector[queue[i]];
+				for (int w = sec.wallptr; w < sec.wallptr + sec.wallnum; ++w) {
+					const short next = wall[w].nextsector;
+					if (next >= 0 && next < numsectors && !setbit(pvs.sets, s, next)) {
+						queue.push_back(next);
+					}
+				}
+			}
+		}
+
+		for (short sect : touched) {
+			queued[sect] = 0;
+		}
+	}
+
+	pvs.mapcrc = mapchecksum();
+	pvs.present = true;
+	pvsactive = true;
+	pvschecked = true;
+
+	int64_t total{0};
+	for (auto word : pvs.sets) {
+		total += std::popcount(word);
+	}
+
+	buildprintf("PVS: {} sectors see {:.1f} each on average, {} gave up, made in {:.1f} ms\n",
+			   numsectors, (double)total / std::max(1, (int)numsectors), fallbacks,
+			   (getusecticks() - t) / 1000.0);
+}
+
+int loadpvs(const std::string& filename)
+{
+	const int fil = kopen4load(filename.c_str(), 0);
+
+	if (fil == -1) {
+		return -1;
+	}
+
+	char magic[8];
+	int header[3];		// version, numsectors, map checksum
+
+	if (kread(fil, magic, sizeof(magic)) != sizeof(magic) || std::memcmp(magic, PVSMAGIC, sizeof(magic)) ||
+		kread(fil, header, sizeof(header)) != sizeof(header) || header[0] != PVSVERSION ||
+		header[1] != numsectors || (unsigned int)header[2] != mapchecksum()) {
+		kclose(fil);
+		return -1;
+	}
+
+	std::lock_guard lock(pvscheck);
+	resetpvs(numsectors);
+
+	const int bytes = (int)(pvs.sets.size() * sizeof(uint64_t));
+	const bool ok = kread(fil, pvs.sets.data(), bytes) == bytes;
+
+	kclose(fil);
+
+	pvs.mapcrc = (unsigned int)header[2];
+	pvs.present = ok;
+	pvsactive = ok;
+	pvschecked = true;
+
+	return ok ? 0 : -1;
+}
+
+int savepvs(const std::string& filename)
+{
+	if (!pvsready()) {
+		return -1;
+	}
+
+	const int fil = Bopen(filename.c_str(), BO_BINARY|BO_TRUNC|BO_CREAT|BO_WRONLY, BS_IREAD|BS_IWRITE);
+
+	if (fil == -1) {
+		return -1;
+	}
+
+	const int header[3]{ PVSVERSION, pvs.numsectors, (int)pvs.mapcrc };
+	const int bytes = (int)(pvs.sets.size() * sizeof(uint64_t));
+	const bool ok = Bwrite(fil, PVSMAGIC, sizeof(PVSMAGIC)) == sizeof(PVSMAGIC) &&
+		Bwrite(fil, header, sizeof(header)) == sizeof(header) &&
+		Bwrite(fil, pvs.sets.data(), bytes) == bytes;
+
+	Bclose(fil);
+
+	return ok ? 0 : -1;
+}
+
+void pvsbench(int views)
+{
+	if (numsectors <= 0) {
+		buildprintf("pvsbench: no map loaded\n");
+		return;
+	}
+	if (!pvsready()) {
+		buildpvs();
+	}
+
+	struct View {
+		int x, y, z;
+		short ang, sectnum;
+	};
+
+	std::mt19937 rng(numsectors + views);
+	std::vector<View> points;
+
+		// random points of random sectors, looking in random directions
+	for (int tries{0}; (int)points.size() < views * 2 && tries < views * 128; ++tries) {
+		const short sectnum = (short)(rng() % numsectors);
+		const auto& sec = g_sector[sectnum];
+		int x1{INT_MAX}, y1{INT_MAX}, x2{INT_MIN}, y2{INT_MIN};
+
+		for (int w = sec.wallptr; w < sec.wallptr + sec.wallnum; ++w) {
+			x1 = std::min(x1, wall[w].pt.x);
+			y1 = std::min(y1, wall[w].pt.y);
+			x2 = std::max(x2, wall[w].pt.x);
+			y2 = std::max(y2, wall[w].pt.y);
+		}
+		if (x1 >= x2 || y1 >= y2) {
+			continue;
+		}
+
+		const int x = std::uniform_int_distribution<int>(x1, x2)(rng);
+		const int y = std::uniform_int_distribution<int>(y1, y2)(rng);
+
+		if (inside(x, y, sectnum) != 1) {
+			continue;
+		}
+
+		const auto cfz = getzsofslope(sectnum, x, y);
+
+		if (cfz.floorz - cfz.ceilz < 2048) {
+			continue;
+		}
+
+		points.push_back({ x, y, (cfz.ceilz + cfz.floorz) / 2, (short)(rng() & 2047), sectnum });
+	}
+
+	if (points.size() < 2) {
+		buildprintf("pvsbench: found nowhere to look from\n");
+		return;
+	}
+
+	const int oldusepvs = usepvs;
+	const int numviews = (int)points.size() / 2;
+
+	if (qsetmode == 200) {
+		int64_t scanned[2]{0, 0};
+		unsigned int times[2]{0, 0};
+
+		for (int pass{0}; pass < 2; ++pass) {
+			usepvs = pass;
+
+			const unsigned int t = getusecticks();
+			for (int v{0}; v < numviews; ++v) {
+				const auto& view = points[v];
+
+				drawrooms(view.x, view.y, view.z, view.ang, 100, view.sectnum);
+				for (int i{0}; i < (numsectors + 7) >> 3; ++i) {
+					scanned[pass] += std::popcount((unsigned int)gotsector[i]);
+				}
+			}
+			times[pass] = getusecticks() - t;
+		}
+
+		buildprintf("pvsbench: {} views scan {:.2f} sectors each without the sets, {:.2f} with, {:.1f} vs {:.1f} us per view\n",
+				   numviews, (double)scanned[0] / numviews, (double)scanned[1] / numviews,
+				   (double)times[0] / numviews, (double)times[1] / numviews);
+	}
+
+	int seen[2]{0, 0};
+	int mismatches{0};
+	unsigned int times[2]{0, 0};
+	std::vector<unsigned char> results(numviews);
+
+	for (int pass{0}; pass < 2; ++pass) {
+		usepvs = pass;
+
+		const unsigned int t = getusecticks();
+		for (int v{0}; v < numviews; ++v) {
+			const auto& a = points[v];
+			const auto& b = points[v + numviews];
+			const bool can = cansee(a.x, a.y, a.z, a.sectnum, b.x, b.y, b.z, b.sectnum);
+
+			seen[pass] += can;
+			if (pass == 0) {
+				results[v] = can;
+			} else {
+				mismatches += (results[v] != can);
+			}
+		}
+		times[pass] = getusecticks() - t;
+	}
+
+	usepvs = oldusepvs;
+
+	buildprintf("pvsbench: {} cansee pairs, {} see each other, {} mismatches, {:.3f} vs {:.3f} us per call\n",
+			   numviews, seen[0], mismatches, (double)times[0] / numviews, (double)times[1] / numviews);
+}
@@ -0,0 +1,25 @@
+#ifndef PVS_PRIV_H
+#define PVS_PRIV_H
+
+/**
+ * Tells whether there are sets to cull with, so drawrooms() can skip
+ * working out whether the view allows it
+ */
+bool pvsready();
+
+/**
+ * Notes that a sector's walls have moved, so the sets of any sector that
+ * could see it no longer hold
+ * @param sectnum the sector, or -1 when the whole map may have changed
+ */
+void pvsmoved(short sectnum);
+
+/**
+ * Renders views from random places in the map with and without the sets,
+ * counting the sectors scanned, and times cansee() between random points
+ * both ways
+ * @param views number of views and of cansee() pairs
+ */
+void pvsbench(int views);
+
+#endif
@@ -34,6 +34,7 @@
 #include "a.hpp"
 #include "osd.hpp"
 #include "glbuild_priv.hpp"
+#include "string_utils.hpp"
 
 #include <algorithm>
 #include <cmath>
@@ -255,14 +256,20 @@ int main(int argc, char *argv[])
 
 	buildkeytranslationtable();
 
+	for (r = 1; r < argc; r++) {
+		if (IsSameAsNoCase(argv[r], "-headless")) headless = true;
+	}
+
 	// SDL must be initialised before GTK or else crashing will ensue.
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER)) {
+	// Headless needs no display, and the events still bring SIGINT and
+	// SIGTERM as quit events.
+	if (SDL_Init(headless ? (SDL_INIT_TIMER | SDL_INIT_EVENTS) : (SDL_INIT_VIDEO | SDL_INIT_TIMER))) {
 		buildprintf("Early initialisation of SDL failed! (%s)\n", SDL_GetError());
 		return 1;
 	}
 
 #ifdef HAVE_GTK
-	wmgtk_init(&argc, &argv);
+	if (!headless) wmgtk_init(&argc, &argv);
 #endif
 
 #ifdef __APPLE__
@@ -281,7 +288,7 @@ int main(int argc, char *argv[])
 	_buildargv = (const char **)argv;
 #endif
 
-	startwin_open();
+	if (!headless) startwin_open();
 	baselayer_init();
 
 	// This avoids doubled character input in the (OSX) startup window's edit fields.
@@ -323,7 +330,7 @@ int initsystem()
 	atexit(uninitsystem);
 
 #if USE_OPENGL
-	if (getenv("BUILD_NOGL")) {
+	if (headless || getenv("BUILD_NOGL")) {
 		buildputs("OpenGL disabled.\n");
 		glunavailable = true;
 	} else {
@@ -0,0 +1,293 @@
+#include "build.hpp"
+#include "baselayer.hpp"
+#include "pvs_priv.hpp"
+#include "sectindex_priv.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <vector>
+
+/*
+ Sector index
+
+ updatesector() and updatesectorz() fall back to testing every sector once
+ a point has left both its old sector and that sector's neighbours, which
+ happens on teleports, respawns, editor clicks and fast movers. The index is
+ a uniform grid over the map's sector bounding boxes, each cell listing the
+ sectors whose box touches it, highest numbered first, so the fallback only
+ runs inside() on those. Cells are a power of two map units wide and the
+ lists are stored back to back, with cellstart[] giving each cell's offset.
+
+ Sectors changed since the grid was built (dragpoint(), the editor, moving
+ sector effects) go on a short dirty list that every lookup considers as
+ well. The grid is rebuilt lazily, on the next lookup after that list grows
+ too long, after updatesectorindex(-1), or when the sector or wall counts
+ have changed.
+
+ Lookups may come from several threads at once, so the rebuild is done
+ under a lock, but updatesectorindex() belongs to whichever thread moves
+ the map's walls.
+ */
+
+namespace {
+
+constexpr int MAXGRIDCELLS{128};	// cells along each side, at most
+constexpr int MAXDIRTY{64};			// changed sectors tolerated before rebuilding
+
+struct SectorBox {
+	int x1, y1;
+	int x2, y2;		// inclusive
+};
+
+struct {
+	int numsectors{0};		// numsectors and numwalls when built
+	int numwalls{0};
+	int x0{0}, y0{0};		// map position of the first cell
+	int shift{0};			// log2 of the cell size
+	int xcells{0}, ycells{0};
+	std::vector<int> cellstart;		// xcells*ycells+1 offsets into cellsects
+	std::vector<short> cellsects;
+	std::vector<short> dirty;		// highest numbered first
+	int builds{0};
+} grid;
+
+std::atomic<bool> gridready{false};	// grid matches the map, as far as updatesectorindex() was told
+std::mutex gridbuild;
+thread_local std::vector<short> merged;
+
+SectorBox sectorbox(short sectnum)
+{
+	const auto& sec = g_sector[sectnum];
+	SectorBox box{INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+	for (int w = sec.wallptr; w < sec.wallptr + sec.wallnum; ++w) {
+		box.x1 = std::min(box.x1, wall[w].pt.x);
+		box.y1 = std::min(box.y1, wall[w].pt.y);
+		box.x2 = std::max(box.x2, wall[w].pt.x);
+		box.y2 = std::max(box.y2, wall[w].pt.y);
+	}
+
+	return box;
+}
+
+/**
+ * Calls a function for each cell a box touches
+ */
+template<typename F>
+void forboxcells(const SectorBox& box, F&& func)
+{
+	const int cx1 = (int)(((int64_t)box.x1 - grid.x0) >> grid.shift);
+	const int cy1 = (int)(((int64_t)box.y1 - grid.y0) >> grid.shift);
+	const int cx2 = (int)(((int64_t)box.x2 - grid.x0) >> grid.shift);
+	const int cy2 = (int)(((int64_t)box.y2 - grid.y0) >> grid.shift);
+
+	for (int cy = cy1; cy <= cy2; ++cy) {
+		for (int cx = cx1; cx <= cx2; ++cx) {
+			func(cy * grid.xcells + cx);
+		}
+	}
+}
+
+void buildgrid()
+{
+	grid.numsectors = numsectors;
+	grid.numwalls = numwalls;
+	grid.xcells = grid.ycells = 0;
+	grid.cellstart.clear();
+	grid.cellsects.clear();
+	grid.dirty.clear();
+	grid.builds++;
+
+	std::vector<SectorBox> boxes(std::max(0, (int)numsectors));
+	SectorBox bounds{INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+
+	for (int i{0}; i < numsectors; ++i) {
+		boxes[i] = sectorbox(i);
+		if (boxes[i].x1 > boxes[i].x2) {
+			continue;
+		}
+		bounds.x1 = std::min(bounds.x1, boxes[i].x1);
+		bounds.y1 = std::min(bounds.y1, boxes[i].y1);
+		bounds.x2 = std::max(bounds.x2, boxes[i].x2);
+		bounds.y2 = std::max(bounds.y2, boxes[i].y2);
+	}
+
+	if (bounds.x1 > bounds.x2) {
+		return;		// nothing has walls, so nothing can contain a point
+	}
+
+	// aim for about as many cells as sectors
+	const int64_t w = (int64_t)bounds.x2 - bounds.x1;
+	const int64_t h = (int64_t)bounds.y2 - bounds.y1;
+	const int64_t target = std::clamp<int64_t>(numsectors, 1, MAXGRIDCELLS * MAXGRIDCELLS);
+
+	grid.x0 = bounds.x1;
+	grid.y0 = bounds.y1;
+	grid.shift = 4;
+	while (((w >> grid.shift) + 1) * ((h >> grid.shift) + 1) > target ||
+		   (w >> grid.shift) >= MAXGRIDCELLS || (h >> grid.shift) >= MAXGRIDCELLS) {
+		grid.shift++;
+	}
+	grid.xcells = (int)(w >> grid.shift) + 1;
+	grid.ycells = (int)(h >> grid.shift) + 1;
+
+	grid.cellstart.assign(grid.xcells * grid.ycells + 1, 0);
+
+	for (const auto& box : boxes) {
+		if (box.x1 <= box.x2) {
+			forboxcells(box, [](int c) { grid.cellstart[c + 1]++; });
+		}
+	}
+
+	std::partial_sum(grid.cellstart.begin(), grid.cellstart.end(), grid.cellstart.begin());
+	grid.cellsects.resize(grid.cellstart.back());
+
+	std::vector<int> fill(grid.cellstart.begin(), grid.cellstart.end() - 1);
+
+	for (int i = numsectors - 1; i >= 0; --i) {
+		if (boxes[i].x1 <= boxes[i].x2) {
+			forboxcells(boxes[i], [&fill, i](int c) { grid.cellsects[fill[c]++] = (short)i; });
+		}
+	}
+}
+
+} // namespace
+
+void updatesectorindex(short sectnum)
+{
+	pvsmoved(sectnum);
+
+	if (sectnum < 0) {
+		gridready = false;
+		return;
+	}
+	if (!gridready || sectnum >= grid.numsectors) {
+		return;
+	}
+
+	const auto it = std::ranges::lower_bound(grid.dirty, sectnum, std::greater<>{});
+
+	if (it != grid.dirty.end() && *it == sectnum) {
+		return;
+	}
+	if ((int)grid.dirty.size() >= MAXDIRTY) {
+		gridready = false;
+		return;
+	}
+
+	grid.dirty.insert(it, sectnum);
+}
+
+std::span<const short> sectindexcandidates(int x, int y)
+{
+	if (!gridready.load(std::memory_order_acquire) || grid.numsectors != numsectors || grid.numwalls != numwalls) {
+		std::lock_guard lock(gridbuild);
+		if (!gridready.load(std::memory_order_relaxed) || grid.numsectors != numsectors || grid.numwalls != numwalls) {
+			buildgrid();
+			gridready.store(true, std::memory_order_release);
+		}
+	}
+
+	std::span<const short> cell;
+
+	if (!grid.cellstart.empty()) {
+		const int64_t cx = ((int64_t)x - grid.x0) >> grid.shift;
+		const int64_t cy = ((int64_t)y - grid.y0) >> grid.shift;
+
+		if (cx >= 0 && cx < grid.xcells && cy >= 0 && cy < grid.ycells) {
+			const int c = (int)cy * grid.xcells + (int)cx;
+
+			cell = std::span<const short>(grid.cellsects.data() + grid.cellstart[c],
+				grid.cellstart[c + 1] - grid.cellstart[c]);
+		}
+	}
+
+	if (grid.dirty.empty()) {
+		return cell;
+	}
+
+	merged.clear();
+	std::ranges::set_union(cell, grid.dirty, std::back_inserter(merged), std::greater<>{});
+
+	return merged;
+}
+
+void sectindexbench(int lookups)
+{
+	{
+		std::lock_guard lock(gridbuild);
+		buildgrid();
+		gridready = true;
+	}
+
+	if (grid.cellstart.empty()) {
+		buildprintf("Sector index: no map loaded\n");
+		return;
+	}
+
+	buildprintf("Sector index: {} sectors on {}x{} cells of {} units, {} entries, {} builds\n",
+			   grid.numsectors, grid.xcells, grid.ycells, 1 << grid.shift,
+			   grid.cellsects.size(), grid.builds);
+
+	// sample a margin around the map too, where lookups should fail quickly
+	const int64_t spanx = (int64_t)grid.xcells << grid.shift;
+	const int64_t spany = (int64_t)grid.ycells << grid.shift;
+	std::mt19937 rng(numsectors);
+	std::uniform_int_distribution<int64_t> distx(grid.x0 - spanx / 8, grid.x0 + spanx + spanx / 8);
+	std::uniform_int_distribution<int64_t> disty(grid.y0 - spany / 8, grid.y0 + spany + spany / 8);
+
+	std::vector<point2di> points(lookups);
+	for (auto& pt : points) {
+		pt.x = (int)std::clamp<int64_t>(distx(rng), INT_MIN, INT_MAX);
+		pt.y = (int)std::clamp<int64_t>(disty(rng), INT_MIN, INT_MAX);
+	}
+
+	std::vector<short> linear(lookups, -1);
+	std::vector<short> indexed(lookups, -1);
+	int64_t candidates{0};
+
+	unsigned int t = getusecticks();
+	for (int n{0}; n < lookups; ++n) {
+		for (int i = numsectors - 1; i >= 0; --i) {
+			if (inside(points[n].x, points[n].y, (short)i) == 1) {
+				linear[n] = (short)i;
+				break;
+			}
+		}
+	}
+	const unsigned int lineart = getusecticks() - t;
+
+	t = getusecticks();
+	for (int n{0}; n < lookups; ++n) {
+		const auto sects = sectindexcandidates(points[n].x, points[n].y);
+		candidates += (int64_t)sects.size();
+		for (short i : sects) {
+			if (inside(points[n].x, points[n].y, i) == 1) {
+				indexed[n] = i;
+				break;
+			}
+		}
+	}
+	const unsigned int indexedt = getusecticks() - t;
+
+	int hits{0};
+	int mismatches{0};
+
+	for (int n{0}; n < lookups; ++n) {
+		hits += (linear[n] >= 0);
+		mismatches += (linear[n] != indexed[n]);
+	}
+
+	buildprintf("  {} lookups, {} inside a sector, {:.2f} candidates each, {} mismatches\n",
+			   lookups, hits, (double)candidates / std::max(1, lookups), mismatches);
+	buildprintf("  linear {:.3f} us, indexed {:.3f} us per lookup ({:.1f}x)\n",
+			   (double)lineart / std::max(1, lookups), (double)indexedt / std::max(1, lookups),
+			   (double)lineart / std::max(1U, indexedt));
+}
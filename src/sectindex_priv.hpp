@@ -0,0 +1,23 @@
+#ifndef SECTINDEX_PRIV_H
+#define SECTINDEX_PRIV_H
+
+#include <span>
+
+/**
+ * Lists the sectors whose bounding box covers a point, highest numbered first.
+ * Testing these in order gives the same answer as testing every sector from
+ * numsectors-1 down to 0 with inside().
+ * @param x map x coordinate
+ * @param y map y coordinate
+ * @return the candidate sectors, valid until the next call on this thread
+ */
+std::span<const short> sectindexcandidates(int x, int y);
+
+/**
+ * Times random point lookups through the index against the linear scan
+ * and checks that both agree
+ * @param lookups number of random points to look up
+ */
+void sectindexbench(int lookups);
+
+#endif
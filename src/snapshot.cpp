@@ -0,0 +1,237 @@
+// Snapshots of the engine's map and sprite state, and of state the game
+// registers, for rollback, instant saves and finding desyncs.
+
+#include "build.hpp"
+#include "baselayer.hpp"
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t SNAPSHOT_BLOCK{256};	// bytes compared and copied at a time
+
+struct snapshotregion {
+	std::string name;
+	unsigned char *data;
+	std::size_t elemsize;
+	std::size_t size;
+	const short *count;
+	void (*restored)(std::size_t first, std::size_t last);	// elements a restore wrote over
+
+	std::size_t used() const
+	{
+		if (!count) return size;
+		return std::min((std::size_t)std::max(*count, (short)0) * elemsize, size);
+	}
+};
+
+	//Regions are only ever added, so a snapshot laid out for fewer of them
+	//can still put back the ones it has
+std::vector<snapshotregion> snapshotregions;
+int snapshotgeneration{0};
+
+void addregion(const char *name, void *data, std::size_t elemsize, std::size_t maxcount, const short *count,
+	void (*restored)(std::size_t, std::size_t) = nullptr)
+{
+	snapshotregions.push_back({ name, (unsigned char *)data, elemsize, elemsize * maxcount, count, restored });
+	snapshotgeneration++;
+}
+
+	//Keep the clipping grid and sector index in step with what a restore
+	//puts back, as setsprite() and the game's wall moves would
+void restoredsprites(std::size_t first, std::size_t last)
+{
+	for (std::size_t i{first}; i <= last; i++) {
+		updatespriteclip((short)i);
+	}
+}
+
+void restoredspritelists(std::size_t, std::size_t)
+{
+	updatespriteclip(-1);
+}
+
+void restoredwalls(std::size_t, std::size_t)
+{
+	updatesectorindex(-1);
+}
+
+void registerengine()
+{
+	if (!snapshotregions.empty()) return;
+
+	addregion("numsectors", &numsectors, sizeof(numsectors), 1, nullptr);
+	addregion("numwalls", &numwalls, sizeof(numwalls), 1, nullptr);
+	addregion("sector", g_sector.data(), sizeof(sectortype), g_sector.size(), &numsectors);
+	addregion("wall", wall.data(), sizeof(walltype), wall.size(), &numwalls, restoredwalls);
+	addregion("sprite", sprite.data(), sizeof(spritetype), sprite.size(), nullptr, restoredsprites);
+	addregion("headspritesect", headspritesect.data(), sizeof(short), headspritesect.size(), nullptr, restoredspritelists);
+	addregion("headspritestat", headspritestat.data(), sizeof(short), headspritestat.size(), nullptr);
+	addregion("prevspritesect", prevspritesect.data(), sizeof(short), prevspritesect.size(), nullptr, restoredspritelists);
+	addregion("prevspritestat", prevspritestat.data(), sizeof(short), prevspritestat.size(), nullptr);
+	addregion("nextspritesect", nextspritesect.data(), sizeof(short), nextspritesect.size(), nullptr, restoredspritelists);
+	addregion("nextspritestat", nextspritestat.data(), sizeof(short), nextspritestat.size(), nullptr);
+	addregion("randomseed", &randomseed, sizeof(randomseed), 1, nullptr);
+}
+
+	//Copies the blocks of src that differ from dest, telling the region which
+	//elements it wrote over if it wants to know
+std::size_t copychanged(unsigned char *dest, const unsigned char *src, std::size_t leng, const snapshotregion *told = nullptr)
+{
+	std::size_t copied{0};
+
+	for (std::size_t i{0}; i < leng; i += SNAPSHOT_BLOCK) {
+		const std::size_t n{std::min(SNAPSHOT_BLOCK, leng - i)};
+		if (std::memcmp(dest + i, src + i, n)) {
+			std::memcpy(dest + i, src + i, n);
+			copied += n;
+			if (told && told->restored) told->restored(i / told->elemsize, (i + n - 1) / told->elemsize);
+		}
+	}
+	return copied;
+}
+
+} // namespace
+
+void snapshot_register(const char *name, void *data, std::size_t elemsize, std::size_t maxcount, const short *count)
+{
+	registerengine();
+	addregion(name, data, elemsize, maxcount, count);
+}
+
+void enginesnapshot::capture()
+{
+	registerengine();
+
+	if (generation != snapshotgeneration) {
+		std::size_t offset{0};
+
+		regions.resize(snapshotregions.size());
+		for (std::size_t i{0}; i < regions.size(); i++) {
+			regions[i].offset = offset;
+			offset += snapshotregions[i].size;
+		}
+		buf.assign(offset, 0);
+		generation = snapshotgeneration;
+	}
+
+	copied = 0;
+	for (std::size_t i{0}; i < regions.size(); i++) {
+		const auto& r = snapshotregions[i];
+		regions[i].used = r.used();
+		copied += copychanged(&buf[regions[i].offset], r.data, regions[i].used);
+	}
+}
+
+void enginesnapshot::restore()
+{
+	copied = 0;
+	for (std::size_t i{0}; i < regions.size(); i++) {
+		copied += copychanged(snapshotregions[i].data, &buf[regions[i].offset], regions[i].used, &snapshotregions[i]);
+	}
+}
+
+int enginesnapshot::differences(const enginesnapshot& other, int maxreport) const
+{
+	int diffs{0};
+
+	for (std::size_t i{0}; i < std::min(regions.size(), other.regions.size()); i++) {
+		const auto& r = snapshotregions[i];
+		const auto *a = &buf[regions[i].offset];
+		const auto *b = &other.buf[other.regions[i].offset];
+		const std::size_t used{std::min(regions[i].used, other.regions[i].used)};
+
+		if (!std::memcmp(a, b, used)) continue;
+		for (std::size_t j{0}; j < used; j += r.elemsize) {
+			if (!std::memcmp(a + j, b + j, r.elemsize)) continue;
+			if (diffs++ < maxreport) {
+				if (r.size == r.elemsize) buildprintf("snapshot: {} differs\n", r.name);
+				else buildprintf("snapshot: {} {} differs\n", r.name, j / r.elemsize);
+			}
+		}
+	}
+	if (diffs > maxreport) buildprintf("snapshot: and {} more\n", diffs - maxreport);
+	return diffs;
+}
+
+void snapshotbench(int sprites)
+{
+	std::vector<short> live;
+
+	for (int i{0}; i < MAXSPRITES; i++) {
+		if (sprite[i].statnum < MAXSTATUS) live.push_back((short)i);
+	}
+	if (numsectors == 0 || live.empty()) {
+		buildprintf("snapshotbench: no map loaded\n");
+		return;
+	}
+
+	enginesnapshot base;
+	enginesnapshot work;
+	enginesnapshot check;
+	std::mt19937 rng(numsectors);
+	std::uniform_int_distribution<std::size_t> pick(0, live.size() - 1);
+	constexpr int passes{100};
+
+	unsigned int t0 = getusecticks();
+	base.capture();
+	const unsigned int tfirst = getusecticks() - t0;
+	const std::size_t firstcopied{base.lastcopied()};
+	work.capture();
+
+		//Move some sprites each pass as a tick of play would, then take the
+		//snapshot again and roll back to the start
+	unsigned int tcapture{0};
+	unsigned int trestore{0};
+	std::size_t capturecopied{0};
+	std::size_t restorecopied{0};
+	for (int p{0}; p < passes; p++) {
+		for (int i{0}; i < sprites; i++) {
+			auto& spr = sprite[live[pick(rng)]];
+			spr.x += 16;
+			spr.ang = (short)((spr.ang + 64) & 2047);
+		}
+		randomseed = (int)rng();
+
+		t0 = getusecticks();
+		work.capture();
+		tcapture += getusecticks() - t0;
+		capturecopied += work.lastcopied();
+
+		t0 = getusecticks();
+		base.restore();
+		trestore += getusecticks() - t0;
+		restorecopied += base.lastcopied();
+	}
+
+		//A plain copy of the whole lot, for comparison
+	std::vector<unsigned char> whole(base.size());
+	t0 = getusecticks();
+	for (int p{0}; p < passes; p++) {
+		std::size_t offset{0};
+		for (const auto& r : snapshotregions) {
+			std::memcpy(&whole[offset], r.data, r.size);
+			offset += r.size;
+		}
+	}
+	const unsigned int twhole = getusecticks() - t0;
+
+	check.capture();
+	const int diffs{base.differences(check, 8)};
+
+	buildprintf("snapshotbench: {} sectors, {} walls, {} sprites, {} kB held in {} regions\n",
+		numsectors, numwalls, live.size(), base.size() / 1024, snapshotregions.size());
+	buildprintf("  first capture:     {:8.1f} us  {:8.1f} kB\n", (float)tfirst, (float)firstcopied / 1024.F);
+	buildprintf("  capture, {:4} moved: {:6.1f} us  {:8.1f} kB\n", sprites,
+		(float)tcapture / (float)passes, (float)capturecopied / 1024.F / (float)passes);
+	buildprintf("  restore:           {:8.1f} us  {:8.1f} kB\n",
+		(float)trestore / (float)passes, (float)restorecopied / 1024.F / (float)passes);
+	buildprintf("  plain copy:        {:8.1f} us  {:8.1f} kB\n",
+		(float)twhole / (float)passes, (float)whole.size() / 1024.F);
+	buildprintf("  state after restore: {}\n", diffs ? "DIFFERS" : "same");
+}
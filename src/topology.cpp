@@ -0,0 +1,105 @@
+#include "build.hpp"
+#include "topology_priv.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/*
+ Map topology
+
+ lastwall(), sectorofwall(), loopnumofsector(), nextsectorneighborz() and the
+ editor's loop helpers used to rediscover which walls and sectors connect by
+ walking wall loops or searching the sector array on every call. The index
+ records the answers for the whole map at once: each wall's predecessor,
+ sector and loop number, each sector's closed loops, and each sector's
+ neighbours with the first wall leading into them.
+
+ It is rebuilt on first use after loadboard(), setfirstwall(), the editor's
+ wall edits or updatetopology(), and whenever the sector or wall counts have
+ changed. Callers check a sector is still current() before trusting what the
+ index says about it, and fall back to walking the walls if not.
+ */
+
+namespace {
+
+MapTopology topo;
+int builtsectors{0};		// numsectors and numwalls when built
+int builtwalls{0};
+std::atomic<bool> topoready{false};
+std::mutex topobuild;
+
+void buildtopology()
+{
+	builtsectors = numsectors;
+	builtwalls = numwalls;
+
+	topo.prevwall.assign(numwalls, -1);
+	topo.wallsect.assign(numwalls, -1);
+	topo.wallloop.assign(numwalls, -1);
+	topo.loopstart.assign(numsectors + 1, 0);
+	topo.loopfirst.clear();
+	topo.linkstart.assign(numsectors + 1, 0);
+	topo.links.clear();
+	topo.firstwall.resize(numsectors);
+	topo.numsectwalls.resize(numsectors);
+
+	std::vector<short> linkedfrom(numsectors, -1);
+
+	for (int s{0}; s < numsectors; ++s) {
+		const int startwall = g_sector[s].wallptr;
+		const int endwall = std::min<int>(startwall + g_sector[s].wallnum, numwalls);
+		int loopbegin{startwall};
+		int numloops{0};
+
+		topo.firstwall[s] = g_sector[s].wallptr;
+		topo.numsectwalls[s] = g_sector[s].wallnum;
+		topo.loopstart[s] = (int)topo.loopfirst.size();
+		topo.linkstart[s] = (int)topo.links.size();
+
+		for (int i = std::max(startwall, 0); i < endwall; ++i) {
+			const auto& wal = wall[i];
+
+			topo.wallsect[i] = (short)s;
+			topo.wallloop[i] = (short)numloops;
+			if (wal.point2 >= 0 && wal.point2 < numwalls && topo.prevwall[wal.point2] < 0) {
+				topo.prevwall[wal.point2] = (short)i;
+			}
+
+			if (wal.point2 < i) {
+				topo.loopfirst.push_back((short)loopbegin);
+				loopbegin = i + 1;
+				numloops++;
+			}
+
+			if (wal.nextsector >= 0 && wal.nextsector < numsectors && linkedfrom[wal.nextsector] != s) {
+				linkedfrom[wal.nextsector] = (short)s;
+				topo.links.push_back({ wal.nextsector, (short)i });
+			}
+		}
+	}
+
+	topo.loopstart[numsectors] = (int)topo.loopfirst.size();
+	topo.linkstart[numsectors] = (int)topo.links.size();
+}
+
+} // namespace
+
+void updatetopology()
+{
+	topoready = false;
+}
+
+const MapTopology& maptopology()
+{
+	if (!topoready.load(std::memory_order_acquire) || builtsectors != numsectors || builtwalls != numwalls) {
+		std::lock_guard lock(topobuild);
+		if (!topoready.load(std::memory_order_relaxed) || builtsectors != numsectors || builtwalls != numwalls) {
+			buildtopology();
+			topoready.store(true, std::memory_order_release);
+		}
+	}
+
+	return topo;
+}
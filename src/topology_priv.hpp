@@ -0,0 +1,56 @@
+#ifndef TOPOLOGY_PRIV_H
+#define TOPOLOGY_PRIV_H
+
+#include <span>
+#include <vector>
+
+struct SectorLink {
+	short sectnum;		// the neighbouring sector
+	short wallnum;		// first wall leading into it
+};
+
+/**
+ * How the map's walls and sectors connect, stored back to back with
+ * offset arrays, one entry per wall or sector as it stood when built
+ */
+struct MapTopology {
+	std::vector<short> prevwall;		// the wall whose point2 is this one, or -1
+	std::vector<short> wallsect;		// sector owning each wall
+	std::vector<short> wallloop;		// loop number of each wall within its sector
+	std::vector<int> loopstart;			// numsectors+1 offsets into loopfirst
+	std::vector<short> loopfirst;		// first wall of each closed loop, sector by sector
+	std::vector<int> linkstart;			// numsectors+1 offsets into links
+	std::vector<SectorLink> links;		// neighbours in the order their walls come
+	std::vector<short> firstwall;		// each sector's wallptr when built
+	std::vector<short> numsectwalls;	// and its wallnum
+
+	/**
+	 * Tells whether a sector's walls are still where they were when built,
+	 * and all of them were indexed
+	 */
+	bool current(short sectnum) const
+	{
+		return sectnum >= 0 && sectnum < (int)firstwall.size() &&
+			firstwall[sectnum] == g_sector[sectnum].wallptr &&
+			numsectwalls[sectnum] == g_sector[sectnum].wallnum &&
+			firstwall[sectnum] >= 0 && firstwall[sectnum] + numsectwalls[sectnum] <= (int)wallsect.size();
+	}
+
+	int numloops(short sectnum) const
+	{
+		return loopstart[sectnum + 1] - loopstart[sectnum];
+	}
+
+	std::span<const SectorLink> neighbours(short sectnum) const
+	{
+		return { links.data() + linkstart[sectnum], links.data() + linkstart[sectnum + 1] };
+	}
+};
+
+/**
+ * Returns the topology index, building it first if the map changed
+ * @return the index, valid until the map is next edited
+ */
+const MapTopology& maptopology();
+
+#endif
@@ -493,7 +493,11 @@ int WINAPI WinMain(HINSTANCE hInst, HINSTANCE hPrevInst, const LPSTR lpCmdLine,
 
 	instanceflag = ::CreateSemaphore(nullptr, 1, 1, WINDOW_CLASS);
 
-	startwin_open();
+	for (int i{1}; i < _buildargc; i++) {
+		if (IsSameAsNoCase(_buildargv[i], "-headless")) headless = true;
+	}
+
+	if (!headless) startwin_open();
 	baselayer_init();
 	r = app_main(_buildargc, _buildargv);
 
@@ -0,0 +1,153 @@
+#include "workpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ Worker pool
+
+ A handful of threads started on first use and parked on a condition
+ variable between jobs, so engine queries run every game tic can be spread
+ across cores without paying for thread creation each time. One job runs at
+ a time: the caller publishes it, joins in, then waits for the workers that
+ picked it up. Chunks are claimed from an atomic counter.
+ */
+
+namespace {
+
+constexpr int MAXWORKERS{15};
+
+struct WorkPool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;					// guards everything below but next
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(int, int)>* func{nullptr};
+	int count{0};
+	int grain{1};
+	std::atomic<int> next{0};			// first item not yet claimed
+	unsigned int generation{0};			// bumped for every job
+	int wanted{0};						// workers still to join the current job
+	int busy{0};						// workers running the current job
+	bool quit{false};
+
+	~WorkPool() { stop(); }
+
+	void stop()
+	{
+		{
+			std::lock_guard lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto& t : threads) {
+			t.join();
+		}
+		threads.clear();
+		quit = false;
+	}
+};
+
+WorkPool pool;
+std::mutex poolowner;				// held by the thread whose job is on the pool
+thread_local bool inchunk{false};
+
+void runchunks(const std::function<void(int, int)>& func, int count, int grain)
+{
+	inchunk = true;
+	for (int begin = pool.next.fetch_add(grain); begin < count; begin = pool.next.fetch_add(grain)) {
+		func(begin, std::min(begin + grain, count));
+	}
+	inchunk = false;
+}
+
+void workermain()
+{
+	unsigned int seen{0};
+	std::unique_lock lock(pool.mutex);
+
+	for (;;) {
+		pool.wake.wait(lock, [&seen] {
+			return pool.quit || (pool.generation != seen && pool.wanted > 0);
+		});
+		if (pool.quit) {
+			return;
+		}
+
+		seen = pool.generation;
+		pool.wanted--;
+		pool.busy++;
+
+		const auto* func = pool.func;
+		const int count = pool.count;
+		const int grain = pool.grain;
+
+		lock.unlock();
+		runchunks(*func, count, grain);
+		lock.lock();
+
+		if (--pool.busy == 0) {
+			pool.done.notify_all();
+		}
+	}
+}
+
+} // namespace
+
+int workpoolsize()
+{
+	return std::clamp((int)std::thread::hardware_concurrency(), 1, MAXWORKERS + 1);
+}
+
+void parallelfor(int count, int grain, int numthreads, const std::function<void(int, int)>& func)
+{
+	if (count <= 0) {
+		return;
+	}
+
+	grain = std::max(1, grain);
+	numthreads = (numthreads > 0) ? std::min(numthreads, workpoolsize()) : workpoolsize();
+	numthreads = std::min(numthreads, (count + grain - 1) / grain);
+
+	std::unique_lock owner(poolowner, std::defer_lock);
+
+	if (numthreads <= 1 || inchunk || !owner.try_lock()) {
+		for (int begin{0}; begin < count; begin += grain) {
+			func(begin, std::min(begin + grain, count));
+		}
+		return;
+	}
+
+	{
+		std::lock_guard lock(pool.mutex);
+
+		while ((int)pool.threads.size() < workpoolsize() - 1) {
+			pool.threads.emplace_back(workermain);
+		}
+
+		pool.func = &func;
+		pool.count = count;
+		pool.grain = grain;
+		pool.next = 0;
+		pool.wanted = numthreads - 1;
+		pool.generation++;
+	}
+	pool.wake.notify_all();
+
+	runchunks(func, count, grain);
+
+	std::unique_lock lock(pool.mutex);
+	pool.wanted = 0;	// whatever is left is already claimed
+	pool.done.wait(lock, [] { return pool.busy == 0; });
+	pool.func = nullptr;
+}
+
+void uninitworkpool()
+{
+	std::lock_guard owner(poolowner);
+	pool.stop();
+}
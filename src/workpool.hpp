@@ -0,0 +1,28 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <functional>
+
+/**
+ * Returns how many threads parallelfor() can use, counting the caller
+ */
+int workpoolsize();
+
+/**
+ * Splits [0,count) into chunks and runs them on the pool's worker threads
+ * and the calling thread, returning once every chunk is done. Nested calls
+ * from inside a chunk, and calls while another thread is using the pool,
+ * run on the calling thread alone.
+ * @param count number of items
+ * @param grain items per chunk
+ * @param numthreads threads to use at most, or 0 for all of them
+ * @param func called with the [begin,end) range of each chunk
+ */
+void parallelfor(int count, int grain, int numthreads, const std::function<void(int, int)>& func);
+
+/**
+ * Stops and joins the worker threads; parallelfor() starts them again if needed
+ */
+void uninitworkpool();
+
+#endif